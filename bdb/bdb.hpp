@@ -1,7 +1,9 @@
 #ifndef _BDB_HPP
 #define _BDB_HPP
 
+#include <future>
 #include <string>
+#include <vector>
 #include "export.hpp"
 #include "common.hpp"
 
@@ -11,6 +13,8 @@ struct BDBImpl;
 struct AddrIterator;
 
 /** @brief Core class
+ *  @remark Operations are serialized by an internal mutex so that an 
+ *  instance can be shared by threads. AddrIterator is not synchronized.
 */
 struct BDB_API BehaviorDB
 {
@@ -50,17 +54,47 @@ struct BDB_API BehaviorDB
   AddrType
   put(char const *data, uint32_t size, AddrType addr, uint32_t off=npos);
 
+  /** @brief Put data to a chunk that has room for its expected size
+   *  @param data
+   *  @param size
+   *  @param hint Expected final size of the data
+   *  @return Address.
+   *  @details Records that grow through appends migrate to a larger 
+   *  pool whenever their chunk is full. Placing a record in a pool 
+   *  whose chunk size covers the hint avoids these migrations.
+   *  @throw See put(char const *, uint32_t)
+   */
+  AddrType
+  put(char const *data, uint32_t size, reserve_hint hint);
+
   /** @brief std::string version put method 
    *  @throw See put(char const *, uint32_t)
   */  
   AddrType
   put(std::string const& data);
 
+  /** @brief std::string version put method with reserve hint
+   *  @throw See put(char const *, uint32_t)
+   */
+  AddrType
+  put(std::string const& data, reserve_hint hint);
+
   /** @brief std::string version put-to-address method 
   */
   AddrType
   put(std::string const& data, AddrType addr, uint32_t off=npos);
 
+  /** @brief Move data of an address to a chunk that has room for
+   *  the capacity. Nothing is changed if the current chunk is large 
+   *  enough.
+   *  @param addr
+   *  @param capacity Expected final size of the data
+   *  @return Address.
+   *  @throw BDB::invalid_addr when the addr had NOT been used.
+   */
+  AddrType
+  reserve(AddrType addr, uint32_t capacity);
+
   /** @brief Replace specific address with new data
    *  @param data New data.
    *  @param size Size of new data.
@@ -94,6 +128,14 @@ struct BDB_API BehaviorDB
   uint32_t
   get(std::string *output, uint32_t max, AddrType addr, uint32_t off=0);
 
+  /** @brief Get whole records in batch order
+   *  @details Records are read by the I/O engine as one batch, see
+   *  Config::io_engine. When reads fail, the others are still read and
+   *  the first exception is rethrown afterwards.
+   */
+  void
+  get(std::vector<AddrType> const &addrs, std::vector<std::string> *output);
+
   /** @brief Delete specified address.
    *  @return 0 for success.
    *  @throw BDB::invalid_addr when the addr had NOT been used.
@@ -108,6 +150,48 @@ struct BDB_API BehaviorDB
   uint32_t
   del(AddrType addr, uint32_t off, uint32_t size);
 
+  /** @name Asynchronous operations
+   *  They queue the operation and return at once, unless the queue is
+   *  full (see Config::async_queue_size). Operations on an address run
+   *  in the order they are queued; others run concurrently on 
+   *  Config::async_threads threads. Gets queued next to each other on
+   *  a thread are read as one batch, see Config::io_engine. Futures 
+   *  hold the result or the exception of the synchronous counterpart. 
+   *  Callbacks get both in an AsyncResult and must not queue operations
+   *  themselves when queues may be full.
+   */
+  //@{
+  /// put(data)
+  std::future<AddrType>
+  async_put(std::string const &data);
+
+  void
+  async_put(std::string const &data, Async_func fn, void *arg = 0);
+
+  /// put(data, addr)
+  std::future<AddrType>
+  async_append(std::string const &data, AddrType addr);
+
+  void
+  async_append(std::string const &data, AddrType addr, 
+               Async_func fn, void *arg = 0);
+
+  /// get(&record, max, addr, off)
+  std::future<std::string>
+  async_get(AddrType addr, uint32_t max = npos, uint32_t off = 0);
+
+  void
+  async_get(AddrType addr, Async_func fn, void *arg = 0,
+            uint32_t max = npos, uint32_t off = 0);
+
+  /// del(addr)
+  std::future<uint32_t>
+  async_del(AddrType addr);
+
+  void
+  async_del(AddrType addr, Async_func fn, void *arg = 0);
+  //@}
+
   /* @brief Create output stream handle, stream_state, for 
    *  asynchronous write.
    *  @param stream_size Future size this handle will be written.
@@ -194,10 +278,72 @@ struct BDB_API BehaviorDB
   AddrIterator
   end() const;
 
+  /** @brief Run one bounded step of pool file compaction.
+   *  @param max_bytes Maximum bytes of chunks to be moved in this step.
+   *  @return Bytes moved plus bytes truncated from pool files in this
+   *  step. 0 indicates nothing left to compact.
+   *  @details Live chunks at the tail of a pool file are moved to 
+   *  free slots near its head, then the pool file is truncated. 
+   *  Call this method repeatedly, e.g. from a maintenance thread that
+   *  sleeps between steps, to limit the I/O rate of compaction.
+   *  Reclaimed bytes are reported by Stat::reclaimed_size.
+   */
+  unsigned long long
+  compact(uint32_t max_bytes);
+
+  /** @brief Visit all records in the order they are stored
+   *  @param fn Called with the address and data of each record
+   *  @param arg Passed to fn
+   *  @param per_pool_threads Scan each pool in a thread of its own.
+   *  fn is then called concurrently, in file order within each pool.
+   *  @return Number of records visited
+   *  @details Pool files are read sequentially in large blocks with
+   *  read-ahead, skipping runs of free chunks, which is much faster 
+   *  than get() in address order. Other operations wait until the scan
+   *  finishes, so fn must not call this BehaviorDB.
+   */
+  unsigned long long
+  scan(Scan_func fn, void *arg = 0, bool per_pool_threads = false);
+
+  /** @brief Visit all records by threads that read pool files in 
+   *  parallel
+   *  @param fn Called concurrently with the address and data of each 
+   *  record
+   *  @param arg Passed to fn
+   *  @param threads Number of threads, 0 for one per hardware thread
+   *  @return Records and bytes visited, and the time taken
+   *  @details Pools are split into ranges of local addresses that the
+   *  threads take in turn and read sequentially through a buffer of 
+   *  their own. Other operations run between the reads and fn may call
+   *  this BehaviorDB. Records present when the scan starts and not 
+   *  deleted during it are visited once, with data that was current at
+   *  some point of the scan. Records put during the scan may or may not
+   *  be visited.
+   */
+  ScanStat
+  parallel_scan(Scan_func fn, void *arg = 0, unsigned int threads = 0);
+
+  /** @brief Recommend a pool layout for the workload seen so far
+   *  @param conf Its min_size and addr_prefix_len are overwritten when
+   *  there are records put since the BehaviorDB was opened.
+   *  @details The recommendation assumes default_chunk_size_est and 
+   *  default_capacity_test: the median record put fits the first pool
+   *  and the largest record fits the last one.
+   */
+  void recommend(Config *conf) const;
+
   /** @brief Obtain BehaviorDB's statistic info.
    *  @see Stat
    */
   void stat(Stat * ms) const;
+
+  /** @brief Obtain statistic info like stat() and zero the metrics
+   *  counters
+   *  @details Operations running meanwhile are not blocked by the 
+   *  counters, each of which is taken and zeroed atomically.
+   *  @see Config::collect_metrics
+   */
+  void stat_reset(Stat * ms);
   
   BDBImpl* impl();
 
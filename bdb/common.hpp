@@ -3,6 +3,9 @@
 
 #include "export.hpp"
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <exception>
 
 #ifdef __GNUC__ // GNU
 
@@ -47,6 +50,127 @@ namespace BDB {
     return (chunk_size - (chunk_size>>2)) >= data_size;
   }
 
+  /** @brief Prototype of pool file preallocation callback.
+   *  @param dir Directory (pool) ID
+   *  @param chunk_size Chunk size of the pool
+   *  @param used Number of chunks used by the pool file (high-water mark)
+   *  @param id_size Number of IDs the pool address table currently holds
+   *  @return Number of chunks the pool file should be extended to. 
+   *  Return a value not greater than used to disable preallocation.
+   */
+  typedef AddrType (*Prealloc_est)(
+    unsigned int dir, uint32_t chunk_size, AddrType used, AddrType id_size);
+
+  /**@brief Default preallocation callback. It disables preallocation.
+   */
+  inline AddrType
+  default_prealloc_est(unsigned int, uint32_t, AddrType, AddrType)
+  {
+    return 0;
+  }
+
+  /**@brief Extent preallocation callback
+   * @details Preallocate pool files ahead in step with their address 
+   * tables but no more than 16MB beyond the used chunks at a time.
+   */
+  inline AddrType
+  extent_prealloc_est(unsigned int, uint32_t chunk_size, 
+                      AddrType used, AddrType id_size)
+  {
+    AddrType ahead = std::max<AddrType>(1, (1<<24) / chunk_size);
+    return std::min<AddrType>(id_size, used + ahead);
+  }
+
+  /** @brief Prototype of the callback choosing pools read through 
+   *  memory mappings.
+   *  @param dir Directory (pool) ID
+   *  @param chunk_size Chunk size of the pool
+   *  @return true to read the pool file through mappings
+   */
+  typedef bool (*Mmap_test)(unsigned int dir, uint32_t chunk_size);
+
+  /**@brief Default mmap callback. Pool files are read through their
+   * stdio buffer.
+   */
+  inline bool
+  default_mmap_test(unsigned int, uint32_t)
+  {
+    return false;
+  }
+
+  /**@brief mmap callback that maps every pool file
+   */
+  inline bool
+  all_mmap_test(unsigned int, uint32_t)
+  {
+    return true;
+  }
+
+  /** @brief Prototype of record scanning callback.
+   *  @param addr Address of the record
+   *  @param data Record data, valid during the call only
+   *  @param size Size of the record
+   *  @param arg User argument passed to the scan
+   *  @return false to stop scanning
+   *  @see BehaviorDB::scan
+   */
+  typedef bool (*Scan_func)(
+    AddrType addr, char const *data, uint32_t size, void *arg);
+
+  /** @brief Outcome of an operation of the asynchronous API
+   *  @see BehaviorDB::async_put
+   */
+  struct AsyncResult
+  {
+    AsyncResult() : addr(0), size(0) {}
+
+    /// Address put, appended to, read or deleted
+    AddrType addr;
+    /// Bytes written, read or deleted
+    uint32_t size;
+    /// Record read by async_get
+    std::string data;
+    /// Set when the operation threw, data members are unset then
+    std::exception_ptr error;
+  };
+
+  /** @brief Prototype of completion callbacks of the asynchronous API
+   *  @param result Outcome of the operation, may be moved from
+   *  @param arg User argument passed with the operation
+   *  @details It is called by a thread of the BehaviorDB and delays 
+   *  the operations queued behind it.
+   */
+  typedef void (*Async_func)(AsyncResult &result, void *arg);
+
+  /** @brief Expected final size of a record
+   *  @see BehaviorDB::put(char const*, uint32_t, reserve_hint)
+   */
+  struct reserve_hint
+  {
+    explicit reserve_hint(uint32_t capacity) : capacity(capacity) {}
+    uint32_t capacity;
+  };
+
+  /// Engines of batched file I/O, see Config::io_engine
+  enum IOEngine
+  {
+    IO_ENGINE_SYNC = 0,  ///< one pread, pwrite or sync call per request
+    IO_ENGINE_URING      ///< io_uring on Linux, IO_ENGINE_SYNC elsewhere
+  };
+
+  /// Placements of pool files over Config::pool_dirs
+  enum PoolPlacement
+  {
+    /// pool of directory ID i in pool_dirs[i % n]
+    PLACE_ROUND_ROBIN = 0,
+    /// pools whose chunk size is not less than large_pool_threshold in
+    /// the last directory, the others round-robin over the rest
+    PLACE_SIZE_CLASS,
+    /// chunk i of each pool in pool_dirs[i % n], packed pools 
+    /// round-robin
+    PLACE_STRIPE
+  };
+
   /** @brief Configuration of BehaviorDB */
   struct BDB_API Config
   {
@@ -77,6 +201,171 @@ namespace BDB {
     Chunk_size_est cse_func;
     /// Capacity testing callback
     Capacity_test ct_func;
+    /** @brief Records no larger than this size are packed into a 
+     *  small-object pool (directory 0). Default is 0 that disables
+     *  the packed pool. 
+     *  @details The packed pool stores many records in a 4KB page and
+     *  keeps their headers in the page as well. This value should not 
+     *  exceed 1024.
+     */
+    uint32_t slab_threshold;
+    /** @brief Disk blocks of freed chunks are released (hole punching)
+     *  for pools whose chunk size is not less than this value. Default
+     *  is 0 that disables hole punching.
+     *  @remark Supported on Linux file systems that support 
+     *  fallocate(FALLOC_FL_PUNCH_HOLE) only.
+     */
+    uint32_t punch_threshold;
+    /** @brief Pools whose chunk size is not less than this value read
+     *  and write data with O_DIRECT, bypassing the page cache. Default
+     *  is 0 that keeps every pool buffered.
+     *  @details Large records then do not evict small ones from the 
+     *  cache. Chunk sizes should be multiples of 4096, the alignment of
+     *  direct I/O; other pools stay buffered, as do all pools where 
+     *  O_DIRECT is not supported. Writes of partial blocks read the 
+     *  block first.
+     *  @remark Supported on Linux only.
+     */
+    uint32_t direct_threshold;
+    /** @brief Tell the OS how pool files are accessed (posix_fadvise).
+     *  Default is false.
+     *  @details Lookups turn read ahead off (POSIX_FADV_RANDOM), scans
+     *  turn it up while they run (POSIX_FADV_SEQUENTIAL). Chunks a 
+     *  record migrates from are read ahead (POSIX_FADV_WILLNEED) and 
+     *  dropped from the page cache afterwards (POSIX_FADV_DONTNEED), as
+     *  are chunks written whole to pools whose chunk size is not less 
+     *  than dontneed_threshold. Pool files are then read and written 
+     *  around their stdio buffer, which reads 1MB ahead of any seek.
+     *  Packed and direct pools get no hints.
+     *  @remark Ignored where posix_fadvise is not supported.
+     */
+    bool io_hints;
+    /** @brief Chunk size from which written chunks are dropped from the
+     *  page cache, see io_hints. Default is 65536.
+     */
+    uint32_t dontneed_threshold;
+    /** @brief Pool file growth policy. Default is default_prealloc_est
+     *  that extends pool files by written chunks only.
+     *  @see extent_prealloc_est
+     */
+    Prealloc_est prealloc_func;
+    /** @brief Pools whose records are read by copies from read-only 
+     *  mappings of their file (mmap) instead of the stdio buffer.
+     *  Default is default_mmap_test that maps no pool.
+     *  @details Suits read-mostly pools: a read is a copy from the page
+     *  cache without system calls once its pages are mapped. Files are
+     *  mapped in windows of 64MB, up to 64 windows per pool. Mappings 
+     *  take the access pattern of io_hints whether it is set or not, 
+     *  random except during scans. Packed and direct pools are not 
+     *  mapped.
+     *  @see all_mmap_test
+     */
+    Mmap_test mmap_func;
+    /** @brief Directories, one per device, that pool files are placed
+     *  in by placement instead of pool_dir. Default is empty.
+     *  @details Scans read the pools of different directories at once,
+     *  and compaction moves chunks of pools on different devices in 
+     *  parallel. Directories should be distinct, and placement and the
+     *  directories should not change once pool files are written.
+     *  @see Stat::device_reads
+     */
+    std::vector<std::string> pool_dirs;
+    /// Placement of pool files over pool_dirs. Default is
+    /// PLACE_ROUND_ROBIN.
+    PoolPlacement placement;
+    /** @brief Chunk size from which pools get the last of pool_dirs to
+     *  themselves with PLACE_SIZE_CLASS. Default is 1MB.
+     */
+    uint32_t large_pool_threshold;
+    /** @brief Choose destinations of migrations from observed growth
+     *  instead of the next directory whose chunk fits. Default is false.
+     *  @details Migrating records get room for another append of the
+     *  average size and skip directories that most records leave again.
+     *  @see BehaviorDB::recommend
+     */
+    bool adaptive_growth;
+    /** @brief Count operations, their latencies and I/O calls. Default
+     *  is false.
+     *  @details When disabled, operations pay a branch for it only.
+     *  @see Stat::ops
+     */
+    bool collect_metrics;
+    /** @brief File that statistics are exported to periodically in 
+     *  Prometheus text format. Default is an empty string that disables
+     *  exporting.
+     *  @details The file is replaced through rename, so it can be read 
+     *  by the textfile collector of node_exporter when named *.prom. 
+     *  Set collect_metrics for operation and I/O metrics.
+     */
+    std::string metrics_file;
+    /// Milliseconds between exports to metrics_file. Default is 10000.
+    uint32_t metrics_interval;
+    /** @brief Operations taking at least this many microseconds are 
+     *  logged to slow.log in log_dir. Default is 0 that disables the log.
+     *  @details Each line holds the operation, address, size, pools 
+     *  involved, whether the record migrated, and microseconds spent in
+     *  global ID lookup, chunk header lookup, data I/O, commit and the
+     *  access log. Waiting for other operations is not included.
+     */
+    uint32_t slow_op_threshold;
+    /** @brief Bytes the write-ahead log grows to before its changes are
+     *  written to transaction and header files, e.g. 4MB. Default is 0,
+     *  which disables the log.
+     *  @details Each operation appends one record of its changes to the
+     *  global ID table and chunk headers to bdb.wal in trans_dir, so 
+     *  writing pool data and the record are the only I/O on its path.
+     *  The record is applied whole or not at all when a BehaviorDB is
+     *  opened after a crash. A checkpoint syncs the transaction files
+     *  before it empties the log, whatever sync_commit. With the log 
+     *  disabled, every change is written to the files of its table 
+     *  immediately.
+     */
+    uint32_t wal_checkpoint;
+    /** @brief Return from writing operations once their changes are on
+     *  the device. Default is false. Requires wal_checkpoint.
+     *  @details Operations of concurrent threads are synced as a group:
+     *  the first one to wait leads it, and one sync of the write-ahead
+     *  log and the pool files written covers every operation logged 
+     *  before it started.
+     */
+    bool sync_commit;
+    /** @brief Microseconds a leader of sync_commit waits for more 
+     *  operations to join its group. Default is 0.
+     *  @details Trades latency of single writers for fewer syncs 
+     *  under many concurrent writers.
+     */
+    uint32_t commit_delay;
+    /** @brief Threads running operations of the asynchronous API. 
+     *  Default is 4.
+     *  @details They start at the first asynchronous operation. Each 
+     *  one runs the operations of a share of the addresses in order.
+     */
+    unsigned int async_threads;
+    /** @brief Operations a thread of async_threads queues. Default is
+     *  1024.
+     *  @details Asynchronous operations wait for room in a full queue.
+     */
+    uint32_t async_queue_size;
+    /** @brief Engine of I/O that is issued in batches. Default is
+     *  IO_ENGINE_SYNC.
+     *  @details Batches are the records of a batch get, the gets queued
+     *  next to each other on a thread of the asynchronous API, the 
+     *  chunks a thread of parallel_scan reads from a window, the chunks
+     *  compact() copies, and the syncs of data files and the write-ahead
+     *  log by a group of sync_commit. Records of packed, direct and 
+     *  mapped pools are read one by one nonetheless, and chunks of 
+     *  direct pools are copied one by one. IO_ENGINE_URING submits a 
+     *  batch by one system call and falls back to IO_ENGINE_SYNC where 
+     *  io_uring is not available.
+     *
+     *  Writes of put, update and the other single operations stay 
+     *  buffered writes: each one is a single request with nothing to 
+     *  batch, and their syncs are left to the group of sync_commit 
+     *  rather than chained to each write.
+     */
+    IOEngine io_engine;
+    /// Requests an I/O engine keeps in flight. Default is 32.
+    uint32_t io_depth;
     /** @brief Config default constructor 
      *  @details Construct BDB::Config with default configurations  
      */
@@ -100,18 +389,162 @@ namespace BDB {
     void validate() const;
   };
 
-  /// Memory/Disk Statistic TODO fragmentation
+  /// Operation kinds counted by Stat::ops
+  enum OpKind
+  {
+    OP_PUT = 0,  ///< put a new record
+    OP_INSERT,   ///< put to an existing address
+    OP_UPDATE,
+    OP_GET,
+    OP_DEL,      ///< whole or partial deletion
+    OP_KINDS
+  };
+
+  /** @brief Counters of an operation kind
+   *  @details Latencies are in nanoseconds, including waiting for other
+   *  operations, and are kept in log-linear buckets whose upper bounds
+   *  are given by latency_upper(). 
+   */
+  struct BDB_API OpStat
+  {
+    /// operations that completed
+    unsigned long long count;
+    /// operations that threw
+    unsigned long long errors;
+    /// user bytes written or read
+    unsigned long long bytes;
+    unsigned long long latency_sum;
+    unsigned long long latency_max;
+    std::vector<unsigned long long> latency_buckets;
+
+    OpStat()
+    :count(0), errors(0), bytes(0), latency_sum(0), latency_max(0)
+    {}
+
+    /// Mean latency of completed and failed operations
+    double latency_mean() const;
+
+    /** @brief Latency at quantile q (0 < q <= 1)
+     *  @return Upper bound of the bucket holding the quantile
+     */
+    unsigned long long latency_percentile(double q) const;
+
+    /// Largest latency counted in bucket i
+    static unsigned long long latency_upper(unsigned int i);
+  };
+
+  /// Memory/Disk Statistic
   struct BDB_API Stat
   {
     /// global ID table byte size
     unsigned long long gid_mem_size;
     /// pool byte size
     unsigned long long pool_mem_size;
-    /// disk usage
+    /// disk blocks allocated to pool files
     unsigned long long disk_size;
+    /// bytes truncated from pool files by compaction
+    unsigned long long reclaimed_size;
+    /// bytes of pool files up to the last used chunks
+    unsigned long long used_size;
+    /// bytes of pool files preallocated beyond the last used chunks
+    unsigned long long prealloc_size;
+    /// bytes of transaction files
+    unsigned long long trans_size;
+    /// bytes of error and access logs
+    unsigned long long log_size;
+    /// migrations out of each pool (indexed by directory)
+    std::vector<unsigned long long> pool_migrations;
+    /// migrations into each pool
+    std::vector<unsigned long long> pool_migrations_in;
+    /// bytes copied by migrations out of each pool
+    std::vector<unsigned long long> pool_copied_size;
+    /// chunk size of each pool, page size for a packed pool
+    std::vector<unsigned long long> pool_chunk_size;
+    /// chunks (pages) holding records in each pool
+    std::vector<unsigned long long> pool_chunks;
+    /// chunks (pages) up to the last used one in each pool
+    std::vector<unsigned long long> pool_slots;
+    /// whether each pool bypasses the page cache, see 
+    /// Config::direct_threshold
+    std::vector<bool> pool_direct;
+    /// whether each pool is read through mappings, see Config::mmap_func
+    std::vector<bool> pool_mmap;
+
+    /** @name Devices
+     *  Indexed like Config::pool_dirs, one device of pool_dir when 
+     *  they are not given. I/O is counted since the BehaviorDB was 
+     *  opened, for chunked pools only.
+     */
+    //@{
+    /// pool files, or stripes of them, in each directory
+    std::vector<unsigned long long> device_files;
+    /// disk blocks allocated to pool files in each directory
+    std::vector<unsigned long long> device_disk_size;
+    std::vector<unsigned long long> device_reads;
+    std::vector<unsigned long long> device_read_bytes;
+    std::vector<unsigned long long> device_writes;
+    std::vector<unsigned long long> device_written_bytes;
+    //@}
+
+    /** @name Metrics
+     *  Collected when Config::collect_metrics is set, since the 
+     *  BehaviorDB was opened or the last BehaviorDB::stat_reset.
+     */
+    //@{
+    /// indexed by OpKind
+    OpStat ops[OP_KINDS];
+    /// seeks, reads, writes and flushes of pool, transaction and 
+    /// header files
+    unsigned long long seek_count;
+    unsigned long long read_count;
+    unsigned long long write_count;
+    unsigned long long flush_count;
+    /// syncs to the device, see Config::sync_commit
+    unsigned long long sync_count;
+    unsigned long long read_bytes;
+    unsigned long long written_bytes;
+    //@}
+
     Stat()
-    :gid_mem_size(0), pool_mem_size(0), disk_size(0)
+    :gid_mem_size(0), pool_mem_size(0), disk_size(0),
+    reclaimed_size(0), used_size(0), prealloc_size(0),
+    trans_size(0), log_size(0),
+    seek_count(0), read_count(0), write_count(0), flush_count(0),
+    sync_count(0), read_bytes(0), written_bytes(0)
+    {}
+
+    /// Chunks holding records per chunk up to the last used one
+    double occupancy(unsigned int dir) const;
+
+    /// Free chunks below the last used one per chunk, i.e. 
+    /// 1 - occupancy(dir). It is what compaction can reclaim.
+    double fragmentation(unsigned int dir) const;
+
+    /// Bytes written to files per user byte put, inserted or updated
+    double write_amplification() const;
+  };
+
+  /// Result of BehaviorDB::parallel_scan
+  struct BDB_API ScanStat
+  {
+    /// records passed to the callback
+    unsigned long long records;
+    /// bytes of those records
+    unsigned long long bytes;
+    /// windows read again because their pool changed during the read
+    unsigned long long retries;
+    /// records among them that moved during the scan and were read by
+    /// address afterwards
+    unsigned long long moved;
+    /// wall clock time of the scan
+    double seconds;
+
+    ScanStat()
+    :records(0), bytes(0), retries(0), moved(0), seconds(0)
     {}
+
+    /// Bytes per second
+    double throughput() const;
   };
 
   /// Not a Position
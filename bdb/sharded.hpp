@@ -0,0 +1,148 @@
+#ifndef BDB_SHARDED_HPP_
+#define BDB_SHARDED_HPP_
+
+#include <string>
+#include <vector>
+#include "export.hpp"
+#include "common.hpp"
+
+namespace BDB {
+
+struct BehaviorDB;
+struct ShardedImpl;
+
+/// Shards that new records are put to by ShardedBehaviorDB
+enum ShardRouting
+{
+  SHARD_HASH = 0,     ///< by a hash of the data
+  SHARD_ROUND_ROBIN   ///< in turn
+};
+
+/** @brief BehaviorDBs that own disjoint ranges of global addresses
+ *  (shards), used as one
+ *  @details Each shard is a BehaviorDB with a directory of its own,
+ *  possibly on a disk of its own, and a worker thread. Operations on an
+ *  address go to the shard whose Config::beg and Config::end range
+ *  holds it. New records go to a shard chosen by ShardRouting. Single
+ *  operations run in the calling thread, shards being thread safe, so
+ *  that operations on different shards do not wait for each other.
+ *  Batches and scans are split by shard and run by the workers in
+ *  parallel.
+ *  @remark Callbacks of scans run on the workers and must not call
+ *  batch or scan methods.
+ */
+struct BDB_API ShardedBehaviorDB
+{
+  /** @brief Open a BehaviorDB for each configuration
+   *  @param shards Configurations with disjoint [beg, end) ranges and
+   *  distinct root_dir
+   *  @param routing Choice of shards for new records
+   *  @throw std::invalid_argument for no shard, overlapping ranges or
+   *  shared root_dir
+   *  @throw See BehaviorDB::BehaviorDB
+   */
+  explicit
+  ShardedBehaviorDB(std::vector<Config> const &shards,
+                    ShardRouting routing = SHARD_HASH);
+
+  ~ShardedBehaviorDB();
+
+  /** @brief Configurations of shards that split the address range of
+   *  a configuration evenly
+   *  @param conf Configuration of every shard but its range and
+   *  root_dir
+   *  @param root_dirs root_dir of each shard
+   *  @throw std::invalid_argument when the range has fewer addresses
+   *  than shards
+   */
+  static std::vector<Config>
+  split(Config const &conf, std::vector<std::string> const &root_dirs);
+
+  /// Number of shards
+  size_t
+  shard_count() const;
+
+  /// Shard i, for operations and statistics of its own
+  BehaviorDB &
+  shard(size_t i);
+
+  /** @brief Shard that owns an address
+   *  @throw BDB::invalid_addr when no shard owns it
+   */
+  size_t
+  shard_of(AddrType addr) const;
+
+  /** @name Single operations
+   *  See their counterparts of BehaviorDB.
+   *  @throw BDB::invalid_addr when no shard owns the address
+   */
+  //@{
+  AddrType
+  put(char const *data, uint32_t size);
+
+  AddrType
+  put(std::string const &data);
+
+  AddrType
+  put(std::string const &data, AddrType addr, uint32_t off = npos);
+
+  AddrType
+  update(std::string const &data, AddrType addr);
+
+  uint32_t
+  get(std::string *output, uint32_t max, AddrType addr, uint32_t off = 0);
+
+  uint32_t
+  del(AddrType addr);
+  //@}
+
+  /** @name Batches
+   *  Operations of a batch are grouped by shard and run by the workers
+   *  of those shards in parallel, in batch order within a shard. When
+   *  operations fail, the others still run and the first exception is
+   *  rethrown afterwards.
+   */
+  //@{
+  /** @brief Put records, their addresses are stored in batch order
+   *  @param addrs Addresses of records, npos for those not stored
+   */
+  void
+  put(std::vector<std::string> const &data, std::vector<AddrType> *addrs);
+
+  /// Get whole records in batch order
+  void
+  get(std::vector<AddrType> const &addrs, std::vector<std::string> *output);
+
+  /// Delete records
+  void
+  del(std::vector<AddrType> const &addrs);
+  //@}
+
+  /** @brief Visit all records, shards are scanned in parallel
+   *  @param fn Called concurrently by the workers of shards
+   *  @return Number of records visited
+   *  @details fn returning false stops the scans of all shards.
+   *  @see BehaviorDB::scan
+   */
+  unsigned long long
+  scan(Scan_func fn, void *arg = 0);
+
+  /** @brief Visit all records by threads of each shard
+   *  @param threads Threads of each shard, 0 for one per hardware
+   *  thread
+   *  @return Totals of the shards, seconds are of the whole scan
+   *  @see BehaviorDB::parallel_scan
+   */
+  ScanStat
+  parallel_scan(Scan_func fn, void *arg = 0, unsigned int threads = 0);
+
+private:
+  ShardedBehaviorDB(ShardedBehaviorDB const &cp);
+  ShardedBehaviorDB &operator=(ShardedBehaviorDB const &cp);
+
+  ShardedImpl *impl_;
+};
+
+} // end of namespace BDB
+
+#endif // header guard
@@ -14,7 +14,8 @@ struct addr_eval
   init(   
     unsigned int dir_prefix_len, uint32_t min_size, 
     Chunk_size_est cse = &BDB::default_chunk_size_est, 
-    Capacity_test ct = &BDB::default_capacity_test );
+    Capacity_test ct = &BDB::default_capacity_test,
+    uint32_t slab_threshold = 0);
 
   bool
   is_init() const;
@@ -31,6 +32,9 @@ struct addr_eval
   void
   set(Capacity_test capacity_test_func);
 
+  void
+  set_slab_threshold(uint32_t slab_threshold);
+
   unsigned int
   global_addr_len() const;
 
@@ -46,9 +50,18 @@ struct addr_eval
   unsigned int 
   dir_count() const;
   
+  // whether a directory is served by a packed small-object pool
+  bool
+  is_packed(unsigned int dir) const;
+  
   // estimate directory ID according to chunk size
   unsigned int 
   directory(uint32_t size) const;
+
+  // estimate directory ID whose chunk size covers the capacity as well,
+  // the last directory is used when no one covers the capacity
+  unsigned int 
+  directory(uint32_t size, uint32_t capacity) const;
   
   unsigned int 
   addr_to_dir(addr_t addr) const;
@@ -62,6 +75,7 @@ struct addr_eval
 private:
   unsigned char dir_prefix_len_;
   uint32_t min_size_;
+  uint32_t slab_threshold_;
   
   Chunk_size_est chunk_size_est_;
   Capacity_test capacity_test_;
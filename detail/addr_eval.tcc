@@ -6,10 +6,11 @@ namespace BDB {
 template<typename T>
 void
 addr_eval<T>::init(unsigned int dir_prefix_len, uint32_t min_size, 
-  Chunk_size_est cse, Capacity_test ct )
+  Chunk_size_est cse, Capacity_test ct, uint32_t slab_threshold )
 { 
   dir_prefix_len_ = dir_prefix_len;
   min_size_ = min_size; 
+  slab_threshold_ = slab_threshold;
   chunk_size_est_= cse;
   capacity_test_ = ct;
 
@@ -50,6 +51,11 @@ void
 addr_eval<T>::set(Capacity_test capacity_test_func)
 { capacity_test_ = capacity_test_func; }
 
+template<typename T>
+void
+addr_eval<T>::set_slab_threshold(uint32_t slab_threshold)
+{ slab_threshold_ = slab_threshold; }
+
 
 template<typename T>
 unsigned int
@@ -64,18 +70,30 @@ addr_eval<T>::local_addr_len() const
 template<typename T>
 uint32_t 
 addr_eval<T>::chunk_size_estimation(unsigned int dir) const
-{ return (*chunk_size_est_)(dir, min_size_); }
+{ 
+  if(is_packed(dir)) return slab_threshold_;
+  return (*chunk_size_est_)(dir, min_size_); 
+}
 
 template<typename T>
 bool
 addr_eval<T>::capacity_test(unsigned int dir, uint32_t size) const
-{ return (*capacity_test_)((*chunk_size_est_)(dir, min_size_), size); }
+{ 
+  // packed records grow in place up to the threshold
+  if(is_packed(dir)) return size <= slab_threshold_;
+  return (*capacity_test_)((*chunk_size_est_)(dir, min_size_), size); 
+}
 
 template<typename T>
 unsigned int 
 addr_eval<T>::dir_count() const
 { return 1<<dir_prefix_len_; }
 
+template<typename T>
+bool
+addr_eval<T>::is_packed(unsigned int dir) const
+{ return 0 == dir && 0 != slab_threshold_; }
+
 template<typename T>
 unsigned int 
 addr_eval<T>::directory(uint32_t size) const
@@ -89,6 +107,19 @@ addr_eval<T>::directory(uint32_t size) const
     ;
 }
 
+template<typename T>
+unsigned int 
+addr_eval<T>::directory(uint32_t size, uint32_t capacity) const
+{
+  unsigned int i = directory(size);
+  if((unsigned int)-1 == i) return i;
+
+  for(; i < dir_count(); ++i)
+    if(chunk_size_estimation(i) >= capacity) break;
+
+  return i < dir_count() ? i : dir_count() - 1;
+}
+
 template<typename T>
 unsigned int 
 addr_eval<T>::addr_to_dir(T addr) const
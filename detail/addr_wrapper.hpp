@@ -4,6 +4,7 @@
 #include <cstdio>
 #include <stdexcept>
 #include "common.hpp"
+#include "file_utils.hpp"
 namespace BDB {
 
 struct addr_wrapper
@@ -16,8 +17,8 @@ struct addr_wrapper
 
 inline FILE* operator<<(FILE* fp, addr_wrapper const & a)
 { 
-  size_t rt = fwrite((void*)&a.addr, sizeof(AddrType), 1, fp);
-  fflush(fp);
+  size_t rt = detail::s_write((char const*)&a.addr, sizeof(AddrType), fp);
+  detail::s_flush(fp);
   if(rt != sizeof(AddrType) && ferror(fp))
     throw std::runtime_error("write addr failed");
   return fp;
@@ -25,7 +26,7 @@ inline FILE* operator<<(FILE* fp, addr_wrapper const & a)
 
 inline FILE* operator>>(FILE* fp, addr_wrapper & a)
 { 
-  size_t rt = fread(&a.addr, sizeof(AddrType), 1, fp);
+  size_t rt = detail::s_read((char*)&a.addr, sizeof(AddrType), fp);
   if(rt != sizeof(AddrType) && ferror(fp))
     throw std::runtime_error("read addr failed");
   return fp;
@@ -0,0 +1,130 @@
+#include "async.hpp"
+
+namespace BDB {
+
+  async_executor::async_executor()
+  : started_(false), queue_size_(0), next_(0)
+  {}
+
+  async_executor::~async_executor()
+  { stop(); }
+
+  void
+  async_executor::start(unsigned int threads, uint32_t queue_size)
+  {
+    if(started_.load(std::memory_order_acquire)) return;
+    std::lock_guard<std::mutex> guard(start_mutex_);
+    if(!lanes_.empty()) return;
+
+    queue_size_ = queue_size;
+    for(unsigned int i = 0; i < threads; ++i){
+      lanes_.push_back(new lane);
+      lanes_.back()->thread = std::thread(&async_executor::run, this,
+                                          lanes_.back());
+    }
+    started_.store(true, std::memory_order_release);
+  }
+
+  void
+  async_executor::submit(AddrType addr, task_type const &task)
+  {
+    entry e;
+    e.task = task;
+    push(addr, e);
+  }
+
+  void
+  async_executor::submit_read(batch_read const &read)
+  {
+    entry e;
+    e.read.reset(new batch_read(read));
+    push(read.addr, e);
+  }
+
+  void
+  async_executor::push(AddrType addr, entry &e)
+  {
+    unsigned int n =
+      (npos == addr) ? next_.fetch_add(1, std::memory_order_relaxed) : addr;
+    lane *l = lanes_[n % lanes_.size()];
+
+    std::unique_lock<std::mutex> guard(l->mutex);
+    while(l->tasks.size() >= queue_size_)
+      l->not_full.wait(guard);
+    l->tasks.push_back(std::move(e));
+    l->not_empty.notify_one();
+  }
+
+  void
+  async_executor::stop()
+  {
+    std::lock_guard<std::mutex> guard(start_mutex_);
+    started_.store(false, std::memory_order_release);
+    for(size_t i = 0; i < lanes_.size(); ++i){
+      {
+        std::lock_guard<std::mutex> lg(lanes_[i]->mutex);
+        lanes_[i]->stop = true;
+      }
+      lanes_[i]->not_empty.notify_one();
+    }
+    for(size_t i = 0; i < lanes_.size(); ++i){
+      lanes_[i]->thread.join();
+      delete lanes_[i];
+    }
+    lanes_.clear();
+  }
+
+  void
+  async_executor::run(lane *l)
+  {
+    std::unique_lock<std::mutex> guard(l->mutex);
+    std::vector<batch_read> reads;
+    while(true){
+      while(l->tasks.empty() && !l->stop)
+        l->not_empty.wait(guard);
+      if(l->tasks.empty())
+        return;
+
+      if(l->tasks.front().read){
+        // reads behind each other keep their order to other operations
+        // on their addresses
+        while(!l->tasks.empty() && l->tasks.front().read){
+          reads.push_back(std::move(*l->tasks.front().read));
+          l->tasks.pop_front();
+        }
+        l->not_full.notify_all();
+
+        guard.unlock();
+        read(reads);
+        reads.clear();
+        guard.lock();
+        continue;
+      }
+
+      task_type task;
+      task.swap(l->tasks.front().task);
+      l->tasks.pop_front();
+      l->not_full.notify_one();
+
+      guard.unlock();
+      task();
+      guard.lock();
+    }
+  }
+
+  void
+  async_executor::read(std::vector<batch_read> &reads)
+  {
+    try {
+      reader_(&reads[0], reads.size());
+    }catch(...){
+      for(size_t i = 0; i < reads.size(); ++i){
+        if(!reads[i].error)
+          reads[i].error = std::current_exception();
+      }
+    }
+    for(size_t i = 0; i < reads.size(); ++i)
+      reads[i].done(reads[i]);
+  }
+
+} // namespace BDB
@@ -0,0 +1,112 @@
+#ifndef BDB_ASYNC_HPP_
+#define BDB_ASYNC_HPP_
+
+#include "common.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace BDB {
+
+  /// A get of a batch, see BDBImpl::get(batch_read*, size_t)
+  struct batch_read
+  {
+    AddrType addr;
+    uint32_t max, off;
+    std::string data;
+    std::exception_ptr error;
+    /// called by async_executor once the read is done
+    std::function<void(batch_read &)> done;
+
+    batch_read() : addr(0), max(npos), off(0) {}
+  };
+
+  /** @brief Threads that run operations submitted by the async API
+   *  @details Each thread owns a bounded queue (lane). Operations on an
+   *  address always go to the same lane, so they run in the order they
+   *  were submitted, while other lanes proceed meanwhile. Submitting to
+   *  a full lane blocks until the lane has room. Reads queued next to 
+   *  each other in a lane run as one batch.
+   */
+  class async_executor
+  : boost::noncopyable
+  {
+  public:
+    typedef std::function<void()> task_type;
+    typedef std::function<void(batch_read *reads, size_t count)> 
+      reader_type;
+
+    async_executor();
+    ~async_executor();
+
+    /// Start threads once, later calls do nothing
+    void
+    start(unsigned int threads, uint32_t queue_size);
+
+    /** @brief Queue a task of an address
+     *  @param addr npos for tasks of no address, which are spread over
+     *  the lanes in turn
+     */
+    void
+    submit(AddrType addr, task_type const &task);
+
+    /// Runs batches of reads, set before the threads start
+    void
+    set_reader(reader_type const &reader)
+    { reader_ = reader; }
+
+    /// Queue a read, its done() is called with the data or the error
+    void
+    submit_read(batch_read const &read);
+
+    /// Run queued tasks and join the threads
+    void
+    stop();
+
+  private:
+    // a task or a read
+    struct entry
+    {
+      task_type task;
+      std::unique_ptr<batch_read> read;
+    };
+
+    struct lane
+    {
+      std::mutex mutex;
+      std::condition_variable not_empty, not_full;
+      std::deque<entry> tasks;
+      bool stop;
+      std::thread thread;
+
+      lane() : stop(false) {}
+    };
+
+    void
+    push(AddrType addr, entry &e);
+
+    void
+    run(lane *l);
+
+    void
+    read(std::vector<batch_read> &reads);
+
+    std::mutex start_mutex_;
+    std::atomic<bool> started_;
+    std::vector<lane*> lanes_;
+    uint32_t queue_size_;
+    std::atomic<unsigned int> next_;
+    reader_type reader_;
+  };
+
+} // namespace BDB
+
+#endif // header guard
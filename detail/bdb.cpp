@@ -1,58 +1,394 @@
 #include "bdb.hpp"
 #include "bdbImpl.hpp"
 #include "addr_iter.hpp"
+#include <memory>
 
 namespace BDB {
   
+  typedef std::unique_lock<std::mutex> guard_t;
+
+  namespace {
+    // log record of an operation under the lock
+    class commit_scope
+    {
+    public:
+      commit_scope(BDBImpl *impl, guard_t &guard)
+      : impl_(impl), guard_(guard), done_(false)
+      {}
+
+      // entries of an operation that throws are already applied to the
+      // tables, they are written as a record of their own rather than
+      // with the record of the next operation
+      ~commit_scope()
+      {
+        if(done_) return;
+        try {
+          impl_->commit_op();
+        }catch(std::exception const &){
+          // kept for the next record
+        }
+      }
+
+      // write the record, and wait for it to be on the device after 
+      // leaving the lock, see Config::sync_commit
+      void
+      commit()
+      {
+        done_ = true;
+        unsigned long long ticket = impl_->commit_op();
+        guard_.unlock();
+        impl_->sync(ticket);
+      }
+
+    private:
+      BDBImpl *impl_;
+      guard_t &guard_;
+      bool done_;
+    };
+
+    // reads of a batch under the lock, timed as one get
+    void
+    read_batch(BDBImpl *impl, batch_read *reads, size_t count)
+    {
+      op_timer tm(impl->metrics_, OP_GET);
+      guard_t guard(impl->mutex_);
+      trace_scope tr(impl->slow_log_, "get");
+      impl->get(reads, count);
+      unsigned long long bytes(0);
+      for(size_t i = 0; i < count; ++i)
+        bytes += reads[i].data.size();
+      tm.done(bytes);
+    }
+
+    // queue op whose result sets a future
+    template<typename T, typename Op>
+    std::future<T>
+    async_future(BDBImpl *impl, AddrType addr, Op op)
+    {
+      std::shared_ptr<std::promise<T> > p(new std::promise<T>);
+      impl->async(addr, [p, op]() {
+        try {
+          p->set_value(op());
+        }catch(...){
+          p->set_exception(std::current_exception());
+        }
+      });
+      return p->get_future();
+    }
+
+    // queue op that fills the result passed to fn
+    template<typename Op>
+    void
+    async_callback(BDBImpl *impl, AddrType addr, Op op, 
+                   Async_func fn, void *arg)
+    {
+      impl->async(addr, [op, fn, arg]() {
+        AsyncResult r;
+        try {
+          op(r);
+        }catch(...){
+          r.error = std::current_exception();
+        }
+        fn(r, arg);
+      });
+    }
+  }
+  
   BehaviorDB::BehaviorDB(Config const &conf)
   : impl_(new BDBImpl(conf))
-  {}
+  {
+    BDBImpl *impl = impl_;
+    impl_->async_.set_reader([impl](batch_read *reads, size_t count) {
+      read_batch(impl, reads, count);
+    });
+  }
   
   BehaviorDB::~BehaviorDB()
-  { delete impl_; }
+  { 
+    // queued operations still use this
+    impl_->async_.stop();
+    delete impl_; 
+  }
 
   //BehaviorDB::operator void const*() const
   //{ if(!*impl_) return 0; return this; }
   
   AddrType
   BehaviorDB::put(char const *data, uint32_t size)
-  { return impl_->put(data, size); }
+  {
+    op_timer tm(impl_->metrics_, OP_PUT);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "put");
+    AddrType rt = impl_->put(data, size);
+    cs.commit();
+    tm.done(size);
+    return rt;
+  }
 
   AddrType
   BehaviorDB::put(char const *data, uint32_t size, AddrType addr, uint32_t off)
-  { return impl_->put(data, size, addr, off); }
+  {
+    op_timer tm(impl_->metrics_, OP_INSERT);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "insert");
+    AddrType rt = impl_->put(data, size, addr, off);
+    cs.commit();
+    tm.done(size);
+    return rt;
+  }
+
+  AddrType
+  BehaviorDB::put(char const *data, uint32_t size, reserve_hint hint)
+  {
+    op_timer tm(impl_->metrics_, OP_PUT);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "put-reserve");
+    AddrType rt = impl_->put(data, size, hint);
+    cs.commit();
+    tm.done(size);
+    return rt;
+  }
 
   AddrType
   BehaviorDB::put(std::string const& data)
-  { return impl_->put(data); }
+  {
+    op_timer tm(impl_->metrics_, OP_PUT);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "put");
+    AddrType rt = impl_->put(data);
+    cs.commit();
+    tm.done(data.size());
+    return rt;
+  }
+
+  AddrType
+  BehaviorDB::put(std::string const& data, reserve_hint hint)
+  {
+    op_timer tm(impl_->metrics_, OP_PUT);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "put-reserve");
+    AddrType rt = impl_->put(data, hint);
+    cs.commit();
+    tm.done(data.size());
+    return rt;
+  }
   
   AddrType
   BehaviorDB::put(std::string const& data, AddrType addr, uint32_t off)
-  { return impl_->put(data, addr, off); }
+  {
+    op_timer tm(impl_->metrics_, OP_INSERT);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "insert");
+    AddrType rt = impl_->put(data, addr, off);
+    cs.commit();
+    tm.done(data.size());
+    return rt;
+  }
+
+  AddrType
+  BehaviorDB::reserve(AddrType addr, uint32_t capacity)
+  {
+    io_scope io(impl_->metrics_);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "reserve");
+    AddrType rt = impl_->reserve(addr, capacity);
+    cs.commit();
+    return rt;
+  }
 
   AddrType
   BehaviorDB::update(char const* data, uint32_t size, AddrType addr)
-  { return impl_->update(data, size, addr); }
+  {
+    op_timer tm(impl_->metrics_, OP_UPDATE);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "update");
+    AddrType rt = impl_->update(data, size, addr);
+    cs.commit();
+    tm.done(size);
+    return rt;
+  }
   
   AddrType
   BehaviorDB::update(std::string const& data, AddrType addr)
-  { return impl_->update(data, addr); }
+  {
+    op_timer tm(impl_->metrics_, OP_UPDATE);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "update");
+    AddrType rt = impl_->update(data, addr);
+    cs.commit();
+    tm.done(data.size());
+    return rt;
+  }
 
   uint32_t
   BehaviorDB::get(char *output, uint32_t size, AddrType addr, uint32_t off)
-  { return impl_->get(output, size, addr, off); }
+  {
+    op_timer tm(impl_->metrics_, OP_GET);
+    guard_t guard(impl_->mutex_);
+    trace_scope tr(impl_->slow_log_, "get");
+    uint32_t rt = impl_->get(output, size, addr, off);
+    tm.done(rt);
+    return rt;
+  }
   
   uint32_t
   BehaviorDB::get(std::string *output, uint32_t max, AddrType addr, uint32_t off)
-  { return impl_->get(output, max, addr, off); }
+  {
+    op_timer tm(impl_->metrics_, OP_GET);
+    guard_t guard(impl_->mutex_);
+    trace_scope tr(impl_->slow_log_, "get");
+    uint32_t rt = impl_->get(output, max, addr, off);
+    tm.done(rt);
+    return rt;
+  }
+
+  void
+  BehaviorDB::get(std::vector<AddrType> const &addrs, 
+                  std::vector<std::string> *output)
+  {
+    std::vector<batch_read> reads(addrs.size());
+    for(size_t i = 0; i < addrs.size(); ++i)
+      reads[i].addr = addrs[i];
+    if(!reads.empty())
+      read_batch(impl_, &reads[0], reads.size());
+
+    output->resize(addrs.size());
+    std::exception_ptr error;
+    for(size_t i = 0; i < reads.size(); ++i){
+      (*output)[i].swap(reads[i].data);
+      if(reads[i].error && !error)
+        error = reads[i].error;
+    }
+    if(error)
+      std::rethrow_exception(error);
+  }
 
   uint32_t
   BehaviorDB::del(AddrType addr)
-  { return impl_->del(addr); }
+  {
+    op_timer tm(impl_->metrics_, OP_DEL);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "del");
+    uint32_t rt = impl_->del(addr);
+    cs.commit();
+    tm.done(0);
+    return rt;
+  }
 
   uint32_t
   BehaviorDB::del(AddrType addr, uint32_t off, uint32_t size)
-  { return impl_->del(addr, off, size); }
+  {
+    op_timer tm(impl_->metrics_, OP_DEL);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    trace_scope tr(impl_->slow_log_, "partial_del");
+    uint32_t rt = impl_->del(addr, off, size);
+    cs.commit();
+    tm.done(size);
+    return rt;
+  }
+
+  std::future<AddrType>
+  BehaviorDB::async_put(std::string const &data)
+  {
+    return async_future<AddrType>(impl_, npos, [this, data]() {
+      return put(data);
+    });
+  }
+
+  void
+  BehaviorDB::async_put(std::string const &data, Async_func fn, void *arg)
+  {
+    async_callback(impl_, npos, [this, data](AsyncResult &r) {
+      r.addr = put(data);
+      r.size = data.size();
+    }, fn, arg);
+  }
+
+  std::future<AddrType>
+  BehaviorDB::async_append(std::string const &data, AddrType addr)
+  {
+    return async_future<AddrType>(impl_, addr, [this, data, addr]() {
+      return put(data, addr);
+    });
+  }
+
+  void
+  BehaviorDB::async_append(std::string const &data, AddrType addr,
+                           Async_func fn, void *arg)
+  {
+    async_callback(impl_, addr, [this, data, addr](AsyncResult &r) {
+      r.addr = put(data, addr);
+      r.size = data.size();
+    }, fn, arg);
+  }
+
+  std::future<std::string>
+  BehaviorDB::async_get(AddrType addr, uint32_t max, uint32_t off)
+  {
+    std::shared_ptr<std::promise<std::string> > p(
+      new std::promise<std::string>);
+    batch_read r;
+    r.addr = addr;
+    r.max = max;
+    r.off = off;
+    r.done = [p](batch_read &r) {
+      if(r.error)
+        p->set_exception(r.error);
+      else
+        p->set_value(std::move(r.data));
+    };
+    impl_->async(r);
+    return p->get_future();
+  }
+
+  void
+  BehaviorDB::async_get(AddrType addr, Async_func fn, void *arg,
+                        uint32_t max, uint32_t off)
+  {
+    batch_read r;
+    r.addr = addr;
+    r.max = max;
+    r.off = off;
+    r.done = [fn, arg](batch_read &r) {
+      AsyncResult rt;
+      rt.addr = r.addr;
+      rt.error = r.error;
+      if(!r.error){
+        rt.size = r.data.size();
+        rt.data.swap(r.data);
+      }
+      fn(rt, arg);
+    };
+    impl_->async(r);
+  }
+
+  std::future<uint32_t>
+  BehaviorDB::async_del(AddrType addr)
+  {
+    return async_future<uint32_t>(impl_, addr, [this, addr]() {
+      return del(addr);
+    });
+  }
+
+  void
+  BehaviorDB::async_del(AddrType addr, Async_func fn, void *arg)
+  {
+    async_callback(impl_, addr, [this, addr](AsyncResult &r) {
+      r.size = del(addr);
+      r.addr = addr;
+    }, fn, arg);
+  }
   
   /*
   stream_state const*
@@ -108,8 +444,48 @@ namespace BDB {
   BehaviorDB::end() const
   { return impl_->end(); }
   
+  unsigned long long
+  BehaviorDB::compact(uint32_t max_bytes)
+  {
+    io_scope io(impl_->metrics_);
+    guard_t guard(impl_->mutex_);
+    commit_scope cs(impl_, guard);
+    unsigned long long rt = impl_->compact(max_bytes);
+    cs.commit();
+    return rt;
+  }
+
+  unsigned long long
+  BehaviorDB::scan(Scan_func fn, void *arg, bool per_pool_threads)
+  {
+    io_scope io(impl_->metrics_);
+    guard_t guard(impl_->mutex_);
+    return impl_->scan(fn, arg, per_pool_threads);
+  }
+
+  ScanStat
+  BehaviorDB::parallel_scan(Scan_func fn, void *arg, unsigned int threads)
+  { return impl_->parallel_scan(fn, arg, threads); }
+
+  void
+  BehaviorDB::recommend(Config *conf) const
+  {
+    guard_t guard(impl_->mutex_);
+    impl_->recommend(conf);
+  }
+
   void
   BehaviorDB::stat(Stat *s) const
-  { impl_->stat(s); }
+  {
+    guard_t guard(impl_->mutex_);
+    impl_->stat(s);
+  }
+
+  void
+  BehaviorDB::stat_reset(Stat *s)
+  {
+    guard_t guard(impl_->mutex_);
+    impl_->stat(s, true);
+  }
 } // end of namespace BDB
 
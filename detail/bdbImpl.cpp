@@ -7,21 +7,38 @@
 #include "addr_iter.hpp"
 #include "stat.hpp"
 //#include "stream_state.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <cassert>
+#include <chrono>
+#include <exception>
 #include <stdexcept>
+#include <thread>
 #include <ios>
 #include <sstream>
 
 namespace BDB {
   
   BDBImpl::BDBImpl(Config const & conf)
-  : pools_(0), err_log_(0), global_id_(0)
+  : pools_(0), err_log_(0), global_id_(0), reclaimed_size_(0),
+  wal_checkpoint_(0), sync_commit_(false), 
+  async_threads_(0), async_queue_size_(0), io_engine_(IO_ENGINE_SYNC),
+  io_depth_(0)
   {
     init_(conf); 
   }
   
   BDBImpl::~BDBImpl()
   {
+    exporter_.stop();
+    if(wal_.is_open()){
+      try {
+        commit_op();
+        checkpoint();
+      }catch(std::exception const &){
+        // the log is applied when the BehaviorDB is opened again
+      }
+    }
     delete global_id_;
 
     access_log_.close();
@@ -38,21 +55,44 @@ namespace BDB {
   {
     using namespace std;
 
+    conf.validate();
+
     addrEval.init(
       conf.addr_prefix_len, 
       conf.min_size, 
       conf.cse_func, 
-      conf.ct_func);
+      conf.ct_func,
+      conf.slab_threshold);
+    growth_.init(&addrEval, conf.adaptive_growth);
+    metrics_.init(conf.collect_metrics);
 
     // initial pools
+    devices_ = conf.pool_dirs;
+    if(devices_.empty())
+      devices_.push_back(conf.pool_dir.empty() ? conf.root_dir : conf.pool_dir);
+    pool_devices_.resize(addrEval.dir_count());
+
     pool::config pcfg;
-    pcfg.work_dir = conf.pool_dir.empty() ? conf.root_dir : conf.pool_dir;
     pcfg.trans_dir =conf.trans_dir.empty() ? conf.root_dir : conf.trans_dir;
     pcfg.header_dir = conf.header_dir.empty() ? conf.root_dir : conf.header_dir;
-
+    pcfg.punch_threshold = conf.punch_threshold;
+    pcfg.direct_threshold = conf.direct_threshold;
+    pcfg.hints = conf.io_hints;
+    pcfg.dontneed_threshold = conf.dontneed_threshold;
+    pcfg.prealloc_func = conf.prealloc_func;
+    pcfg.mmap_func = conf.mmap_func;
+
+    pool::upgrade(pcfg.trans_dir, addrEval.dir_count());
     pools_ = (pool*)malloc(sizeof(pool) * addrEval.dir_count());
     for(unsigned int i =0; i<addrEval.dir_count(); ++i){
       pcfg.dirID = i;
+      pcfg.packed = addrEval.is_packed(i);
+      place_pool(conf, i, &pool_devices_[i]);
+      pcfg.work_dir = devices_[pool_devices_[i][0]];
+      pcfg.stripe_dirs.clear();
+      for(size_t k = 0; pool_devices_[i].size() > 1 && 
+          k < pool_devices_[i].size(); ++k)
+        pcfg.stripe_dirs.push_back(devices_[pool_devices_[i][k]]);
       new (&pools_[i]) pool(pcfg, addrEval); 
     }
 
@@ -73,24 +113,353 @@ namespace BDB {
     sprintf(fname, "%saccess.log", log_dir);
     if(!access_log_.rdbuf()->pubsetbuf(acc_log_buf_, 4096))
       throw std::runtime_error("setvbuf to log file failed\n");
+    access_log_path_ = fname;
     access_log_.open(fname, ios::out | ios::binary | ios::app);
     if(!access_log_.is_open())
       throw std::runtime_error("create access.log file failed\n");
     logger_.reset(new logger(access_log_));
 
+    sprintf(fname, "%sslow.log", log_dir);
+    slow_log_.init(fname, conf.slow_op_threshold);
+
     // init IDValPool
     sprintf(fname, "%sgid_", conf.root_dir.c_str());
     global_id_ = new idpool_t(0, fname, conf.beg, npos, dynamic);
 
+    if(conf.wal_checkpoint){
+      wal_checkpoint_ = conf.wal_checkpoint;
+      sprintf(fname, "%sbdb.wal", pcfg.trans_dir.c_str());
+      wal_.open(fname);
+      global_id_->attach(&wal_, "gid");
+      for(unsigned int i =0; i<addrEval.dir_count(); ++i){
+        pools_[i].attach_wal(&wal_);
+        pool_files_.push_back(wal_.add_file(pools_[i].file_no()));
+        for(unsigned int k = 1; k < pools_[i].stripe_count(); ++k)
+          wal_.add_file(pools_[i].file_no(k));
+        pool_versions_.push_back(pools_[i].version());
+      }
+      sync_commit_ = conf.sync_commit;
+      wal_.set_sync(conf.sync_commit, conf.commit_delay);
+      if(sync_commit_)
+        wal_.set_engine(io_engine::create(conf.io_engine, conf.io_depth));
+      recover();
+    }
+    reclaim_slots();
+
     logger_->log("conf", conf.beg, conf.end, conf.addr_prefix_len,
                  conf.min_size, conf.root_dir, conf.pool_dir,
                  conf.trans_dir, conf.header_dir, conf.log_dir);
+
+    if(!conf.metrics_file.empty())
+      exporter_.start(this, conf.metrics_file, conf.metrics_interval);
+
+    async_threads_ = conf.async_threads;
+    async_queue_size_ = conf.async_queue_size;
+    io_engine_ = conf.io_engine;
+    io_depth_ = conf.io_depth;
   }
   
   void
-  BDBImpl::purgeclean() // TODO
+  BDBImpl::place_pool(Config const &conf, unsigned int dir,
+                      std::vector<unsigned int> *devices) const
   {
+    unsigned int n = devices_.size();
+    bool packed = addrEval.is_packed(dir);
+
+    devices->clear();
+    switch(conf.placement){
+    case PLACE_SIZE_CLASS:
+      if(n > 1 && !packed && 
+         addrEval.chunk_size_estimation(dir) >= conf.large_pool_threshold)
+        devices->push_back(n - 1);
+      else
+        devices->push_back(n > 1 ? dir % (n - 1) : 0);
+      break;
+    case PLACE_STRIPE:
+      // pages of a packed pool are in one file
+      for(unsigned int i = 0; !packed && n > 1 && i < n; ++i)
+        devices->push_back(i);
+      if(devices->empty())
+        devices->push_back(dir % n);
+      break;
+    default:
+      devices->push_back(dir % n);
+    }
+  }
+
+  void
+  BDBImpl::recover()
+  {
+    std::vector<std::string> records;
+    wal_.records(&records);
+
+    for(size_t i = 0; i < records.size(); ++i){
+      std::istringstream in(records[i]);
+      std::string tag;
+      while(in >> tag){
+        in.ignore(1);
+        if("gid" == tag){
+          global_id_->redo(in);
+          continue;
+        }
+        unsigned long dir = strtoul(tag.c_str(), 0, 16);
+        if(dir >= addrEval.dir_count())
+          throw std::runtime_error("Bad pool in write-ahead log");
+        pools_[dir].redo(in);
+      }
+    }
+    // also drops a record torn by a crash
+    checkpoint();
+  }
+
+  void
+  BDBImpl::reclaim_slots()
+  {
+    std::vector<std::vector<AddrType> > refs(addrEval.dir_count());
+    bool packed = false;
+    for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir)
+      packed = pools_[dir].packed() || packed;
+    if(!packed) return;
+
+    for(AddrType id = global_id_->next_used(global_id_->begin());
+        id != global_id_->end(); id = global_id_->next_used(id + 1))
+    {
+      AddrType in_addr = global_id_->Find(id);
+      unsigned int dir = addrEval.addr_to_dir(in_addr);
+      if(pools_[dir].packed())
+        refs[dir].push_back(addrEval.local_addr(in_addr));
+    }
+    for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir){
+      if(!pools_[dir].packed()) continue;
+      std::sort(refs[dir].begin(), refs[dir].end());
+      pools_[dir].reclaim(refs[dir]);
+    }
+  }
+
+  unsigned long long
+  BDBImpl::commit_op()
+  {
+    if(!wal_.is_open()) return 0;
+
+    phase_scope ps(PHASE_COMMIT);
+    if(sync_commit_){
+      // pool files written are synced with the record
+      for(unsigned int i =0; i<addrEval.dir_count(); ++i){
+        if(pool_versions_[i] == pools_[i].version()) continue;
+        pool_versions_[i] = pools_[i].version();
+        for(unsigned int k = 0; k < pools_[i].stripe_count(); ++k)
+          wal_.touch(pool_files_[i] + k);
+      }
+    }
+    unsigned long long ticket = wal_.commit();
+    unsigned long long synced = 
+      sync_commit_ ? wal_.synced_ticket() : ticket;
+    for(unsigned int i =0; i<addrEval.dir_count(); ++i)
+      pools_[i].release_deferred(ticket, synced);
+    if(wal_.size() >= wal_checkpoint_)
+      checkpoint();
+    return ticket;
+  }
+
+  void
+  BDBImpl::sync(unsigned long long ticket)
+  {
+    if(!sync_commit_) return;
+    phase_scope ps(PHASE_COMMIT);
+    wal_.sync(ticket);
+  }
+
+  void
+  BDBImpl::checkpoint()
+  {
+    unsigned long long ticket = wal_.last_ticket();
+    // records are synced before table files hold them
+    wal_.sync(ticket);
+    // the log is emptied behind them, so tables are synced whatever
+    // sync_commit_
+    global_id_->checkpoint(true);
+    for(unsigned int i =0; i<addrEval.dir_count(); ++i){
+      pools_[i].checkpoint(true);
+      pools_[i].release_deferred(ticket, ticket);
+    }
+    wal_.reset();
+  }
+
+  void
+  BDBImpl::async(AddrType addr, async_executor::task_type const &task)
+  {
+    async_.start(async_threads_, async_queue_size_);
+    async_.submit(addr, task);
+  }
+
+  void
+  BDBImpl::async(batch_read const &read)
+  {
+    async_.start(async_threads_, async_queue_size_);
+    async_.submit_read(read);
+  }
+
+  void
+  BDBImpl::purgeclean()
+  {
+    while(compact(MIGBUF_SIZ))
+      ;
+  }
+
+  unsigned long long
+  BDBImpl::compact(uint32_t max_bytes)
+  {
+    typedef boost::unordered_map<AddrType, AddrType> owner_map;
+    
+    std::vector<pool::move_list> plans(addrEval.dir_count());
+    std::vector<std::vector<AddrType> > owners(addrEval.dir_count());
+    owner_map unknown;
+    unsigned long long planned(0), rt(0);
+
+    // chunk headers name their owners, which are checked against the
+    // global table
+    for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir){
+      if(planned >= max_bytes) break;
+      pools_[dir].compact_plan(max_bytes - planned, &plans[dir]);
+      planned += 
+        plans[dir].size() * (unsigned long long)
+        addrEval.chunk_size_estimation(dir);
+      for(size_t i = 0; i < plans[dir].size(); ++i){
+        AddrType in_addr = addrEval.global_addr(dir, plans[dir][i].first);
+        AddrType owner = pools_[dir].owner(plans[dir][i].first);
+        if(npos == owner || !global_id_->isAcquired(owner) ||
+           global_id_->Find(owner) != in_addr){
+          unknown[in_addr] = npos;
+          owner = npos;
+        }
+        owners[dir].push_back(owner);
+      }
+    }
+    
+    // resolve the others (chunks written by older versions) through 
+    // the global table
+    size_t resolved(0);
+    AddrType id = unknown.empty() ? 
+      global_id_->end() : global_id_->next_used(global_id_->begin());
+    while(resolved < unknown.size() && id != global_id_->end()){
+      owner_map::iterator iter = unknown.find(global_id_->Find(id));
+      if(unknown.end() != iter){
+        iter->second = id;
+        ++resolved;
+      }
+      id = global_id_->next_used(id + 1);
+    }
+    
+    struct chunk_move
+    {
+      AddrType from, to, owner;
+      bool adopt;
+    };
+    std::vector<std::vector<chunk_move> > moves(addrEval.dir_count());
+    // pools by device, striped pools share the last group
+    std::vector<std::vector<unsigned int> > groups(devices_.size() + 1);
+    for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir){
+      for(size_t i = 0; i < plans[dir].size(); ++i){
+        chunk_move m = { 
+          plans[dir][i].first, plans[dir][i].second, owners[dir][i], false 
+        };
+        m.adopt = npos == m.owner;
+        if(m.adopt){
+          m.owner = unknown[addrEval.global_addr(dir, m.from)];
+          // chunks not referred by the global table are left untouched
+          if(npos == m.owner) continue;
+        }
+        moves[dir].push_back(m);
+      }
+      if(moves[dir].empty()) continue;
+      groups[pools_[dir].stripe_count() > 1 ? 
+             devices_.size() : pool_devices_[dir][0]].push_back(dir);
+    }
+    groups.erase(
+      std::remove_if(groups.begin(), groups.end(), 
+                     [](std::vector<unsigned int> const &g) { 
+                       return g.empty(); 
+                     }),
+      groups.end());
+
+    // chunks are copied by a thread per device, their owners are 
+    // pointed to the copies afterwards
+    std::vector<size_t> copied(addrEval.dir_count(), 0);
+    std::vector<std::exception_ptr> errors(groups.size());
+    auto copy = [&](size_t g) {
+      try{
+        // batches of io_depth_ chunks, or of 1MB 
+        std::unique_ptr<io_engine> engine(
+          io_engine::create(io_engine_, io_depth_));
+        std::vector<char> buf;
+        pool::move_list batch;
+        for(size_t j = 0; j < groups[g].size(); ++j){
+          unsigned int dir = groups[g][j];
+          size_t batch_size = std::max<size_t>(1, std::min<size_t>(
+            io_depth_, (1 << 20) / addrEval.chunk_size_estimation(dir)));
+          while(copied[dir] < moves[dir].size()){
+            size_t end = 
+              std::min(copied[dir] + batch_size, moves[dir].size());
+            batch.clear();
+            for(size_t i = copied[dir]; i < end; ++i)
+              batch.push_back(
+                std::make_pair(moves[dir][i].from, moves[dir][i].to));
+            pools_[dir].relocate(batch, &buf, *engine);
+            for(; copied[dir] < end; ++copied[dir]){
+              chunk_move const &m = moves[dir][copied[dir]];
+              if(m.adopt) 
+                pools_[dir].set_owner(m.to, m.owner);
+            }
+          }
+        }
+      }catch(...){
+        errors[g] = std::current_exception();
+      }
+    };
+    if(groups.size() > 1){
+      std::vector<std::thread> workers;
+      for(size_t g = 0; g < groups.size(); ++g){
+        workers.push_back(std::thread([&, g]() {
+          io_scope io(metrics_);
+          copy(g);
+        }));
+      }
+      for(size_t g = 0; g < workers.size(); ++g)
+        workers[g].join();
+    }else if(!groups.empty()){
+      copy(0);
+    }
+
+    for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir){
+      for(size_t i = 0; i < copied[dir]; ++i){
+        chunk_move const &m = moves[dir][i];
+        id_handle_t hdl(detail::MODIFY, *global_id_, m.owner);
+        hdl.value() = addrEval.global_addr(dir, m.to);
+        hdl.commit();
+        pools_[dir].free(m.from);
+        rt += addrEval.chunk_size_estimation(dir);
+      }
+    }
+    for(size_t g = 0; g < errors.size(); ++g){
+      if(errors[g])
+        std::rethrow_exception(errors[g]);
+    }
     
+    // freed chunks are truncated below, so the copies and the records 
+    // freeing the chunks are put on the device before
+    if(wal_.is_open()){
+      for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir){
+        if(copied[dir]) pools_[dir].sync();
+      }
+      commit_op();
+      checkpoint();
+    }
+    for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir){
+      unsigned long long reclaimed = pools_[dir].shrink();
+      reclaimed_size_ += reclaimed;
+      rt += reclaimed;
+    }
+    return rt;
   }
 
   AddrType
@@ -99,10 +468,16 @@ namespace BDB {
     if(!global_id_->avail()) 
       throw addr_overflow();
     
+    phase_scope ps(PHASE_LOOKUP);
     id_handle_t hdl(detail::ACQUIRE_AUTO, *global_id_);
-    hdl.value() = write_pool(data, size);
+    ps.next(PHASE_OTHER);
+    hdl.value() = write_pool(data, size, 0, hdl.addr());
+    ps.next(PHASE_COMMIT);
     hdl.commit();
-    logger_->log("put", size);
+    growth_.on_put(addrEval.addr_to_dir(hdl.const_value()), size);
+    trace_addr(hdl.addr(), size);
+    ps.next(PHASE_LOG);
+    logger_->log("put", size, hdl.addr());
     return hdl.addr();
   }
 
@@ -110,60 +485,114 @@ namespace BDB {
   AddrType
   BDBImpl::put(char const* data, uint32_t size, AddrType addr, uint32_t off)
   {
+    trace_addr(addr, size);
+    phase_scope ps(PHASE_LOOKUP);
     try{
       id_handle_t hdl(detail::ACQUIRE_SPEC, *global_id_, addr);
-      hdl.value() = write_pool(data, size);
+      ps.next(PHASE_OTHER);
+      hdl.value() = write_pool(data, size, 0, addr);
+      ps.next(PHASE_COMMIT);
       hdl.commit();
+      growth_.on_put(addrEval.addr_to_dir(hdl.const_value()), size);
+      ps.next(PHASE_LOG);
       logger_->log("put-spec", size, addr, off);
     }catch(BDB::invalid_addr const &ia){
 
+      ps.next(PHASE_LOOKUP);
       id_handle_t hdl(detail::MODIFY, *global_id_, addr);
+      ps.next(PHASE_OTHER);
 
       unsigned int dir = addrEval.addr_to_dir(hdl.const_value());
       AddrType loc_addr = addrEval.local_addr(hdl.const_value());
 
       try{
         // no pool-to-pool migration 
+        trace_pools(dir, dir, false);
         loc_addr = pools_[dir].write(data, size, loc_addr, off);
         hdl.value() = addrEval.global_addr(dir, loc_addr);
+        ps.next(PHASE_COMMIT);
         hdl.commit();
+        growth_.on_append(dir, size);
+        ps.next(PHASE_LOG);
         logger_->log("insert", size, addr, off);
       }catch(internal_chunk_overflow const &co){
         // migration
         unsigned int next_dir = 
-          addrEval.directory(size + co.current_size);
-        AddrType next_loc_addr;
+          growth_.directory(dir, size + co.current_size);
 
         if((unsigned int)-1 == next_dir)
           throw chunk_overflow();
 
-        while(next_dir < addrEval.dir_count()){
-          try{
-            next_loc_addr = 
-              pools_[dir].merge_move(
-                data, size, loc_addr, off,
-                &pools_[next_dir]);
-          }catch(addr_overflow const &){
-            next_dir++;
-            continue;
-          }
-          break;
-        }
-        if( next_dir >= addrEval.dir_count())
-          throw addr_overflow();
-
-        hdl.value() = addrEval.global_addr(next_dir, next_loc_addr);
+        ps.next(PHASE_OTHER);
+        hdl.value() = 
+          migrate(dir, loc_addr, next_dir, data, size, off, addr);
+        ps.next(PHASE_COMMIT);
         hdl.commit();
+        growth_.on_append(dir, size);
+        growth_.on_migrate(dir, addrEval.addr_to_dir(hdl.const_value()),
+                           co.current_size, size + co.current_size);
+        ps.next(PHASE_LOG);
         logger_->log("insert", size, addr, off);
       }
     }
     return addr;
   }
   
+  AddrType
+  BDBImpl::put(char const *data, uint32_t size, reserve_hint hint)
+  {
+    if(!global_id_->avail()) 
+      throw addr_overflow();
+    
+    phase_scope ps(PHASE_LOOKUP);
+    id_handle_t hdl(detail::ACQUIRE_AUTO, *global_id_);
+    ps.next(PHASE_OTHER);
+    hdl.value() = write_pool(data, size, hint.capacity, hdl.addr());
+    ps.next(PHASE_COMMIT);
+    hdl.commit();
+    growth_.on_put(addrEval.addr_to_dir(hdl.const_value()), size);
+    trace_addr(hdl.addr(), size);
+    ps.next(PHASE_LOG);
+    logger_->log("put-reserve", size, hint.capacity, hdl.addr());
+    return hdl.addr();
+  }
+
+  AddrType
+  BDBImpl::reserve(AddrType addr, uint32_t capacity)
+  {
+    trace_addr(addr, capacity);
+    phase_scope ps(PHASE_LOOKUP);
+    id_handle_t hdl(detail::MODIFY, *global_id_, addr);
+    ps.next(PHASE_OTHER);
+
+    unsigned int dir = addrEval.addr_to_dir(hdl.const_value());
+    AddrType loc_addr = addrEval.local_addr(hdl.const_value());
+    
+    unsigned int next_dir = dir;
+    while(next_dir + 1 < addrEval.dir_count() &&
+          addrEval.chunk_size_estimation(next_dir) < capacity)
+      ++next_dir;
+
+    if(next_dir != dir){
+      uint32_t size = pools_[dir].data_size(loc_addr);
+      hdl.value() = migrate(dir, loc_addr, next_dir, 0, 0, npos, addr);
+      ps.next(PHASE_COMMIT);
+      hdl.commit();
+      growth_.on_migrate(dir, addrEval.addr_to_dir(hdl.const_value()),
+                         size, size);
+    }
+    ps.next(PHASE_LOG);
+    logger_->log("reserve", addr, capacity);
+    return addr;
+  }
+
   AddrType
   BDBImpl::update(char const *data, uint32_t size, AddrType addr)
   {
+    trace_addr(addr, size);
+    phase_scope ps(PHASE_LOOKUP);
     id_handle_t hdl(detail::MODIFY, *global_id_, addr);
+    ps.next(PHASE_OTHER);
 
     unsigned int dir = addrEval.addr_to_dir(hdl.const_value());
     AddrType loc_addr = addrEval.local_addr(hdl.const_value());
@@ -173,14 +602,26 @@ namespace BDB {
 
       unsigned int old_dir = dir;
       AddrType old_loc_addr = loc_addr;
-      AddrType new_internal_addr = write_pool(data, size);
+      AddrType new_internal_addr = write_pool(data, size, 0, addr);
+      trace_pools(old_dir, addrEval.addr_to_dir(new_internal_addr), true);
  
       hdl.value() = new_internal_addr;
+      ps.next(PHASE_COMMIT);
       hdl.commit();
+      ps.next(PHASE_OTHER);
       pools_[old_dir].free(old_loc_addr);
+      ps.next(PHASE_LOG);
       logger_->log("update_put", size, addr);
     }else{
-      loc_addr = pools_[dir].replace(data, size, loc_addr);
+      // a packed pool may relocate the record within itself
+      trace_pools(dir, dir, false);
+      AddrType new_loc_addr = pools_[dir].replace(data, size, loc_addr);
+      if(new_loc_addr != loc_addr){
+        hdl.value() = addrEval.global_addr(dir, new_loc_addr);
+        ps.next(PHASE_COMMIT);
+        hdl.commit();
+      }
+      ps.next(PHASE_LOG);
       logger_->log("update", size, addr);
     }
     return addr;
@@ -189,13 +630,18 @@ namespace BDB {
   uint32_t
   BDBImpl::get(char *output, uint32_t size, AddrType addr, uint32_t off)
   {
+    phase_scope ps(PHASE_LOOKUP);
     id_handle_t hdl(detail::READONLY, *global_id_, addr);
+    ps.next(PHASE_OTHER);
 
     uint32_t rt(0);
     unsigned int dir = addrEval.addr_to_dir(hdl.const_value());
     AddrType loc_addr = addrEval.local_addr(hdl.const_value());
+    trace_pools(dir, (unsigned int)-1, false);
     
     rt = pools_[dir].read(output, size, loc_addr, off);
+    trace_addr(addr, rt);
+    ps.next(PHASE_LOG);
     logger_->log("get", size, addr, off);
     return rt;
   }
@@ -203,31 +649,102 @@ namespace BDB {
   uint32_t
   BDBImpl::get(std::string *output, uint32_t max, AddrType addr, uint32_t off)
   {
+    phase_scope ps(PHASE_LOOKUP);
     id_handle_t hdl(detail::READONLY, *global_id_, addr);
+    ps.next(PHASE_OTHER);
 
     uint32_t rt(0);
     unsigned int dir = addrEval.addr_to_dir(hdl.const_value());
     AddrType loc_addr = addrEval.local_addr(hdl.const_value());
+    trace_pools(dir, (unsigned int)-1, false);
     
     rt = pools_[dir].read(output, max, loc_addr, off);
+    trace_addr(addr, rt);
+    ps.next(PHASE_LOG);
     logger_->log("string_get", max, addr, off);
     return rt;
   }
 
+  void
+  BDBImpl::get(batch_read *reads, size_t count)
+  {
+    phase_scope ps(PHASE_LOOKUP);
+    std::vector<io_request> reqs;
+    // read, pool and local address of each request
+    std::vector<size_t> req_reads;
+    std::vector<unsigned int> req_dirs;
+    std::vector<AddrType> req_addrs;
+
+    for(size_t i = 0; i < count; ++i){
+      batch_read &r = reads[i];
+      try{
+        ps.next(PHASE_LOOKUP);
+        id_handle_t hdl(detail::READONLY, *global_id_, r.addr);
+        ps.next(PHASE_OTHER);
+
+        unsigned int dir = addrEval.addr_to_dir(hdl.const_value());
+        AddrType loc_addr = addrEval.local_addr(hdl.const_value());
+        trace_pools(dir, (unsigned int)-1, false);
+
+        io_request req;
+        if(pools_[dir].read_request(&r.data, r.max, loc_addr, r.off, &req)){
+          reqs.push_back(req);
+          req_reads.push_back(i);
+          req_dirs.push_back(dir);
+          req_addrs.push_back(loc_addr);
+          continue;
+        }
+        trace_addr(r.addr, pools_[dir].read(&r.data, r.max, loc_addr, r.off));
+        ps.next(PHASE_LOG);
+        logger_->log("string_get", r.max, r.addr, r.off);
+      }catch(...){
+        r.error = std::current_exception();
+      }
+    }
+    if(reqs.empty()) return;
+
+    ps.next(PHASE_IO);
+    std::exception_ptr error;
+    try{
+      if(!read_engine_)
+        read_engine_.reset(io_engine::create(io_engine_, io_depth_));
+      read_engine_->run(&reqs[0], reqs.size());
+    }catch(...){
+      error = std::current_exception();
+    }
+    for(size_t i = 0; i < reqs.size(); ++i){
+      batch_read &r = reads[req_reads[i]];
+      if(error)
+        r.error = error;
+      else if(!pools_[req_dirs[i]].read_done(req_addrs[i], reqs[i]))
+        r.error = std::make_exception_ptr(std::runtime_error(SRC_POS));
+      if(r.error) continue;
+      trace_addr(r.addr, r.data.size());
+      ps.next(PHASE_LOG);
+      logger_->log("string_get", r.max, r.addr, r.off);
+    }
+  }
+
   uint32_t
   BDBImpl::del(AddrType addr)
   {
+    trace_addr(addr, 0);
+    phase_scope ps(PHASE_LOOKUP);
     id_handle_t hdl(detail::READONLY, *global_id_, addr);
+    ps.next(PHASE_OTHER);
    
     unsigned int dir = addrEval.addr_to_dir(hdl.const_value());
     AddrType loc_addr = addrEval.local_addr(hdl.const_value());
+    trace_pools(dir, (unsigned int)-1, false);
     
     pools_[dir].free(loc_addr);
 
     {
+      ps.next(PHASE_COMMIT);
       id_handle_t hdl(detail::RELEASE, *global_id_, addr);
       hdl.commit();
     }
+    ps.next(PHASE_LOG);
     logger_->log("del", addr);
     return 0;
   }
@@ -236,14 +753,20 @@ namespace BDB {
   BDBImpl::del(AddrType addr, uint32_t off, uint32_t size)
   {
     
+    trace_addr(addr, size);
+    phase_scope ps(PHASE_LOOKUP);
     id_handle_t hdl(detail::MODIFY, *global_id_, addr);
+    ps.next(PHASE_OTHER);
 
     unsigned int dir = addrEval.addr_to_dir(hdl.const_value());
     AddrType loc_addr = addrEval.local_addr(hdl.const_value());
     uint32_t nsize;
+    trace_pools(dir, (unsigned int)-1, false);
 
     nsize = pools_[dir].erase(loc_addr, off, size);
+    ps.next(PHASE_COMMIT);
     hdl.commit();
+    ps.next(PHASE_LOG);
     logger_->log("partial_del", addr, off, size);
     return nsize;
   }
@@ -613,6 +1136,289 @@ namespace BDB {
   }
   */
 
+  unsigned long long
+  BDBImpl::scan(Scan_func fn, void *arg, bool per_pool_threads)
+  {
+    std::vector<owner_list> owners(addrEval.dir_count());
+    list_owners(&owners);
+
+    std::atomic<bool> stop(false);
+    unsigned long long rt(0);
+    
+    if(!per_pool_threads){
+      for(unsigned int dir = 0; dir < addrEval.dir_count() && !stop; ++dir)
+        rt += scan_pool(dir, owners[dir], fn, arg, &stop);
+      return rt;
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<unsigned long long> counts(addrEval.dir_count(), 0);
+    std::vector<std::exception_ptr> errors(addrEval.dir_count());
+    for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir){
+      if(owners[dir].empty()) continue;
+      threads.push_back(std::thread([&, dir]() {
+        try{
+          counts[dir] = scan_pool(dir, owners[dir], fn, arg, &stop);
+        }catch(...){
+          errors[dir] = std::current_exception();
+          stop = true;
+        }
+      }));
+    }
+    for(size_t i = 0; i < threads.size(); ++i)
+      threads[i].join();
+    for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir){
+      if(errors[dir]) 
+        std::rethrow_exception(errors[dir]);
+      rt += counts[dir];
+    }
+    return rt;
+  }
+
+  void
+  BDBImpl::list_owners(std::vector<owner_list> *owners) const
+  {
+    AddrType id = global_id_->next_used(global_id_->begin());
+    while(id != global_id_->end()){
+      AddrType in_addr = global_id_->Find(id);
+      (*owners)[addrEval.addr_to_dir(in_addr)].push_back(
+        std::make_pair(addrEval.local_addr(in_addr), id));
+      id = global_id_->next_used(id + 1);
+    }
+    for(size_t dir = 0; dir < owners->size(); ++dir)
+      std::sort((*owners)[dir].begin(), (*owners)[dir].end());
+  }
+
+  unsigned long long
+  BDBImpl::scan_pool(unsigned int dir, owner_list const &owners,
+                     Scan_func fn, void *arg, std::atomic<bool> *stop)
+  {
+    if(owners.empty()) return 0;
+
+    sequential_scope seq(&pools_[dir], 1);
+    std::vector<AddrType> addrs(owners.size());
+    for(size_t i = 0; i < owners.size(); ++i)
+      addrs[i] = owners[i].first;
+    
+    std::vector<pool::scan_item> items(owners.size());
+    std::vector<char> buf(
+      std::max<uint32_t>(SCAN_BUF_SIZ, pools_[dir].scan_min_buffer()));
+    
+    unsigned long long rt(0);
+    uint32_t i(0), count(addrs.size());
+    while(i < count && !*stop){
+      uint32_t n = pools_[dir].read_window(
+        &addrs[i], count - i, &buf[0], buf.size(), &items[i]);
+      for(uint32_t j = i; j < i + n; ++j){
+        ++rt;
+        if(!fn(owners[j].second, &buf[items[j].off], items[j].size, arg)){
+          *stop = true;
+          return rt;
+        }
+      }
+      i += n;
+    }
+    return rt;
+  }
+
+  ScanStat
+  BDBImpl::parallel_scan(Scan_func fn, void *arg, unsigned int threads)
+  {
+    typedef std::lock_guard<std::mutex> guard_t;
+    typedef std::chrono::steady_clock clock_type;
+
+    clock_type::time_point beg = clock_type::now();
+    if(!threads)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // split pools into tasks of consecutive records, queued by device
+    std::vector<owner_list> owners(addrEval.dir_count());
+    std::vector<std::vector<scan_task> > queues(devices_.size());
+    std::vector<int> fds;
+    uint32_t buf_size = SCAN_BUF_SIZ;
+    {
+      guard_t guard(mutex_);
+      list_owners(&owners);
+      for(unsigned int dir = 0; dir < addrEval.dir_count(); ++dir){
+        for(unsigned int k = 0; k < pools_[dir].stripe_count(); ++k)
+          fds.push_back(pools_[dir].file_no(k));
+        uint32_t min_buf = pools_[dir].scan_min_buffer();
+        size_t step = std::max<size_t>(1, PSCAN_TASK_SIZ / min_buf);
+        buf_size = std::max(buf_size, min_buf);
+        for(size_t i = 0; i < owners[dir].size(); i += step){
+          scan_task t = { dir, i, std::min(i + step, owners[dir].size()) };
+          queues[pool_devices_[dir][0]].push_back(t);
+        }
+      }
+    }
+
+    // threads taking tasks in turn read different devices at once
+    std::vector<scan_task> tasks;
+    for(size_t i = 0, added = 1; added; ++i){
+      added = 0;
+      for(size_t d = 0; d < queues.size(); ++d){
+        if(i >= queues[d].size()) continue;
+        tasks.push_back(queues[d][i]);
+        ++added;
+      }
+    }
+
+    sequential_scope seq(pools_, addrEval.dir_count());
+    std::atomic<size_t> next(0);
+    std::atomic<bool> stop(false);
+    std::vector<ScanStat> stats(threads);
+    std::vector<std::vector<AddrType> > moved(threads);
+    std::vector<std::exception_ptr> errors(threads);
+    std::vector<std::thread> workers;
+    for(unsigned int t = 0; t < threads; ++t){
+      workers.push_back(std::thread([&, t]() {
+        io_scope io(metrics_);
+        try{
+          std::vector<char> buf(buf_size);
+          std::unique_ptr<io_engine> engine(
+            io_engine::create(io_engine_, io_depth_));
+          engine->register_buffer(&buf[0], buf.size());
+          engine->register_files(&fds[0], fds.size());
+          size_t k;
+          while(!stop && (k = next++) < tasks.size())
+            scan_range(tasks[k], owners[tasks[k].dir], fn, arg, buf,
+                       *engine, &stats[t], &moved[t], &stop);
+        }catch(...){
+          errors[t] = std::current_exception();
+          stop = true;
+        }
+      }));
+    }
+    for(unsigned int t = 0; t < threads; ++t)
+      workers[t].join();
+    
+    ScanStat rt;
+    for(unsigned int t = 0; t < threads; ++t){
+      if(errors[t])
+        std::rethrow_exception(errors[t]);
+      rt.records += stats[t].records;
+      rt.bytes += stats[t].bytes;
+      rt.retries += stats[t].retries;
+    }
+
+    // read records that moved where they are now
+    io_scope io(metrics_);
+    std::string data;
+    for(unsigned int t = 0; t < threads && !stop; ++t){
+      for(size_t i = 0; i < moved[t].size() && !stop; ++i){
+        {
+          guard_t guard(mutex_);
+          if(!global_id_->isAcquired(moved[t][i]))
+            continue;
+          AddrType in_addr = global_id_->Find(moved[t][i]);
+          pools_[addrEval.addr_to_dir(in_addr)].read(
+            &data, npos, addrEval.local_addr(in_addr), 0);
+        }
+        ++rt.records;
+        ++rt.moved;
+        rt.bytes += data.size();
+        if(!fn(moved[t][i], data.data(), data.size(), arg))
+          stop = true;
+      }
+    }
+    
+    rt.seconds = std::chrono::duration<double>(clock_type::now() - beg).count();
+    return rt;
+  }
+
+  void
+  BDBImpl::scan_range(scan_task const &task, owner_list const &owners,
+                      Scan_func fn, void *arg, std::vector<char> &buf,
+                      io_engine &engine, ScanStat *st, 
+                      std::vector<AddrType> *moved, std::atomic<bool> *stop)
+  {
+    typedef std::lock_guard<std::mutex> guard_t;
+
+    pool &p = pools_[task.dir];
+    size_t cap = buf.size() / p.scan_min_buffer();
+    std::vector<AddrType> addrs;
+    std::vector<size_t> pos, gone;
+    std::vector<pool::scan_item> items(cap);
+    std::vector<pool::scan_run> runs;
+    bool locked_read = false;
+
+    size_t i = task.beg;
+    while(i < task.end && !*stop){
+      size_t end = std::min(task.end, i + cap);
+      uint32_t n = 0;
+      unsigned long long version;
+      addrs.clear();
+      pos.clear();
+      gone.clear();
+      runs.clear();
+      {
+        // skip deleted records and those that moved
+        guard_t guard(mutex_);
+        for(size_t j = i; j < end; ++j){
+          AddrType ext = owners[j].second;
+          if(!global_id_->isAcquired(ext))
+            continue;
+          if(global_id_->Find(ext) == 
+             addrEval.global_addr(task.dir, owners[j].first)){
+            addrs.push_back(owners[j].first);
+            pos.push_back(j);
+          }else{
+            gone.push_back(j);
+          }
+        }
+        // chunks are read after unlocking unless the last try failed
+        if(!addrs.empty())
+          n = p.read_window(&addrs[0], addrs.size(), &buf[0], buf.size(),
+                            &items[0], locked_read ? 0 : &runs);
+        version = p.version();
+      }
+      if(n < addrs.size())
+        end = pos[n];
+
+      if(!runs.empty()){
+        bool ok = p.read_runs(runs, &buf[0], engine);
+        if(ok){
+          guard_t guard(mutex_);
+          ok = version == p.version();
+        }
+        if(!ok){
+          ++st->retries;
+          locked_read = true;
+          continue;
+        }
+      }
+      locked_read = false;
+
+      for(size_t j = 0; j < gone.size() && gone[j] < end; ++j)
+        moved->push_back(owners[gone[j]].second);
+      for(uint32_t j = 0; j < n; ++j){
+        ++st->records;
+        st->bytes += items[j].size;
+        if(!fn(owners[pos[j]].second, &buf[items[j].off], items[j].size, 
+               arg)){
+          *stop = true;
+          return;
+        }
+      }
+      i = end;
+    }
+  }
+
+  unsigned long long
+  BDBImpl::stale_owners()
+  {
+    unsigned long long rt(0);
+    AddrType id = global_id_->next_used(global_id_->begin());
+    while(id != global_id_->end()){
+      AddrType in_addr = global_id_->Find(id);
+      pool &p = pools_[addrEval.addr_to_dir(in_addr)];
+      if(!p.packed() && id != p.owner(addrEval.local_addr(in_addr)))
+        ++rt;
+      id = global_id_->next_used(id + 1);
+    }
+    return rt;
+  }
+
   AddrIterator
   BDBImpl::begin() const
   {
@@ -629,29 +1435,35 @@ namespace BDB {
   }
 
   void
-  BDBImpl::stat(Stat *s) const
+  BDBImpl::stat(Stat *s, bool reset) const
   {
     if(!s) return;
-    bdbStater bstat(s);
+    bdbStater bstat(s, reset);
     bstat(this);
   }
   
+  void
+  BDBImpl::recommend(Config *conf) const
+  { growth_.recommend(conf); }
+
   bool
   BDBImpl::full() const
   { return !global_id_->avail(); }
 
   
   AddrType
-  BDBImpl::write_pool(char const*data, uint32_t size)
+  BDBImpl::write_pool(char const*data, uint32_t size, uint32_t capacity,
+                      AddrType owner)
   {
-      unsigned int dir = addrEval.directory(size);
+      unsigned int dir = capacity > size ? 
+        addrEval.directory(size, capacity) : addrEval.directory(size);
       if((unsigned int)-1 == dir)
         throw std::length_error(SRC_POS);
 
       AddrType rt(0), loc_addr(0);
       while(dir < addrEval.dir_count()){
         try{
-          loc_addr = pools_[dir].write(data, size);
+          loc_addr = pools_[dir].write(data, size, chunk_owner(owner));
         }catch(addr_overflow const &){
           dir++;
           continue;
@@ -663,7 +1475,39 @@ namespace BDB {
         throw addr_overflow();
 
       rt = addrEval.global_addr(dir, loc_addr);
+      trace_pools(dir, (unsigned int)-1, false);
       return rt;
   }
 
+  AddrType
+  BDBImpl::migrate(unsigned int dir, AddrType loc_addr, 
+                   unsigned int next_dir,
+                   char const *data, uint32_t size, uint32_t off,
+                   AddrType owner)
+  {
+    AddrType next_loc_addr(0);
+
+    while(next_dir < addrEval.dir_count()){
+      try{
+        next_loc_addr = 
+          pools_[dir].merge_move(
+            data, size, loc_addr, off,
+            &pools_[next_dir]);
+      }catch(addr_overflow const &){
+        next_dir++;
+        continue;
+      }
+      break;
+    }
+    if( next_dir >= addrEval.dir_count())
+      throw addr_overflow();
+
+    // packed pools keep no owners to be copied
+    if(pools_[dir].packed())
+      pools_[next_dir].set_owner(next_loc_addr, owner);
+
+    trace_pools(dir, next_dir, true);
+    return addrEval.global_addr(next_dir, next_loc_addr);
+  }
+
 } // end of namespace BDB
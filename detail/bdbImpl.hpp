@@ -4,6 +4,9 @@
 #include <cstdio>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
 #include <fstream>
 
 #include "boost/unordered_map.hpp"
@@ -15,7 +18,14 @@
 #include "fixedPool.hpp"
 #include "addr_eval.hpp"
 #include "addr_wrapper.hpp"
+#include "growth.hpp"
+#include "metrics.hpp"
+#include "exporter.hpp"
+#include "trace.hpp"
 #include "log.hpp"
+#include "wal.hpp"
+#include "async.hpp"
+#include "io_engine.hpp"
 
 namespace BDB {
   
@@ -44,9 +54,19 @@ namespace BDB {
     void
     init_(Config const & conf);
   
+    /** @brief Compact all pools until no more chunk can be moved
+     */
     void
     purgeclean();
 
+    /** @brief Run one bounded step of pool file compaction
+     *  @param max_bytes Maximum bytes of chunks to be moved in this step
+     *  @return Bytes moved plus bytes reclaimed in this step. 0 
+     *  indicates no more work.
+     */
+    unsigned long long
+    compact(uint32_t max_bytes);
+
     /** @brief Put data
      *  @param data
      *  @param size
@@ -57,15 +77,28 @@ namespace BDB {
 
     AddrType
     put(char const *data, uint32_t size, AddrType addr, uint32_t off=npos);
+    
+    AddrType
+    put(char const *data, uint32_t size, reserve_hint hint);
       
     AddrType
     put(std::string const& data)
     { return put(data.data(), data.size()); }
     
+    AddrType
+    put(std::string const& data, reserve_hint hint)
+    { return put(data.data(), data.size(), hint); }
+    
     AddrType
     put(std::string const& data, AddrType addr, uint32_t off=npos)
     { return put(data.data(), data.size(), addr, off); }
     
+    /** @brief Move a chunk to a pool whose chunk size covers the
+     *  capacity
+     */
+    AddrType
+    reserve(AddrType addr, uint32_t capacity);
+
     AddrType
     update(char const *data, uint32_t size, AddrType addr);
     
@@ -79,6 +112,14 @@ namespace BDB {
     uint32_t
     get(std::string *output, uint32_t max, AddrType addr, uint32_t off=0);
 
+    /** @brief Read a batch of record ranges, see get(std::string*, ...)
+     *  @details Ranges of pools read through files are read by the I/O
+     *  engine as one batch, see Config::io_engine. Failed reads keep
+     *  their exception, the others are still read.
+     */
+    void
+    get(batch_read *reads, size_t count);
+
     uint32_t
     del(AddrType addr);
 
@@ -161,21 +202,130 @@ namespace BDB {
     stream_error(stream_state const* state);
     */
 
+    /** @brief Visit records in pool file order
+     *  @return Number of records visited
+     */
+    unsigned long long
+    scan(Scan_func fn, void *arg, bool per_pool_threads);
+
+    /** @brief Visit records by threads that read pool ranges
+     *  @remark Locks mutex_ itself, for short periods only.
+     */
+    ScanStat
+    parallel_scan(Scan_func fn, void *arg, unsigned int threads);
+
     AddrIterator
     begin() const;
 
     AddrIterator
     end() const;
     
-    void stat(Stat* s) const;
+    /** @brief Count records whose chunk header names another owner
+     *  @details Records in packed pools are not counted. A BehaviorDB
+     *  that stopped cleanly has none.
+     */
+    unsigned long long
+    stale_owners();
+
+    /** @brief Write the log record of the operation that just finished
+     *  @details Checkpoints once the log reaches Config::wal_checkpoint.
+     *  @return Ticket of the record for sync()
+     */
+    unsigned long long
+    commit_op();
+
+    /** @brief Wait for a record to be on the device when 
+     *  Config::sync_commit is set
+     *  @remark Called without mutex_, so that records of other threads
+     *  join the sync.
+     */
+    void
+    sync(unsigned long long ticket);
+
+    /// Write logged changes to the table files and empty the log
+    void
+    checkpoint();
+
+    /// reset zeroes metrics counters after they are added to s
+    void stat(Stat* s, bool reset=false) const;
+
+    void recommend(Config *conf) const;
     
     bool full() const;
 
+    /// Queue a task of the asynchronous API, see async_executor
+    void
+    async(AddrType addr, async_executor::task_type const &task);
+
+    /// Queue a read of the asynchronous API, see async_executor
+    void
+    async(batch_read const &read);
+
+    /// serializes operations of BehaviorDB 
+    std::mutex mutex_;
+
+    /// updated outside of mutex_
+    mutable metrics metrics_;
+
+    slow_log slow_log_;
+
+    /// stopped by BehaviorDB before the BDBImpl is destroyed
+    async_executor async_;
+
   protected:
+
+    // apply records of the write-ahead log left by the last run
+    void
+    recover();
+
+    // free slots of packed pools left by a crash before their global
+    // addresses were committed, see slab_pool
+    void
+    reclaim_slots();
+
+    // (local address, global address) pairs of records in a pool
+    typedef std::vector<std::pair<AddrType, AddrType> > owner_list;
+
+    // devices (indexes of Config::pool_dirs) of the stripes of a pool
+    void
+    place_pool(Config const &conf, unsigned int dir,
+               std::vector<unsigned int> *devices) const;
+
+    // list records of each pool through the global table, ordered by
+    // local addresses
+    void
+    list_owners(std::vector<owner_list> *owners) const;
+
+    unsigned long long
+    scan_pool(unsigned int dir, owner_list const &owners, 
+              Scan_func fn, void *arg, std::atomic<bool> *stop);
+
+    // owners [beg, end) of a pool, scanned by a thread of parallel_scan
+    struct scan_task
+    {
+      unsigned int dir;
+      size_t beg, end;
+    };
+
+    // visit records of a task window by window. Records that moved 
+    // since owners were listed are added to moved.
+    void
+    scan_range(scan_task const &task, owner_list const &owners,
+               Scan_func fn, void *arg, std::vector<char> &buf,
+               io_engine &engine, ScanStat *st, 
+               std::vector<AddrType> *moved, std::atomic<bool> *stop);
     
-    // write data to pool
+    // write data to pool, capacity is the expected final size and 
+    // owner the global address of the record
     AddrType
-    write_pool(char const*data, uint32_t size);
+    write_pool(char const*data, uint32_t size, uint32_t capacity=0,
+               AddrType owner=npos);
+
+    // move (and merge data to) a chunk of the record owner to the pool
+    // next_dir or a larger one, return new global address
+    AddrType
+    migrate(unsigned int dir, AddrType loc_addr, unsigned int next_dir,
+            char const *data, uint32_t size, uint32_t off, AddrType owner);
 
   private:
     // typedef boost::unordered_map<AddrType, unsigned int> AddrCntCont;
@@ -195,7 +345,29 @@ namespace BDB {
     idpool_t *global_id_;
     
     std::ofstream access_log_;
+    std::string access_log_path_;
     std::shared_ptr<logger> logger_;
+    
+    unsigned long long reclaimed_size_;
+    wal wal_;
+    uint32_t wal_checkpoint_;
+    bool sync_commit_;
+    // version of each pool at its last log record
+    std::vector<unsigned long long> pool_versions_;
+    // log file number of the first stripe of each pool
+    std::vector<unsigned int> pool_files_;
+    // directories of pool files, one per device
+    std::vector<std::string> devices_;
+    // devices of the stripes of each pool
+    std::vector<std::vector<unsigned int> > pool_devices_;
+    unsigned int async_threads_;
+    uint32_t async_queue_size_;
+    IOEngine io_engine_;
+    uint32_t io_depth_;
+    // reads batches of get(batch_read*, size_t), made on first use
+    std::unique_ptr<io_engine> read_engine_;
+    growth_tracker growth_;
+    stat_exporter exporter_;
     // AddrCntCont in_reading_;
     // TODO two containers as follows are not recoverable
     // EncStreamCont enc_stream_state_;
@@ -1,4 +1,5 @@
 #include "chunk.h"
+#include "file_utils.hpp"
 
 #include <cstdlib>
 #include <cstring>
@@ -9,54 +10,59 @@
 
 //#include <iostream>
 
-using std::hex;
 
 
+namespace {
+  ChunkHeader
+  parse_header(char const *buf)
+  {
+    char field[9] = {};
+    ChunkHeader rt;
+    memcpy(field, buf, 8);
+    rt.size = strtoul(field, 0, 16);
+    memcpy(field, buf + 8, 8);
+    rt.owner = strtoul(field, 0, 16);
+    return rt;
+  }
+
+  void
+  format_header(char *buf, ChunkHeader const &ch)
+  { sprintf(buf, "%08x%08x", ch.size, ch.owner); }
+}
+
 std::istream& 
 operator>>(std::istream &is, ChunkHeader &ch)
 {
-  static char buf[9];
-  buf[8] = 0;
-  is.read(buf, 8);
-  ch.size = strtoul(buf, 0, 16);
+  // headers of older formats are converted by BDB::pool::upgrade()
+  char buf[CHUNK_HEADER_SIZ];
+  if(is.read(buf, CHUNK_HEADER_SIZ))
+    ch = parse_header(buf);
   return is;  
 }
 
 std::ostream& 
 operator<<(std::ostream &os, ChunkHeader const &ch)
 {
-  using std::ios;
-  using std::setfill;
-  using std::setw;
-  
-  ios::fmtflags oldflag = os.flags();
-  os.unsetf(oldflag);
-  os << setw(8) << setfill('0') << hex << ch.size;
-  os.flags(oldflag);
+  char buf[CHUNK_HEADER_SIZ + 1];
+  format_header(buf, ch);
+  os.write(buf, CHUNK_HEADER_SIZ);
   return os;  
 }
 
 FILE*
 operator>>(FILE* fp, ChunkHeader &ch)
 {
-  static char buf[9];
-  buf[8] = 0;
-  if(8 != fread(buf, 1, 8, fp))
+  if(read_header(fp, ch))
     return 0;
-  ch.size = strtoul(buf, 0, 16);
   return fp;
 }
 
 FILE*
 operator<<(FILE* fp, ChunkHeader const &ch)
 {
-  using namespace std;
-  stringstream cvt;
-  cvt << setfill('0') << setw(8) << hex << ch.size;
-
-  if( 8 != fwrite(cvt.str().c_str(), 1, 8, fp))
+  if(write_header(fp, ch))
     return 0;
-  fflush(fp);
+  BDB::detail::s_flush(fp);
   return fp;
 }
 
@@ -64,21 +70,21 @@ operator<<(FILE* fp, ChunkHeader const &ch)
 int
 read_header(FILE* fp, ChunkHeader &ch)
 {
-  static char buf[9];
-  buf[8] = 0;
-  if(8 != fread(buf, 1, 8, fp)){
+  char buf[CHUNK_HEADER_SIZ];
+  if(CHUNK_HEADER_SIZ != BDB::detail::s_read(buf, CHUNK_HEADER_SIZ, fp)){
     return -1;
   }
-  ch.size = strtoul(buf, 0, 16);
+  ch = parse_header(buf);
   return 0;
 }
 
 int
 write_header(FILE* fp, ChunkHeader const& ch)
 { 
-  if(0 >  fprintf(fp, "%08x", ch.size)){
+  char buf[CHUNK_HEADER_SIZ + 1];
+  format_header(buf, ch);
+  if(CHUNK_HEADER_SIZ != BDB::detail::s_write(buf, CHUNK_HEADER_SIZ, fp)){
     return -1;
   }
   return 0;
 }
-
@@ -6,12 +6,17 @@
 #include <cstdio>
 #include "common.hpp"
 
+// bytes of a serialized ChunkHeader
+#define CHUNK_HEADER_SIZ 16
+
 struct ChunkHeader
 {
   uint32_t size;
+  /// global address of the record in the chunk, BDB::npos if unknown
+  BDB::AddrType owner;
   
   ChunkHeader()
-  :size(0)
+  :size(0), owner(BDB::npos)
   {}
 };
 
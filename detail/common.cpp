@@ -29,7 +29,27 @@ namespace BDB {
   root_dir(root_dir), pool_dir(pool_dir), 
   trans_dir(trans_dir), header_dir(header_dir), log_dir(log_dir),
   cse_func(cse_func), 
-  ct_func(ct_func)
+  ct_func(ct_func),
+  slab_threshold(0),
+  punch_threshold(0),
+  direct_threshold(0),
+  io_hints(false),
+  dontneed_threshold(1<<16),
+  prealloc_func(&default_prealloc_est),
+  mmap_func(&default_mmap_test),
+  placement(PLACE_ROUND_ROBIN),
+  large_pool_threshold(1<<20),
+  adaptive_growth(false),
+  collect_metrics(false),
+  metrics_interval(10000),
+  slow_op_threshold(0),
+  wal_checkpoint(0),
+  sync_commit(false),
+  commit_delay(0),
+  async_threads(4),
+  async_queue_size(1024),
+  io_engine(IO_ENGINE_SYNC),
+  io_depth(32)
   { validate(); }
 
   void
@@ -53,6 +73,13 @@ namespace BDB {
     BDB_CHK_DIR_(trans_dir);
     BDB_CHK_DIR_(header_dir);
     BDB_CHK_DIR_(log_dir);
+    for(size_t i = 0; i < pool_dirs.size(); ++i){
+      BDB_CHK_DIR_(pool_dirs[i]);
+      // stripes of a pool have the same file name
+      if(pool_dirs.end() != 
+         std::find(pool_dirs.begin() + i + 1, pool_dirs.end(), pool_dirs[i]))
+        throw invalid_argument("Config: pool_dirs should be distinct");
+    }
 
     /*
     if(root_dir.size() && PATH_DELIM != root_dir.back())
@@ -79,6 +106,30 @@ namespace BDB {
     }
     if(!match) throw invalid_argument("Config: capacity_test should hold be true for some data size");
 
+    if(slab_threshold > 1024)
+      throw invalid_argument("Config: slab_threshold should not exceed 1024");
+
+    if(0 == prealloc_func)
+      throw invalid_argument("Config: prealloc_func should not be null");
+
+    if(0 == mmap_func)
+      throw invalid_argument("Config: mmap_func should not be null");
+
+    if(placement > PLACE_STRIPE)
+      throw invalid_argument("Config: unknown placement");
+
+    if(!metrics_file.empty() && 0 == metrics_interval)
+      throw invalid_argument("Config: metrics_interval should be positive");
+
+    if(sync_commit && 0 == wal_checkpoint)
+      throw invalid_argument("Config: sync_commit requires wal_checkpoint");
+
+    if(0 == async_threads || 0 == async_queue_size)
+      throw invalid_argument("Config: async_threads and async_queue_size should be positive");
+
+    if(0 == io_depth || io_depth > 4096)
+      throw invalid_argument("Config: io_depth should be in [1, 4096]");
+
     
   }
 } // end of namespace BDB
@@ -0,0 +1,190 @@
+#include "direct_io.hpp"
+#include "file_utils.hpp"
+#include <boost/pool/pool.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace BDB {
+namespace detail {
+
+  namespace {
+    // bytes of a direct_buffer, as the buffers of migration
+    uint32_t const DIRECT_BUF_SIZ = 1<<20;
+
+    // boost::pool user allocator of blocks aligned for direct I/O
+    struct aligned_alloc
+    {
+      typedef std::size_t size_type;
+      typedef std::ptrdiff_t difference_type;
+
+      static char*
+      malloc(size_type bytes)
+      {
+#if defined(_WIN32) || defined(_WIN64)
+        return (char*)_aligned_malloc(bytes, DIRECT_ALIGN);
+#else
+        void *p = 0;
+        return posix_memalign(&p, DIRECT_ALIGN, bytes) ? 0 : (char*)p;
+#endif
+      }
+
+      static void
+      free(char *block)
+      {
+#if defined(_WIN32) || defined(_WIN64)
+        _aligned_free(block);
+#else
+        ::free(block);
+#endif
+      }
+    };
+
+    // buffers are taken by pools of different BehaviorDBs, and by
+    // threads of parallel scans
+    std::mutex buffer_mutex;
+    boost::pool<aligned_alloc> buffer_pool(DIRECT_BUF_SIZ);
+
+    uint32_t
+    round_up(uint32_t n)
+    { return (n + DIRECT_ALIGN - 1) & ~(DIRECT_ALIGN - 1); }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    // transfer whole blocks, return bytes transferred
+    uint32_t
+    block_io(bool write, char *buf, uint32_t size, off_t off, int fd)
+    {
+      uint32_t done = 0;
+      while(done < size){
+        ssize_t n = write ?
+          pwrite(fd, buf + done, size - done, off + done) :
+          pread(fd, buf + done, size - done, off + done);
+        if(n < 0 && EINTR == errno)
+          continue;
+        if(n <= 0)
+          break;
+        done += n;
+      }
+      return done;
+    }
+
+    // read a block, zeros behind the end of the file
+    void
+    read_block(char *buf, off_t off, int fd)
+    {
+      io_count(&io_counter::reads);
+      io_count(&io_counter::read_bytes, DIRECT_ALIGN);
+      uint32_t n = block_io(false, buf, DIRECT_ALIGN, off, fd);
+      memset(buf + n, 0, DIRECT_ALIGN - n);
+    }
+#endif
+  }
+
+  direct_buffer::direct_buffer()
+  : buffer(0)
+  {
+    std::lock_guard<std::mutex> guard(buffer_mutex);
+    buffer = (char*)buffer_pool.malloc();
+    if(!buffer) throw std::bad_alloc();
+  }
+
+  direct_buffer::~direct_buffer()
+  {
+    std::lock_guard<std::mutex> guard(buffer_mutex);
+    buffer_pool.free((void*)buffer);
+  }
+
+  uint32_t
+  direct_buffer::size()
+  { return DIRECT_BUF_SIZ; }
+
+  int
+  s_open_direct(char const *path)
+  {
+#if defined(__linux__) && defined(O_DIRECT)
+    return open(path, O_RDWR | O_DIRECT);
+#else
+    return -1;
+#endif
+  }
+
+  uint32_t
+  s_direct_pread(char *dest, uint32_t size, off_t off, int fd)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    return 0;
+#else
+    io_count(&io_counter::reads);
+    io_count(&io_counter::read_bytes, size);
+
+    direct_buffer buf;
+    uint32_t done = 0;
+    while(done < size){
+      off_t pos = off + done;
+      off_t beg = pos & ~(off_t)(DIRECT_ALIGN - 1);
+      uint32_t head = pos - beg;
+      uint32_t want =
+        std::min(round_up(head + size - done), direct_buffer::size());
+      uint32_t n = block_io(false, buf.buffer, want, beg, fd);
+      if(n <= head)
+        break;
+      uint32_t got = std::min(n - head, size - done);
+      memcpy(dest + done, buf.buffer + head, got);
+      done += got;
+      if(n < want)
+        break;
+    }
+    return done;
+#endif
+  }
+
+  uint32_t
+  s_direct_pwrite(char const *src, uint32_t size, off_t off, int fd,
+                  bool keep_tail)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    return 0;
+#else
+    io_count(&io_counter::writes);
+    io_count(&io_counter::written_bytes, size);
+
+    direct_buffer buf;
+    uint32_t done = 0;
+    while(done < size){
+      off_t pos = off + done;
+      off_t beg = pos & ~(off_t)(DIRECT_ALIGN - 1);
+      uint32_t head = pos - beg;
+      uint32_t len = std::min(size - done, direct_buffer::size() - head);
+      uint32_t end = head + len;
+      uint32_t span = round_up(end);
+
+      // read-modify-write of partial blocks
+      if(head)
+        read_block(buf.buffer, beg, fd);
+      if(end != span){
+        uint32_t last = span - DIRECT_ALIGN;
+        if(!keep_tail)
+          memset(buf.buffer + end, 0, span - end);
+        else if(!head || last)
+          read_block(buf.buffer + last, beg + last, fd);
+      }
+      memcpy(buf.buffer + head, src + done, len);
+
+      if(span != block_io(true, buf.buffer, span, beg, fd))
+        break;
+      done += len;
+    }
+    return done;
+#endif
+  }
+
+}} // namespace BDB::detail
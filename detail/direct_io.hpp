@@ -0,0 +1,58 @@
+#ifndef BDB_DIRECT_IO_HPP_
+#define BDB_DIRECT_IO_HPP_
+
+#include "common.hpp"
+#include <sys/types.h>
+#include <boost/noncopyable.hpp>
+
+namespace BDB {
+namespace detail {
+
+  /** Alignment of buffers, file offsets and sizes of direct I/O, a
+   *  multiple of the logical block size of common devices
+   */
+  uint32_t const DIRECT_ALIGN = 4096;
+
+  /// Buffer aligned for direct I/O, taken from a pool of buffers
+  struct direct_buffer
+  : boost::noncopyable
+  {
+    direct_buffer();
+    ~direct_buffer();
+
+    /// Bytes of a buffer, a multiple of DIRECT_ALIGN
+    static uint32_t
+    size();
+
+    char *buffer;
+  };
+
+  /** @brief Open a file for I/O that bypasses the page cache (O_DIRECT)
+   *  @return Descriptor, or -1 if the system or file system does not
+   *  support it
+   */
+  int
+  s_open_direct(char const *path);
+
+  /** @brief Read from a descriptor opened by s_open_direct
+   *  @details The file range is widened to aligned blocks and read
+   *  through a direct_buffer.
+   *  @return Bytes read, less than size at the end of the file or on
+   *  errors
+   */
+  uint32_t
+  s_direct_pread(char *dest, uint32_t size, off_t off, int fd);
+
+  /** @brief Write to a descriptor opened by s_open_direct
+   *  @param keep_tail Keep the bytes behind data in its last block. The
+   *  block is read and written back (read-modify-write), otherwise it
+   *  is padded with zeros. A partial first block is always kept.
+   *  @return Bytes written, less than size on errors
+   */
+  uint32_t
+  s_direct_pwrite(char const *src, uint32_t size, off_t off, int fd,
+                  bool keep_tail = true);
+
+}} // namespace BDB::detail
+
+#endif // header guard
@@ -0,0 +1,272 @@
+#include "exporter.hpp"
+#include "bdbImpl.hpp"
+#include "histogram.hpp"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+
+namespace BDB {
+
+  namespace {
+    char const *op_names[OP_KINDS] = {
+      "put", "insert", "update", "get", "del" };
+
+    void
+    append(std::string *out, char const *fmt, ...)
+    {
+      char buf[256];
+      va_list ap;
+      va_start(ap, fmt);
+      int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+      va_end(ap);
+      if(n > 0) 
+        out->append(buf, std::min<size_t>(n, sizeof(buf) - 1));
+    }
+
+    void
+    header(std::string *out, char const *name, char const *type,
+           char const *help)
+    {
+      append(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+
+    void
+    gauge(std::string *out, char const *name, char const *help,
+          unsigned long long val)
+    {
+      header(out, name, "gauge", help);
+      append(out, "%s %llu\n", name, val);
+    }
+
+    void
+    counter(std::string *out, char const *name, char const *help,
+            unsigned long long val)
+    {
+      header(out, name, "counter", help);
+      append(out, "%s %llu\n", name, val);
+    }
+
+    void
+    per_op(std::string *out, char const *name, char const *help,
+           Stat const &s, unsigned long long OpStat::*field)
+    {
+      header(out, name, "counter", help);
+      for(unsigned int i = 0; i < OP_KINDS; ++i)
+        append(out, "%s{op=\"%s\"} %llu\n", name, op_names[i],
+               s.ops[i].*field);
+    }
+
+    void
+    per_pool(std::string *out, char const *name, char const *type,
+             char const *help, 
+             std::vector<unsigned long long> const &vals)
+    {
+      header(out, name, type, help);
+      for(size_t i = 0; i < vals.size(); ++i)
+        append(out, "%s{pool=\"%u\"} %llu\n", name, (unsigned)i, vals[i]);
+    }
+
+    // indexed like Config::pool_dirs
+    void
+    per_device(std::string *out, char const *name, char const *type,
+               char const *help, 
+               std::vector<unsigned long long> const &vals)
+    {
+      header(out, name, type, help);
+      for(size_t i = 0; i < vals.size(); ++i)
+        append(out, "%s{device=\"%u\"} %llu\n", name, (unsigned)i, vals[i]);
+    }
+
+    void
+    latency(std::string *out, Stat const &s)
+    {
+      char const *name = "bdb_op_latency_seconds";
+      header(out, name, "histogram", 
+             "Latency of operations including waiting for others.");
+      // the same bounds for all operations, up to the largest latency
+      size_t last = 0;
+      for(unsigned int i = 0; i < OP_KINDS; ++i){
+        std::vector<unsigned long long> const &b = s.ops[i].latency_buckets;
+        for(size_t j = last; j < b.size(); ++j)
+          if(b[j]) last = j + 1;
+      }
+      last = (last + HISTOGRAM_SUB_BUCKETS - 1) / HISTOGRAM_SUB_BUCKETS * 
+        HISTOGRAM_SUB_BUCKETS;
+
+      for(unsigned int i = 0; i < OP_KINDS; ++i){
+        OpStat const &op = s.ops[i];
+        unsigned long long cum = 0;
+        for(size_t b = 0; b < last; ++b){
+          cum += op.latency_buckets[b];
+          // one bucket per power of two
+          if((b + 1) % HISTOGRAM_SUB_BUCKETS)
+            continue;
+          append(out, "%s_bucket{op=\"%s\",le=\"%.9g\"} %llu\n", name,
+                 op_names[i], OpStat::latency_upper(b) * 1e-9, cum);
+        }
+        append(out, "%s_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", name,
+               op_names[i], cum);
+        append(out, "%s_sum{op=\"%s\"} %.9g\n", name, op_names[i],
+               op.latency_sum * 1e-9);
+        append(out, "%s_count{op=\"%s\"} %llu\n", name, op_names[i],
+               op.count + op.errors);
+      }
+    }
+  }
+
+  void
+  prometheus_text(Stat const &s, std::string *out)
+  {
+    per_op(out, "bdb_ops_total", "Completed operations.", 
+           s, &OpStat::count);
+    per_op(out, "bdb_op_errors_total", "Operations that failed.", 
+           s, &OpStat::errors);
+    per_op(out, "bdb_op_bytes_total", "User bytes written or read.", 
+           s, &OpStat::bytes);
+    latency(out, s);
+
+    header(out, "bdb_io_calls_total", "counter", 
+           "Calls on pool, transaction and header files.");
+    append(out, "bdb_io_calls_total{call=\"seek\"} %llu\n", s.seek_count);
+    append(out, "bdb_io_calls_total{call=\"read\"} %llu\n", s.read_count);
+    append(out, "bdb_io_calls_total{call=\"write\"} %llu\n", 
+           s.write_count);
+    append(out, "bdb_io_calls_total{call=\"flush\"} %llu\n", 
+           s.flush_count);
+    append(out, "bdb_io_calls_total{call=\"sync\"} %llu\n", 
+           s.sync_count);
+    counter(out, "bdb_io_read_bytes_total", 
+            "Bytes read from pool, transaction and header files.", 
+            s.read_bytes);
+    counter(out, "bdb_io_written_bytes_total",
+            "Bytes written to pool, transaction and header files.",
+            s.written_bytes);
+    header(out, "bdb_write_amplification_ratio", "gauge",
+           "Bytes written per user byte.");
+    append(out, "bdb_write_amplification_ratio %.6g\n", 
+           s.write_amplification());
+
+    gauge(out, "bdb_disk_bytes", "Disk blocks allocated to pool files.",
+          s.disk_size);
+    gauge(out, "bdb_used_bytes", "Pool file bytes up to the last used chunks.",
+          s.used_size);
+    gauge(out, "bdb_prealloc_bytes", 
+          "Pool file bytes preallocated beyond the last used chunks.",
+          s.prealloc_size);
+    counter(out, "bdb_reclaimed_bytes_total", 
+            "Bytes truncated from pool files by compaction.",
+            s.reclaimed_size);
+    gauge(out, "bdb_memory_bytes", "Memory of ID tables and pools.",
+          s.gid_mem_size + s.pool_mem_size);
+    gauge(out, "bdb_transaction_log_bytes", "Bytes of transaction files.",
+          s.trans_size);
+    gauge(out, "bdb_log_bytes", "Bytes of error and access logs.",
+          s.log_size);
+
+    per_pool(out, "bdb_pool_chunk_size_bytes", "gauge", 
+             "Chunk size, page size for a packed pool.", s.pool_chunk_size);
+    per_pool(out, "bdb_pool_chunks", "gauge", 
+             "Chunks holding records.", s.pool_chunks);
+    per_pool(out, "bdb_pool_slots", "gauge",
+             "Chunks up to the last used one.", s.pool_slots);
+    header(out, "bdb_pool_occupancy_ratio", "gauge",
+           "Chunks holding records per slot.");
+    for(size_t i = 0; i < s.pool_slots.size(); ++i)
+      append(out, "bdb_pool_occupancy_ratio{pool=\"%u\"} %.6g\n", 
+             (unsigned)i, s.occupancy(i));
+    per_pool(out, "bdb_pool_migrations_out_total", "counter",
+             "Records migrated out of the pool.", s.pool_migrations);
+    per_pool(out, "bdb_pool_migrations_in_total", "counter",
+             "Records migrated into the pool.", s.pool_migrations_in);
+    per_pool(out, "bdb_pool_copied_bytes_total", "counter",
+             "Bytes copied by migrations out of the pool.", 
+             s.pool_copied_size);
+
+    per_device(out, "bdb_device_files", "gauge",
+               "Pool files, or stripes of them, in the directory.",
+               s.device_files);
+    per_device(out, "bdb_device_disk_bytes", "gauge",
+               "Disk blocks allocated to pool files in the directory.",
+               s.device_disk_size);
+    per_device(out, "bdb_device_reads_total", "counter",
+               "Reads of chunk data in the directory.", s.device_reads);
+    per_device(out, "bdb_device_read_bytes_total", "counter",
+               "Bytes of chunk data read in the directory.", 
+               s.device_read_bytes);
+    per_device(out, "bdb_device_writes_total", "counter",
+               "Writes of chunk data in the directory.", s.device_writes);
+    per_device(out, "bdb_device_written_bytes_total", "counter",
+               "Bytes of chunk data written in the directory.", 
+               s.device_written_bytes);
+  }
+
+  stat_exporter::stat_exporter()
+  : bdb_(0), interval_(0), stop_(false)
+  {}
+
+  stat_exporter::~stat_exporter()
+  { stop(); }
+
+  void
+  stat_exporter::start(BDBImpl *bdb, std::string const &file, 
+                       uint32_t interval_ms)
+  {
+    bdb_ = bdb;
+    file_ = file;
+    interval_ = interval_ms;
+    stop_ = false;
+    thread_ = std::thread(&stat_exporter::run, this);
+  }
+
+  void
+  stat_exporter::stop()
+  {
+    if(!thread_.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    export_once();
+  }
+
+  bool
+  stat_exporter::export_once()
+  {
+    Stat s;
+    {
+      std::lock_guard<std::mutex> lock(bdb_->mutex_);
+      bdb_->stat(&s);
+    }
+    std::string text;
+    prometheus_text(s, &text);
+
+    std::string tmp = file_ + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if(!fp) 
+      return false;
+    bool ok = text.size() == fwrite(text.data(), 1, text.size(), fp);
+    ok = (0 == fclose(fp)) && ok;
+    if(ok && 0 == rename(tmp.c_str(), file_.c_str()))
+      return true;
+    remove(tmp.c_str());
+    return false;
+  }
+
+  void
+  stat_exporter::run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(!stop_){
+      if(cv_.wait_for(lock, std::chrono::milliseconds(interval_), 
+                      [this]() { return stop_; }))
+        break;
+      lock.unlock();
+      export_once();
+      lock.lock();
+    }
+  }
+
+} // namespace BDB
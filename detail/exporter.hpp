@@ -0,0 +1,59 @@
+#ifndef BDB_EXPORTER_HPP_
+#define BDB_EXPORTER_HPP_
+
+#include "common.hpp"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <boost/noncopyable.hpp>
+
+namespace BDB {
+
+  struct BDBImpl;
+
+  /** @brief Format statistics in Prometheus text exposition format
+   *  @details Latency histograms are reduced to one bucket per power 
+   *  of two.
+   */
+  void
+  prometheus_text(Stat const &s, std::string *out);
+
+  /** @brief Background thread that writes statistics of a BehaviorDB 
+   *  to a file periodically
+   *  @details Each export is written to file.tmp and renamed to file.
+   *  A final export is written when the exporter stops.
+   */
+  class stat_exporter
+  : boost::noncopyable
+  {
+  public:
+    stat_exporter();
+    ~stat_exporter();
+
+    void
+    start(BDBImpl *bdb, std::string const &file, uint32_t interval_ms);
+
+    void
+    stop();
+
+    /// Write statistics once, return false on failure
+    bool
+    export_once();
+
+  private:
+    void
+    run();
+
+    BDBImpl *bdb_;
+    std::string file_;
+    uint32_t interval_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+  };
+
+} // namespace BDB
+
+#endif // header guard
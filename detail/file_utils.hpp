@@ -4,7 +4,18 @@
 #include "common.hpp"
 #include <cstdio>
 #include <cerrno>
+#include <atomic>
+#include <mutex>
 #include <boost/pool/pool.hpp>
+#include <sys/types.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
 
 #ifdef __MINGW__
 #define ftello(X) ftello64(X)
@@ -26,12 +37,78 @@ namespace detail {
     //static uint32_t alloc_size();
     char *buffer;
   private:
+    // buffers are taken by pools of different BehaviorDBs, and by
+    // workers of shards
+    static std::mutex mutex_;
     static boost::pool<> pool_;
   };
 
+  /// Stdio calls issued on pool, transaction and header files
+  struct io_counter
+  {
+    std::atomic<unsigned long long> seeks, reads, writes, flushes, syncs;
+    std::atomic<unsigned long long> read_bytes, written_bytes;
+
+    io_counter()
+    : seeks(0), reads(0), writes(0), flushes(0), syncs(0),
+    read_bytes(0), written_bytes(0)
+    {}
+  };
+
+  /** Counter of the calling thread, 0 disables counting. Set by 
+   *  BehaviorDB for the duration of an operation.
+   */
+  extern thread_local io_counter *io_sink;
+
+  inline void
+  io_count(std::atomic<unsigned long long> io_counter::*field, 
+           unsigned long long n = 1)
+  {
+    if(io_sink) 
+      (io_sink->*field).fetch_add(n, std::memory_order_relaxed);
+  }
+
+  inline int
+  s_seek(FILE* fp, off_t off, int whence)
+  {
+    io_count(&io_counter::seeks);
+    return fseeko(fp, off, whence);
+  }
+
+  inline int
+  s_flush(FILE* fp)
+  {
+    io_count(&io_counter::flushes);
+    return fflush(fp);
+  }
+
+  /// Write data of a file through to the device
+  inline int
+  s_sync(int fd)
+  {
+    io_count(&io_counter::syncs);
+#if defined(_WIN32) || defined(_WIN64)
+    return _commit(fd);
+#elif defined(__linux__)
+    return fdatasync(fd);
+#else
+    return fsync(fd);
+#endif
+  }
+
+  inline int
+  s_sync(FILE* fp)
+  {
+    if(fflush(fp))
+      return -1;
+    return s_sync(fileno(fp));
+  }
+
   inline uint32_t 
   s_write(char const* data, uint32_t size, FILE* fp)
   {
+    io_count(&io_counter::writes);
+    io_count(&io_counter::written_bytes, size);
     uint32_t total_written = 0;
     while(size>0){
       errno = 0;
@@ -52,6 +129,8 @@ namespace detail {
   inline uint32_t
   s_read(char *dest, uint32_t size, FILE* fp)
   {
+    io_count(&io_counter::reads);
+    io_count(&io_counter::read_bytes, size);
     uint32_t total_read = 0;
     while(size > 0){
       errno = 0;
@@ -69,6 +148,220 @@ namespace detail {
     return total_read;
   }
 
+#if !defined(_WIN32) && !defined(_WIN64)
+  /** @brief Read from a file descriptor at an offset
+   *  @details Unlike s_pread(char*, uint32_t, off_t, FILE*), the FILE
+   *  is not touched, so this may run while another thread uses it.
+   */
+  inline uint32_t
+  s_pread(char *dest, uint32_t size, off_t off, int fd)
+  {
+    io_count(&io_counter::reads);
+    io_count(&io_counter::read_bytes, size);
+    uint32_t total_read = 0;
+    while(size > 0){
+      ssize_t readcnt = pread(fd, dest, size, off);
+      if(readcnt < 0 && errno == EINTR)
+        continue;
+      if(readcnt <= 0)
+        break;
+      total_read += readcnt;
+      dest += readcnt;
+      size -= readcnt;
+      off += readcnt;
+    }
+    return total_read;
+  }
+#endif
+
+  /** @brief Read at a file offset without moving the file position
+   *  @return Bytes read
+   */
+  inline uint32_t
+  s_pread(char *dest, uint32_t size, off_t off, FILE* fp)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    off_t pos = ftello(fp);
+    fseeko(fp, off, SEEK_SET);
+    uint32_t rt = s_read(dest, size, fp);
+    fseeko(fp, pos, SEEK_SET);
+    return rt;
+#else
+    if(fflush(fp))
+      return 0;
+    return s_pread(dest, size, off, fileno(fp));
+#endif
+  }
+
+  /** @brief Write at a file offset without the FILE buffer
+   *  @details A seek of a FILE opened for reading fills its buffer 
+   *  first, which reads a buffer of the file into the page cache. Data
+   *  written here is not seen by reads through the FILE buffer, use 
+   *  s_pread.
+   *  @return Bytes written
+   */
+  inline uint32_t
+  s_pwrite(char const *data, uint32_t size, off_t off, FILE* fp)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    fseeko(fp, off, SEEK_SET);
+    return s_write(data, size, fp);
+#else
+    if(fflush(fp))
+      return 0;
+    io_count(&io_counter::writes);
+    io_count(&io_counter::written_bytes, size);
+    uint32_t total_written = 0;
+    while(size > 0){
+      ssize_t written = pwrite(fileno(fp), data, size, off);
+      if(written < 0 && errno == EINTR)
+        continue;
+      if(written <= 0)
+        break;
+      total_written += written;
+      data += written;
+      size -= written;
+      off += written;
+    }
+    return total_written;
+#endif
+  }
+
+  /// Access patterns told to the OS by s_advise
+  enum io_hint
+  {
+    HINT_NORMAL = 0,
+    HINT_RANDOM,      ///< no read ahead, for point lookups
+    HINT_SEQUENTIAL,  ///< more read ahead, for scans
+    HINT_WILLNEED,    ///< read a range ahead
+    HINT_DONTNEED     ///< drop cached pages of a range
+  };
+
+  /** @brief Tell the OS how a file range is accessed, best effort
+   *  @param len 0 for the range up to the end of the file
+   *  @remark RANDOM and SEQUENTIAL apply to the whole open file on 
+   *  Linux, whatever the range.
+   */
+  inline void
+  s_advise(int fd, off_t off, off_t len, io_hint hint)
+  {
+#if defined(POSIX_FADV_WILLNEED)
+    static int const advice[] = {
+      POSIX_FADV_NORMAL, POSIX_FADV_RANDOM, POSIX_FADV_SEQUENTIAL,
+      POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED
+    };
+    posix_fadvise(fd, off, len, advice[hint]);
+#endif
+  }
+
+  /// Ask the OS to read a file range ahead, best effort
+  inline void
+  s_readahead(FILE* fp, off_t off, off_t len)
+  { s_advise(fileno(fp), off, len, HINT_WILLNEED); }
+
+  /** @brief Truncate a file to a given size 
+   *  @return 0 for success
+   */
+  inline int
+  s_truncate(FILE* fp, off_t size)
+  {
+    if(fflush(fp)) 
+      return -1;
+#if defined(_WIN32) || defined(_WIN64)
+    return _chsize_s(_fileno(fp), size);
+#else
+    return ftruncate(fileno(fp), size);
+#endif
+  }
+
+  /** @brief Deallocate disk blocks of a file range. File size is kept.
+   *  @return 0 for success, -1 if it is not supported.
+   */
+  inline int
+  s_punch_hole(FILE* fp, off_t off, off_t len)
+  {
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    if(fflush(fp))
+      return -1;
+    return fallocate(fileno(fp), 
+                     FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 
+                     off, len);
+#else
+    return -1;
+#endif
+  }
+
+  /** @brief Allocate disk blocks of a file range
+   *  @param keep_size Do not extend the file size
+   *  @return 0 for success, -1 if it is not supported.
+   */
+  inline int
+  s_preallocate(FILE* fp, off_t off, off_t len, bool keep_size)
+  {
+    if(fflush(fp))
+      return -1;
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    return fallocate(fileno(fp), keep_size ? FALLOC_FL_KEEP_SIZE : 0, 
+                     off, len);
+#elif defined(_WIN32) || defined(_WIN64)
+    return -1;
+#else
+    if(keep_size) 
+      return -1;
+    return posix_fallocate(fileno(fp), off, len) ? -1 : 0;
+#endif
+  }
+
+  /// Bytes of disk blocks allocated to a file
+  inline unsigned long long
+  s_allocated_size(FILE* fp)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    off_t pos = ftello(fp);
+    fseeko(fp, 0, SEEK_END);
+    unsigned long long rt = ftello(fp);
+    fseeko(fp, pos, SEEK_SET);
+    return rt;
+#else
+    struct stat st;
+    if(fflush(fp) || fstat(fileno(fp), &st))
+      return 0;
+    return (unsigned long long)st.st_blocks * 512;
+#endif
+  }
+
+  /// Size of an open file, 0 if it is unknown
+  inline unsigned long long
+  s_file_size(FILE* fp)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    struct _stat64 st;
+    if(_fstat64(_fileno(fp), &st))
+      return 0;
+#else
+    struct stat st;
+    if(fstat(fileno(fp), &st))
+      return 0;
+#endif
+    return st.st_size;
+  }
+
+  /// Size of a file, 0 if it does not exist
+  inline unsigned long long
+  s_file_size(char const* path)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    struct _stat64 st;
+    if(_stat64(path, &st))
+      return 0;
+#else
+    struct stat st;
+    if(stat(path, &st))
+      return 0;
+#endif
+    return st.st_size;
+  }
+
   inline char 
   path_delim() 
   {
@@ -4,6 +4,10 @@
 namespace BDB {
 namespace detail{
   
+  template<uint32_t RS>
+  std::mutex
+  s_buffer<RS>::mutex_;
+
   template<uint32_t RS>
   boost::pool<>
   s_buffer<RS>::pool_(RS);
@@ -12,13 +16,17 @@ namespace detail{
   s_buffer<RS>::s_buffer()
   : buffer(0)
   {
+    std::lock_guard<std::mutex> guard(mutex_);
     buffer = (char*)pool_.malloc();
     if(!buffer) throw std::bad_alloc();
   }
 
   template<uint32_t RS>
   s_buffer<RS>::~s_buffer()
-  { pool_.free((void*)buffer);  }
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    pool_.free((void*)buffer);
+  }
 
 
   template<uint32_t RS>
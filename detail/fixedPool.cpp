@@ -25,7 +25,7 @@ template<typename T, uint32_t TextSize>
 fixed_pool<T,TextSize>::~fixed_pool()
 {
   if(file_){
-    fflush(file_);
+    detail::s_flush(file_);
     fclose(file_);
   }
   delete []fbuf_;
@@ -79,7 +79,7 @@ T fixed_pool<T,TextSize>::operator[](AddrType addr) const
   T rt;
   off_t loc_addr = addr;
   loc_addr *= TextSize;
-  fseeko(file_, loc_addr, SEEK_SET);
+  detail::s_seek(file_, loc_addr, SEEK_SET);
   if( 0 == (file_ >> rt) || ferror(file_))
     throw std::runtime_error(SRC_POS);
   return rt;
@@ -90,13 +90,21 @@ void fixed_pool<T,TextSize>::store(T const &val, AddrType off)
 { 
   off_t loc_addr = off;
   loc_addr *= TextSize;
-  fseeko(file_, loc_addr, SEEK_SET);
-  if( 0 == (file_ << val) || ferror(file_) || fflush(file_) ) 
+  detail::s_seek(file_, loc_addr, SEEK_SET);
+  if( 0 == (file_ << val) || ferror(file_) || detail::s_flush(file_) ) 
     throw std::runtime_error(SRC_POS);
 }
 
+template<typename T, uint32_t TextSize>
+void fixed_pool<T,TextSize>::truncate(uint32_t size)
+{
+  off_t loc_addr = size;
+  loc_addr *= TextSize;
+  if(detail::s_truncate(file_, loc_addr))
+    throw std::runtime_error(SRC_POS);
+}
 
-template struct fixed_pool<ChunkHeader, 8>;
+template struct fixed_pool<ChunkHeader, CHUNK_HEADER_SIZ>;
 template struct fixed_pool<addr_wrapper, sizeof(AddrType)>;
 
 } // namespace BDB
@@ -37,6 +37,8 @@ namespace BDB {
     T operator[](AddrType addr) const;
     void store(T const &val, AddrType off);
     void resize(uint32_t size){};
+    /// Discard stored values after size
+    void truncate(uint32_t size);
     //int read(T* val, AddrType addr) const;
     //int write(T const & val, AddrType addr);
     std::string dir() const;
@@ -74,6 +76,9 @@ namespace BDB {
     
     void resize(size_type size)
     { vec_.resize(size); }
+    
+    void truncate(size_type)
+    {}
 
   private:
     std::vector<T> vec_;
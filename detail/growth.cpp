@@ -0,0 +1,131 @@
+#include "growth.hpp"
+#include <algorithm>
+#include <cstring>
+
+// Minimum number of records observed in a class before its
+// statistics are trusted
+#define GROWTH_MIN_SAMPLES 16
+// Maximum number of classes skipped by a migration 
+#define GROWTH_MAX_SKIP 3
+
+namespace BDB {
+  
+  namespace {
+    unsigned int
+    log2_floor(uint32_t v)
+    {
+      unsigned int rt = 0;
+      while(v >>= 1) ++rt;
+      return rt;
+    }
+  }
+
+  growth_tracker::growth_tracker()
+  : addrEval_(0), adaptive_(false), max_size_(0)
+  {
+    memset(put_hist_, 0, sizeof(put_hist_));
+  }
+
+  void
+  growth_tracker::init(addr_eval<AddrType> const *addrEval, bool adaptive)
+  {
+    addrEval_ = addrEval;
+    adaptive_ = adaptive;
+    stats_.assign(addrEval->dir_count(), growth_stat());
+  }
+
+  void
+  growth_tracker::on_put(unsigned int dir, uint32_t size)
+  {
+    stats_[dir].puts++;
+    put_hist_[log2_floor(size)]++;
+    max_size_ = std::max(max_size_, size);
+  }
+
+  void
+  growth_tracker::on_append(unsigned int dir, uint32_t size)
+  {
+    stats_[dir].appends++;
+    stats_[dir].append_bytes += size;
+  }
+
+  void
+  growth_tracker::on_migrate(unsigned int src, unsigned int dest,
+                             uint32_t copied, uint32_t new_size)
+  {
+    stats_[src].migrations_out++;
+    stats_[src].copied_size += copied;
+    stats_[dest].migrations_in++;
+    max_size_ = std::max(max_size_, new_size);
+  }
+
+  bool
+  growth_tracker::transient(unsigned int dir, bool fallback) const
+  {
+    growth_stat const &s = stats_[dir];
+    unsigned long long entered = s.puts + s.migrations_in;
+    if(entered < GROWTH_MIN_SAMPLES || 
+       (!s.migrations_out && s.migrations_in == entered))
+      return fallback;
+    return (s.migrations_out << 1) > entered;
+  }
+
+  unsigned int
+  growth_tracker::directory(unsigned int dir, uint32_t size) const
+  {
+    unsigned int rt = addrEval_->directory(size);
+    if(!adaptive_ || (unsigned int)-1 == rt)
+      return rt;
+
+    // leave room for one more append of the average size
+    growth_stat const &s = stats_[dir];
+    if(s.appends){
+      uint32_t headroom = s.append_bytes / s.appends;
+      rt = addrEval_->directory(size, size + headroom);
+    }
+
+    bool growing = transient(dir, false);
+    for(unsigned int skip = 0; skip < GROWTH_MAX_SKIP; ++skip){
+      if(rt + 1 >= addrEval_->dir_count() || !transient(rt, growing))
+        break;
+      ++rt;
+    }
+    return rt;
+  }
+
+  void
+  growth_tracker::recommend(Config *conf) const
+  {
+    unsigned long long total(0), half(0);
+    unsigned int bits = sizeof(uint32_t)<<3;
+    
+    for(unsigned int i = 0; i < bits; ++i)
+      total += put_hist_[i];
+    if(!total) return;
+
+    // the median initial size fits the first chunk
+    unsigned int median = 0;
+    for(; median < bits; ++median)
+      if((half += put_hist_[median]) << 1 >= total) break;
+    
+    // records in bucket i are less than 2^(i+1), add 1/3 for
+    // the 75% fill of default_capacity_test
+    uint32_t min_size = 16;
+    while(min_size < (1u << 30) && 
+          (min_size - (min_size>>2)) < (2u << median) - 1)
+      min_size <<= 1;
+
+    // enough directories to hold the largest record
+    unsigned int dirs = 1;
+    while(dirs < 32 && 
+          ((unsigned long long)min_size << (dirs - 1)) < max_size_)
+      ++dirs;
+    
+    unsigned int prefix = 1;
+    while((1u << prefix) < dirs) ++prefix;
+
+    conf->min_size = min_size;
+    conf->addr_prefix_len = prefix;
+  }
+
+} // namespace BDB
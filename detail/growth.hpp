@@ -0,0 +1,86 @@
+#ifndef BDB_GROWTH_HPP_
+#define BDB_GROWTH_HPP_
+
+#include "common.hpp"
+#include "addr_eval.hpp"
+#include <vector>
+
+namespace BDB {
+
+  /// Growth statistics of a directory (size class)
+  struct growth_stat
+  {
+    unsigned long long puts;           ///< records created in this class
+    unsigned long long appends;        ///< writes to records of this class
+    unsigned long long append_bytes;
+    unsigned long long migrations_in;  ///< records moved into this class
+    unsigned long long migrations_out; ///< records moved out of this class
+    unsigned long long copied_size;    ///< bytes copied by migrations out
+
+    growth_stat()
+    : puts(0), appends(0), append_bytes(0), 
+    migrations_in(0), migrations_out(0), copied_size(0)
+    {}
+  };
+
+  /** @brief Learn how records grow and choose destinations of 
+   *  migrations.
+   *  @details A record entering a class that most records leave again
+   *  (by appending more data) is moved further, skipping the class. 
+   *  Classes not observed enough are judged by the class the record
+   *  leaves. Statistics are kept in memory and start over on each open.
+   */
+  class growth_tracker
+  {
+  public:
+    growth_tracker();
+
+    void
+    init(addr_eval<AddrType> const *addrEval, bool adaptive);
+
+    void
+    on_put(unsigned int dir, uint32_t size);
+
+    void
+    on_append(unsigned int dir, uint32_t size);
+
+    void
+    on_migrate(unsigned int src, unsigned int dest, 
+               uint32_t copied, uint32_t new_size);
+
+    /** @brief Choose the destination directory of a migrating record
+     *  @param dir Current directory
+     *  @param size Size of the record after migration
+     *  @return Directory or (unsigned int)-1 if size is too large.
+     */
+    unsigned int
+    directory(unsigned int dir, uint32_t size) const;
+
+    /** @brief Recommend min_size and addr_prefix_len that fit the 
+     *  observed record sizes under default_chunk_size_est and 
+     *  default_capacity_test
+     */
+    void
+    recommend(Config *conf) const;
+
+    growth_stat const&
+    stat(unsigned int dir) const
+    { return stats_[dir]; }
+
+  private:
+    // whether records entering dir usually leave it, return 
+    // fallback if there are too few samples
+    bool
+    transient(unsigned int dir, bool fallback) const;
+
+    addr_eval<AddrType> const *addrEval_;
+    bool adaptive_;
+    std::vector<growth_stat> stats_;
+    // histogram of initial sizes in log2 buckets
+    unsigned long long put_hist_[sizeof(uint32_t)<<3];
+    uint32_t max_size_;
+  };
+
+} // namespace BDB
+
+#endif // header guard
@@ -0,0 +1,119 @@
+#ifndef BDB_HISTOGRAM_HPP_
+#define BDB_HISTOGRAM_HPP_
+
+#include <cstring>
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1<<HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+namespace BDB {
+
+  /** @brief Log-linear histogram of non-negative values
+   *  @details Each power of two range is split into HISTOGRAM_SUB_BUCKETS
+   *  linear buckets, so the relative error of a percentile is within
+   *  1/HISTOGRAM_SUB_BUCKETS. Values less than HISTOGRAM_SUB_BUCKETS are
+   *  exact. Recording is O(1) and does not allocate.
+   */
+  class histogram
+  {
+  public:
+    histogram()
+    { reset(); }
+
+    void
+    reset()
+    {
+      memset(buckets_, 0, sizeof(buckets_));
+      count_ = sum_ = max_ = 0;
+      min_ = (uint64_t)-1;
+    }
+
+    void
+    record(uint64_t v)
+    {
+      buckets_[index(v)]++;
+      count_++;
+      sum_ += v;
+      if(v > max_) max_ = v;
+      if(v < min_) min_ = v;
+    }
+
+    void
+    merge(histogram const &h)
+    {
+      for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        buckets_[i] += h.buckets_[i];
+      count_ += h.count_;
+      sum_ += h.sum_;
+      if(h.max_ > max_) max_ = h.max_;
+      if(h.min_ < min_) min_ = h.min_;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t sum() const { return sum_; }
+    uint64_t max() const { return max_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+
+    double
+    mean() const
+    { return count_ ? (double)sum_ / count_ : 0; }
+
+    /** @brief Value at quantile q (0 < q <= 1)
+     *  @return Upper bound of the bucket holding the quantile, clamped to
+     *  max().
+     */
+    uint64_t
+    percentile(double q) const
+    {
+      if(!count_) return 0;
+      uint64_t rank = (uint64_t)(q * count_ + 0.5);
+      if(rank < 1) rank = 1;
+      uint64_t seen = 0;
+      for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i){
+        seen += buckets_[i];
+        if(seen >= rank){
+          uint64_t rt = upper(i);
+          return rt < max_ ? rt : max_;
+        }
+      }
+      return max_;
+    }
+
+    uint64_t
+    bucket_count(unsigned int i) const
+    { return buckets_[i]; }
+
+    /// Largest value recorded in bucket i
+    static uint64_t
+    upper(unsigned int i)
+    {
+      unsigned int e = i >> HISTOGRAM_SUB_BITS;
+      uint64_t sub = i & (HISTOGRAM_SUB_BUCKETS - 1);
+      if(0 == e) return sub;
+      unsigned int shift = e - 1;
+      return ((HISTOGRAM_SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+
+    static unsigned int
+    index(uint64_t v)
+    {
+      if(v < HISTOGRAM_SUB_BUCKETS) return v;
+      unsigned int msb = 63;
+      while(!(v >> msb)) --msb;
+      // v in [2^msb, 2^(msb+1)), e = msb - SUB_BITS + 1
+      unsigned int shift = msb - HISTOGRAM_SUB_BITS;
+      unsigned int e = shift + 1;
+      unsigned int sub = (v >> shift) - HISTOGRAM_SUB_BUCKETS;
+      return (e << HISTOGRAM_SUB_BITS) | sub;
+    }
+
+  private:
+    uint64_t buckets_[HISTOGRAM_BUCKETS];
+    uint64_t count_, sum_, max_, min_;
+  };
+
+} // namespace BDB
+
+#endif // header guard
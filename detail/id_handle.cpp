@@ -5,7 +5,7 @@
 #include "addr_wrapper.hpp"
 
 namespace BDB {
-  template struct id_handle<IDPool<fixed_pool<ChunkHeader, 8> > >;
+  template struct id_handle<IDPool<fixed_pool<ChunkHeader, CHUNK_HEADER_SIZ> > >;
   template struct id_handle<IDPool<fixed_pool<addr_wrapper, sizeof(AddrType)> > >;
   template struct id_handle<IDPool<vec_wrapper<AddrType> > >;
 }
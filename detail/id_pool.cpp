@@ -5,7 +5,7 @@
 
 namespace BDB {
 
-template class IDPool<fixed_pool<ChunkHeader, 8> >;
+template class IDPool<fixed_pool<ChunkHeader, CHUNK_HEADER_SIZ> >;
 template class IDPool<fixed_pool<addr_wrapper, sizeof(AddrType)> >;
 template class IDPool<vec_wrapper<AddrType> >;
 
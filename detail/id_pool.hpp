@@ -4,11 +4,16 @@
 #include <boost/noncopyable.hpp>
 #include <boost/dynamic_bitset.hpp>
 #include <cstdio>
+#include <istream>
+#include <map>
+#include <string>
 #include "common.hpp"
 
 namespace BDB
 {
 
+class wal;
+
 enum IDPoolAlloc {
   dynamic = 0,
   full = 1
@@ -49,9 +54,14 @@ public:
 
   AddrType max_used() const;
   AddrType next_used(AddrType curID) const;
+  AddrType prev_used(AddrType curID) const;
+  AddrType next_free(AddrType curID) const;
 
   size_type size() const;
   size_type num_blocks() const;
+  size_type num_acquired() const;
+  /// Bytes of the transaction file
+  unsigned long long trans_size() const;
   bool avail() const;
 
   AddrType begin() const;
@@ -60,14 +70,47 @@ public:
   void replay_transaction(char const* file);
   void init_transaction(char const* file);
 
+  /** Lower max_used() to the one after the last acquired ID and
+   *  release space of IDs behind it.
+   *  @param floor max_used() is not lowered below it
+   *  @remark With a write-ahead log, callers make the releases of those
+   *  IDs durable first. The entry is committed with their next record.
+   */
+  void shrink(AddrType floor = 0);
+
+  /** @brief Log commits to a write-ahead log shared with other tables
+   *  @param tag Names this table in entries of the log
+   *  @details Commits are then kept in memory, and written to the 
+   *  transaction file and the array by checkpoint().
+   */
+  void attach(wal *log, std::string const &tag);
+
+  /// Apply an entry of the write-ahead log, read from in
+  void redo(std::istream &in);
+
+  /** @brief Write commits logged since the last checkpoint to the 
+   *  table files
+   *  @param sync Sync the transaction file to the device
+   */
+  void checkpoint(bool sync = false);
+
 private:
+
+  bool read_entry(std::istream &in, char *op, AddrType *off, 
+                  value_type *val);
+  void apply_entry(char op, AddrType off, value_type const &val);
+  // write a transaction line or add it to the write-ahead log
+  bool log(std::string const &line);
+  void store(value_type const &val, AddrType off);
   
+
   void extend(uint32_t new_size=0);
 
   typedef boost::dynamic_bitset<uint32_t> Bitmap;
 
 
   AddrType const beg_, end_;
+  Bitmap::size_type init_size_;
   Bitmap bm_;
   Bitmap lock_;
   IDPoolAlloc full_alloc_;
@@ -76,6 +119,12 @@ private:
   FILE* file_;
 
   Array arr_;
+
+  wal *wal_;
+  std::string tag_;
+  // logged since the last checkpoint
+  std::string tran_buf_;
+  std::map<AddrType, value_type> dirty_;
 };
   
 }
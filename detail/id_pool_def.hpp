@@ -8,6 +8,7 @@
 #include "file_utils.hpp"
 #include "fixedPool.hpp"
 #include "addr_wrapper.hpp"
+#include "wal.hpp"
 
 namespace BDB{ 
 
@@ -16,10 +17,10 @@ IDPool<Array>::IDPool(
   unsigned int id, char const* work_dir,
   AddrType beg, AddrType end, 
   IDPoolAlloc alloc_policy)
-: beg_(beg), end_(end), 
+: beg_(beg), end_(end), init_size_(0),
   bm_(), lock_(), 
   full_alloc_(alloc_policy), max_used_(0),
-  file_(0),  arr_(0)
+  file_(0),  arr_(0), wal_(0)
 {
   if(beg >= end)
     throw std::invalid_argument(SRC_POS);
@@ -31,6 +32,7 @@ IDPool<Array>::IDPool(
     while(size > 1024)
       size >>= 1;
   }
+  init_size_ = size;
   bm_.resize(size, true);
   lock_.resize(size, false);
   arr_.template resize(size);
@@ -107,12 +109,9 @@ bool IDPool<Array>::Commit(
     ss << '-' << off <<"\n";
   else{
     ss << '+' << off << "\t" << val << "\n";
-    arr_.template store(val, off);
+    store(val, off);
   }
-  return 
-    ss.str().size() == 
-    detail::s_write(ss.str().c_str(), ss.str().size(), file_) &&
-    0 == fflush(file_);
+  return log(ss.str());
 }
 
 template<typename Array>
@@ -124,10 +123,7 @@ bool IDPool<Array>::ReleaseAndCommit(AddrType id)
     throw invalid_addr();
   bm_[off] = true;
   ss<<'-'<<off<<"\n";
-  return 
-    ss.str().size() == 
-    detail::s_write(ss.str().c_str(), ss.str().size(), file_) &&
-    0 == fflush(file_);
+  return log(ss.str());
 }
 
 template<typename Array>
@@ -159,7 +155,15 @@ bool IDPool<Array>::isLocked(AddrType id) const
 template<typename Array>
 typename IDPool<Array>::value_type 
 IDPool<Array>::Find(AddrType id)
-{ return arr_[id - beg_]; }
+{ 
+  if(!dirty_.empty()){
+    typename std::map<AddrType, value_type>::const_iterator 
+      iter = dirty_.find(id - beg_);
+    if(dirty_.end() != iter)
+      return iter->second;
+  }
+  return arr_[id - beg_]; 
+}
 
 template<typename Array>
 AddrType IDPool<Array>::max_used() const
@@ -176,10 +180,42 @@ AddrType IDPool<Array>::next_used(AddrType curID) const
   return end_;
 }
 
+template<typename Array>
+AddrType IDPool<Array>::prev_used(AddrType curID) const
+{
+  AddrType off = curID - beg_;
+  if(off > bm_.size()) 
+    off = bm_.size();
+  while(off){
+    --off;
+    if(false == bm_[off])
+      return beg_ + off;
+  }
+  return end_;
+}
+
+template<typename Array>
+AddrType IDPool<Array>::next_free(AddrType curID) const
+{
+  Bitmap::size_type off = curID - beg_;
+  if(off >= bm_.size())
+    return end_;
+  off = (off) ? bm_.find_next(off - 1) : bm_.find_first();
+  return (Bitmap::npos == off) ? end_ : beg_ + off;
+}
+
 template<typename Array>
 typename IDPool<Array>::size_type IDPool<Array>::size() const
 { return bm_.size(); }
 
+template<typename Array>
+typename IDPool<Array>::size_type IDPool<Array>::num_acquired() const
+{ return bm_.size() - bm_.count(); }
+
+template<typename Array>
+unsigned long long IDPool<Array>::trans_size() const
+{ return file_ ? detail::s_file_size(file_) : 0; }
+
 template<typename Array>
 typename IDPool<Array>::size_type IDPool<Array>::num_blocks() const
 { return bm_.num_blocks();  }
@@ -215,19 +251,8 @@ void IDPool<Array>::replay_transaction(char const* file)
   char op;
   AddrType off;
   value_type val;
-  while(tfile >> op >> off){
-    if('+' == op) {
-      if('\t' == tfile.peek()) tfile.ignore(1);
-      tfile >> val;
-      if(bm_.size() <= off)
-        extend(off+1);
-      bm_[off] = false;
-      arr_.template store(val, off);
-      if(max_used_ <= off) max_used_ = off+1;
-    }else if('-' == op){
-      bm_[off] = true;
-    }
-  }
+  while(read_entry(tfile, &op, &off, &val))
+    apply_entry(op, off, val);
   tfile.close();
 }
 
@@ -242,6 +267,131 @@ void IDPool<Array>::init_transaction(char const* file)
     throw std::runtime_error("IDPool: Fail to set zero buffer on transaction_file");
 }
 
+template<typename Array>
+void IDPool<Array>::shrink(AddrType floor)
+{
+  AddrType old_max = max_used_;
+  while(max_used_ > floor && bm_[max_used_ - 1])
+    --max_used_;
+
+  if(old_max == max_used_) 
+    return;
+
+  std::stringstream ss;
+  ss << '~' << max_used_ << "\n";
+  if(!log(ss.str()))
+    throw std::runtime_error(SRC_POS);
+
+  if(wal_)
+    dirty_.erase(dirty_.lower_bound(max_used_), dirty_.end());
+  arr_.template truncate(max_used_);
+
+  if(dynamic == full_alloc_){
+    Bitmap::size_type size = 
+      (max_used_ > init_size_) ? max_used_ : init_size_;
+    if(size < bm_.size()){
+      bm_.resize(size);
+      lock_.resize(size);
+    }
+  }
+}
+
+template<typename Array>
+void IDPool<Array>::attach(wal *log, std::string const &tag)
+{
+  wal_ = log;
+  tag_ = tag;
+}
+
+template<typename Array>
+void IDPool<Array>::redo(std::istream &in)
+{
+  char op;
+  AddrType off;
+  value_type val;
+  if(!read_entry(in, &op, &off, &val))
+    throw std::runtime_error("IDPool: Bad entry in write-ahead log");
+  apply_entry(op, off, val);
+
+  std::stringstream ss;
+  ss << op << off;
+  if('+' == op) 
+    ss << "\t" << val;
+  ss << "\n";
+  tran_buf_ += ss.str();
+}
+
+template<typename Array>
+void IDPool<Array>::checkpoint(bool sync)
+{
+  if(!tran_buf_.empty()){
+    if(tran_buf_.size() != 
+       detail::s_write(tran_buf_.data(), tran_buf_.size(), file_) ||
+       0 != detail::s_flush(file_) ||
+       (sync && 0 != detail::s_sync(file_)))
+      throw std::runtime_error(SRC_POS);
+    tran_buf_.clear();
+  }
+
+  typename std::map<AddrType, value_type>::const_iterator 
+    iter = dirty_.begin();
+  for(; iter != dirty_.end(); ++iter)
+    arr_.template store(iter->second, iter->first);
+  dirty_.clear();
+}
+
+template<typename Array>
+bool IDPool<Array>::read_entry(
+  std::istream &in, char *op, AddrType *off, value_type *val)
+{
+  if(!(in >> *op >> *off))
+    return false;
+  if('+' == *op){
+    if('\t' == in.peek()) in.ignore(1);
+    in >> *val;
+  }
+  return true;
+}
+
+template<typename Array>
+void IDPool<Array>::apply_entry(
+  char op, AddrType off, value_type const &val)
+{
+  if('+' == op) {
+    if(bm_.size() <= off)
+      extend(off+1);
+    bm_[off] = false;
+    store(val, off);
+    if(max_used_ <= off) max_used_ = off+1;
+  }else if('-' == op){
+    bm_[off] = true;
+  }else if('~' == op){ // shrunk
+    max_used_ = off;
+  }
+}
+
+template<typename Array>
+bool IDPool<Array>::log(std::string const &line)
+{
+  if(wal_){
+    wal_->append(tag_, line);
+    tran_buf_ += line;
+    return true;
+  }
+  return 
+    line.size() == detail::s_write(line.c_str(), line.size(), file_) &&
+    0 == detail::s_flush(file_);
+}
+
+template<typename Array>
+void IDPool<Array>::store(value_type const &val, AddrType off)
+{
+  if(wal_) 
+    dirty_[off] = val;
+  else
+    arr_.template store(val, off);
+}
+
 template<typename Array>
 void IDPool<Array>::extend(uint32_t new_size)
 {
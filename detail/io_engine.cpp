@@ -0,0 +1,423 @@
+#include "io_engine.hpp"
+#include "file_utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#ifdef BDB_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace BDB {
+
+  namespace {
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    // finish a read or write of which done bytes are transferred,
+    // return bytes transferred or -errno
+    int
+    transfer(io_request const &r, uint32_t done)
+    {
+      while(done < r.len){
+        ssize_t n = (IO_READ == r.op) ?
+          pread(r.fd, r.buf + done, r.len - done, r.off + done) :
+          pwrite(r.fd, r.buf + done, r.len - done, r.off + done);
+        if(n < 0 && EINTR == errno)
+          continue;
+        if(n < 0)
+          return -errno;
+        if(0 == n)
+          break;
+        done += n;
+      }
+      return done;
+    }
+
+    // counted by count()
+    int
+    sync_fd(int fd)
+    {
+#if defined(__linux__)
+      return fdatasync(fd) ? -errno : 0;
+#else
+      return fsync(fd) ? -errno : 0;
+#endif
+    }
+#endif
+
+    void
+    count(io_request const &r)
+    {
+      using namespace detail;
+      switch(r.op){
+      case IO_READ:
+        io_count(&io_counter::reads);
+        io_count(&io_counter::read_bytes, r.len);
+        break;
+      case IO_WRITE:
+        io_count(&io_counter::writes);
+        io_count(&io_counter::written_bytes, r.len);
+        if(r.sync)
+          io_count(&io_counter::syncs);
+        break;
+      case IO_SYNC:
+        io_count(&io_counter::syncs);
+        break;
+      }
+    }
+
+  } // anonymous namespace
+
+  void
+  sync_engine::run(io_request *reqs, size_t count_)
+  {
+    for(size_t i = 0; i < count_; ++i){
+      io_request &r = reqs[i];
+#if defined(_WIN32) || defined(_WIN64)
+      r.result = -ENOSYS;
+#else
+      count(r);
+      if(IO_SYNC == r.op){
+        r.result = sync_fd(r.fd);
+        continue;
+      }
+      r.result = transfer(r, 0);
+      if(IO_WRITE == r.op && r.sync && r.result >= 0){
+        int rt = sync_fd(r.fd);
+        if(rt) r.result = rt;
+      }
+#endif
+    }
+  }
+
+#ifdef BDB_HAVE_IO_URING
+
+  /** @brief Requests submitted to an io_uring instance
+   *  @details The rings are driven by raw system calls, so liburing is
+   *  not needed. A batch is queued to the submission ring and handed to
+   *  the kernel by one io_uring_enter call that also waits for its
+   *  completions, as long as it fits the depth of the ring.
+   */
+  class uring_engine
+  : public io_engine
+  {
+  public:
+    uring_engine();
+    ~uring_engine();
+
+    /// Set up a ring, false if the kernel does not allow it
+    bool
+    init(uint32_t depth);
+
+    void
+    run(io_request *reqs, size_t count);
+
+    bool
+    register_files(int const *fds, size_t count);
+
+    bool
+    register_buffer(char *buf, size_t size);
+
+    IOEngine
+    kind() const
+    { return IO_ENGINE_URING; }
+
+    char const*
+    name() const
+    { return "io_uring"; }
+
+  private:
+    // queue the entries of a request, two for a write with a sync
+    void
+    prepare(io_request *reqs, size_t i);
+
+    io_uring_sqe*
+    next_sqe(io_request const &r, uint8_t opcode, uint64_t data);
+
+    // handle completions, return entries reaped
+    unsigned int
+    reap(io_request *reqs);
+
+    int ring_;
+    unsigned int entries_;
+    void *sq_ptr_, *cq_ptr_;
+    size_t sq_size_, cq_size_;
+    io_uring_sqe *sqes_;
+    unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+    unsigned *cq_head_, *cq_tail_, *cq_mask_;
+    io_uring_cqe *cqes_;
+    unsigned int tail_;
+
+    std::vector<int> files_;
+    char *buf_;
+    size_t buf_size_;
+    std::vector<iovec> iovs_;
+    std::vector<int> sync_results_;
+  };
+
+  namespace {
+    int
+    sys_setup(unsigned int entries, io_uring_params *p)
+    { return syscall(__NR_io_uring_setup, entries, p); }
+
+    int
+    sys_enter(int ring, unsigned int submit, unsigned int wait)
+    {
+      return syscall(__NR_io_uring_enter, ring, submit, wait,
+                     wait ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+    }
+
+    int
+    sys_register(int ring, unsigned int opcode, void const *arg,
+                 unsigned int count)
+    { return syscall(__NR_io_uring_register, ring, opcode, arg, count); }
+
+    unsigned int const SYNC_BIT = 1;
+  }
+
+  uring_engine::uring_engine()
+  : ring_(-1), entries_(0), sq_ptr_(MAP_FAILED), cq_ptr_(MAP_FAILED),
+  sq_size_(0), cq_size_(0), sqes_((io_uring_sqe*)MAP_FAILED), tail_(0),
+  buf_(0), buf_size_(0)
+  {}
+
+  uring_engine::~uring_engine()
+  {
+    if(MAP_FAILED != (void*)sqes_)
+      munmap(sqes_, entries_ * sizeof(io_uring_sqe));
+    if(MAP_FAILED != cq_ptr_ && cq_ptr_ != sq_ptr_)
+      munmap(cq_ptr_, cq_size_);
+    if(MAP_FAILED != sq_ptr_)
+      munmap(sq_ptr_, sq_size_);
+    if(ring_ >= 0)
+      close(ring_);
+  }
+
+  bool
+  uring_engine::init(uint32_t depth)
+  {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // room for a write and its chained sync
+    if(0 > (ring_ = sys_setup(std::max<uint32_t>(depth, 2), &p)))
+      return false;
+    entries_ = p.sq_entries;
+
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+    sq_ptr_ = mmap(0, sq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQ_RING);
+    if(MAP_FAILED == sq_ptr_)
+      return false;
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+      cq_ptr_ = sq_ptr_;
+    else
+      cq_ptr_ = mmap(0, cq_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_CQ_RING);
+    if(MAP_FAILED == cq_ptr_)
+      return false;
+    sqes_ = (io_uring_sqe*)mmap(0, entries_ * sizeof(io_uring_sqe),
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring_,
+                                IORING_OFF_SQES);
+    if(MAP_FAILED == (void*)sqes_)
+      return false;
+
+    char *sq = (char*)sq_ptr_, *cq = (char*)cq_ptr_;
+    sq_head_ = (unsigned*)(sq + p.sq_off.head);
+    sq_tail_ = (unsigned*)(sq + p.sq_off.tail);
+    sq_mask_ = (unsigned*)(sq + p.sq_off.ring_mask);
+    sq_array_ = (unsigned*)(sq + p.sq_off.array);
+    cq_head_ = (unsigned*)(cq + p.cq_off.head);
+    cq_tail_ = (unsigned*)(cq + p.cq_off.tail);
+    cq_mask_ = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    tail_ = *sq_tail_;
+    return true;
+  }
+
+  bool
+  uring_engine::register_files(int const *fds, size_t count)
+  {
+    if(!files_.empty()){
+      sys_register(ring_, IORING_UNREGISTER_FILES, 0, 0);
+      files_.clear();
+    }
+    if(!count ||
+       0 > sys_register(ring_, IORING_REGISTER_FILES, fds, count))
+      return false;
+    files_.assign(fds, fds + count);
+    return true;
+  }
+
+  bool
+  uring_engine::register_buffer(char *buf, size_t size)
+  {
+    if(buf_){
+      sys_register(ring_, IORING_UNREGISTER_BUFFERS, 0, 0);
+      buf_ = 0;
+      buf_size_ = 0;
+    }
+    iovec iov = { buf, size };
+    // pinned memory is limited by RLIMIT_MEMLOCK
+    if(!size || 0 > sys_register(ring_, IORING_REGISTER_BUFFERS, &iov, 1))
+      return false;
+    buf_ = buf;
+    buf_size_ = size;
+    return true;
+  }
+
+  io_uring_sqe*
+  uring_engine::next_sqe(io_request const &r, uint8_t opcode, uint64_t data)
+  {
+    unsigned int idx = tail_ & *sq_mask_;
+    io_uring_sqe *sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = r.fd;
+    for(size_t i = 0; i < files_.size(); ++i){
+      if(files_[i] == r.fd){
+        sqe->fd = i;
+        sqe->flags |= IOSQE_FIXED_FILE;
+        break;
+      }
+    }
+    sqe->user_data = data;
+    sq_array_[idx] = idx;
+    ++tail_;
+    return sqe;
+  }
+
+  void
+  uring_engine::prepare(io_request *reqs, size_t i)
+  {
+    io_request &r = reqs[i];
+    count(r);
+    r.result = 0;
+    sync_results_[i] = 0;
+
+    io_uring_sqe *sqe;
+    if(IO_SYNC == r.op){
+      sqe = next_sqe(r, IORING_OP_FSYNC, i << 1);
+      sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    }else if(buf_ && r.buf >= buf_ && r.buf + r.len <= buf_ + buf_size_){
+      sqe = next_sqe(r, IO_READ == r.op ?
+                     IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED, i << 1);
+      sqe->addr = (uint64_t)(uintptr_t)r.buf;
+      sqe->len = r.len;
+      sqe->off = r.off;
+      sqe->buf_index = 0;
+    }else{
+      iovs_[i].iov_base = r.buf;
+      iovs_[i].iov_len = r.len;
+      sqe = next_sqe(r, IO_READ == r.op ?
+                     IORING_OP_READV : IORING_OP_WRITEV, i << 1);
+      sqe->addr = (uint64_t)(uintptr_t)&iovs_[i];
+      sqe->len = 1;
+      sqe->off = r.off;
+    }
+    if(r.drain)
+      sqe->flags |= IOSQE_IO_DRAIN;
+
+    if(IO_WRITE == r.op && r.sync){
+      // the sync starts after the write completes, and is cancelled
+      // if it fails or is short
+      sqe->flags |= IOSQE_IO_LINK;
+      io_uring_sqe *fsync = next_sqe(r, IORING_OP_FSYNC, (i << 1) | SYNC_BIT);
+      fsync->fsync_flags = IORING_FSYNC_DATASYNC;
+    }
+  }
+
+  unsigned int
+  uring_engine::reap(io_request *reqs)
+  {
+    unsigned int head = *cq_head_, n = 0;
+    unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for(; head != tail; ++head, ++n){
+      io_uring_cqe const &cqe = cqes_[head & *cq_mask_];
+      size_t i = cqe.user_data >> 1;
+      if(cqe.user_data & SYNC_BIT)
+        sync_results_[i] = cqe.res;
+      else
+        reqs[i].result = cqe.res;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return n;
+  }
+
+  void
+  uring_engine::run(io_request *reqs, size_t count_)
+  {
+    iovs_.resize(count_);
+    sync_results_.resize(count_);
+
+    size_t next = 0;
+    unsigned int queued = 0, inflight = 0;
+    while(next < count_ || queued || inflight){
+      while(next < count_){
+        unsigned int need =
+          (IO_WRITE == reqs[next].op && reqs[next].sync) ? 2 : 1;
+        if(queued + inflight + need > entries_)
+          break;
+        prepare(reqs, next++);
+        queued += need;
+      }
+      __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+
+      // wait for the whole batch once it is queued, or for room
+      unsigned int wait = (next < count_) ? 
+        std::min(1u, queued + inflight) : queued + inflight;
+      int rt = sys_enter(ring_, queued, wait);
+      if(rt < 0){
+        if(EINTR == errno)
+          continue;
+        if((EAGAIN != errno && EBUSY != errno) || !inflight)
+          throw std::runtime_error("io_engine: io_uring_enter failed");
+        rt = 0;
+      }
+      queued -= rt;
+      inflight += rt;
+      inflight -= reap(reqs);
+    }
+
+    // finish short transfers and writes whose sync was cancelled
+    for(size_t i = 0; i < count_; ++i){
+      io_request &r = reqs[i];
+      if(IO_SYNC == r.op || r.result < 0)
+        continue;
+      if((uint32_t)r.result < r.len &&
+         (IO_WRITE == r.op || r.result > 0))
+        r.result = transfer(r, r.result);
+      if(IO_WRITE == r.op && r.sync && r.result >= 0){
+        int rt = (-ECANCELED == sync_results_[i]) ?
+          sync_fd(r.fd) : sync_results_[i];
+        if(rt) r.result = rt;
+      }
+    }
+  }
+
+#endif // BDB_HAVE_IO_URING
+
+  io_engine*
+  io_engine::create(IOEngine kind, uint32_t depth)
+  {
+#ifdef BDB_HAVE_IO_URING
+    if(IO_ENGINE_URING == kind){
+      uring_engine *e = new uring_engine;
+      if(e->init(depth))
+        return e;
+      delete e;
+    }
+#endif
+    return new sync_engine;
+  }
+
+} // namespace BDB
@@ -0,0 +1,105 @@
+#ifndef BDB_IO_ENGINE_HPP_
+#define BDB_IO_ENGINE_HPP_
+
+#include "common.hpp"
+#include <cstddef>
+#include <sys/types.h>
+#include <boost/noncopyable.hpp>
+
+namespace BDB {
+
+  enum io_op
+  {
+    IO_READ = 0,
+    IO_WRITE,
+    IO_SYNC     ///< sync data of fd to the device
+  };
+
+  /// A request run by io_engine::run()
+  struct io_request
+  {
+    io_op op;
+    int fd;
+    char *buf;
+    uint32_t len;
+    off_t off;
+    /// sync fd once an IO_WRITE completes, chained in the same batch
+    bool sync;
+    /// start after every earlier request of the batch completes
+    bool drain;
+    /** Bytes read or written, 0 for a successful IO_SYNC, or -errno.
+     *  A write is successful only if its chained sync is.
+     */
+    int result;
+
+    io_request()
+    : op(IO_READ), fd(-1), buf(0), len(0), off(0), sync(false),
+    drain(false), result(0)
+    {}
+  };
+
+  /** @brief Runs batches of file I/O requests of a thread
+   *  @details Requests of a batch may run in any order and concurrently,
+   *  unless they are marked drain. Reads and writes are complete when
+   *  run() returns, short ones only at the end of a file. An engine is
+   *  used by one thread at a time.
+   */
+  class io_engine
+  : boost::noncopyable
+  {
+  public:
+    /** @brief Create an engine of a kind
+     *  @param depth Requests in flight at most
+     *  @details Returns a synchronous engine when the kind is not
+     *  available on this system.
+     */
+    static io_engine*
+    create(IOEngine kind, uint32_t depth);
+
+    virtual ~io_engine() {}
+
+    /// Run requests and wait for all of them
+    virtual void
+    run(io_request *reqs, size_t count) = 0;
+
+    /** @brief Files requests refer to often, replacing earlier ones
+     *  @return false if the engine does not keep them
+     */
+    virtual bool
+    register_files(int const *, size_t)
+    { return false; }
+
+    /** @brief Memory requests transfer to often, replacing earlier ones
+     *  @return false if the engine does not keep it
+     */
+    virtual bool
+    register_buffer(char *, size_t)
+    { return false; }
+
+    virtual IOEngine
+    kind() const = 0;
+
+    virtual char const*
+    name() const = 0;
+  };
+
+  /// One pread, pwrite or sync call per request
+  class sync_engine
+  : public io_engine
+  {
+  public:
+    void
+    run(io_request *reqs, size_t count);
+
+    IOEngine
+    kind() const
+    { return IO_ENGINE_SYNC; }
+
+    char const*
+    name() const
+    { return "sync"; }
+  };
+
+} // namespace BDB
+
+#endif // header guard
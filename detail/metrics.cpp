@@ -0,0 +1,82 @@
+#include "metrics.hpp"
+
+namespace BDB {
+
+  namespace detail {
+    thread_local io_counter *io_sink = 0;
+  }
+
+  namespace {
+    typedef std::atomic<unsigned long long> counter_t;
+
+    unsigned long long
+    take(counter_t &c, bool reset)
+    {
+      return reset ?
+        c.exchange(0, std::memory_order_relaxed) :
+        c.load(std::memory_order_relaxed);
+    }
+  }
+
+  op_metrics::op_metrics()
+  : count(0), errors(0), bytes(0), latency_sum(0), latency_max(0)
+  {
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+      buckets[i].store(0, std::memory_order_relaxed);
+  }
+
+  void
+  op_metrics::record(unsigned long long ns, bool ok,
+                     unsigned long long nbytes)
+  {
+    if(ok){
+      count.fetch_add(1, std::memory_order_relaxed);
+      bytes.fetch_add(nbytes, std::memory_order_relaxed);
+    }else{
+      errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    latency_sum.fetch_add(ns, std::memory_order_relaxed);
+    buckets[histogram::index(ns)].fetch_add(1, std::memory_order_relaxed);
+
+    unsigned long long cur = latency_max.load(std::memory_order_relaxed);
+    while(ns > cur &&
+          !latency_max.compare_exchange_weak(
+            cur, ns, std::memory_order_relaxed))
+      ;
+  }
+
+  void
+  op_metrics::collect(OpStat *s, bool reset)
+  {
+    if(s->latency_buckets.size() < HISTOGRAM_BUCKETS)
+      s->latency_buckets.resize(HISTOGRAM_BUCKETS, 0);
+
+    s->count += take(count, reset);
+    s->errors += take(errors, reset);
+    s->bytes += take(bytes, reset);
+    s->latency_sum += take(latency_sum, reset);
+    s->latency_max = std::max(s->latency_max, take(latency_max, reset));
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+      s->latency_buckets[i] += take(buckets[i], reset);
+  }
+
+  metrics::metrics()
+  : enabled_(false)
+  {}
+
+  void
+  metrics::collect(Stat *s, bool reset)
+  {
+    for(unsigned int i = 0; i < OP_KINDS; ++i)
+      ops[i].collect(s->ops + i, reset);
+
+    s->seek_count += take(io.seeks, reset);
+    s->read_count += take(io.reads, reset);
+    s->write_count += take(io.writes, reset);
+    s->flush_count += take(io.flushes, reset);
+    s->sync_count += take(io.syncs, reset);
+    s->read_bytes += take(io.read_bytes, reset);
+    s->written_bytes += take(io.written_bytes, reset);
+  }
+
+} // namespace BDB
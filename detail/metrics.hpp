@@ -0,0 +1,114 @@
+#ifndef BDB_METRICS_HPP_
+#define BDB_METRICS_HPP_
+
+#include "common.hpp"
+#include "file_utils.hpp"
+#include "histogram.hpp"
+#include <atomic>
+#include <chrono>
+#include <boost/noncopyable.hpp>
+
+namespace BDB {
+
+  /// Counters of an operation kind, see OpStat
+  struct op_metrics
+  {
+    std::atomic<unsigned long long> count, errors, bytes;
+    std::atomic<unsigned long long> latency_sum, latency_max;
+    std::atomic<unsigned long long> buckets[HISTOGRAM_BUCKETS];
+
+    op_metrics();
+
+    void
+    record(unsigned long long ns, bool ok, unsigned long long nbytes);
+
+    /// Add counters to s, and zero them if reset is true
+    void
+    collect(OpStat *s, bool reset);
+  };
+
+  /** @brief Operation and I/O counters of a BehaviorDB
+   *  @details Counters are relaxed atomics, so they are read and reset
+   *  without stopping operations. An operation running across a reset
+   *  may be split between two snapshots.
+   */
+  class metrics
+  : boost::noncopyable
+  {
+  public:
+    metrics();
+
+    void
+    init(bool enabled)
+    { enabled_ = enabled; }
+
+    bool
+    enabled() const
+    { return enabled_; }
+
+    /// Add counters to s, and zero them if reset is true
+    void
+    collect(Stat *s, bool reset);
+
+    op_metrics ops[OP_KINDS];
+    detail::io_counter io;
+
+  private:
+    bool enabled_;
+  };
+
+  /** @brief Count I/O calls of the calling thread while in scope
+   */
+  class io_scope
+  : boost::noncopyable
+  {
+  public:
+    explicit
+    io_scope(metrics &m)
+    : prev_(detail::io_sink)
+    { if(m.enabled()) detail::io_sink = &m.io; }
+
+    ~io_scope()
+    { detail::io_sink = prev_; }
+
+  private:
+    detail::io_counter *prev_;
+  };
+
+  /** @brief Time an operation and count its I/O calls
+   *  @details Call done() before leaving the scope normally, otherwise
+   *  the operation is counted as an error.
+   */
+  class op_timer
+  : boost::noncopyable
+  {
+    typedef std::chrono::steady_clock clock_type;
+  public:
+    op_timer(metrics &m, OpKind kind)
+    : io_(m), m_(m.enabled() ? &m.ops[kind] : 0), ok_(false), bytes_(0)
+    { if(m_) beg_ = clock_type::now(); }
+
+    ~op_timer()
+    {
+      if(!m_) return;
+      m_->record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          clock_type::now() - beg_).count(),
+        ok_, bytes_);
+    }
+
+    void
+    done(unsigned long long bytes)
+    { ok_ = true; bytes_ = bytes; }
+
+  private:
+    io_scope io_;
+    op_metrics *m_;
+    bool ok_;
+    unsigned long long bytes_;
+    clock_type::time_point beg_;
+  };
+
+} // namespace BDB
+
+#endif // header guard
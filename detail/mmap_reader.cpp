@@ -0,0 +1,174 @@
+#include "mmap_reader.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace BDB {
+namespace detail {
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  namespace {
+    int
+    to_madvise(io_hint hint)
+    {
+      static int const advice[] = {
+        MADV_NORMAL, MADV_RANDOM, MADV_SEQUENTIAL,
+        MADV_WILLNEED, MADV_DONTNEED
+      };
+      return advice[hint];
+    }
+  }
+#endif
+
+  mmap_reader::mmap_reader(int fd, off_t window, size_t max_windows)
+  : fd_(fd), window_size_(window), 
+    max_windows_(std::max<size_t>(1, max_windows)),
+    size_(0), hint_(HINT_RANDOM)
+  {}
+
+  mmap_reader::~mmap_reader()
+  {
+    for(size_t i = 0; i < windows_.size(); ++i)
+      unmap(i);
+  }
+
+  uint32_t
+  mmap_reader::read(char *dest, uint32_t size, off_t off)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    return 0;
+#else
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    // pages behind the end of the file fault, the file may have grown
+    // by writes since
+    if(off + (off_t)size > size_){
+      struct stat st;
+      if(0 == fstat(fd_, &st) && st.st_size > size_)
+        size_ = st.st_size;
+      if(off >= size_)
+        return 0;
+      size = std::min<off_t>(size, size_ - off);
+    }
+
+    uint32_t done = 0;
+    while(done < size){
+      off_t pos = off + done;
+      size_t i = pos / window_size_;
+      char *base = window(i);
+      if(!base)
+        break;
+      off_t in = pos - (off_t)i * window_size_;
+      uint32_t len = std::min<off_t>(size - done, window_size_ - in);
+      memcpy(dest + done, base + in, len);
+      done += len;
+    }
+    io_count(&io_counter::reads);
+    io_count(&io_counter::read_bytes, done);
+    return done;
+#endif
+  }
+
+  void
+  mmap_reader::extend(off_t size)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    size_ = std::max(size_, size);
+  }
+
+  void
+  mmap_reader::truncate(off_t size)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    size_ = std::min(size_, size);
+    size_t keep = (size + window_size_ - 1) / window_size_;
+    for(size_t i = keep; i < windows_.size(); ++i)
+      unmap(i);
+  }
+
+  void
+  mmap_reader::advise(io_hint hint)
+  {
+#if !defined(_WIN32) && !defined(_WIN64)
+    std::lock_guard<std::mutex> guard(mutex_);
+    hint_ = hint;
+    for(size_t i = 0; i < windows_.size(); ++i){
+      if(windows_[i])
+        madvise(windows_[i], window_size_, to_madvise(hint));
+    }
+#endif
+  }
+
+  void
+  mmap_reader::advise(off_t off, off_t len, io_hint hint)
+  {
+#if !defined(_WIN32) && !defined(_WIN64)
+    std::lock_guard<std::mutex> guard(mutex_);
+    off_t const page = sysconf(_SC_PAGESIZE);
+    off_t end = off + len;
+    while(off < end){
+      size_t i = off / window_size_;
+      off_t beg = (off_t)i * window_size_;
+      off_t stop = std::min(end, beg + window_size_);
+      if(i < windows_.size() && windows_[i]){
+        // whole pages only, others hold data of other ranges
+        off_t first = (off - beg + page - 1) / page * page;
+        off_t last = hint == HINT_DONTNEED ?
+          (stop - beg) / page * page : stop - beg;
+        if(first < last)
+          madvise(windows_[i] + first, last - first, to_madvise(hint));
+      }
+      off = stop;
+    }
+#endif
+  }
+
+  size_t
+  mmap_reader::mapped() const
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return order_.size();
+  }
+
+  char*
+  mmap_reader::window(size_t i)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    return 0;
+#else
+    if(i < windows_.size() && windows_[i])
+      return windows_[i];
+
+    if(order_.size() >= max_windows_)
+      unmap(order_.front());
+    void *p = mmap(0, window_size_, PROT_READ, MAP_SHARED, fd_,
+                   (off_t)i * window_size_);
+    if(MAP_FAILED == p)
+      return 0;
+    madvise(p, window_size_, to_madvise(hint_));
+
+    if(i >= windows_.size())
+      windows_.resize(i + 1, 0);
+    windows_[i] = (char*)p;
+    order_.push_back(i);
+    return windows_[i];
+#endif
+  }
+
+  void
+  mmap_reader::unmap(size_t i)
+  {
+#if !defined(_WIN32) && !defined(_WIN64)
+    if(i >= windows_.size() || !windows_[i])
+      return;
+    munmap(windows_[i], window_size_);
+    windows_[i] = 0;
+    order_.erase(std::find(order_.begin(), order_.end(), i));
+#endif
+  }
+
+}} // namespace BDB::detail
@@ -0,0 +1,100 @@
+#ifndef BDB_MMAP_READER_HPP_
+#define BDB_MMAP_READER_HPP_
+
+#include "common.hpp"
+#include "file_utils.hpp"
+#include <sys/types.h>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+// bytes of a window mapped by an mmap_reader
+#define MMAP_WINDOW_SIZ ((off_t)1<<26)
+// windows an mmap_reader keeps mapped
+#define MMAP_WINDOWS 64
+
+namespace BDB {
+namespace detail {
+
+  /** @brief Reads of a file copied from read-only shared mappings
+   *  @details The file is mapped in windows of a fixed size when they
+   *  are first read, up to a number of windows, the least recently
+   *  mapped one is unmapped for another. Windows are mapped whole,
+   *  beyond the end of the file as well, so that a growing file needs
+   *  no remapping, only its size is raised (extend()). Data written
+   *  to the file by write(2) or flushed stdio is seen by the mappings,
+   *  they share the page cache.
+   *  @remark Not supported on Windows, where every read returns 0.
+   */
+  class mmap_reader
+  : boost::noncopyable
+  {
+  public:
+    /** @param fd File descriptor opened for reading, not owned
+     *  @param window Bytes of a window, a multiple of the page size
+     *  @param max_windows Windows kept mapped
+     */
+    explicit
+    mmap_reader(int fd, off_t window = MMAP_WINDOW_SIZ,
+                size_t max_windows = MMAP_WINDOWS);
+
+    ~mmap_reader();
+
+    /** @brief Copy a file range
+     *  @return Bytes copied, less than size at the end of the file or
+     *  when a window can not be mapped
+     */
+    uint32_t
+    read(char *dest, uint32_t size, off_t off);
+
+    /// The file grew to size bytes, ranges up to it can be read
+    void
+    extend(off_t size);
+
+    /// The file was truncated to size bytes, windows behind are unmapped
+    void
+    truncate(off_t size);
+
+    /** @brief Access pattern of the mappings (madvise)
+     *  @details HINT_NORMAL, HINT_RANDOM and HINT_SEQUENTIAL apply to
+     *  every window, mapped later as well. The default is HINT_RANDOM.
+     */
+    void
+    advise(io_hint hint);
+
+    /** @brief Access pattern of a file range, mapped windows only
+     *  @details HINT_DONTNEED unmaps the pages from the process, pages
+     *  that are mapped can not be dropped from the page cache.
+     */
+    void
+    advise(off_t off, off_t len, io_hint hint);
+
+    /// Windows mapped now
+    size_t
+    mapped() const;
+
+  private:
+    // mapped window i, 0 when it can not be mapped
+    char*
+    window(size_t i);
+
+    void
+    unmap(size_t i);
+
+    int fd_;
+    off_t window_size_;
+    size_t max_windows_;
+    // bytes of the file known to be readable
+    off_t size_;
+    io_hint hint_;
+    std::vector<char*> windows_;
+    // mapped windows, the least recently mapped first
+    std::deque<size_t> order_;
+    mutable std::mutex mutex_;
+  };
+
+}} // namespace BDB::detail
+
+#endif // header guard
@@ -5,42 +5,74 @@
 #include "id_pool.hpp"
 #include "id_handle.hpp"
 #include "v_iovec.hpp"
+#include "slabPool.hpp"
+#include "trace.hpp"
+#include "io_engine.hpp"
+#include "direct_io.hpp"
+#include "mmap_reader.hpp"
 #include <boost/variant/apply_visitor.hpp>
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <stdexcept>
 
 namespace BDB {
   typedef detail::s_buffer<MIGBUF_SIZ> my_buffer_;
+
+  // format of .fpo and .tran files, 2 since chunk headers keep owners
+  unsigned int const POOL_FORMAT = 2;
   
   pool::pool(pool::config const &conf, addr_eval<AddrType>& addrEval)
     : addrEval(addrEval),
     dirID(conf.dirID), 
-    work_dir(conf.work_dir), trans_dir(conf.trans_dir), 
-    file_(0), idpool_(0)
+    work_dir(conf.work_dir), trans_dir(conf.trans_dir), punch_(false),
+    prealloc_func_(conf.prealloc_func), extent_(0),
+    stripes_(0), stripe_count_(0), hints_(false), drop_(false),
+    idpool_(0), slab_(0), wal_(0),
+    version_(0)
   {
     using namespace std;
 
-    // create pool file
-    char fname[256] = {};
+    if(conf.packed){
+      slab_ = new slab_pool(
+        dirID, work_dir, 
+        addrEval.chunk_size_estimation(dirID),
+        addrEval.local_addr_len());
+      return;
+    }
 
-    if(work_dir.size() > 256) 
-      throw length_error("pool: length of pool_dir string is too long");
+    uint32_t chunk_size = addrEval.chunk_size_estimation(dirID);
+    punch_ = conf.punch_threshold && chunk_size >= conf.punch_threshold;
 
+    // create pool files
+    std::vector<std::string> dirs(conf.stripe_dirs);
+    if(dirs.empty())
+      dirs.push_back(work_dir);
+    stripe_count_ = dirs.size();
+    stripes_ = new stripe[stripe_count_];
+    for(unsigned int i = 0; i < stripe_count_; ++i)
+      open_stripe(stripes_ + i, dirs[i], conf);
 
-    sprintf(fname, "%s%04x.pool", work_dir.c_str(), dirID);
-    if(0 == (file_ = fopen(fname, "r+b"))){
-      if(0 == (file_ = fopen(fname, "w+b"))){
-        string msg("pool: Unable to create pool file ");
-        msg += fname;
-        throw invalid_argument(msg.c_str());
-      }
+    // direct pools have no cached pages to hint about
+    if(conf.hints && !direct()){
+      hints_ = true;
+      drop_ = chunk_size >= conf.dontneed_threshold;
+      for(unsigned int i = 0; i < stripe_count_; ++i)
+        detail::s_advise(fileno(stripes_[i].file), 0, 0, 
+                         detail::HINT_RANDOM);
     }
 
-    file_buf_ = new char[MIGBUF_SIZ];
+    // the first chunk a stripe file does not cover, a seek of the FILE 
+    // reads a buffer and fills the page cache
+    extent_ = npos;
+    for(unsigned int i = 0; i < stripe_count_; ++i){
+      AddrType covered = detail::s_file_size(stripes_[i].file) / chunk_size;
+      extent_ = std::min<AddrType>(extent_, covered * stripe_count_ + i);
+    }
 
-    if(0 != setvbuf(file_, file_buf_, _IOFBF, MIGBUF_SIZ))
-      throw runtime_error("pool: setvbuf to pool file failed");
+    char fname[256] = {};
 
     // setup idPool
     sprintf(fname, "%s%04x.tran", trans_dir.c_str(), dirID);
@@ -50,31 +82,180 @@ namespace BDB {
 
   }
 
+  void
+  pool::upgrade(std::string const &trans_dir, unsigned int dir_count)
+  {
+    using namespace std;
+
+    string marker = trans_dir + "pool_format";
+    unsigned int format = 0;
+    ifstream fin(marker.c_str());
+    if(fin.is_open() && !(fin >> format))
+      throw runtime_error(SRC_POS);
+    fin.close();
+    if(format > POOL_FORMAT){
+      ostringstream msg;
+      msg << "pool: " << marker << " is of format " << format 
+        << ", newer than " << POOL_FORMAT;
+      throw invalid_argument(msg.str());
+    }
+    if(POOL_FORMAT == format) 
+      return;
+
+    // headers of 8 digits, a size, get an unknown owner. Entries 
+    // converted by an interrupted upgrade are kept as they are.
+    char owner[9] = {};
+    sprintf(owner, "%08x", npos);
+    char fname[256] = {};
+    for(unsigned int dir = 0; dir < dir_count; ++dir){
+      sprintf(fname, "%s%04x.tran", trans_dir.c_str(), dir);
+      ifstream tran(fname, ios::in | ios::binary);
+      if(!tran.is_open()) continue;
+
+      string tmp = string(fname) + ".tmp";
+      ofstream out(tmp.c_str(), ios::out | ios::binary | ios::trunc);
+      string line;
+      while(getline(tran, line)){
+        if(!line.empty() && '+' == line[0]){
+          size_t val = line.find_first_not_of("0123456789", 1);
+          if(string::npos != val && '\t' == line[val]) ++val;
+          if(string::npos != val && 8 == line.size() - val)
+            line += owner;
+        }
+        out << line;
+        if(!tran.eof()) out << '\n';
+      }
+      out.close();
+      tran.close();
+      if(!out)
+        throw runtime_error(SRC_POS);
+
+      FILE *fp = fopen(tmp.c_str(), "rb");
+      bool synced = fp && 0 == detail::s_sync(fp);
+      if(fp) fclose(fp);
+      if(!synced || rename(tmp.c_str(), fname))
+        throw runtime_error(SRC_POS);
+
+      // slots of 8 digits, rebuilt by replaying the transaction file
+      sprintf(fname, "%s%04x.fpo", trans_dir.c_str(), dir);
+      if(0 != (fp = fopen(fname, "r+b"))){
+        int rt = detail::s_truncate(fp, 0);
+        fclose(fp);
+        if(rt) throw runtime_error(SRC_POS);
+      }
+    }
+
+    string tmp = marker + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    bool written = fp && 0 < fprintf(fp, "%u\n", POOL_FORMAT) &&
+      0 == detail::s_sync(fp);
+    if(fp) fclose(fp);
+    if(!written || rename(tmp.c_str(), marker.c_str()))
+      throw runtime_error(SRC_POS);
+  }
+
   pool::~pool()
   {
+    delete slab_;
     delete idpool_;
-    delete [] file_buf_;
-    fclose(file_);
+    delete [] stripes_;
+  }
+
+  pool::stripe::stripe()
+  : file(0), buf(0), direct_fd(-1), mmap(0),
+    reads(0), read_bytes(0), writes(0), written_bytes(0)
+  {}
+
+  pool::stripe::~stripe()
+  {
+    delete mmap;
+    if(file) fclose(file);
+    if(direct_fd >= 0) close(direct_fd);
+    delete [] buf;
+  }
+
+  void
+  pool::stripe::count_read(uint32_t size)
+  {
+    reads.fetch_add(1, std::memory_order_relaxed);
+    read_bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+
+  void
+  pool::stripe::count_write(uint32_t size)
+  {
+    writes.fetch_add(1, std::memory_order_relaxed);
+    written_bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+
+  void
+  pool::open_stripe(stripe *s, std::string const &dir, config const &conf)
+  {
+    using namespace std;
+
+    char fname[256] = {};
+
+    if(dir.size() > 256) 
+      throw length_error("pool: length of pool_dir string is too long");
+
+    sprintf(fname, "%s%04x.pool", dir.c_str(), dirID);
+    if(0 == (s->file = fopen(fname, "r+b"))){
+      if(0 == (s->file = fopen(fname, "w+b"))){
+        string msg("pool: Unable to create pool file ");
+        msg += fname;
+        throw invalid_argument(msg.c_str());
+      }
+    }
+
+    s->buf = new char[MIGBUF_SIZ];
+
+    if(0 != setvbuf(s->file, s->buf, _IOFBF, MIGBUF_SIZ))
+      throw runtime_error("pool: setvbuf to pool file failed");
+
+    // chunks are aligned when their size is, and the pool stays
+    // buffered where O_DIRECT is not supported
+    uint32_t chunk_size = addrEval.chunk_size_estimation(dirID);
+    if(conf.direct_threshold && chunk_size >= conf.direct_threshold &&
+       0 == chunk_size % detail::DIRECT_ALIGN)
+      s->direct_fd = detail::s_open_direct(fname);
+
+    // pages of a direct pool bypass the cache that mappings share
+#if !defined(_WIN32) && !defined(_WIN64)
+    if(s->direct_fd < 0 && (*conf.mmap_func)(dirID, chunk_size))
+      s->mmap = new detail::mmap_reader(fileno(s->file));
+#endif
   }
 
   AddrType
   pool::write(char const* data, uint32_t size)
+  { return write(data, size, chunk_owner(npos)); }
+
+  AddrType
+  pool::write(char const* data, uint32_t size, chunk_owner owner)
   {
     using namespace detail;
-   
+    ++version_;
+
+    // a packed pool keeps headers along with data
+    phase_scope ps(PHASE_IO);
+    if(slab_) return slab_->write(data, size);
+
+    ps.next(PHASE_HEADER);
     id_handle_t hdl(ACQUIRE_AUTO, *idpool_);
 
     hdl.value().size = size;
-      
-    seek(hdl.addr());
+    hdl.value().owner = owner.addr;
+    
+    ps.next(PHASE_IO);
+    reserve_blocks(hdl.addr());
 
     // allow data = 0 to act as allocation
-    if(0 != data && size != s_write(data, size, file_))
-      throw std::runtime_error(SRC_POS);
-    
-    if(fflush(file_))
+    if(0 != data && !write_at(data, size, hdl.addr(), 0, false))
       throw std::runtime_error(SRC_POS);
+    if(0 != data && drop_)
+      drop_pages(hdl.addr(), 0, size);
 
+    ps.next(PHASE_COMMIT);
     hdl.commit();
 
     return hdl.addr();
@@ -85,7 +266,12 @@ namespace BDB {
   pool::write(char const* data, uint32_t size, AddrType addr, uint32_t off)
   {
     using namespace detail;
-    
+    ++version_;
+
+    phase_scope ps(PHASE_IO);
+    if(slab_) return slab_->write(data, size, addr, off);
+
+    ps.next(PHASE_HEADER);
     id_handle_t hdl(MODIFY, *idpool_, addr);
 
     ChunkHeader &loc_header(hdl.value());
@@ -95,11 +281,14 @@ namespace BDB {
 
     off = (npos == off) ? loc_header.size : off;
     
-    if(npos == off){
-      fseeko(file_, addr_off2tell(addr, loc_header.size), SEEK_SET);
-      if(size != s_write(data,size,file_) || fflush(file_))
+    if(loc_header.size == off){
+      ps.next(PHASE_IO);
+      if(!write_at(data, size, addr, loc_header.size, false))
        throw std::runtime_error(SRC_POS);
+      if(drop_)
+        drop_pages(addr, loc_header.size, size);
       loc_header.size += size;
+      ps.next(PHASE_COMMIT);
       hdl.commit();
     }else{
       addr = merge_move(data, size, addr, off, this);
@@ -114,15 +303,32 @@ namespace BDB {
   }
 
   AddrType
-  pool::write(viov* vv, uint32_t len)
+  pool::write(viov* vv, uint32_t len, chunk_owner owner)
   {
     using namespace detail;
+    ++version_;
+
+    phase_scope ps(PHASE_IO);
+    if(slab_) return slab_->write(vv, len);
+
+    ps.next(PHASE_HEADER);
     id_handle_t hdl(ACQUIRE_AUTO, *idpool_);
+    hdl.value().owner = owner.addr;
     
-    hdl.value().size = 
-      writevv(vv, len, file_, 
-            addr_off2tell(hdl.addr(),0) );
+    ps.next(PHASE_IO);
+    reserve_blocks(hdl.addr());
+    // sources are read ahead, they are mostly chunks of migrations
+    stripe &dest = stripe_of(hdl.addr());
+    hdl.value().size = (dest.direct_fd >= 0) ?
+      writevv(vv, len, dest.direct_fd, addr_off2tell(hdl.addr(), 0), 
+              hints_) :
+      writevv(vv, len, dest.file, 
+            addr_off2tell(hdl.addr(),0), hints_);
+    dest.count_write(hdl.value().size);
+    if(drop_)
+      drop_pages(hdl.addr(), 0, hdl.value().size);
      
+    ps.next(PHASE_COMMIT);
     hdl.commit();
     
     return hdl.addr();
@@ -132,19 +338,26 @@ namespace BDB {
   pool::replace(char const *data, uint32_t size, AddrType addr)
   {
     using namespace detail;
-    
+    ++version_;
+
+    phase_scope ps(PHASE_IO);
+    if(slab_) return slab_->replace(data, size, addr);
+
     assert(size <= addrEval.chunk_size_estimation(dirID));
 
+    ps.next(PHASE_HEADER);
     id_handle_t hdl(MODIFY, *idpool_, addr);
     
     hdl.value().size = size;
-    seek(addr, 0);
+    ps.next(PHASE_IO);
 
-    if(size != s_write(data, size, file_) ||
-       0 != fflush(file_))
+    if(!write_at(data, size, addr, 0, false))
       throw data_currupted(
         (data_currupted){addr} );
+    if(drop_)
+      drop_pages(addr, 0, size);
     
+    ps.next(PHASE_COMMIT);
     hdl.commit();
 
     return addr;
@@ -154,25 +367,72 @@ namespace BDB {
   pool::read(char* buffer, uint32_t size, AddrType addr, uint32_t off)
   {
     using namespace detail;
-    
+
+    phase_scope ps(PHASE_IO);
+    if(slab_) return slab_->read(buffer, size, addr, off);
+
+    ps.next(PHASE_HEADER);
     id_handle_t hdl(READONLY, *idpool_, addr);
     uint32_t orig_size = hdl.const_value().size;
 
     if(off > orig_size)
       return 0;
 
-    seek(addr, off);
-
+    ps.next(PHASE_IO);
     uint32_t toRead = (size > orig_size - off) ? 
       orig_size - off 
-      : orig_size;
+      : size;
+
+    return read_at(buffer, toRead, addr, off);
+  }
+
+  uint32_t
+  pool::data_size(AddrType addr)
+  {
+    using namespace detail;
+
+    if(slab_) return slab_->data_size(addr);
+
+    id_handle_t hdl(READONLY, *idpool_, addr);
+    return hdl.const_value().size;
+  }
+
+  AddrType
+  pool::owner(AddrType addr)
+  {
+    if(slab_) return npos;
 
-    return s_read(buffer, toRead, file_);
+    id_handle_t hdl(detail::READONLY, *idpool_, addr);
+    return hdl.const_value().owner;
+  }
+
+  uint32_t
+  pool::reclaim(std::vector<AddrType> const &refs)
+  {
+    if(!slab_) return 0;
+    ++version_;
+    return slab_->reclaim(refs);
+  }
+
+  void
+  pool::set_owner(AddrType addr, AddrType owner)
+  {
+    if(slab_) return;
+
+    id_handle_t hdl(detail::MODIFY, *idpool_, addr);
+    if(hdl.const_value().owner == owner) return;
+
+    ++version_;
+    hdl.value().owner = owner;
+    hdl.commit();
   }
 
   uint32_t
   pool::read(std::string *buffer, uint32_t max, AddrType addr, uint32_t off)
   {
+    phase_scope ps(PHASE_IO);
+    if(slab_) return slab_->read(buffer, max, addr, off);
+
     if(!buffer) return 0;
     if(buffer->size()) buffer->clear();
     
@@ -188,6 +448,43 @@ namespace BDB {
     return total;
   }
 
+  bool
+  pool::read_request(std::string *buffer, uint32_t max, AddrType addr,
+                     uint32_t off, io_request *req)
+  {
+    using namespace detail;
+
+#if defined(_WIN32) || defined(_WIN64)
+    return false;
+#else
+    if(slab_ || direct() || mapped()) return false;
+
+    id_handle_t hdl(READONLY, *idpool_, addr);
+    uint32_t orig_size = hdl.const_value().size;
+    if(off >= orig_size || 0 == max)
+      return false;
+
+    buffer->resize(std::min(max, orig_size - off));
+    // pool files are flushed after each write, so the descriptor is 
+    // read without taking the FILE
+    req->op = IO_READ;
+    req->fd = fileno(stripe_of(addr).file);
+    req->buf = &(*buffer)[0];
+    req->len = buffer->size();
+    req->off = addr_off2tell(addr, off);
+    return true;
+#endif
+  }
+
+  bool
+  pool::read_done(AddrType addr, io_request const &req) const
+  {
+    if(req.result < 0 || (uint32_t)req.result < req.len)
+      return false;
+    stripes_[addr % stripe_count_].count_read(req.result);
+    return true;
+  }
+
   AddrType
   pool::merge_copy(
     char const* data, 
@@ -197,55 +494,21 @@ namespace BDB {
     pool *dest_pool)
   {
     using namespace detail;
+    
+    if(slab_) 
+      return slab_->merge_copy(data, size, src_addr, off, dest_pool);
+
+    phase_scope ps(PHASE_HEADER);
     id_handle_t hdl(READONLY, *idpool_, src_addr);
     uint32_t orig_size = hdl.const_value().size;
+    ps.next(PHASE_OTHER);
     
-    off = npos == off ? orig_size : off;
-
-    // TODO make it shorter
     viov vv[3];
-    file_src fs;
-    blank_src blank;
-    AddrType loc_addr;
-    if(0 == off){ // prepend
-      if(0 == data)
-        vv[0].data = blank;
-      else
-        vv[0].data = data;
-      vv[0].size = size;
-      fs.fp = file_;
-      fs.off = addr_off2tell(src_addr, 0);
-      vv[1].data = fs;
-      vv[1].size = orig_size;
-      loc_addr = dest_pool->write(vv, 2);
-    }else if(orig_size == off){ // append
-      fs.fp = file_;
-      fs.off = addr_off2tell(src_addr, 0);
-      vv[0].data = fs;
-      vv[0].size = orig_size;
-      if(0 == data)
-        vv[1].data = blank;
-      else
-        vv[1].data = data;
-      vv[1].size = size;
-      loc_addr = dest_pool->write(vv, 2);
-    }else{ // insert
-      fs.fp = file_;
-      fs.off = addr_off2tell(src_addr, 0);
-      vv[0].data = fs;
-      vv[0].size = off;
-      if(0 == data)
-        vv[1].data = blank;
-      else
-        vv[1].data = data;
-      vv[1].size = size;
-      fs.off += off;
-      vv[2].data = fs;
-      vv[2].size = orig_size - off;
-      loc_addr = dest_pool->write(vv, 3);
-    }
+    file_src fs = source(src_addr);
     
-    return loc_addr;
+    uint32_t len = merge_viov(vv, fs, orig_size, data, size, off);
+    
+    return dest_pool->write(vv, len, chunk_owner(hdl.const_value().owner));
   }
 
   AddrType
@@ -256,45 +519,26 @@ namespace BDB {
       pool* dest_pool)
   {
     using namespace detail;
+    
+    if(slab_) 
+      return slab_->merge_erase(size, src_addr, off, dest_pool);
+
+    phase_scope ps(PHASE_HEADER);
     id_handle_t hdl(READONLY, *idpool_, src_addr);
     uint32_t orig_size = hdl.const_value().size;
+    ps.next(PHASE_OTHER);
     
     off = npos == off ? orig_size : off;
     
     if(off > orig_size)
       return src_addr;
     
-    if(off + size > orig_size)
-      size = orig_size - off;
-
     viov vv[2];
-    file_src fs;
-    AddrType loc_addr = 0;
-    if(0 == off){ // pre
-      fs.fp = file_;
-      fs.off = addr_off2tell(src_addr, size);
-      vv[0].data = fs;
-      vv[0].size = orig_size - size;
-      loc_addr = dest_pool->write(vv, 1);
-    }else if(orig_size - size == off){ // post
-      fs.fp = file_;
-      fs.off = addr_off2tell(src_addr, orig_size - size);
-      vv[0].data = fs;
-      vv[0].size = orig_size - size;
-      loc_addr = dest_pool->write(vv, 1);
-    }else if(off < orig_size){ // in
-      fs.fp = file_;
-      fs.off = addr_off2tell(src_addr, 0);
-      vv[0].data = fs;
-      vv[0].size = off;
-      fs.off = addr_off2tell(src_addr, off+size);
-      vv[1].data = fs;
-      vv[1].size = orig_size - ( off + size );
-      loc_addr = dest_pool->write(vv, 2);
-    }else{
-      assert(false && "never reach");
-    }
-    return loc_addr;
+    file_src fs = source(src_addr);
+
+    uint32_t len = erase_viov(vv, fs, orig_size, size, off);
+
+    return dest_pool->write(vv, len, chunk_owner(hdl.const_value().owner));
   }
 
 
@@ -307,13 +551,25 @@ namespace BDB {
     pool *dest_pool)
   {
     using namespace detail;
+    ++version_;
     
+    if(slab_) 
+      return slab_->merge_move(data, size, src_addr, off, dest_pool);
+
+    phase_scope ps(PHASE_HEADER);
     id_handle_t hdl(RELEASE, *idpool_, src_addr);
+    ps.next(PHASE_OTHER);
 
     AddrType loc_addr = 
       merge_copy(data, size, src_addr, off, dest_pool);
     
+    ps.next(PHASE_COMMIT);
     hdl.commit();
+    ps.next(PHASE_IO);
+    release_blocks(src_addr);
+    // the source is not read again
+    if(hints_)
+      drop_pages(src_addr, 0, addrEval.chunk_size_estimation(dirID));
 
     return loc_addr;
   }
@@ -322,8 +578,16 @@ namespace BDB {
   pool::free(AddrType addr)
   { 
     using namespace detail;
+    ++version_;
+
+    phase_scope ps(PHASE_IO);
+    if(slab_) return slab_->free(addr);
+
+    ps.next(PHASE_COMMIT);
     id_handle_t hdl(RELEASE, *idpool_, addr);
     hdl.commit();
+    ps.next(PHASE_IO);
+    release_blocks(addr);
     return 0;
   }
 
@@ -331,9 +595,15 @@ namespace BDB {
   pool::erase(AddrType addr, uint32_t off, uint32_t size)
   { 
     using namespace detail;
-    
+    ++version_;
+
+    phase_scope ps(PHASE_IO);
+    if(slab_) return slab_->erase(addr, off, size);
+
+    ps.next(PHASE_HEADER);
     id_handle_t hdl(MODIFY, *idpool_, addr);
     uint32_t orig_size = hdl.value().size;
+    ps.next(PHASE_IO);
 
     if(off > orig_size) return orig_size;
 
@@ -349,16 +619,15 @@ namespace BDB {
 
     while(toRead > 0){
       readCnt = (toRead > my_buffer_::size()) ? my_buffer_::size() : toRead;
-      seek(addr, off + size + loopOff);
-      if(readCnt != s_read(mig_buf.buffer, readCnt, file_)){
+      if(readCnt != read_at(mig_buf.buffer, readCnt, 
+                            addr, off + size + loopOff))
+      {
         if(loopOff == 0)
           return orig_size;
         else
           throw data_currupted((data_currupted){addr});
       }
-      seek(addr, off + loopOff);
-      if(readCnt != s_write(mig_buf.buffer, readCnt, file_) ||
-         0 != fflush(file_))
+      if(!write_at(mig_buf.buffer, readCnt, addr, off + loopOff, true))
       {
         throw data_currupted((data_currupted){addr});
       }
@@ -367,6 +636,7 @@ namespace BDB {
     }
     
     hdl.value().size -= size;
+    ps.next(PHASE_COMMIT);
     hdl.commit();
 
     return hdl.value().size;
@@ -376,49 +646,509 @@ namespace BDB {
   pool::overwrite(char const* data, uint32_t size, AddrType addr, uint32_t off)
   {
     using namespace detail;
-    
+    ++version_;
+
+    if(slab_) return slab_->overwrite(data, size, addr, off);
+
     if(!idpool_->isAcquired(addr))
       throw invalid_addr();
 
-    seek(addr, off);
-
-    if(size != s_write(data, size, file_) ||
-       fflush(file_) )
+    if(!write_at(data, size, addr, off, true))
       throw data_currupted((data_currupted){addr});
 
     return size;
   }
 
-  off_t
-  pool::seek(AddrType addr, uint32_t off)
+  uint32_t
+  pool::scan_min_buffer() const
   {
-    off_t pos = addr;
-    pos *= addrEval.chunk_size_estimation(dirID);
-    pos += off;
-    fseeko(file_, pos, SEEK_SET);
-    return pos;
+    if(slab_) return slab_->max_size();
+    return addrEval.chunk_size_estimation(dirID);
+  }
+
+  uint32_t
+  pool::read_window(AddrType const *addrs, uint32_t count,
+                    char *buf, uint32_t buf_size, scan_item *items,
+                    std::vector<scan_run> *deferred)
+  {
+    using namespace detail;
+
+    uint32_t i(0), used(0);
+
+    if(slab_){
+      // records of a packed pool are small, read them one by one
+      while(i < count && used + slab_->max_size() <= buf_size){
+        items[i].off = used;
+        items[i].size = slab_->read(buf + used, buf_size - used, addrs[i]);
+        used += items[i].size;
+        ++i;
+      }
+      return i;
+    }
+
+    uint32_t chunk_size = addrEval.chunk_size_estimation(dirID);
+    
+    while(i < count && used + chunk_size <= buf_size){
+      // extend the run over chunks whose gap is small enough to read,
+      // chunks next to each other are in different files when striped
+      uint32_t run = 1;
+      while(1 == stripe_count_ && i + run < count){
+        unsigned long long span = 
+          (unsigned long long)(addrs[i + run] - addrs[i] + 1) * chunk_size;
+        if(used + span > buf_size ||
+           (addrs[i + run] - addrs[i + run - 1] - 1) * 
+           (unsigned long long)chunk_size >= SCAN_GAP_SIZ)
+          break;
+        ++run;
+      }
+      
+      for(uint32_t j = i; j < i + run; ++j){
+        items[j].off = used + (addrs[j] - addrs[i]) * chunk_size;
+        items[j].size = idpool_->Find(addrs[j]).size;
+      }
+
+      // the file may end within the last chunk
+      uint32_t last = i + run - 1;
+      scan_run r;
+      r.pos = addr_off2tell(addrs[i], 0);
+      r.stripe = addrs[i] % stripe_count_;
+      r.off = used;
+      r.len = (addrs[last] - addrs[i] + 1) * chunk_size;
+      r.need = items[last].off - used + items[last].size;
+      if(deferred){
+        deferred->push_back(r);
+      }else{
+        stripe &s = stripes_[r.stripe];
+        uint32_t got = s_pread(buf + used, r.len, r.pos, s.file);
+        s.count_read(got);
+        if(got < r.need)
+          throw std::runtime_error(SRC_POS);
+      }
+
+      used += r.len;
+      i += run;
+    }
+
+    // the buffer is shared by the stripes
+    for(unsigned int k = 0; i < count && k < stripe_count_; ++k){
+      off_t pos = stripe_size(addrs[i], k);
+      off_t end = stripe_size(addrs[count - 1] + 1, k);
+      if(end > pos)
+        s_readahead(stripes_[k].file, pos, 
+                    std::min<off_t>(buf_size / stripe_count_, end - pos));
+    }
+    return i;
+  }
+
+  bool
+  pool::read_runs(std::vector<scan_run> const &runs, char *buf,
+                  io_engine &engine) const
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    return runs.empty();
+#else
+    // pool files are flushed after each write, so the descriptor is 
+    // read without taking the FILE
+    std::vector<io_request> reqs(runs.size());
+    for(size_t i = 0; i < runs.size(); ++i){
+      reqs[i].op = IO_READ;
+      reqs[i].fd = fileno(stripes_[runs[i].stripe].file);
+      reqs[i].buf = buf + runs[i].off;
+      reqs[i].len = runs[i].len;
+      reqs[i].off = runs[i].pos;
+    }
+    if(!reqs.empty())
+      engine.run(&reqs[0], reqs.size());
+    bool rt = true;
+    for(size_t i = 0; i < runs.size(); ++i){
+      if(reqs[i].result < 0 || (uint32_t)reqs[i].result < runs[i].need){
+        rt = false;
+        continue;
+      }
+      stripes_[runs[i].stripe].count_read(reqs[i].result);
+    }
+    return rt;
+#endif
+  }
+
+  void
+  pool::compact_plan(uint32_t max_bytes, move_list *moves) const
+  {
+    if(slab_ || !moves) return;
+
+    uint32_t chunk_size = addrEval.chunk_size_estimation(dirID);
+    uint32_t planned(0);
+    AddrType from = idpool_->max_used();
+    AddrType to = idpool_->next_free(idpool_->begin());
+
+    while(planned < max_bytes){
+      from = idpool_->prev_used(from);
+      if(from == idpool_->end() || to >= from)
+        break;
+      moves->push_back(std::make_pair(from, to));
+      planned += chunk_size;
+      to = idpool_->next_free(to + 1);
+    }
+  }
+
+  AddrType
+  pool::relocate(AddrType from, AddrType to)
+  {
+    using namespace detail;
+    ++version_;
+    
+    if(slab_) throw invalid_addr();
+
+    id_handle_t src(READONLY, *idpool_, from);
+    id_handle_t dest(ACQUIRE_SPEC, *idpool_, to);
+    reserve_blocks(to);
+
+    viov vv;
+    vv.data = source(from);
+    vv.size = src.const_value().size;
+
+    stripe &s = stripe_of(to);
+    if(s.direct_fd >= 0)
+      s.count_write(writevv(&vv, 1, s.direct_fd, addr_off2tell(to, 0)));
+    else
+      s.count_write(writevv(&vv, 1, s.file, addr_off2tell(to, 0)));
+    
+    dest.value() = src.const_value();
+    dest.commit();
+    return to;
+  }
+
+  void
+  pool::relocate(move_list const &moves, std::vector<char> *buf,
+                 io_engine &engine)
+  {
+    using namespace detail;
+    ++version_;
+
+    if(slab_) throw invalid_addr();
+
+    bool direct = false;
+    size_t total = 0;
+    for(size_t i = 0; i < moves.size(); ++i){
+      if(!idpool_->isAcquired(moves[i].first) || 
+         idpool_->isAcquired(moves[i].second))
+        throw invalid_addr();
+      direct = direct || stripe_of(moves[i].second).direct_fd >= 0 ||
+        stripe_of(moves[i].first).direct_fd >= 0;
+      total += idpool_->Find(moves[i].first).size;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    direct = true;
+#endif
+    // direct descriptors take aligned buffers only
+    if(direct){
+      for(size_t i = 0; i < moves.size(); ++i)
+        relocate(moves[i].first, moves[i].second);
+      return;
+    }
+
+    if(buf->size() < total)
+      buf->resize(total);
+    for(size_t i = 0; i < moves.size(); ++i)
+      reserve_blocks(moves[i].second);
+
+    // pool files are flushed after each write, so descriptors are read
+    // and written without taking the FILEs
+    std::vector<io_request> reqs(moves.size());
+    size_t off = 0;
+    for(size_t i = 0; i < moves.size(); ++i){
+      reqs[i].op = IO_READ;
+      reqs[i].fd = fileno(stripe_of(moves[i].first).file);
+      reqs[i].buf = &(*buf)[off];
+      reqs[i].len = idpool_->Find(moves[i].first).size;
+      reqs[i].off = addr_off2tell(moves[i].first, 0);
+      off += reqs[i].len;
+    }
+    if(!reqs.empty())
+      engine.run(&reqs[0], reqs.size());
+    for(size_t i = 0; i < reqs.size(); ++i){
+      if(reqs[i].result < 0 || (uint32_t)reqs[i].result != reqs[i].len)
+        throw std::runtime_error(SRC_POS);
+      stripe_of(moves[i].first).count_read(reqs[i].len);
+
+      reqs[i].op = IO_WRITE;
+      reqs[i].fd = fileno(stripe_of(moves[i].second).file);
+      reqs[i].off = addr_off2tell(moves[i].second, 0);
+    }
+    if(!reqs.empty())
+      engine.run(&reqs[0], reqs.size());
+    for(size_t i = 0; i < reqs.size(); ++i){
+      if(reqs[i].result < 0 || (uint32_t)reqs[i].result != reqs[i].len)
+        throw std::runtime_error(SRC_POS);
+      stripe_of(moves[i].second).count_write(reqs[i].len);
+    }
+
+    for(size_t i = 0; i < moves.size(); ++i){
+      id_handle_t src(READONLY, *idpool_, moves[i].first);
+      id_handle_t dest(ACQUIRE_SPEC, *idpool_, moves[i].second);
+      dest.value() = src.const_value();
+      dest.commit();
+    }
+  }
+
+  unsigned long long
+  pool::shrink()
+  {
+    using namespace detail;
+    ++version_;
+
+    if(slab_) return 0;
+
+    // chunks whose release is not yet on the device keep their blocks
+    AddrType floor = 0;
+    for(size_t i = 0; i < deferred_.size(); ++i)
+      floor = std::max(floor, deferred_[i] + 1);
+    for(size_t i = 0; i < held_.size(); ++i)
+      floor = std::max(floor, held_[i].second + 1);
+
+    AddrType old_max = idpool_->max_used();
+    idpool_->shrink(floor);
+    
+    if(old_max == idpool_->max_used()) 
+      return 0;
+
+    for(unsigned int k = 0; k < stripe_count_; ++k){
+      stripe &s = stripes_[k];
+      off_t new_end = stripe_size(idpool_->max_used(), k);
+      if(s.mmap)
+        s.mmap->truncate(new_end);
+      if((off_t)s_file_size(s.file) > new_end && s_truncate(s.file, new_end))
+        throw std::runtime_error(SRC_POS);
+    }
+    extent_ = idpool_->max_used();
+
+    unsigned long long rt = old_max - idpool_->max_used();
+    return rt * addrEval.chunk_size_estimation(dirID);
   }
 
 
+  void
+  pool::sync()
+  {
+    using namespace detail;
+    int rt = slab_ ? s_sync(slab_->file_no()) : 0;
+    for(unsigned int k = 0; 0 == rt && k < stripe_count_; ++k)
+      rt = s_sync(stripes_[k].file);
+    if(rt)
+      throw std::runtime_error(SRC_POS);
+  }
+
   off_t
   pool::addr_off2tell(AddrType addr, uint32_t off) const
   {
-    off_t pos = addr;
+    off_t pos = addr / stripe_count_;
     pos *= addrEval.chunk_size_estimation(dirID);
     pos += off;
     return pos;
   }
 
+  off_t
+  pool::stripe_size(AddrType addr, unsigned int stripe) const
+  {
+    off_t chunks = 
+      addr > stripe ? (addr - stripe + stripe_count_ - 1) / stripe_count_ : 0;
+    return chunks * addrEval.chunk_size_estimation(dirID);
+  }
+
+  uint32_t
+  pool::read_at(char *dest, uint32_t size, AddrType addr, uint32_t off)
+  {
+    stripe &s = stripe_of(addr);
+    off_t pos = addr_off2tell(addr, off);
+    uint32_t rt;
+
+    // writes are flushed, so mappings are up to date. Ranges they do 
+    // not cover are read from the file.
+    if(s.direct_fd >= 0)
+      rt = detail::s_direct_pread(dest, size, pos, s.direct_fd);
+    else if(s.mmap && size == s.mmap->read(dest, size, pos))
+      rt = size;
+    // the FILE buffer reads a MIGBUF_SIZ ahead, whatever the hint
+    else if(hints_)
+      rt = detail::s_pread(dest, size, pos, s.file);
+    else{
+      detail::s_seek(s.file, pos, SEEK_SET);
+      rt = detail::s_read(dest, size, s.file);
+    }
+    s.count_read(rt);
+    return rt;
+  }
+
+  bool
+  pool::write_at(char const *src, uint32_t size, AddrType addr, 
+                 uint32_t off, bool keep_tail)
+  {
+    stripe &s = stripe_of(addr);
+    off_t pos = addr_off2tell(addr, off);
+    s.count_write(size);
+
+    if(s.direct_fd >= 0)
+      return size == detail::s_direct_pwrite(src, size, pos, s.direct_fd,
+                                             keep_tail);
+    if(hints_)
+      return size == detail::s_pwrite(src, size, pos, s.file);
+    detail::s_seek(s.file, pos, SEEK_SET);
+    return size == detail::s_write(src, size, s.file) && 
+      0 == detail::s_flush(s.file);
+  }
+
+  file_src
+  pool::source(AddrType addr) const
+  {
+    stripe const &s = stripe_of(addr);
+    file_src fs;
+    fs.fp = s.file;
+    fs.off = addr_off2tell(addr, 0);
+    fs.fd = s.direct_fd;
+    return fs;
+  }
+
   void
-  pool::pine(AddrType addr)
-  { idpool_->Lock(addr); }
+  pool::advise(detail::io_hint hint)
+  {
+    for(unsigned int k = 0; stripes_ && k < stripe_count_; ++k){
+      if(stripes_[k].mmap)
+        stripes_[k].mmap->advise(hint);
+      if(hints_)
+        detail::s_advise(fileno(stripes_[k].file), 0, 0, hint);
+    }
+  }
 
   void
-  pool::unpine(AddrType addr)
-  { idpool_->Unlock(addr); }
+  pool::drop_pages(AddrType addr, uint32_t off, off_t len)
+  {
+    using namespace detail;
 
-  bool
-  pool::is_pinned(AddrType addr)
-  { return idpool_->isLocked(addr); }
+    stripe &s = stripe_of(addr);
+    off_t pos = addr_off2tell(addr, off);
+
+    // dirty pages are written back instead of dropped, they are 
+    // dropped again once the range is DROPPED_RANGES calls old
+    int fd = fileno(s.file);
+    // mapped pages are not dropped
+    if(s.mmap)
+      s.mmap->advise(pos, len, HINT_DONTNEED);
+    s_advise(fd, pos, len, HINT_DONTNEED);
+    s.dropped.push_back(std::make_pair(pos, len));
+    if(s.dropped.size() > DROPPED_RANGES){
+      s_advise(fd, s.dropped.front().first, s.dropped.front().second, 
+               HINT_DONTNEED);
+      s.dropped.pop_front();
+    }
+  }
+
+  void
+  pool::release_blocks(AddrType addr)
+  {
+    if(wal_){
+      deferred_.push_back(addr);
+      return;
+    }
+    if(!punch_) return;
+    // best effort, the chunk is still freed when it's not supported
+    detail::s_punch_hole(stripe_of(addr).file, addr_off2tell(addr, 0), 
+                         addrEval.chunk_size_estimation(dirID));
+  }
+
+  void
+  pool::reserve_blocks(AddrType addr)
+  {
+    uint32_t chunk_size = addrEval.chunk_size_estimation(dirID);
+
+    if(addr >= extent_){
+      AddrType target = (*prealloc_func_)(
+        dirID, chunk_size, idpool_->max_used(), idpool_->size());
+      // best effort, fall back to extending by writes
+      bool grown = target > addr;
+      for(unsigned int k = 0; grown && k < stripe_count_; ++k){
+        off_t beg = stripe_size(extent_, k);
+        off_t end = stripe_size(target, k);
+        grown = end <= beg || 
+          0 == detail::s_preallocate(stripes_[k].file, beg, end - beg, 
+                                     false);
+      }
+      if(grown){
+        extent_ = target;
+        // the files grew, their mappings can read up to the new end
+        for(unsigned int k = 0; k < stripe_count_; ++k){
+          if(stripes_[k].mmap)
+            stripes_[k].mmap->extend(stripe_size(extent_, k));
+        }
+        return;
+      }
+      extent_ = addr + 1;
+    }
+
+    if(!deferred_.empty())
+      deferred_.erase(
+        std::remove(deferred_.begin(), deferred_.end(), addr), 
+        deferred_.end());
+    if(!punch_) return;
+    detail::s_preallocate(stripe_of(addr).file, addr_off2tell(addr, 0), 
+                          chunk_size, true);
+  }
+
+  void
+  pool::attach_wal(wal *log)
+  {
+    wal_ = log;
+    if(!idpool_) return;
+    char tag[16] = {};
+    sprintf(tag, "%04x", dirID);
+    idpool_->attach(log, tag);
+  }
+
+  void
+  pool::redo(std::istream &in)
+  {
+    if(!idpool_) 
+      throw std::runtime_error("pool: Log entry of a packed pool");
+    idpool_->redo(in);
+  }
+
+  void
+  pool::checkpoint(bool sync)
+  { if(idpool_) idpool_->checkpoint(sync); }
+
+  int
+  pool::file_no(unsigned int stripe) const
+  { return slab_ ? slab_->file_no() : fileno(stripes_[stripe].file); }
+
+  void
+  pool::release_deferred(unsigned long long ticket, 
+                         unsigned long long synced)
+  {
+    uint32_t chunk_size = addrEval.chunk_size_estimation(dirID);
+
+    // chunks freed by the record of ticket
+    for(size_t i = 0; i < deferred_.size(); ++i){
+      if(synced < ticket){
+        idpool_->Acquire(deferred_[i]);
+        held_.push_back(std::make_pair(ticket, deferred_[i]));
+      }else if(punch_){
+        detail::s_punch_hole(
+          stripe_of(deferred_[i]).file, addr_off2tell(deferred_[i], 0), 
+          chunk_size);
+      }
+    }
+    deferred_.clear();
+
+    size_t released = 0;
+    for(; released < held_.size() && held_[released].first <= synced; 
+        ++released)
+    {
+      AddrType addr = held_[released].second;
+      idpool_->Release(addr);
+      if(punch_)
+        detail::s_punch_hole(stripe_of(addr).file, addr_off2tell(addr, 0), 
+                             chunk_size);
+    }
+    held_.erase(held_.begin(), held_.begin() + released);
+  }
 
 } // end of BDB namespace
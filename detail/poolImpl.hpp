@@ -5,16 +5,34 @@
 #include "addr_eval.hpp"
 #include "fixedPool.hpp"
 #include "chunk.h"
+#include "file_utils.hpp"
 #include <string>
+#include <atomic>
 #include <cstdlib>
 #include <deque>
+#include <iosfwd>
 #include <utility>
+#include <vector>
 
 #define MIGBUF_SIZ (1<<20)
+// free chunks of this many bytes are skipped instead of read by a scan
+#define SCAN_GAP_SIZ (1<<16)
+// bytes read ahead by a scan
+#define SCAN_BUF_SIZ (1<<22)
+// bytes of a pool file scanned by a task of a parallel scan
+#define PSCAN_TASK_SIZ (1<<24)
+// written ranges dropped from the page cache again, see drop_pages()
+#define DROPPED_RANGES 8
 
 namespace BDB {
 
   struct viov;
+  struct file_src;
+  struct slab_pool;
+  class wal;
+  class io_engine;
+  struct io_request;
+  namespace detail { class mmap_reader; }
 
   template<typename T>
   class IDPool;
@@ -22,6 +40,13 @@ namespace BDB {
   template<typename T>
   struct id_handle;
 
+  /// Global address of the record a new chunk holds
+  struct chunk_owner
+  {
+    explicit chunk_owner(AddrType addr) : addr(addr) {}
+    AddrType addr;
+  };
+
   /// pool manager
   //! \callgraph
   struct pool
@@ -33,13 +58,50 @@ namespace BDB {
     {
       unsigned int dirID;
       std::string work_dir;
+      /// directories that chunks are striped over instead of work_dir,
+      /// chunk i in stripe_dirs[i % n]
+      std::vector<std::string> stripe_dirs;
       std::string trans_dir;
       std::string header_dir;
+      /// store records in a packed slab_pool
+      bool packed;
+      /// punch holes for freed chunks not smaller than this size
+      uint32_t punch_threshold;
+      /// pool file growth policy
+      Prealloc_est prealloc_func;
+      /// read the pool file through mappings
+      Mmap_test mmap_func;
+      /// read and write data with O_DIRECT for chunks not smaller
+      /// than this size
+      uint32_t direct_threshold;
+      /// tell the OS how the pool file is accessed
+      bool hints;
+      /// drop cached pages of written chunks not smaller than this
+      /// size, with hints
+      uint32_t dontneed_threshold;
       
-      config() : dirID(0)  {}
+      config() 
+      : dirID(0), packed(false), punch_threshold(0), 
+      prealloc_func(&default_prealloc_est), 
+      mmap_func(&default_mmap_test), direct_threshold(0),
+      hints(false), dontneed_threshold(0)
+      {}
     };
 
     pool(config const &conf, addr_eval<AddrType> &addrEval);
+
+    /** @brief Convert transaction files of pools to the current format
+     *  @param trans_dir Directory of the transaction files
+     *  @param dir_count Number of pools
+     *  @throw std::invalid_argument if the pools are of a newer format
+     *  @details The format is kept in trans_dir/pool_format. Before it, 
+     *  chunk headers had a size field only; their entries get an unknown 
+     *  owner and the .fpo files are rebuilt from the transaction files.
+     *  Pools are constructed after this.
+     */
+    static void
+    upgrade(std::string const &trans_dir, unsigned int dir_count);
+
     ~pool();
     
     /** @brief Write new data
@@ -49,6 +111,12 @@ namespace BDB {
      */
     AddrType
     write(char const* data, uint32_t size);
+
+    /** @brief Write new data of a record
+     *  @param owner Kept in the chunk header, see owner()
+     */
+    AddrType
+    write(char const* data, uint32_t size, chunk_owner owner);
     
     /** off = BDB::npos represents an append write
      */
@@ -56,7 +124,7 @@ namespace BDB {
     write(char const* data, uint32_t size, AddrType addr, uint32_t off=npos);
     
     AddrType
-    write(viov *vv, uint32_t len);
+    write(viov *vv, uint32_t len, chunk_owner owner = chunk_owner(npos));
     
     AddrType
     replace(char const *data, uint32_t size, AddrType addr);
@@ -66,7 +134,70 @@ namespace BDB {
     
     uint32_t
     read(std::string *buffer, uint32_t max, AddrType addr, uint32_t off=0);
+
+    /** @brief Prepare a read of a record range for an io_engine batch
+     *  @param buffer Resized to the bytes the request reads into it
+     *  @return false if the range is read by read() instead: records of
+     *  packed, direct and mapped pools, empty ranges, and platforms that
+     *  cannot read a file concurrently
+     */
+    bool
+    read_request(std::string *buffer, uint32_t max, AddrType addr, 
+                 uint32_t off, io_request *req);
+
+    /// Account a request of read_request() run, false if it was short
+    bool
+    read_done(AddrType addr, io_request const &req) const;
     
+    /// Size of data stored in a chunk
+    uint32_t
+    data_size(AddrType addr);
+
+    /** @brief Global address of the record in a chunk
+     *  @return npos for packed pools and chunks written without an owner
+     *  @details Copies made by merge_*() and relocate() keep the owner
+     *  of their source.
+     */
+    AddrType
+    owner(AddrType addr);
+
+    /** @brief Free slots of a packed pool no global address refers to
+     *  @param refs Sorted local addresses that global addresses refer to
+     *  @return Number of slots freed, 0 for other pools
+     */
+    uint32_t
+    reclaim(std::vector<AddrType> const &refs);
+
+    /// Change the owner of a chunk, ignored by packed pools
+    void
+    set_owner(AddrType addr, AddrType owner);
+
+    bool
+    packed() const
+    { return 0 != slab_; }
+
+    /// Data bypasses the page cache, see Config::direct_threshold
+    bool
+    direct() const
+    { return stripes_ && stripes_[0].direct_fd >= 0; }
+
+    /// Records are read through mappings, see Config::mmap_func
+    bool
+    mapped() const
+    { return stripes_ && 0 != stripes_[0].mmap; }
+
+    /// Number of files chunks are striped over, 1 for a packed pool
+    unsigned int
+    stripe_count() const
+    { return stripes_ ? stripe_count_ : 1; }
+
+    /** @brief Tell the OS how the pool file is read from now on
+     *  @details Ignored without Config::io_hints, except by mappings. 
+     *  Lookups are random, scans switch to HINT_SEQUENTIAL and back.
+     */
+    void
+    advise(detail::io_hint hint);
+
     AddrType
     merge_copy(
       char const* data, 
@@ -121,6 +252,137 @@ namespace BDB {
     uint32_t
     overwrite(char const* data, uint32_t size, AddrType addr, uint32_t off);
 
+    // --------- compaction -----------
+    
+    typedef std::vector<std::pair<AddrType, AddrType> > move_list;
+
+    /** @brief Plan chunk movements from the tail to free slots near 
+     *  the head of the pool file
+     *  @param max_bytes Maximum bytes (in chunk size) to be moved
+     *  @param moves Output (from, to) pairs in order of execution
+     *  @remark Packed pools are not compacted.
+     */
+    void
+    compact_plan(uint32_t max_bytes, move_list *moves) const;
+
+    /** @brief Copy a chunk to a free slot 
+     *  @return Address of the copy (the to parameter)
+     *  @throw invalid_addr if from is not acquired or to is acquired
+     */
+    AddrType
+    relocate(AddrType from, AddrType to);
+
+    /** @brief Copy chunks to free slots through an I/O engine
+     *  @param moves (from, to) pairs, each one as relocate()
+     *  @param buf Chunks are read into it, resized to hold them all
+     *  @param engine Engine the chunks are read and then written by,
+     *  as a batch each
+     *  @throw invalid_addr if a from is not acquired or a to is
+     *  @details Chunks of direct pools are copied by relocate().
+     */
+    void
+    relocate(move_list const &moves, std::vector<char> *buf,
+             io_engine &engine);
+
+    /** @brief Truncate pool file and ID table behind the last used chunk
+     *  @details Chunks held by release_deferred() are not truncated. With
+     *  a write-ahead log, the caller checkpoints the frees of the chunks
+     *  behind first.
+     *  @return Bytes reclaimed
+     */
+    unsigned long long
+    shrink();
+
+    /// Sync data files to the device
+    void
+    sync();
+
+    // --------- scanning -----------
+
+    /// Location of a record in a scan buffer
+    struct scan_item
+    {
+      uint32_t off;
+      uint32_t size;
+    };
+
+    /// A file range of a window left to read_runs()
+    struct scan_run
+    {
+      off_t pos;
+      unsigned int stripe;
+      uint32_t off;   ///< offset in the scan buffer
+      uint32_t len;
+      uint32_t need;  ///< bytes up to the end of the last record
+    };
+
+    /** @brief Read records into a buffer in file order
+     *  @param addrs Ascending local addresses of used chunks
+     *  @param count Number of addresses
+     *  @param buf Buffer not smaller than scan_min_buffer()
+     *  @param items Output locations of the records read
+     *  @param deferred If not 0, file ranges of chunks are appended to 
+     *  it instead of being read. Records of a packed pool are always read.
+     *  @return Number of leading addresses read, at least 1 if count > 0
+     *  @details Adjacent chunks are read by one call and runs of free 
+     *  chunks are skipped. The chunks behind the last one read are read
+     *  ahead by the OS.
+     */
+    uint32_t
+    read_window(AddrType const *addrs, uint32_t count, 
+                char *buf, uint32_t buf_size, scan_item *items,
+                std::vector<scan_run> *deferred = 0);
+
+    /** @brief Read file ranges deferred by read_window
+     *  @param engine Engine the ranges are read by as one batch
+     *  @return false if a range was read short or the platform cannot
+     *  read a file concurrently
+     *  @remark This method may run concurrently with other methods. 
+     *  Data read is valid if version() did not change meanwhile.
+     */
+    bool
+    read_runs(std::vector<scan_run> const &runs, char *buf, 
+              io_engine &engine) const;
+
+    /// Changes whenever data or headers of the pool change
+    unsigned long long
+    version() const
+    { return version_; }
+
+    uint32_t
+    scan_min_buffer() const;
+
+    // --------- write-ahead log -----------
+    /** @brief Log chunk header commits to a write-ahead log
+     *  @details Packed pools keep their headers in pages and are not
+     *  logged. Chunks freed by an operation are handed to 
+     *  release_deferred() after the log record freeing them is written.
+     */
+    void
+    attach_wal(wal *log);
+
+    /// Apply a chunk header entry of the write-ahead log
+    void
+    redo(std::istream &in);
+
+    /** @brief Write chunk headers logged since the last checkpoint
+     *  @param sync Sync them to the device
+     */
+    void
+    checkpoint(bool sync = false);
+
+    /** @brief Release disk blocks of chunks freed since the last call
+     *  @param ticket Log record that freed them
+     *  @param synced Records up to this ticket are on the device. Chunks
+     *  of later records are not reused and keep their blocks until then.
+     */
+    void
+    release_deferred(unsigned long long ticket, unsigned long long synced);
+
+    /// Descriptor of a file holding data, pages of a packed pool
+    int
+    file_no(unsigned int stripe = 0) const;
+
     // --------- misc -----------
     void
     pine(AddrType addr);
@@ -133,11 +395,73 @@ namespace BDB {
     
   private:
 
-    off_t
-    seek(AddrType addr, uint32_t off =0);
+    // a pool file, one per directory chunks are striped over
+    struct stripe
+    {
+      FILE *file;
+      char *buf;
+      // the file opened with O_DIRECT, -1 for buffered data
+      int direct_fd;
+      // reads of the file, 0 when it's read through file
+      detail::mmap_reader *mmap;
+      // ranges dropped lately, their dirty pages stay cached until
+      // written back and are dropped again by a later drop_pages()
+      std::deque<std::pair<off_t, off_t> > dropped;
+      // I/O of data, see Stat::device_reads
+      std::atomic<unsigned long long> reads, read_bytes;
+      std::atomic<unsigned long long> writes, written_bytes;
+
+      stripe();
+      ~stripe();
+
+      void
+      count_read(uint32_t size);
 
+      void
+      count_write(uint32_t size);
+    };
+
+    void
+    open_stripe(stripe *s, std::string const &dir, config const &conf);
+
+    stripe &
+    stripe_of(AddrType addr) const
+    { return stripes_[addr % stripe_count_]; }
+
+    // position in the file of its stripe
     off_t
     addr_off2tell(AddrType addr, uint32_t off) const;
+
+    // bytes of a stripe file holding the chunks below addr
+    off_t
+    stripe_size(AddrType addr, unsigned int stripe) const;
+
+    // read or write data of a chunk, through the direct descriptor of
+    // a direct pool
+    uint32_t
+    read_at(char *dest, uint32_t size, AddrType addr, uint32_t off);
+
+    // keep_tail: keep the bytes behind data in a direct block
+    bool
+    write_at(char const *src, uint32_t size, AddrType addr, uint32_t off,
+             bool keep_tail);
+
+    file_src
+    source(AddrType addr) const;
+
+    // drop cached pages of a chunk range written or moved out once,
+    // see Config::dontneed_threshold
+    void
+    drop_pages(AddrType addr, uint32_t off, off_t len);
+
+    // release disk blocks of a freed chunk 
+    void
+    release_blocks(AddrType addr);
+
+    // allocate disk blocks of a (re)acquired chunk and 
+    // preallocate the file ahead when addr is beyond the extent
+    void
+    reserve_blocks(AddrType addr);
     
     /*
     void lock_acq();
@@ -152,15 +476,56 @@ namespace BDB {
     unsigned int dirID;
     std::string work_dir;
     std::string trans_dir;
+    bool punch_;
+    Prealloc_est prealloc_func_;
+    // number of chunks covered by the pool files
+    AddrType extent_;
     
-    // pool file
-    FILE *file_;
-    char *file_buf_;
+    // pool files, 0 for a packed pool
+    stripe *stripes_;
+    unsigned int stripe_count_;
+    // see Config::io_hints, drop_ for written chunks
+    bool hints_, drop_;
     
-    typedef IDPool<fixed_pool<ChunkHeader,8> > idpool_t;
+    typedef IDPool<fixed_pool<ChunkHeader, CHUNK_HEADER_SIZ> > idpool_t;
     typedef id_handle<idpool_t> id_handle_t;
 
     idpool_t *idpool_;
+    
+    // packed small-object storage, replaces file_ and idpool_
+    slab_pool *slab_;
+
+    wal *wal_;
+    // chunks whose blocks are released by release_deferred()
+    std::vector<AddrType> deferred_;
+    // chunks waiting for their (ticket of) records to be synced
+    std::deque<std::pair<unsigned long long, AddrType> > held_;
+
+    unsigned long long version_;
+  };
+
+  /// Pools read sequentially while a scan runs, see pool::advise
+  struct sequential_scope
+  {
+    sequential_scope(pool *pools, unsigned int count)
+    : pools_(pools), count_(count)
+    {
+      for(unsigned int i = 0; i < count_; ++i)
+        pools_[i].advise(detail::HINT_SEQUENTIAL);
+    }
+
+    ~sequential_scope()
+    {
+      for(unsigned int i = 0; i < count_; ++i)
+        pools_[i].advise(detail::HINT_RANDOM);
+    }
+
+  private:
+    sequential_scope(sequential_scope const &cp);
+    sequential_scope& operator=(sequential_scope const &cp);
+
+    pool *pools_;
+    unsigned int count_;
   };
 } // end of namespace BDB
 
@@ -0,0 +1,374 @@
+#include "sharded.hpp"
+#include "bdb.hpp"
+#include "exception.hpp"
+#include "async.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <stdexcept>
+
+namespace BDB {
+
+  struct ShardedImpl
+  {
+    struct shard
+    {
+      BehaviorDB *db;
+      AddrType beg, end;
+      // runs the batches and scans of the shard
+      async_executor worker;
+
+      shard() : db(0), beg(0), end(0) {}
+    };
+
+    // in the order of configurations
+    std::vector<shard*> shards;
+    // shards in the order of their ranges
+    std::vector<size_t> by_range;
+    ShardRouting routing;
+    std::atomic<unsigned int> next;
+
+    ShardedImpl() : routing(SHARD_HASH), next(0) {}
+
+    ~ShardedImpl()
+    {
+      // queued operations still use the BehaviorDBs
+      for(size_t i = 0; i < shards.size(); ++i)
+        shards[i]->worker.stop();
+      for(size_t i = 0; i < shards.size(); ++i){
+        delete shards[i]->db;
+        delete shards[i];
+      }
+    }
+
+    size_t
+    route(char const *data, uint32_t size)
+    {
+      if(SHARD_ROUND_ROBIN == routing)
+        return next.fetch_add(1, std::memory_order_relaxed) % shards.size();
+      // FNV-1a
+      unsigned long long h = 14695981039346656037ULL;
+      for(uint32_t i = 0; i < size; ++i){
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+      }
+      // low bits of FNV follow those of the last bytes only
+      return (h ^ (h >> 32)) % shards.size();
+    }
+
+    /* Run op(shard, items) by the worker of each shard that has items,
+     * and wait for all. Exceptions are rethrown afterwards, the one of
+     * the first shard first.
+     */
+    template<typename Op>
+    void
+    run(std::vector<std::vector<size_t> > const &groups, Op const &op)
+    {
+      std::vector<std::future<void> > done;
+      for(size_t s = 0; s < shards.size(); ++s){
+        if(groups[s].empty()) continue;
+        std::shared_ptr<std::promise<void> > p(new std::promise<void>);
+        done.push_back(p->get_future());
+        std::vector<size_t> const *items = &groups[s];
+        shards[s]->worker.submit(npos, [p, &op, s, items]() {
+          try {
+            op(s, *items);
+            p->set_value();
+          }catch(...){
+            p->set_exception(std::current_exception());
+          }
+        });
+      }
+      for(size_t i = 0; i < done.size(); ++i)
+        done[i].wait();
+      for(size_t i = 0; i < done.size(); ++i)
+        done[i].get();
+    }
+
+    /* Run op(item) for the items of a shard, all of them whatever
+     * fails, then rethrow the first exception.
+     */
+    template<typename Op>
+    static void
+    each(std::vector<size_t> const &items, Op const &op)
+    {
+      std::exception_ptr error;
+      for(size_t i = 0; i < items.size(); ++i){
+        try {
+          op(items[i]);
+        }catch(...){
+          if(!error) error = std::current_exception();
+        }
+      }
+      if(error)
+        std::rethrow_exception(error);
+    }
+  };
+
+  namespace {
+    // a scan callback shared by the scans of all shards
+    struct scan_context
+    {
+      Scan_func fn;
+      void *arg;
+      std::atomic<bool> stop;
+    };
+
+    bool
+    scan_shard(AddrType addr, char const *data, uint32_t size, void *arg)
+    {
+      scan_context *ctx = (scan_context*)arg;
+      if(ctx->stop.load(std::memory_order_relaxed))
+        return false;
+      if(!ctx->fn(addr, data, size, ctx->arg)){
+        ctx->stop = true;
+        return false;
+      }
+      return true;
+    }
+  }
+
+  ShardedBehaviorDB::ShardedBehaviorDB(std::vector<Config> const &shards,
+                                       ShardRouting routing)
+  : impl_(new ShardedImpl)
+  {
+    using namespace std;
+
+    unique_ptr<ShardedImpl> impl(impl_);
+    impl_->routing = routing;
+
+    if(shards.empty())
+      throw invalid_argument("ShardedBehaviorDB: no shard");
+
+    for(size_t i = 0; i < shards.size(); ++i)
+      impl_->by_range.push_back(i);
+    sort(impl_->by_range.begin(), impl_->by_range.end(),
+         [&shards](size_t a, size_t b) {
+           return shards[a].beg < shards[b].beg; 
+         });
+    for(size_t i = 1; i < shards.size(); ++i){
+      if(shards[impl_->by_range[i - 1]].end > shards[impl_->by_range[i]].beg)
+        throw invalid_argument("ShardedBehaviorDB: address ranges of shards overlap");
+      for(size_t j = 0; j < i; ++j){
+        if(shards[i].root_dir == shards[j].root_dir)
+          throw invalid_argument("ShardedBehaviorDB: shards share a root_dir");
+      }
+    }
+
+    for(size_t i = 0; i < shards.size(); ++i){
+      impl_->shards.push_back(new ShardedImpl::shard);
+      ShardedImpl::shard &s = *impl_->shards.back();
+      s.db = new BehaviorDB(shards[i]);
+      s.beg = shards[i].beg;
+      s.end = shards[i].end;
+      s.worker.start(1, shards[i].async_queue_size);
+    }
+    impl.release();
+  }
+
+  ShardedBehaviorDB::~ShardedBehaviorDB()
+  { delete impl_; }
+
+  std::vector<Config>
+  ShardedBehaviorDB::split(Config const &conf,
+                           std::vector<std::string> const &root_dirs)
+  {
+    AddrType n = root_dirs.size();
+    if(0 == n || conf.end - conf.beg < n)
+      throw std::invalid_argument("ShardedBehaviorDB: fewer addresses than shards");
+
+    AddrType step = (conf.end - conf.beg) / n;
+    std::vector<Config> rt(n, conf);
+    for(AddrType i = 0; i < n; ++i){
+      rt[i].beg = conf.beg + i * step;
+      rt[i].end = (i + 1 == n) ? conf.end : rt[i].beg + step;
+      rt[i].root_dir = root_dirs[i];
+    }
+    return rt;
+  }
+
+  size_t
+  ShardedBehaviorDB::shard_count() const
+  { return impl_->shards.size(); }
+
+  BehaviorDB &
+  ShardedBehaviorDB::shard(size_t i)
+  { return *impl_->shards.at(i)->db; }
+
+  size_t
+  ShardedBehaviorDB::shard_of(AddrType addr) const
+  {
+    std::vector<size_t> const &order = impl_->by_range;
+    std::vector<ShardedImpl::shard*> const &shards = impl_->shards;
+
+    // the last shard that begins at or before addr
+    size_t lo = 0, hi = order.size();
+    while(lo < hi){
+      size_t mid = (lo + hi) / 2;
+      if(shards[order[mid]]->beg <= addr)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if(0 == lo || addr >= shards[order[lo - 1]]->end)
+      throw invalid_addr();
+    return order[lo - 1];
+  }
+
+  AddrType
+  ShardedBehaviorDB::put(char const *data, uint32_t size)
+  { return impl_->shards[impl_->route(data, size)]->db->put(data, size); }
+
+  AddrType
+  ShardedBehaviorDB::put(std::string const &data)
+  { return put(data.data(), data.size()); }
+
+  AddrType
+  ShardedBehaviorDB::put(std::string const &data, AddrType addr,
+                         uint32_t off)
+  { return impl_->shards[shard_of(addr)]->db->put(data, addr, off); }
+
+  AddrType
+  ShardedBehaviorDB::update(std::string const &data, AddrType addr)
+  { return impl_->shards[shard_of(addr)]->db->update(data, addr); }
+
+  uint32_t
+  ShardedBehaviorDB::get(std::string *output, uint32_t max, AddrType addr,
+                         uint32_t off)
+  { return impl_->shards[shard_of(addr)]->db->get(output, max, addr, off); }
+
+  uint32_t
+  ShardedBehaviorDB::del(AddrType addr)
+  { return impl_->shards[shard_of(addr)]->db->del(addr); }
+
+  void
+  ShardedBehaviorDB::put(std::vector<std::string> const &data,
+                         std::vector<AddrType> *addrs)
+  {
+    std::vector<std::vector<size_t> > groups(impl_->shards.size());
+    for(size_t i = 0; i < data.size(); ++i)
+      groups[impl_->route(data[i].data(), data[i].size())].push_back(i);
+
+    addrs->assign(data.size(), npos);
+    ShardedImpl *impl = impl_;
+    impl_->run(groups, [impl, &data, addrs](size_t s,
+                                            std::vector<size_t> const &items) {
+      BehaviorDB &db = *impl->shards[s]->db;
+      ShardedImpl::each(items, [&](size_t i) {
+        (*addrs)[i] = db.put(data[i]);
+      });
+    });
+  }
+
+  void
+  ShardedBehaviorDB::get(std::vector<AddrType> const &addrs,
+                         std::vector<std::string> *output)
+  {
+    std::vector<std::vector<size_t> > groups(impl_->shards.size());
+    for(size_t i = 0; i < addrs.size(); ++i)
+      groups[shard_of(addrs[i])].push_back(i);
+
+    output->assign(addrs.size(), std::string());
+    ShardedImpl *impl = impl_;
+    impl_->run(groups, [impl, &addrs, output](size_t s,
+                                              std::vector<size_t> const &items) {
+      // one batch of the shard, see BehaviorDB::get
+      std::vector<AddrType> mine(items.size());
+      for(size_t k = 0; k < items.size(); ++k)
+        mine[k] = addrs[items[k]];
+      std::vector<std::string> records;
+      std::exception_ptr error;
+      try {
+        impl->shards[s]->db->get(mine, &records);
+      }catch(...){
+        error = std::current_exception();
+      }
+      for(size_t k = 0; k < records.size(); ++k)
+        (*output)[items[k]].swap(records[k]);
+      if(error)
+        std::rethrow_exception(error);
+    });
+  }
+
+  void
+  ShardedBehaviorDB::del(std::vector<AddrType> const &addrs)
+  {
+    std::vector<std::vector<size_t> > groups(impl_->shards.size());
+    for(size_t i = 0; i < addrs.size(); ++i)
+      groups[shard_of(addrs[i])].push_back(i);
+
+    ShardedImpl *impl = impl_;
+    impl_->run(groups, [impl, &addrs](size_t s,
+                                      std::vector<size_t> const &items) {
+      BehaviorDB &db = *impl->shards[s]->db;
+      ShardedImpl::each(items, [&](size_t i) {
+        db.del(addrs[i]);
+      });
+    });
+  }
+
+  unsigned long long
+  ShardedBehaviorDB::scan(Scan_func fn, void *arg)
+  {
+    scan_context ctx;
+    ctx.fn = fn;
+    ctx.arg = arg;
+    ctx.stop = false;
+
+    // one item per shard
+    std::vector<std::vector<size_t> > groups(impl_->shards.size());
+    std::vector<unsigned long long> counts(impl_->shards.size(), 0);
+    for(size_t s = 0; s < groups.size(); ++s)
+      groups[s].push_back(s);
+
+    ShardedImpl *impl = impl_;
+    impl_->run(groups, [impl, &ctx, &counts](size_t s,
+                                             std::vector<size_t> const &) {
+      counts[s] = impl->shards[s]->db->scan(&scan_shard, &ctx);
+    });
+
+    unsigned long long rt(0);
+    for(size_t s = 0; s < counts.size(); ++s)
+      rt += counts[s];
+    return rt;
+  }
+
+  ScanStat
+  ShardedBehaviorDB::parallel_scan(Scan_func fn, void *arg,
+                                   unsigned int threads)
+  {
+    typedef std::chrono::steady_clock clock_type;
+    clock_type::time_point beg = clock_type::now();
+
+    scan_context ctx;
+    ctx.fn = fn;
+    ctx.arg = arg;
+    ctx.stop = false;
+
+    std::vector<std::vector<size_t> > groups(impl_->shards.size());
+    std::vector<ScanStat> stats(impl_->shards.size());
+    for(size_t s = 0; s < groups.size(); ++s)
+      groups[s].push_back(s);
+
+    ShardedImpl *impl = impl_;
+    impl_->run(groups, [impl, &ctx, &stats, threads](
+                 size_t s, std::vector<size_t> const &) {
+      stats[s] = impl->shards[s]->db->parallel_scan(&scan_shard, &ctx,
+                                                    threads);
+    });
+
+    ScanStat rt;
+    for(size_t s = 0; s < stats.size(); ++s){
+      rt.records += stats[s].records;
+      rt.bytes += stats[s].bytes;
+      rt.retries += stats[s].retries;
+      rt.moved += stats[s].moved;
+    }
+    rt.seconds = std::chrono::duration<double>(clock_type::now() - beg).count();
+    return rt;
+  }
+
+} // end of namespace BDB
@@ -0,0 +1,534 @@
+#include "slabPool.hpp"
+#include "poolImpl.hpp"
+#include "v_iovec.hpp"
+#include "file_utils.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+namespace BDB {
+
+  slab_pool::slab_pool(unsigned int dirID, std::string const& work_dir,
+                       uint32_t max_size, unsigned int addr_len)
+  : dirID(dirID), max_size_(max_size), max_pages_(0),
+    file_(0), file_buf_(0), used_bytes_(0)
+  {
+    using namespace std;
+
+    if(0 == max_size_ || max_size_ >
+       SLAB_PAGE_SIZ - sizeof(slab_page_header) - sizeof(slab_slot))
+      throw invalid_argument("slab_pool: invalid maximum record size");
+
+    max_pages_ = (addr_len > 31 + SLAB_SLOT_BITS) ?
+      (uint32_t)-1 : 1u << (addr_len - SLAB_SLOT_BITS);
+
+    char fname[256] = {};
+    if(work_dir.size() > 240)
+      throw length_error("slab_pool: length of pool_dir string is too long");
+
+    sprintf(fname, "%s%04x.slab", work_dir.c_str(), dirID);
+    if(0 == (file_ = fopen(fname, "r+b"))){
+      if(0 == (file_ = fopen(fname, "w+b"))){
+        string msg("slab_pool: Unable to create slab file ");
+        msg += fname;
+        throw invalid_argument(msg.c_str());
+      }
+    }
+
+    file_buf_ = new char[SLAB_BUF_SIZ];
+    if(0 != setvbuf(file_, file_buf_, _IOFBF, SLAB_BUF_SIZ))
+      throw runtime_error("slab_pool: setvbuf to slab file failed");
+
+    recover();
+  }
+
+  slab_pool::~slab_pool()
+  {
+    fclose(file_);
+    delete [] file_buf_;
+  }
+
+  AddrType
+  slab_pool::write(char const* data, uint32_t size)
+  {
+    using namespace detail;
+
+    if(size > max_size_)
+      throw addr_overflow();
+
+    slab_slot slot;
+    AddrType addr = alloc(size, slot);
+
+    // allow data = 0 to act as allocation
+    detail::s_seek(file_, data_pos(addr, slot), SEEK_SET);
+    if(0 != data && size != s_write(data, size, file_))
+      throw std::runtime_error(SRC_POS);
+
+    slot.size = size;
+    slot.used = 1;
+    store(slot, addr);
+    if(detail::s_flush(file_))
+      throw std::runtime_error(SRC_POS);
+
+    used_bytes_ += size;
+    return addr;
+  }
+
+  AddrType
+  slab_pool::write(char const* data, uint32_t size, AddrType addr, uint32_t off)
+  {
+    using namespace detail;
+
+    slab_slot slot = load(addr);
+    // reserve and migrate write nothing, from no data
+    if(0 == size)
+      return addr;
+
+    uint32_t nsize = slot.size + size;
+
+    if(nsize > max_size_)
+      throw internal_chunk_overflow((internal_chunk_overflow){slot.size});
+
+    off = (npos == off || off > slot.size) ? slot.size : off;
+
+    char buf[SLAB_PAGE_SIZ];
+
+    if(nsize <= slot.cap){ // in place
+      uint32_t tail = slot.size - off;
+      detail::s_seek(file_, data_pos(addr, slot, off), SEEK_SET);
+      if(tail != s_read(buf + size, tail, file_))
+        throw data_currupted((data_currupted){addr});
+      memcpy(buf, data, size);
+      detail::s_seek(file_, data_pos(addr, slot, off), SEEK_SET);
+      if(size + tail != s_write(buf, size + tail, file_))
+        throw data_currupted((data_currupted){addr});
+      slot.size = nsize;
+      store(slot, addr);
+      if(detail::s_flush(file_))
+        throw data_currupted((data_currupted){addr});
+      used_bytes_ += size;
+      return addr;
+    }
+
+    // relocate to a slot of larger class
+    detail::s_seek(file_, data_pos(addr, slot), SEEK_SET);
+    if(slot.size != s_read(buf, slot.size, file_))
+      throw data_currupted((data_currupted){addr});
+    memmove(buf + off + size, buf + off, slot.size - off);
+    memcpy(buf + off, data, size);
+
+    AddrType rt = write(buf, nsize);
+    release(addr, slot);
+    if(detail::s_flush(file_))
+      throw std::runtime_error(SRC_POS);
+    return rt;
+  }
+
+  AddrType
+  slab_pool::write(viov *vv, uint32_t len)
+  {
+    uint32_t size(0);
+    for(uint32_t i=0; i<len; ++i)
+      size += vv[i].size;
+
+    if(size > max_size_)
+      throw addr_overflow();
+
+    slab_slot slot;
+    AddrType addr = alloc(size, slot);
+
+    writevv(vv, len, file_, data_pos(addr, slot));
+
+    slot.size = size;
+    slot.used = 1;
+    store(slot, addr);
+    if(detail::s_flush(file_))
+      throw std::runtime_error(SRC_POS);
+
+    used_bytes_ += size;
+    return addr;
+  }
+
+  AddrType
+  slab_pool::replace(char const *data, uint32_t size, AddrType addr)
+  {
+    using namespace detail;
+
+    slab_slot slot = load(addr);
+
+    if(size > max_size_)
+      throw internal_chunk_overflow((internal_chunk_overflow){slot.size});
+
+    if(size > slot.cap){
+      AddrType rt = write(data, size);
+      release(addr, slot);
+      if(detail::s_flush(file_))
+        throw std::runtime_error(SRC_POS);
+      return rt;
+    }
+
+    detail::s_seek(file_, data_pos(addr, slot), SEEK_SET);
+    if(size != s_write(data, size, file_))
+      throw data_currupted((data_currupted){addr});
+
+    used_bytes_ += size;
+    used_bytes_ -= slot.size;
+    slot.size = size;
+    store(slot, addr);
+    if(detail::s_flush(file_))
+      throw data_currupted((data_currupted){addr});
+
+    return addr;
+  }
+
+  uint32_t
+  slab_pool::read(char* buffer, uint32_t size, AddrType addr, uint32_t off)
+  {
+    using namespace detail;
+
+    slab_slot slot = load(addr);
+
+    if(off > slot.size)
+      return 0;
+
+    uint32_t toRead = (size > slot.size - off) ? slot.size - off : size;
+
+    detail::s_seek(file_, data_pos(addr, slot, off), SEEK_SET);
+    return s_read(buffer, toRead, file_);
+  }
+
+  uint32_t
+  slab_pool::data_size(AddrType addr) const
+  { return load(addr).size; }
+
+  uint32_t
+  slab_pool::read(std::string *buffer, uint32_t max, AddrType addr, uint32_t off)
+  {
+    using namespace detail;
+
+    if(!buffer) return 0;
+    if(buffer->size()) buffer->clear();
+
+    slab_slot slot = load(addr);
+
+    if(off > slot.size)
+      return 0;
+
+    uint32_t toRead = (max > slot.size - off) ? slot.size - off : max;
+
+    buffer->resize(toRead);
+    detail::s_seek(file_, data_pos(addr, slot, off), SEEK_SET);
+    toRead = s_read(&(*buffer)[0], toRead, file_);
+    buffer->resize(toRead);
+    return toRead;
+  }
+
+  AddrType
+  slab_pool::merge_copy(char const* data, uint32_t size, AddrType src_addr,
+                        uint32_t off, pool* dest_pool)
+  {
+    slab_slot slot = load(src_addr);
+
+    viov vv[3];
+    file_src fs;
+    fs.fp = file_;
+    fs.off = data_pos(src_addr, slot);
+
+    uint32_t len = merge_viov(vv, fs, slot.size, data, size, off);
+
+    return dest_pool->write(vv, len);
+  }
+
+  AddrType
+  slab_pool::merge_move(char const* data, uint32_t size, AddrType src_addr,
+                        uint32_t off, pool* dest_pool)
+  {
+    slab_slot slot = load(src_addr);
+
+    AddrType loc_addr = merge_copy(data, size, src_addr, off, dest_pool);
+
+    release(src_addr, slot);
+    if(detail::s_flush(file_))
+      throw std::runtime_error(SRC_POS);
+
+    return loc_addr;
+  }
+
+  AddrType
+  slab_pool::merge_erase(uint32_t size, AddrType src_addr, uint32_t off,
+                         pool* dest_pool)
+  {
+    slab_slot slot = load(src_addr);
+
+    off = npos == off ? slot.size : off;
+
+    if(off > slot.size)
+      return src_addr;
+
+    viov vv[2];
+    file_src fs;
+    fs.fp = file_;
+    fs.off = data_pos(src_addr, slot);
+
+    uint32_t len = erase_viov(vv, fs, slot.size, size, off);
+
+    return dest_pool->write(vv, len);
+  }
+
+  uint32_t
+  slab_pool::free(AddrType addr)
+  {
+    slab_slot slot = load(addr);
+    release(addr, slot);
+    if(detail::s_flush(file_))
+      throw std::runtime_error(SRC_POS);
+    return 0;
+  }
+
+  uint32_t
+  slab_pool::erase(AddrType addr, uint32_t off, uint32_t size)
+  {
+    using namespace detail;
+
+    slab_slot slot = load(addr);
+
+    if(off > slot.size) return slot.size;
+
+    // overflow check
+    size = (off + size > off) ?
+      (off + size > slot.size) ? slot.size - off : size
+      : slot.size - off;
+
+    char buf[SLAB_PAGE_SIZ];
+    uint32_t tail = slot.size - size - off;
+
+    detail::s_seek(file_, data_pos(addr, slot, off + size), SEEK_SET);
+    if(tail != s_read(buf, tail, file_))
+      throw data_currupted((data_currupted){addr});
+    detail::s_seek(file_, data_pos(addr, slot, off), SEEK_SET);
+    if(tail != s_write(buf, tail, file_))
+      throw data_currupted((data_currupted){addr});
+
+    slot.size -= size;
+    used_bytes_ -= size;
+    store(slot, addr);
+    if(detail::s_flush(file_))
+      throw data_currupted((data_currupted){addr});
+
+    return slot.size;
+  }
+
+  uint32_t
+  slab_pool::overwrite(char const* data, uint32_t size, AddrType addr, uint32_t off)
+  {
+    using namespace detail;
+
+    slab_slot slot = load(addr);
+
+    if(off + size > slot.cap || off + size < off)
+      throw internal_chunk_overflow((internal_chunk_overflow){slot.size});
+
+    detail::s_seek(file_, data_pos(addr, slot, off), SEEK_SET);
+    if(size != s_write(data, size, file_) || detail::s_flush(file_))
+      throw data_currupted((data_currupted){addr});
+
+    return size;
+  }
+
+  uint32_t
+  slab_pool::max_size() const
+  { return max_size_; }
+
+  uint32_t
+  slab_pool::reclaim(std::vector<AddrType> const &refs)
+  {
+    uint32_t rt(0);
+    for(uint32_t page = 0; page < pages_.size(); ++page){
+      for(uint32_t i = 0; i < pages_[page].nslots; ++i){
+        AddrType addr = page << SLAB_SLOT_BITS | i;
+        slab_slot slot = load(addr, false);
+        if(!slot.used || std::binary_search(refs.begin(), refs.end(), addr))
+          continue;
+        release(addr, slot);
+        ++rt;
+      }
+    }
+    if(rt && detail::s_flush(file_))
+      throw std::runtime_error(SRC_POS);
+    return rt;
+  }
+
+  AddrType
+  slab_pool::alloc(uint32_t size, slab_slot &slot)
+  {
+    uint16_t cls = size_class(size);
+
+    std::map<uint16_t, std::vector<AddrType> >::iterator
+      iter = free_slots_.find(cls);
+
+    if(free_slots_.end() != iter && !iter->second.empty()){
+      AddrType addr = iter->second.back();
+      iter->second.pop_back();
+      slot = load(addr, false);
+      return addr;
+    }
+
+    // take room from the last page or open a new one
+    uint32_t page = pages_.size();
+    if(page){
+      slab_page_header const &last = pages_.back();
+      if(last.nslots < SLAB_MAX_SLOTS &&
+         last.top >= cls + sizeof(slab_page_header) +
+         (last.nslots + 1) * sizeof(slab_slot))
+      {
+        page--;
+      }
+    }
+
+    if(page == pages_.size()){
+      if(page >= max_pages_)
+        throw addr_overflow();
+      slab_page_header ph = { 0, SLAB_PAGE_SIZ, 0 };
+      pages_.push_back(ph);
+    }
+
+    slab_page_header &ph = pages_[page];
+    AddrType addr = page << SLAB_SLOT_BITS | ph.nslots;
+
+    ph.top -= cls;
+    ph.nslots++;
+
+    slot.off = ph.top;
+    slot.cap = cls;
+    slot.size = 0;
+    slot.used = 0;
+
+    store(slot, addr);
+    store(ph, page);
+
+    return addr;
+  }
+
+  void
+  slab_pool::release(AddrType addr, slab_slot &slot)
+  {
+    used_bytes_ -= slot.size;
+    slot.used = 0;
+    slot.size = 0;
+    store(slot, addr);
+    free_slots_[slot.cap].push_back(addr);
+  }
+
+  slab_slot
+  slab_pool::load(AddrType addr, bool used) const
+  {
+    using namespace detail;
+
+    uint32_t page = addr >> SLAB_SLOT_BITS;
+    uint32_t idx = addr & (SLAB_MAX_SLOTS - 1);
+
+    if(page >= pages_.size() || idx >= pages_[page].nslots)
+      throw invalid_addr();
+
+    off_t pos = page;
+    pos *= SLAB_PAGE_SIZ;
+    pos += sizeof(slab_page_header) + idx * sizeof(slab_slot);
+
+    slab_slot slot;
+    detail::s_seek(file_, pos, SEEK_SET);
+    if(sizeof(slot) != s_read((char*)&slot, sizeof(slot), file_))
+      throw std::runtime_error(SRC_POS);
+
+    if(used && !slot.used)
+      throw invalid_addr();
+
+    return slot;
+  }
+
+  void
+  slab_pool::store(slab_slot const &slot, AddrType addr)
+  {
+    using namespace detail;
+
+    off_t pos = addr >> SLAB_SLOT_BITS;
+    pos *= SLAB_PAGE_SIZ;
+    pos += sizeof(slab_page_header) +
+      (addr & (SLAB_MAX_SLOTS - 1)) * sizeof(slab_slot);
+
+    detail::s_seek(file_, pos, SEEK_SET);
+    if(sizeof(slot) != s_write((char const*)&slot, sizeof(slot), file_))
+      throw std::runtime_error(SRC_POS);
+  }
+
+  void
+  slab_pool::store(slab_page_header const &ph, uint32_t page)
+  {
+    using namespace detail;
+
+    off_t pos = page;
+    pos *= SLAB_PAGE_SIZ;
+
+    detail::s_seek(file_, pos, SEEK_SET);
+    if(sizeof(ph) != s_write((char const*)&ph, sizeof(ph), file_))
+      throw std::runtime_error(SRC_POS);
+  }
+
+  off_t
+  slab_pool::data_pos(AddrType addr, slab_slot const &slot, uint32_t off) const
+  {
+    off_t pos = addr >> SLAB_SLOT_BITS;
+    pos *= SLAB_PAGE_SIZ;
+    pos += slot.off + off;
+    return pos;
+  }
+
+  void
+  slab_pool::recover()
+  {
+    using namespace detail;
+
+    detail::s_seek(file_, 0, SEEK_END);
+    off_t fsize = ftello(file_);
+    uint32_t npages = (fsize + SLAB_PAGE_SIZ - 1) / SLAB_PAGE_SIZ;
+
+    pages_.resize(npages);
+
+    slab_slot slots[SLAB_MAX_SLOTS];
+    for(uint32_t page = 0; page < npages; ++page){
+      slab_page_header &ph = pages_[page];
+      off_t pos = page;
+      pos *= SLAB_PAGE_SIZ;
+      detail::s_seek(file_, pos, SEEK_SET);
+      if(sizeof(ph) != s_read((char*)&ph, sizeof(ph), file_))
+        throw std::runtime_error(SRC_POS);
+
+      if(0 == ph.nslots){ // page that has not been initiated
+        ph.top = SLAB_PAGE_SIZ;
+        continue;
+      }
+
+      if(ph.nslots > SLAB_MAX_SLOTS || ph.top > SLAB_PAGE_SIZ)
+        throw std::runtime_error("slab_pool: corrupted slab page");
+
+      uint32_t dir_size = ph.nslots * sizeof(slab_slot);
+      if(dir_size != s_read((char*)slots, dir_size, file_))
+        throw std::runtime_error(SRC_POS);
+
+      for(uint32_t i=0; i < ph.nslots; ++i){
+        if(slots[i].used)
+          used_bytes_ += slots[i].size;
+        else
+          free_slots_[slots[i].cap].push_back(page << SLAB_SLOT_BITS | i);
+      }
+    }
+  }
+
+  uint16_t
+  slab_pool::size_class(uint32_t size)
+  {
+    uint32_t cls = (size + SLAB_CLASS_UNIT - 1) & ~(SLAB_CLASS_UNIT - 1);
+    return cls ? cls : SLAB_CLASS_UNIT;
+  }
+
+} // namespace BDB
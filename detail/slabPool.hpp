@@ -0,0 +1,170 @@
+#ifndef BDB_SLAB_POOL_HPP_
+#define BDB_SLAB_POOL_HPP_
+
+#include "common.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/noncopyable.hpp>
+
+#define SLAB_PAGE_SIZ 4096
+#define SLAB_SLOT_BITS 6
+#define SLAB_MAX_SLOTS (1<<SLAB_SLOT_BITS)
+#define SLAB_CLASS_UNIT 16
+#define SLAB_BUF_SIZ (SLAB_PAGE_SIZ<<4)
+
+namespace BDB {
+
+  struct viov;
+  struct pool;
+
+  /// Page header of a slab page
+  struct slab_page_header
+  {
+    uint16_t nslots;  ///< number of slot entries in the directory
+    uint16_t top;     ///< lowest offset of the data area
+    uint32_t reserved;
+  };
+
+  /// Slot directory entry of a slab page
+  struct slab_slot
+  {
+    uint16_t off;   ///< offset of record within its page
+    uint16_t cap;   ///< size class (room) of the slot
+    uint16_t size;  ///< data size of the record
+    uint16_t used;
+  };
+
+  /** @brief Packed small-object pool
+   *  @details Stores many small records per SLAB_PAGE_SIZ page. Each page
+   *  begins with a slab_page_header and a slot directory growing upward
+   *  while record data grows downward from the end of the page. A local
+   *  address is (page << SLAB_SLOT_BITS | slot). Records are rounded up to
+   *  a size class of SLAB_CLASS_UNIT bytes so that updates within a class
+   *  happen in place, and freed slots are reused by records of the same
+   *  class.
+   *
+   *  Slots are allocated and released in their pages, through neither
+   *  the write-ahead log nor a transaction file. A crash between the
+   *  write of a slot and the commit of its global address leaves the
+   *  slot used by no record; reclaim() frees such slots when the
+   *  BehaviorDB is opened.
+   */
+  struct slab_pool
+  : boost::noncopyable
+  {
+    friend struct bdbStater;
+
+    /** @param dirID
+     *  @param work_dir
+     *  @param max_size Maximum record size
+     *  @param addr_len Bit length of local addresses
+     *  @throw std::invalid_argument For invalid max_size or unable to open
+     *  the slab file.
+     */
+    slab_pool(unsigned int dirID, std::string const& work_dir,
+              uint32_t max_size, unsigned int addr_len);
+    ~slab_pool();
+
+    AddrType
+    write(char const* data, uint32_t size);
+
+    AddrType
+    write(char const* data, uint32_t size, AddrType addr, uint32_t off=npos);
+
+    AddrType
+    write(viov *vv, uint32_t len);
+
+    AddrType
+    replace(char const *data, uint32_t size, AddrType addr);
+
+    uint32_t
+    read(char* buffer, uint32_t size, AddrType addr, uint32_t off=0);
+
+    uint32_t
+    read(std::string *buffer, uint32_t max, AddrType addr, uint32_t off=0);
+
+    uint32_t
+    data_size(AddrType addr) const;
+
+    AddrType
+    merge_copy(char const* data, uint32_t size, AddrType src_addr,
+               uint32_t off, pool* dest_pool);
+
+    AddrType
+    merge_move(char const* data, uint32_t size, AddrType src_addr,
+               uint32_t off, pool* dest_pool);
+
+    AddrType
+    merge_erase(uint32_t size, AddrType src_addr, uint32_t off,
+                pool* dest_pool);
+
+    uint32_t
+    free(AddrType addr);
+
+    uint32_t
+    erase(AddrType addr, uint32_t off, uint32_t size);
+
+    uint32_t
+    overwrite(char const* data, uint32_t size, AddrType addr, uint32_t off);
+
+    uint32_t
+    max_size() const;
+
+    /** @brief Free used slots that no global address refers to
+     *  @param refs Sorted local addresses that global addresses refer to
+     *  @return Number of slots freed
+     */
+    uint32_t
+    reclaim(std::vector<AddrType> const &refs);
+
+    /// Descriptor of the page file
+    int
+    file_no() const
+    { return fileno(file_); }
+
+  private:
+
+    /// Allocate a slot whose class fits size
+    AddrType
+    alloc(uint32_t size, slab_slot &slot);
+
+    void
+    release(AddrType addr, slab_slot &slot);
+
+    slab_slot
+    load(AddrType addr, bool used=true) const;
+
+    void
+    store(slab_slot const &slot, AddrType addr);
+
+    void
+    store(slab_page_header const &ph, uint32_t page);
+
+    off_t
+    data_pos(AddrType addr, slab_slot const &slot, uint32_t off=0) const;
+
+    void
+    recover();
+
+    static uint16_t
+    size_class(uint32_t size);
+
+    unsigned int dirID;
+    uint32_t max_size_;
+    uint32_t max_pages_;
+
+    FILE *file_;
+    char *file_buf_;
+
+    std::vector<slab_page_header> pages_;
+    /// freed slots indexed by their size class
+    std::map<uint16_t, std::vector<AddrType> > free_slots_;
+
+    unsigned long long used_bytes_;
+  };
+
+} // namespace BDB
+
+#endif // header guard
@@ -2,12 +2,69 @@
 #include "bdbImpl.hpp"
 #include "poolImpl.hpp"
 #include "id_pool.hpp"
+#include "slabPool.hpp"
+#include "file_utils.hpp"
 #include "file_utils_def.hpp"
+#include "histogram.hpp"
 
 namespace BDB {
-  
-  bdbStater::bdbStater(Stat *s)
-  : s(s)
+
+  double
+  OpStat::latency_mean() const
+  {
+    unsigned long long n = count + errors;
+    return n ? (double)latency_sum / n : 0;
+  }
+
+  unsigned long long
+  OpStat::latency_percentile(double q) const
+  {
+    unsigned long long n = 0;
+    for(size_t i = 0; i < latency_buckets.size(); ++i)
+      n += latency_buckets[i];
+    if(!n) return 0;
+
+    unsigned long long rank = (unsigned long long)(q * n + 0.5);
+    if(rank < 1) rank = 1;
+    unsigned long long seen = 0;
+    for(size_t i = 0; i < latency_buckets.size(); ++i){
+      seen += latency_buckets[i];
+      if(seen >= rank)
+        return std::min(latency_upper(i), latency_max);
+    }
+    return latency_max;
+  }
+
+  unsigned long long
+  OpStat::latency_upper(unsigned int i)
+  { return histogram::upper(i); }
+
+  double
+  Stat::occupancy(unsigned int dir) const
+  {
+    if(dir >= pool_slots.size() || !pool_slots[dir])
+      return 1;
+    return (double)pool_chunks[dir] / pool_slots[dir];
+  }
+
+  double
+  Stat::fragmentation(unsigned int dir) const
+  { return 1 - occupancy(dir); }
+
+  double
+  Stat::write_amplification() const
+  {
+    unsigned long long user = 
+      ops[OP_PUT].bytes + ops[OP_INSERT].bytes + ops[OP_UPDATE].bytes;
+    return user ? (double)written_bytes / user : 0;
+  }
+
+  double
+  ScanStat::throughput() const
+  { return seconds > 0 ? bytes / seconds : 0; }
+
+  bdbStater::bdbStater(Stat *s, bool reset)
+  : s(s), reset(reset)
   {}
 
   void
@@ -15,10 +72,45 @@ namespace BDB {
   {
 
     (*this)(bdb->global_id_);
+    s->trans_size += bdb->wal_.size();
+    
+    s->reclaimed_size += bdb->reclaimed_size_;
+    s->log_size += 
+      detail::s_file_size(bdb->err_log_) +
+      detail::s_file_size(bdb->access_log_path_.c_str()) +
+      bdb->slow_log_.size();
     
-    for(uint32_t i=0;i< bdb->addrEval.dir_count();++i){
+    unsigned int dirs = bdb->addrEval.dir_count();
+    if(s->pool_migrations.size() < dirs){
+      s->pool_migrations.resize(dirs, 0);
+      s->pool_migrations_in.resize(dirs, 0);
+      s->pool_copied_size.resize(dirs, 0);
+      s->pool_chunk_size.resize(dirs, 0);
+      s->pool_chunks.resize(dirs, 0);
+      s->pool_slots.resize(dirs, 0);
+      s->pool_direct.resize(dirs, false);
+      s->pool_mmap.resize(dirs, false);
+    }
+
+    unsigned int devices = bdb->devices_.size();
+    if(s->device_files.size() < devices){
+      s->device_files.resize(devices, 0);
+      s->device_disk_size.resize(devices, 0);
+      s->device_reads.resize(devices, 0);
+      s->device_read_bytes.resize(devices, 0);
+      s->device_writes.resize(devices, 0);
+      s->device_written_bytes.resize(devices, 0);
+    }
+
+    for(uint32_t i=0;i< dirs;++i){
       (*this)(bdb->pools_ + i);
+      s->pool_migrations[i] += bdb->growth_.stat(i).migrations_out;
+      s->pool_migrations_in[i] += bdb->growth_.stat(i).migrations_in;
+      s->pool_copied_size[i] += bdb->growth_.stat(i).copied_size;
+      (*this)(bdb->pools_ + i, bdb->pool_devices_[i]);
     }
+
+    bdb->metrics_.collect(s, reset);
     //s->pool_mem_size +=
     //  detail::s_buffer<MIGBUF_SIZ>::alloc_size();
   }
@@ -26,20 +118,75 @@ namespace BDB {
   void
   bdbStater::operator()(pool const *pool) const
   {
+    if(pool->slab_){
+      (*this)(pool->slab_);
+      // pages are not tracked by occupancy
+      s->pool_chunk_size[pool->dirID] = SLAB_PAGE_SIZ;
+      s->pool_chunks[pool->dirID] += pool->slab_->pages_.size();
+      s->pool_slots[pool->dirID] += pool->slab_->pages_.size();
+      return;
+    }
+
     (*this)(pool->idpool_);
 
-    s->disk_size += 
-      pool->idpool_->max_used()* 
+    for(unsigned int k = 0; k < pool->stripe_count_; ++k)
+      s->disk_size += detail::s_allocated_size(pool->stripes_[k].file);
+
+    unsigned long long chunk_size = 
       pool->addrEval.chunk_size_estimation(pool->dirID);
+    AddrType used = pool->idpool_->max_used();
+    s->used_size += used * chunk_size;
+    s->pool_chunk_size[pool->dirID] = chunk_size;
+    s->pool_chunks[pool->dirID] += pool->idpool_->num_acquired();
+    s->pool_slots[pool->dirID] += used;
+    s->pool_direct[pool->dirID] = pool->direct();
+    s->pool_mmap[pool->dirID] = pool->mapped();
+    if(pool->extent_ > used)
+      s->prealloc_size += (pool->extent_ - used) * chunk_size;
 
     s->pool_mem_size += MIGBUF_SIZ;
   }
   
+  void
+  bdbStater::operator()(pool const *pool, 
+                        std::vector<unsigned int> const &devices) const
+  {
+    if(pool->slab_){
+      s->device_files[devices[0]] += 1;
+      s->device_disk_size[devices[0]] += 
+        detail::s_allocated_size(pool->slab_->file_);
+      return;
+    }
+
+    for(unsigned int k = 0; k < pool->stripe_count_; ++k){
+      pool::stripe const &st = pool->stripes_[k];
+      unsigned int d = devices[k];
+      s->device_files[d] += 1;
+      s->device_disk_size[d] += detail::s_allocated_size(st.file);
+      s->device_reads[d] += st.reads.load(std::memory_order_relaxed);
+      s->device_read_bytes[d] += 
+        st.read_bytes.load(std::memory_order_relaxed);
+      s->device_writes[d] += st.writes.load(std::memory_order_relaxed);
+      s->device_written_bytes[d] += 
+        st.written_bytes.load(std::memory_order_relaxed);
+    }
+  }
+
+  void
+  bdbStater::operator()(slab_pool const *slab) const
+  {
+    s->disk_size += detail::s_allocated_size(slab->file_);
+    s->used_size += (unsigned long long)slab->pages_.size() * SLAB_PAGE_SIZ;
+    s->pool_mem_size += SLAB_BUF_SIZ + 
+      slab->pages_.size() * sizeof(slab_page_header);
+  }
+  
   template<typename T>
   void
   bdbStater::operator()(IDPool<T> const *idp) const
   {
     s->pool_mem_size += sizeof(AddrType) * idp->num_blocks(); 
+    s->trans_size += idp->trans_size();
   }
 
 } // end of namespace BDB
@@ -10,22 +10,33 @@ namespace BDB {
   class IDPool;
   struct BDBImpl;
   struct pool;
+  struct slab_pool;
 
   struct bdbStater 
   {
-    bdbStater(Stat *s);
+    /// reset zeroes metrics counters after they are added to s
+    bdbStater(Stat *s, bool reset=false);
 
     void
     operator()(BDBImpl const* bdb) const;
     
     void
     operator()(pool const *pool) const;
+
+    // files and I/O of the stripes of a pool on their devices
+    void
+    operator()(pool const *pool, 
+               std::vector<unsigned int> const &devices) const;
+
+    void
+    operator()(slab_pool const *slab) const;
     
     template<typename T>
     void
     operator()( IDPool<T> const *idp) const;
 
     Stat *s;
+    bool reset;
   };
 
 } // end of namespace BDB
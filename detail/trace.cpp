@@ -0,0 +1,90 @@
+#include "trace.hpp"
+#include "file_utils.hpp"
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+namespace BDB {
+
+  namespace detail {
+    thread_local op_trace *trace_sink = 0;
+  }
+
+  op_trace::op_trace(char const *op)
+  : op(op), addr(0), size(0), src_dir(-1), dest_dir(-1), migrated(false),
+  cur(PHASE_OTHER)
+  {}
+
+  void
+  op_trace::start()
+  {
+    memset(phase_ns, 0, sizeof(phase_ns));
+    since = clock_type::now();
+  }
+
+  trace_phase
+  op_trace::enter(trace_phase p)
+  {
+    clock_type::time_point now = clock_type::now();
+    phase_ns[cur] += 
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now - since).count();
+    since = now;
+    trace_phase rt = cur;
+    cur = p;
+    return rt;
+  }
+
+  slow_log::slow_log()
+  : file_(0), threshold_ns_(0)
+  {}
+
+  slow_log::~slow_log()
+  { if(file_) fclose(file_); }
+
+  void
+  slow_log::init(std::string const &path, uint32_t threshold_us)
+  {
+    if(!threshold_us) return;
+    threshold_ns_ = threshold_us * 1000ULL;
+    if(0 == (file_ = fopen(path.c_str(), "ab")))
+      throw std::runtime_error("create slow.log file failed\n");
+    if(0 != setvbuf(file_, buf_, _IOLBF, sizeof(buf_)))
+      throw std::runtime_error("setvbuf to log file failed\n");
+  }
+
+  unsigned long long
+  slow_log::size() const
+  { return file_ ? detail::s_file_size(file_) : 0; }
+
+  void
+  slow_log::record(op_trace const &t)
+  {
+    unsigned long long total = 0;
+    for(unsigned int i = 0; i < PHASE_COUNT; ++i)
+      total += t.phase_ns[i];
+    if(total < threshold_ns_) 
+      return;
+
+    char when[32];
+    time_t now = time(0);
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    char pools[32] = "-";
+    if((unsigned int)-1 != t.src_dir && (unsigned int)-1 != t.dest_dir)
+      sprintf(pools, "%u->%u", t.src_dir, t.dest_dir);
+    else if((unsigned int)-1 != t.src_dir)
+      sprintf(pools, "%u", t.src_dir);
+
+    fprintf(file_, 
+      "%s\t%-12s\t%08x\t%u\tpools=%s\tmigrated=%d\ttotal=%llu"
+      "\tlookup=%llu\theader=%llu\tio=%llu\tcommit=%llu\tlog=%llu"
+      "\tother=%llu\n",
+      when, t.op, t.addr, t.size, pools, t.migrated ? 1 : 0,
+      total / 1000,
+      t.phase_ns[PHASE_LOOKUP] / 1000, t.phase_ns[PHASE_HEADER] / 1000,
+      t.phase_ns[PHASE_IO] / 1000, t.phase_ns[PHASE_COMMIT] / 1000,
+      t.phase_ns[PHASE_LOG] / 1000, t.phase_ns[PHASE_OTHER] / 1000);
+  }
+
+} // namespace BDB
@@ -0,0 +1,161 @@
+#ifndef BDB_TRACE_HPP_
+#define BDB_TRACE_HPP_
+
+#include "common.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+namespace BDB {
+
+  /// Phases an operation's time is split into
+  enum trace_phase
+  {
+    PHASE_OTHER = 0,
+    PHASE_LOOKUP,   ///< global ID table
+    PHASE_HEADER,   ///< chunk headers of pools
+    PHASE_IO,       ///< data of pool files
+    PHASE_COMMIT,   ///< write-ahead log, transaction and header files
+    PHASE_LOG,      ///< access log
+    PHASE_COUNT
+  };
+
+  /** @brief Timeline of the operation running in the calling thread
+   *  @details Time is charged to one phase at a time; entering a phase
+   *  stops the clock of the current one.
+   */
+  struct op_trace
+  {
+    typedef std::chrono::steady_clock clock_type;
+
+    op_trace(char const *op);
+
+    void
+    start();
+
+    trace_phase
+    enter(trace_phase p);
+
+    char const *op;
+    AddrType addr;
+    uint32_t size;
+    unsigned int src_dir, dest_dir;
+    bool migrated;
+    unsigned long long phase_ns[PHASE_COUNT];
+    trace_phase cur;
+    clock_type::time_point since;
+  };
+
+  namespace detail {
+    /// Trace of the calling thread, 0 disables tracing
+    extern thread_local op_trace *trace_sink;
+  }
+
+  /** @brief Charge time to a phase while in scope
+   *  @details next() moves to another phase, leaving the scope returns
+   *  to the phase before it.
+   */
+  class phase_scope
+  : boost::noncopyable
+  {
+  public:
+    explicit
+    phase_scope(trace_phase p)
+    : t_(detail::trace_sink), prev_(PHASE_OTHER)
+    { if(t_) prev_ = t_->enter(p); }
+
+    ~phase_scope()
+    { if(t_) t_->enter(prev_); }
+
+    void
+    next(trace_phase p)
+    { if(t_) t_->enter(p); }
+
+  private:
+    op_trace *t_;
+    trace_phase prev_;
+  };
+
+  /// Record what the traced operation works on
+  inline void
+  trace_addr(AddrType addr, uint32_t size)
+  {
+    if(!detail::trace_sink) return;
+    detail::trace_sink->addr = addr;
+    detail::trace_sink->size = size;
+  }
+
+  inline void
+  trace_pools(unsigned int src_dir, unsigned int dest_dir, bool migrated)
+  {
+    if(!detail::trace_sink) return;
+    detail::trace_sink->src_dir = src_dir;
+    detail::trace_sink->dest_dir = dest_dir;
+    detail::trace_sink->migrated = migrated;
+  }
+
+  /** @brief Log of operations slower than a threshold
+   *  @details One line per operation with the time of each phase in 
+   *  microseconds.
+   */
+  class slow_log
+  : boost::noncopyable
+  {
+  public:
+    slow_log();
+    ~slow_log();
+
+    /// Open the log, threshold_us 0 disables it
+    void
+    init(std::string const &path, uint32_t threshold_us);
+
+    bool
+    enabled() const
+    { return 0 != file_; }
+
+    void
+    record(op_trace const &t);
+
+    /// Bytes of the log file
+    unsigned long long
+    size() const;
+
+  private:
+    FILE *file_;
+    char buf_[4096];
+    unsigned long long threshold_ns_;
+  };
+
+  /** @brief Trace an operation in scope and log it if it is slow
+   */
+  class trace_scope
+  : boost::noncopyable
+  {
+  public:
+    trace_scope(slow_log &log, char const *op)
+    : log_(log.enabled() ? &log : 0), trace_(op), 
+    prev_(detail::trace_sink)
+    {
+      if(!log_) return;
+      trace_.start();
+      detail::trace_sink = &trace_;
+    }
+
+    ~trace_scope()
+    {
+      if(!log_) return;
+      detail::trace_sink = prev_;
+      trace_.enter(PHASE_OTHER);
+      log_->record(trace_);
+    }
+
+  private:
+    slow_log *log_;
+    op_trace trace_;
+    op_trace *prev_;
+  };
+
+} // namespace BDB
+
+#endif // header guard
@@ -1,7 +1,10 @@
 #include "common.hpp"
 #include "v_iovec.hpp"
 #include "file_utils.hpp"
+#include "direct_io.hpp"
 #include "error.hpp"
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 namespace BDB {
   
@@ -21,6 +24,8 @@ namespace BDB {
     FILE* dest;
     off_t dest_pos;
     uint32_t size;
+    // read and write around FILE buffers, see advise_sources()
+    bool unbuffered;
   };
   
   uint32_t
@@ -34,14 +39,28 @@ namespace BDB {
     uint32_t readCnt, loopOff(0);
     while(toRead){
       readCnt = (bsize > toRead) ? toRead : bsize;
-      fseeko(fsrc.fp, fsrc.off + loopOff, SEEK_SET);
-      if(readCnt != s_read(buf, readCnt, fsrc.fp))
-        throw std::runtime_error(SRC_POS);
+      if(fsrc.fd >= 0){
+        if(readCnt != s_direct_pread(buf, readCnt, fsrc.off + loopOff, 
+                                     fsrc.fd))
+          throw std::runtime_error(SRC_POS);
+      }else if(unbuffered){
+        if(readCnt != s_pread(buf, readCnt, fsrc.off + loopOff, fsrc.fp))
+          throw std::runtime_error(SRC_POS);
+      }else{
+        detail::s_seek(fsrc.fp, fsrc.off + loopOff, SEEK_SET);
+        if(readCnt != s_read(buf, readCnt, fsrc.fp))
+          throw std::runtime_error(SRC_POS);
+      }
       
-      fseeko(dest, dest_pos + loopOff, SEEK_SET);
       //write
-      if(readCnt != s_write(buf, readCnt, dest))
-        throw std::runtime_error(SRC_POS);
+      if(unbuffered){
+        if(readCnt != s_pwrite(buf, readCnt, dest_pos + loopOff, dest))
+          throw std::runtime_error(SRC_POS);
+      }else{
+        detail::s_seek(dest, dest_pos + loopOff, SEEK_SET);
+        if(readCnt != s_write(buf, readCnt, dest))
+          throw std::runtime_error(SRC_POS);
+      }
         
       loopOff += readCnt;
       toRead -= readCnt;
@@ -53,7 +72,13 @@ namespace BDB {
   uint32_t
   write_viov::operator()(char const* str)
   {
-    fseeko(dest, dest_pos, SEEK_SET);
+    if(unbuffered){
+      if(size != s_pwrite(str, size, dest_pos, dest))
+        throw std::runtime_error(SRC_POS);
+      dest_pos += size;
+      return size;
+    }
+    detail::s_seek(dest, dest_pos, SEEK_SET);
     if(size != s_write(str, size, dest))
       throw std::runtime_error(SRC_POS);
     dest_pos += size;
@@ -63,20 +88,37 @@ namespace BDB {
   uint32_t
   write_viov::operator()(blank_src &)
   {
-    fseeko(dest, dest_pos, SEEK_SET);
+    if(!unbuffered)
+      detail::s_seek(dest, dest_pos, SEEK_SET);
     dest_pos += size;
     return size;
   }
 
-  uint32_t writevv(viov *vv, uint32_t len, FILE* dest, uint32_t off)
+  // read buffered file sources ahead, they are copied in small pieces.
+  // FILE buffers would read a MIGBUF_SIZ of other chunks as well, so
+  // advised vectors are copied with s_pread and s_pwrite.
+  void advise_sources(viov *vv, uint32_t len)
+  {
+    for(uint32_t i =0;i<len;++i){
+      file_src *fs = boost::get<file_src>(&vv[i].data);
+      if(fs && fs->fd < 0 && vv[i].size)
+        s_advise(fileno(fs->fp), fs->off, vv[i].size, HINT_WILLNEED);
+    }
+  }
+
+  uint32_t writevv(viov *vv, uint32_t len, FILE* dest, off_t off, 
+                   bool advise)
   {
     using boost::apply_visitor;
 
     uint32_t rt(0);
+    if(advise)
+      advise_sources(vv, len);
 
     write_viov wv;
     wv.dest = dest;
     wv.dest_pos = off;
+    wv.unbuffered = advise;
 
     for(uint32_t i =0;i<len;++i){
       wv.size = vv[i].size;
@@ -84,9 +126,124 @@ namespace BDB {
       rt += vv[i].size;
     }
 
-    if(fflush(dest))
+    if(detail::s_flush(dest))
+      throw std::runtime_error(SRC_POS);
+    return rt;
+  }
+
+  // copies io vectors to an aligned buffer
+  struct gather_viov : public boost::static_visitor<>
+  {
+    void
+    operator()(char const* str)
+    { memcpy(dest, str + off, size); }
+
+    void
+    operator()(file_src &fsrc)
+    {
+      if(fsrc.fd >= 0){
+        if(size != s_direct_pread(dest, size, fsrc.off + off, fsrc.fd))
+          throw std::runtime_error(SRC_POS);
+        return;
+      }
+      if(unbuffered){
+        if(size != s_pread(dest, size, fsrc.off + off, fsrc.fp))
+          throw std::runtime_error(SRC_POS);
+        return;
+      }
+      detail::s_seek(fsrc.fp, fsrc.off + off, SEEK_SET);
+      if(size != s_read(dest, size, fsrc.fp))
+        throw std::runtime_error(SRC_POS);
+    }
+
+    void
+    operator()(blank_src &)
+    { memset(dest, 0, size); }
+
+    char *dest;
+    // range of the vector
+    uint32_t off, size;
+    bool unbuffered;
+  };
+
+  uint32_t writevv(viov *vv, uint32_t len, int direct_fd, off_t off,
+                   bool advise)
+  {
+    using boost::apply_visitor;
+
+    direct_buffer buf;
+    uint32_t used(0), rt(0);
+    gather_viov gv;
+    gv.unbuffered = advise;
+    if(advise)
+      advise_sources(vv, len);
+
+    for(uint32_t i =0;i<len;++i){
+      for(gv.off = 0; gv.off < vv[i].size; gv.off += gv.size){
+        gv.dest = buf.buffer + used;
+        gv.size = std::min(vv[i].size - gv.off, direct_buffer::size() - used);
+        apply_visitor(gv, vv[i].data);
+        used += gv.size;
+        if(used == direct_buffer::size()){
+          if(used != s_direct_pwrite(buf.buffer, used, off, direct_fd))
+            throw std::runtime_error(SRC_POS);
+          off += used;
+          used = 0;
+        }
+      }
+      rt += vv[i].size;
+    }
+    if(used && 
+       used != s_direct_pwrite(buf.buffer, used, off, direct_fd, false))
       throw std::runtime_error(SRC_POS);
     return rt;
   }
 
+  uint32_t merge_viov(viov *vv, file_src src, uint32_t orig_size,
+                      char const* data, uint32_t size, uint32_t off)
+  {
+    if(npos == off || off > orig_size)
+      off = orig_size;
+    
+    if(0 == data)
+      vv[0].data = blank_src();
+    else
+      vv[0].data = data;
+    vv[0].size = size;
+
+    if(0 == off){ // prepend
+      vv[1].data = src;
+      vv[1].size = orig_size;
+      return 2;
+    }
+    
+    vv[1] = vv[0];
+    vv[0].data = src;
+    vv[0].size = off;
+    if(orig_size == off) // append
+      return 2;
+    
+    // insert
+    src.off += off;
+    vv[2].data = src;
+    vv[2].size = orig_size - off;
+    return 3;
+  }
+
+  uint32_t erase_viov(viov *vv, file_src src, uint32_t orig_size,
+                      uint32_t size, uint32_t off)
+  {
+    if(off > orig_size)
+      off = orig_size;
+    if(off + size > orig_size || off + size < off)
+      size = orig_size - off;
+
+    vv[0].data = src;
+    vv[0].size = off;
+    src.off += off + size;
+    vv[1].data = src;
+    vv[1].size = orig_size - (off + size);
+    return 2;
+  }
+
 } // end of namespace BDB
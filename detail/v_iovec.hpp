@@ -3,6 +3,8 @@
 
 #include "boost/variant.hpp"
 #include <cstdio>
+#include <sys/types.h>
+#include "common.hpp"
 
 namespace BDB {
 
@@ -10,6 +12,10 @@ namespace BDB {
   {
     FILE *fp;
     off_t off;
+    /// opened by detail::s_open_direct and read instead of fp, or -1
+    int fd;
+
+    file_src() : fp(0), off(0), fd(-1) {}
   };
   
   struct blank_src
@@ -21,7 +27,39 @@ namespace BDB {
     uint32_t size;
   };
 
-  uint32_t writevv(viov *vv, uint32_t len, FILE* dest, uint32_t off);
+  /** @brief Write io vectors to a file
+   *  @param advise Ask the OS to read ranges of file sources ahead
+   */
+  uint32_t writevv(viov *vv, uint32_t len, FILE* dest, off_t off,
+                   bool advise = false);
+
+  /** @brief Write io vectors to a new chunk of a file opened by 
+   *  detail::s_open_direct
+   *  @param off Aligned to detail::DIRECT_ALIGN
+   *  @details Data is gathered in aligned buffers, and the last block
+   *  is padded with zeros.
+   */
+  uint32_t writevv(viov *vv, uint32_t len, int direct_fd, off_t off,
+                   bool advise = false);
+
+  /** @brief Compose io vectors that merge data into an existing chunk
+   *  @param vv Output vectors, at least 3 elements
+   *  @param src Position of the existing chunk
+   *  @param orig_size Data size of the existing chunk
+   *  @param data Data to be merged, 0 for a blank room
+   *  @param size Size of data
+   *  @param off Merge position, BDB::npos for appending
+   *  @return Number of vectors used
+   */
+  uint32_t merge_viov(viov *vv, file_src src, uint32_t orig_size,
+                      char const* data, uint32_t size, uint32_t off);
+
+  /** @brief Compose io vectors that copy an existing chunk except
+   *  a segment of it
+   *  @return Number of vectors used (at most 2)
+   */
+  uint32_t erase_viov(viov *vv, file_src src, uint32_t orig_size,
+                      uint32_t size, uint32_t off);
 
 } // end of namespace BDB
 
@@ -0,0 +1,213 @@
+#include "wal.hpp"
+#include "error.hpp"
+#include "file_utils.hpp"
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace BDB {
+
+  namespace {
+    // body size and checksum
+    uint32_t const WAL_HEADER_SIZ = 18;
+
+    uint32_t
+    checksum(char const *data, size_t size)
+    {
+      boost::crc_32_type crc;
+      crc.process_bytes(data, size);
+      return crc.checksum();
+    }
+  }
+
+  wal::wal()
+  : file_(0), size_(0), sync_(false), delay_us_(0), 
+  written_(0), synced_(0), syncing_(false), engine_(new sync_engine)
+  {}
+
+  wal::~wal()
+  { if(file_) fclose(file_); }
+
+  void
+  wal::open(std::string const &path)
+  {
+    path_ = path;
+    if(0 == (file_ = fopen(path.c_str(), "ab")))
+      throw std::runtime_error("wal: Unable to open log file");
+    // a record is written by one call
+    if(0 != setvbuf(file_, 0, _IONBF, 0))
+      throw std::runtime_error("wal: setvbuf to log file failed");
+    size_ = detail::s_file_size(file_);
+  }
+
+  void
+  wal::append(std::string const &tag, std::string const &line)
+  {
+    std::lock_guard<std::mutex> lock(buf_mutex_);
+    buf_ += tag;
+    buf_ += ' ';
+    buf_ += line;
+  }
+
+  unsigned long long
+  wal::commit()
+  {
+    if(buf_.empty() || !file_) return last_ticket();
+
+    // entries stay in buf_ until their record is written
+    char header[WAL_HEADER_SIZ + 1];
+    sprintf(header, "%08x\t%08x\n", (uint32_t)buf_.size(),
+            checksum(buf_.data(), buf_.size()));
+    std::string record(header, WAL_HEADER_SIZ);
+    record += buf_;
+
+    uint32_t written = detail::s_write(record.data(), record.size(), file_);
+    if(written != record.size()){
+      // drop a torn record, records after it would not be read
+      if(written && 0 != detail::s_truncate(file_, size_))
+        size_ += written;
+      throw std::runtime_error(SRC_POS);
+    }
+    size_ += written;
+    buf_.clear();
+
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    written_ += written;
+    return written_;
+  }
+
+  void
+  wal::set_sync(bool enabled, uint32_t delay_us)
+  {
+    sync_ = enabled;
+    delay_us_ = delay_us;
+  }
+
+  void
+  wal::set_engine(io_engine *engine)
+  {
+    engine_.reset(engine);
+    std::vector<int> fds(files_);
+    if(file_)
+      fds.push_back(fileno(file_));
+    if(!fds.empty())
+      engine_->register_files(&fds[0], fds.size());
+  }
+
+  unsigned int
+  wal::add_file(int fd)
+  {
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    files_.push_back(fd);
+    return files_.size() - 1;
+  }
+
+  void
+  wal::touch(unsigned int file)
+  {
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    if(touched_.end() == std::find(touched_.begin(), touched_.end(), file))
+      touched_.push_back(file);
+  }
+
+  unsigned long long
+  wal::last_ticket() const
+  {
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    return written_;
+  }
+
+  unsigned long long
+  wal::synced_ticket() const
+  {
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    return synced_;
+  }
+
+  void
+  wal::sync(unsigned long long ticket)
+  {
+    if(!sync_ || !file_) return;
+
+    std::unique_lock<std::mutex> lock(sync_mutex_);
+    while(synced_ < ticket){
+      if(syncing_){
+        synced_cond_.wait(lock);
+        continue;
+      }
+
+      // lead a group of the records written until the sync starts
+      syncing_ = true;
+      if(delay_us_)
+        synced_cond_.wait_for(lock, std::chrono::microseconds(delay_us_));
+      unsigned long long target = written_;
+      std::vector<unsigned int> touched;
+      touched.swap(touched_);
+      lock.unlock();
+
+      // data first, records must not refer to data lost by a crash
+      reqs_.resize(touched.size() + 1);
+      for(size_t i = 0; i < reqs_.size(); ++i){
+        reqs_[i].op = IO_SYNC;
+        reqs_[i].fd = (i < touched.size()) ? files_[touched[i]] : 
+          fileno(file_);
+        reqs_[i].drain = (i == touched.size());
+      }
+      bool ok = true;
+      try {
+        engine_->run(&reqs_[0], reqs_.size());
+        for(size_t i = 0; i < reqs_.size(); ++i)
+          ok = 0 == reqs_[i].result && ok;
+      }catch(std::exception const &){
+        ok = false;
+      }
+
+      lock.lock();
+      syncing_ = false;
+      if(ok && synced_ < target) 
+        synced_ = target;
+      else if(!ok)
+        touched_.insert(touched_.end(), touched.begin(), touched.end());
+      synced_cond_.notify_all();
+      if(!ok)
+        throw std::runtime_error("wal: Sync of log failed");
+    }
+  }
+
+  void
+  wal::records(std::vector<std::string> *bodies) const
+  {
+    std::ifstream in(path_.c_str(), std::ios::in | std::ios::binary);
+    char header[WAL_HEADER_SIZ + 1] = {};
+    std::string body;
+
+    while(in.read(header, WAL_HEADER_SIZ)){
+      if('\t' != header[8] || '\n' != header[17])
+        break;
+      header[8] = header[17] = 0;
+      uint32_t size = strtoul(header, 0, 16);
+      uint32_t crc = strtoul(header + 9, 0, 16);
+
+      body.resize(size);
+      if(size && !in.read(&body[0], size))
+        break;
+      if(crc != checksum(body.data(), body.size()))
+        break;
+      bodies->push_back(body);
+    }
+  }
+
+  void
+  wal::reset()
+  {
+    if(!file_) return;
+    if(detail::s_truncate(file_, 0))
+      throw std::runtime_error(SRC_POS);
+    size_ = 0;
+  }
+
+} // namespace BDB
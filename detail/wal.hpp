@@ -0,0 +1,141 @@
+#ifndef BDB_WAL_HPP_
+#define BDB_WAL_HPP_
+
+#include "io_engine.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace BDB {
+
+  /** @brief Write-ahead log of ID table changes
+   *  @details A record holds the changes of one operation to the global
+   *  ID table and the chunk headers of pools, and is written by a single
+   *  call:
+   *  @code
+   *  <body size, 8 hex digits>\t<CRC-32 of body, 8 hex digits>\n<body>
+   *  @endcode
+   *  The body is a sequence of entries, each one a table tag, a space
+   *  and a line as written to the transaction file of the table. Tables
+   *  keep the changes in memory until a checkpoint writes them to their
+   *  own files and resets the log.
+   *
+   *  Records are made durable by sync() in groups: threads waiting for
+   *  their records elect a leader that syncs the log, and the data 
+   *  files touched by the records, once for all of them.
+   */
+  class wal
+  : boost::noncopyable
+  {
+  public:
+    wal();
+    ~wal();
+
+    /// Open or create the log file
+    void
+    open(std::string const &path);
+
+    bool
+    is_open() const
+    { return 0 != file_; }
+
+    /// Add an entry to the record of the operation in progress
+    void
+    append(std::string const &tag, std::string const &line);
+
+    bool
+    pending() const
+    { return !buf_.empty(); }
+
+    /** @brief Write entries appended since the last commit as a record
+     *  @return Ticket of the record for sync()
+     *  @throw std::runtime_error
+     */
+    unsigned long long
+    commit();
+
+    /** @brief Sync records to the device
+     *  @param delay_us Microseconds a leader waits for more records 
+     *  before syncing, 0 disables syncing
+     */
+    void
+    set_sync(bool enabled, uint32_t delay_us);
+
+    /** @brief Engine that syncs a group, taking its ownership
+     *  @details The syncs of the data files and the log are submitted as
+     *  one batch. Call it after the files are added.
+     */
+    void
+    set_engine(io_engine *engine);
+
+    /// Register a data file synced with records that touch() it
+    unsigned int
+    add_file(int fd);
+
+    /// Data of a registered file is written by the next record
+    void
+    touch(unsigned int file);
+
+    /** @brief Wait until the record of a ticket is on the device
+     *  @details It can be called without a lock on the log writer. The
+     *  caller syncs the log itself when no other thread does so.
+     *  @throw std::runtime_error if the sync fails
+     */
+    void
+    sync(unsigned long long ticket);
+
+    /// Ticket of the last record
+    unsigned long long
+    last_ticket() const;
+
+    /// Records up to this ticket are on the device
+    unsigned long long
+    synced_ticket() const;
+
+    /** @brief Bodies of the records in the log
+     *  @details Reading stops at the first record that is incomplete or
+     *  whose checksum does not match, i.e. one torn by a crash.
+     */
+    void
+    records(std::vector<std::string> *bodies) const;
+
+    /// Empty the log, after its records are applied to the tables
+    void
+    reset();
+
+    /// Bytes of the log file
+    unsigned long long
+    size() const
+    { return size_; }
+
+  private:
+    std::string path_;
+    FILE *file_;
+    std::string buf_;
+    // pools of different devices append entries at once, see 
+    // BDBImpl::compact
+    std::mutex buf_mutex_;
+    unsigned long long size_;
+
+    bool sync_;
+    uint32_t delay_us_;
+    // guards the members below
+    mutable std::mutex sync_mutex_;
+    std::condition_variable synced_cond_;
+    // bytes of records written and synced since the log was opened
+    unsigned long long written_, synced_;
+    bool syncing_;
+    std::vector<int> files_;
+    std::vector<unsigned int> touched_;
+    // used by the leader of a sync only
+    std::unique_ptr<io_engine> engine_;
+    std::vector<io_request> reqs_;
+  };
+
+} // namespace BDB
+
+#endif // header guard
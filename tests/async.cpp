@@ -0,0 +1,125 @@
+#include "bdb.hpp"
+#include "exception.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_async work_dir/\n");
+  exit(1);
+}
+
+struct completions
+{
+  std::atomic<int> done, errors;
+  completions() : done(0), errors(0) {}
+};
+
+void count_done(BDB::AsyncResult &r, void *arg)
+{
+  completions *c = (completions*)arg;
+  if(r.error) ++c->errors;
+  ++c->done;
+}
+
+std::atomic<bool> released(false);
+
+void wait_released(BDB::AsyncResult &, void *)
+{
+  while(!released)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Asynchronous API Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+  conf.async_threads = 4;
+  conf.async_queue_size = 8;
+
+  int const count = 500;
+  std::vector<AddrType> addrs(count);
+  {
+    BehaviorDB bdb(conf);
+
+    printf(" - futures\n");
+    std::vector<std::future<AddrType> > puts;
+    for(int i=0; i < count; ++i)
+      puts.push_back(bdb.async_put(std::string(100 + i, 'a' + i % 26)));
+    for(int i=0; i < count; ++i)
+      addrs[i] = puts[i].get();
+
+    printf(" - operations on an address keep their order\n");
+    std::vector<std::future<std::string> > gets;
+    for(int i=0; i < count; ++i){
+      bdb.async_append("x", addrs[i]);
+      bdb.async_append("y", addrs[i]);
+      gets.push_back(bdb.async_get(addrs[i]));
+    }
+    for(int i=0; i < count; ++i)
+      assert(std::string(100 + i, 'a' + i % 26) + "xy" == gets[i].get());
+
+    printf(" - errors\n");
+    std::future<std::string> bad = bdb.async_get(count * 10);
+    try {
+      bad.get();
+      assert(false && "get of an unused address");
+    }catch(invalid_addr const &){}
+
+    printf(" - callbacks\n");
+    completions c;
+    for(int i=0; i < count; i += 2)
+      bdb.async_del(addrs[i], &count_done, &c);
+    bdb.async_del(addrs[0], &count_done, &c);
+    bdb.async_get(addrs[1], &count_done, &c);
+    while(c.done < count / 2 + 2)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    assert(1 == c.errors);
+    for(int i=1; i < count; i += 2)
+      assert(0 == bdb.async_del(addrs[i]).get());
+
+    printf(" - full queues block\n");
+    bdb.async_get(addrs[1], &wait_released, 0);
+    std::atomic<int> queued(0);
+    std::thread producer([&]() {
+      for(int i=0; i < 60; ++i){
+        bdb.async_put(std::string(10, 'q'));
+        ++queued;
+      }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // lanes other than the blocked one drain
+    int before = queued;
+    assert(before < 60);
+    released = true;
+    producer.join();
+    assert(60 == queued);
+  }
+
+  printf(" - queued operations finish before closing\n");
+  std::vector<std::future<AddrType> > last;
+  {
+    BehaviorDB bdb(conf);
+    for(int i=0; i < 100; ++i)
+      last.push_back(bdb.async_put(std::string(50, 'z')));
+  }
+  for(size_t i = 0; i < last.size(); ++i)
+    last[i].get();
+
+  return 0;
+}
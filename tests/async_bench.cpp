@@ -0,0 +1,86 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cassert>
+#include <cstdlib>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <string>
+
+// A single thread, like an event loop, keeps a fixed number of
+// operations in flight through the asynchronous API, and is compared
+// with issuing the same operations one at a time.
+
+void usage()
+{
+  printf("./bdb_async_bench work_dir/ [records] [in_flight] [threads]\n");
+  exit(1);
+}
+
+void clean(std::string const &dir)
+{
+  std::string cmd = "rm -f " + dir + "*";
+  if(0 != system(cmd.c_str()))
+    exit(1);
+}
+
+double run(std::string const &dir, bool async, bool durable, int records,
+           size_t in_flight, unsigned int threads)
+{
+  using namespace BDB;
+
+  clean(dir);
+  Config conf;
+  conf.root_dir = dir;
+  conf.beg = 0;
+  conf.wal_checkpoint = 1 << 22;
+  conf.sync_commit = durable;
+  conf.async_threads = threads;
+  BehaviorDB bdb(conf);
+  std::string rec(100, 'r');
+
+  std::chrono::steady_clock::time_point beg =
+    std::chrono::steady_clock::now();
+  if(async){
+    std::deque<std::future<AddrType> > pending;
+    for(int i = 0; i < records; ++i){
+      if(pending.size() == in_flight){
+        pending.front().get();
+        pending.pop_front();
+      }
+      pending.push_back(bdb.async_put(rec));
+    }
+    while(!pending.empty()){
+      pending.front().get();
+      pending.pop_front();
+    }
+  }else{
+    for(int i = 0; i < records; ++i)
+      bdb.put(rec);
+  }
+  double sec = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - beg).count();
+  return records / sec;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc < 2) usage();
+
+  int records = argc > 2 ? atoi(argv[2]) : 20000;
+  size_t in_flight = argc > 3 ? strtoul(argv[3], 0, 10) : 64;
+  unsigned int threads = argc > 4 ? strtoul(argv[4], 0, 10) : 8;
+
+  printf("==== BehaviorDB Asynchronous API Benchmark ====\n");
+  printf("%d puts of 100 bytes, %zu in flight, %u threads\n",
+         records, in_flight, threads);
+
+  for(int durable = 0; durable < 2; ++durable){
+    printf("%s\n", durable ? "sync_commit:" : "buffered:");
+    printf("  sync:  %9.0f ops/s\n",
+           run(argv[1], false, durable, records, in_flight, threads));
+    printf("  async: %9.0f ops/s\n",
+           run(argv[1], true, durable, records, in_flight, threads));
+  }
+  return 0;
+}
@@ -1,155 +1,519 @@
-#include "bench.h"
-#include <fstream>
+#include "bdb.hpp"
+#include "histogram.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
 #include <iostream>
 #include <iomanip>
-#include <vector>
 #include <sstream>
-#include "bdb.h"
-#include <fcntl.h>
-#include <cstring>
-#include <cerrno>
+#include <string>
+#include <vector>
+
+// Synthetic workload benchmark of BehaviorDB and a one-file-per-object
+// baseline. Records are loaded first, then a mix of operations chooses
+// records by a key distribution:
+//
+//   a        50% read, 50% update
+//   b        95% read, 5% update
+//   c        100% read
+//   d        95% read, 5% insert, latest-biased keys
+//   e        95% scan, 5% insert
+//   f        50% read, 50% read-modify-write
+//   append   50% append, 50% read
+//   pdel     40% partial delete, 40% append, 20% read
 
 void usage()
 {
-	printf("bench distribution-file [b|f]\n");
-	printf("\'b\' for BehaviorDB benchmark(default).\n");
-	printf("\'f\' for filesystem benchmark.\n");
+  printf(
+    "./bdb_bench work_dir/ [options]\n"
+    "  --workload a|b|c|d|e|f|append|pdel|all  (default all)\n"
+    "  --records N          records loaded before each run (default 10000)\n"
+    "  --ops N              operations of each run (default 100000)\n"
+    "  --dist uniform|zipfian|latest  key distribution (default zipfian)\n"
+    "  --value fixed:N|uniform:MIN:MAX|exp:MEAN  value size (default fixed:100)\n"
+    "  --append N           bytes per append (default 100)\n"
+    "  --scan N             maximum records per scan (default 100)\n"
+    "  --baseline           run the one-file-per-object baseline as well\n"
+    "  --json               print results in JSON\n");
+  exit(1);
+}
+
+// ---------------- random generators ----------------
+
+// xorshift64*
+struct rng
+{
+  explicit rng(uint64_t seed) : s(seed ? seed : 88172645463325252ull) {}
+
+  uint64_t
+  next()
+  {
+    s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+    return s * 2685821657736338717ull;
+  }
+
+  double
+  uniform()
+  { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  uint64_t s;
+};
+
+/** Zipfian generator over [0, n) by Gray et al., as used by YCSB.
+ *  Rank 0 is the most popular item.
+ */
+struct zipfian
+{
+  zipfian(uint64_t n, double theta = 0.99)
+  : n(0), theta(theta), zetan(0)
+  {
+    zeta2 = zeta(0, 2);
+    resize(n);
+  }
+
+  // extend item count, zeta is updated incrementally
+  void
+  resize(uint64_t new_n)
+  {
+    zetan += zeta(n, new_n);
+    n = new_n;
+    alpha = 1.0 / (1.0 - theta);
+    eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+  }
+
+  uint64_t
+  next(rng &r) const
+  {
+    double u = r.uniform();
+    double uz = u * zetan;
+    if(uz < 1.0) return 0;
+    if(uz < 1.0 + pow(0.5, theta)) return 1;
+    uint64_t rt = (uint64_t)(n * pow(eta * u - eta + 1, alpha));
+    return rt < n ? rt : n - 1;
+  }
+
+  double
+  zeta(uint64_t from, uint64_t to) const
+  {
+    double sum = 0;
+    for(uint64_t i = from; i < to; ++i)
+      sum += 1.0 / pow(i + 1.0, theta);
+    return sum;
+  }
+
+  uint64_t n;
+  double theta, zetan, zeta2, alpha, eta;
+};
+
+enum key_dist { UNIFORM, ZIPFIAN, LATEST };
+
+struct key_chooser
+{
+  key_chooser(key_dist dist, uint64_t n)
+  : dist(dist), zipf(n)
+  {}
+
+  uint64_t
+  next(rng &r, uint64_t n)
+  {
+    if(zipf.n < n) zipf.resize(n);
+    switch(dist){
+    case UNIFORM:
+      return r.next() % n;
+    case ZIPFIAN: // scrambled so that popular keys are spread
+      return fnv(zipf.next(r)) % n;
+    default:      // popular keys are the most recent ones
+      return n - 1 - zipf.next(r);
+    }
+  }
+
+  static uint64_t
+  fnv(uint64_t v)
+  {
+    uint64_t h = 14695981039346656037ull;
+    for(int i = 0; i < 8; ++i, v >>= 8){
+      h ^= v & 0xff;
+      h *= 1099511628211ull;
+    }
+    return h;
+  }
+
+  key_dist dist;
+  zipfian zipf;
+};
+
+struct value_size
+{
+  enum { FIXED, UNIFORM, EXP } kind;
+  uint32_t a, b;
+
+  bool
+  parse(std::string const &s)
+  {
+    char k[16] = {};
+    if(2 == sscanf(s.c_str(), "%15[a-z]:%u", k, &a) && !strcmp(k, "fixed"))
+      kind = FIXED;
+    else if(3 == sscanf(s.c_str(), "%15[a-z]:%u:%u", k, &a, &b) &&
+            !strcmp(k, "uniform") && a <= b)
+      kind = UNIFORM;
+    else if(2 == sscanf(s.c_str(), "%15[a-z]:%u", k, &a) && !strcmp(k, "exp"))
+      kind = EXP;
+    else
+      return false;
+    return a > 0;
+  }
+
+  uint32_t
+  next(rng &r) const
+  {
+    uint32_t rt;
+    switch(kind){
+    case FIXED: rt = a; break;
+    case UNIFORM: rt = a + r.next() % (b - a + 1); break;
+    default: rt = (uint32_t)(-log(1 - r.uniform()) * a); break;
+    }
+    return rt ? rt : 1;
+  }
+};
+
+// ---------------- stores ----------------
+
+struct store
+{
+  virtual ~store() {}
+  virtual char const* name() const = 0;
+  virtual void insert(uint64_t key, char const *data, uint32_t size) = 0;
+  virtual uint32_t read(uint64_t key, std::string *out) = 0;
+  virtual void update(uint64_t key, char const *data, uint32_t size) = 0;
+  virtual void append(uint64_t key, char const *data, uint32_t size) = 0;
+  // delete a segment and return the size after deletion
+  virtual uint32_t erase(uint64_t key, uint32_t off, uint32_t size) = 0;
+  virtual void remove(uint64_t key) = 0;
+};
+
+struct bdb_store : store
+{
+  explicit bdb_store(char const *dir)
+  {
+    BDB::Config conf;
+    conf.root_dir = dir;
+    conf.beg = 0;
+    bdb = new BDB::BehaviorDB(conf);
+  }
+  ~bdb_store() { delete bdb; }
+
+  char const* name() const { return "bdb"; }
+
+  void insert(uint64_t key, char const *data, uint32_t size)
+  {
+    if(key >= addrs.size()) addrs.resize(key + 1);
+    addrs[key] = bdb->put(data, size);
+  }
+
+  uint32_t read(uint64_t key, std::string *out)
+  { return bdb->get(out, BDB::npos, addrs[key]); }
+
+  void update(uint64_t key, char const *data, uint32_t size)
+  { bdb->update(data, size, addrs[key]); }
+
+  void append(uint64_t key, char const *data, uint32_t size)
+  { bdb->put(data, size, addrs[key]); }
+
+  uint32_t erase(uint64_t key, uint32_t off, uint32_t size)
+  { return bdb->del(addrs[key], off, size); }
+
+  void remove(uint64_t key)
+  { bdb->del(addrs[key]); }
+
+  BDB::BehaviorDB *bdb;
+  std::vector<BDB::AddrType> addrs;
+};
+
+// one file per object, opened and closed by every operation
+struct file_store : store
+{
+  explicit file_store(char const *dir) : dir(dir) {}
+
+  char const* name() const { return "file-per-object"; }
+
+  std::string
+  path(uint64_t key) const
+  {
+    char buf[32];
+    sprintf(buf, "bench_%08llx", (unsigned long long)key);
+    return dir + buf;
+  }
+
+  void write(uint64_t key, char const *mode, char const *data, uint32_t size)
+  {
+    FILE *fp = fopen(path(key).c_str(), mode);
+    if(!fp || size != fwrite(data, 1, size, fp)){
+      perror("file_store");
+      exit(1);
+    }
+    fclose(fp);
+  }
+
+  void insert(uint64_t key, char const *data, uint32_t size)
+  { write(key, "wb", data, size); }
+
+  uint32_t read(uint64_t key, std::string *out)
+  {
+    FILE *fp = fopen(path(key).c_str(), "rb");
+    if(!fp) return 0;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    out->resize(size);
+    size = size ? fread(&(*out)[0], 1, size, fp) : 0;
+    fclose(fp);
+    return size;
+  }
+
+  void update(uint64_t key, char const *data, uint32_t size)
+  { write(key, "wb", data, size); }
+
+  void append(uint64_t key, char const *data, uint32_t size)
+  { write(key, "ab", data, size); }
+
+  uint32_t erase(uint64_t key, uint32_t off, uint32_t size)
+  {
+    std::string buf;
+    read(key, &buf);
+    if(off > buf.size()) off = buf.size();
+    buf.erase(off, size);
+    write(key, "wb", buf.data(), buf.size());
+    return buf.size();
+  }
+
+  void remove(uint64_t key)
+  { ::remove(path(key).c_str()); }
+
+  std::string dir;
+};
+
+// ---------------- workloads ----------------
+
+enum op_type { READ, UPDATE, INSERT, SCAN, RMW, APPEND, PDEL, OP_TYPES };
+char const *op_names[] = {
+  "read", "update", "insert", "scan", "rmw", "append", "partial_del" };
+
+struct workload
+{
+  char const *name;
+  double mix[OP_TYPES]; // proportion of each op_type
+  bool latest;          // override key distribution with latest
+};
+
+workload const workloads[] = {
+  { "a",      { .50, .50, 0, 0, 0, 0, 0 }, false },
+  { "b",      { .95, .05, 0, 0, 0, 0, 0 }, false },
+  { "c",      { 1, 0, 0, 0, 0, 0, 0 }, false },
+  { "d",      { .95, 0, .05, 0, 0, 0, 0 }, true },
+  { "e",      { 0, 0, .05, .95, 0, 0, 0 }, false },
+  { "f",      { .50, 0, 0, 0, .50, 0, 0 }, false },
+  { "append", { .50, 0, 0, 0, 0, .50, 0 }, false },
+  { "pdel",   { .20, 0, 0, 0, 0, .40, .40 }, false }
+};
+
+struct options
+{
+  std::string dir;
+  uint64_t records, ops;
+  key_dist dist;
+  value_size vsize;
+  uint32_t append_size, scan_len;
+  bool baseline, json;
+};
+
+struct result
+{
+  std::string workload, store;
+  uint64_t ops, errors;
+  double elapsed;
+  BDB::histogram hist[OP_TYPES];
+};
+
+result
+run(workload const &w, store &st, options const &opt)
+{
+  typedef std::chrono::steady_clock clock_type;
+
+  rng r(42);
+  key_chooser keys(w.latest ? LATEST : opt.dist, opt.records);
+  std::string data, out;
+  uint64_t n = 0;
+
+  data.assign(1 << 20, 'x');
+  for(; n < opt.records; ++n)
+    st.insert(n, data.data(), opt.vsize.next(r));
+
+  result res;
+  res.workload = w.name;
+  res.store = st.name();
+  res.ops = opt.ops;
+  res.errors = 0;
+
+  clock_type::time_point beg = clock_type::now();
+  for(uint64_t i = 0; i < opt.ops; ++i){
+    double p = r.uniform();
+    unsigned int t = 0;
+    while(t + 1 < OP_TYPES && p >= w.mix[t]){
+      p -= w.mix[t];
+      ++t;
+    }
+    uint64_t key = keys.next(r, n);
+    uint32_t size = opt.vsize.next(r);
+    if(size > data.size()) size = data.size();
+
+    clock_type::time_point start = clock_type::now();
+    try{
+    switch(t){
+    case READ:
+      st.read(key, &out);
+      break;
+    case UPDATE:
+      st.update(key, data.data(), size);
+      break;
+    case INSERT:
+      st.insert(n++, data.data(), size);
+      break;
+    case SCAN:{
+      uint64_t len = 1 + r.next() % opt.scan_len;
+      for(uint64_t k = key; k < n && k < key + len; ++k)
+        st.read(k, &out);
+      }break;
+    case RMW:
+      st.read(key, &out);
+      st.update(key, out.data(), out.size());
+      break;
+    case APPEND:
+      st.append(key, data.data(), opt.append_size);
+      break;
+    case PDEL:
+      if(st.read(key, &out) > opt.append_size)
+        st.erase(key, r.next() % (out.size() - opt.append_size),
+                 opt.append_size);
+      break;
+    }
+    }catch(std::exception const &){
+      // e.g. chunk_overflow of a record grown by appends
+      res.errors++;
+    }
+    res.hist[t].record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      clock_type::now() - start).count());
+  }
+  res.elapsed = std::chrono::duration<double>(clock_type::now() - beg).count();
+
+  for(uint64_t k = 0; k < n; ++k)
+    st.remove(k);
+  return res;
+}
+
+void
+print(result const &res, bool json, bool first)
+{
+  using namespace std;
+  double tput = res.elapsed > 0 ? res.ops / res.elapsed : 0;
+
+  if(json){
+    cout << (first ? "  " : ", ") << fixed << setprecision(3)
+      << "{\"workload\": \"" << res.workload << "\""
+      << ", \"store\": \"" << res.store << "\""
+      << ", \"ops\": " << res.ops
+      << ", \"errors\": " << res.errors
+      << ", \"elapsed_s\": " << res.elapsed
+      << ", \"throughput\": " << tput
+      << ", \"latency_us\": {";
+    bool f = true;
+    for(unsigned int t = 0; t < OP_TYPES; ++t){
+      BDB::histogram const &h = res.hist[t];
+      if(!h.count()) continue;
+      cout << (f ? "" : ", ") << "\"" << op_names[t] << "\": {"
+        << "\"count\": " << h.count()
+        << ", \"mean\": " << h.mean() / 1e3
+        << ", \"p50\": " << h.percentile(.5) / 1e3
+        << ", \"p99\": " << h.percentile(.99) / 1e3
+        << ", \"p999\": " << h.percentile(.999) / 1e3
+        << ", \"max\": " << h.max() / 1e3 << "}";
+      f = false;
+    }
+    cout << "}}\n";
+    return;
+  }
+
+  cout << "workload " << res.workload << " (" << res.store << "): "
+    << fixed << setprecision(0) << tput << " ops/s, " 
+    << res.errors << " errors\n" << setprecision(1);
+  for(unsigned int t = 0; t < OP_TYPES; ++t){
+    BDB::histogram const &h = res.hist[t];
+    if(!h.count()) continue;
+    cout << "  " << left << setw(12) << op_names[t] << right
+      << setw(9) << h.count()
+      << "  p50 " << setw(8) << h.percentile(.5) / 1e3
+      << "  p99 " << setw(8) << h.percentile(.99) / 1e3
+      << "  p999 " << setw(8) << h.percentile(.999) / 1e3
+      << "  max " << setw(8) << h.max() / 1e3 << " us\n";
+  }
 }
 
 int main(int argc, char** argv)
 {
-	using namespace std;
-
-	char mode = 'b';
-	ifstream fin;
-	char buffer[1024*1024];
-	switch(argc){
-	case 3:
-		mode = argv[2][0];
-		if(mode != 'b' && mode != 'f' && mode != 'r'){
-			usage();
-			exit(1);
-		}
-	case 2:
-		fin.rdbuf()->pubsetbuf(buffer, 1024*1024);
-		fin.open(argv[1]);
-		if(!fin.is_open()){
-			cerr<<"Error: Open distribution file failed"<<endl;
-			usage();
-			exit(1);
-		}
-		
-	break;
-	default:
-		usage();
-		return 0;
-	}
-
-	Config conf;
-	conf.pool_log = false;
-	conf.chunk_unit = 12;
-	conf.migrate_threshold = 0x32;
-	BehaviorDB bdb(conf);
-	unsigned int handleCnt(0), accessCnt(0), handle(0); 
-	char data[100] = "data 100";
-	strcpy(data + 100 -5, "end\n");
-
-
-	fin>>handleCnt>>accessCnt;
-	
-	timeval put, append;
-	if('b' == mode){
-		vector<AddrType> handles(handleCnt);
-		TimeBeg(put);
-		for(int i=0; i<handleCnt; ++i){
-			handles[i] = (bdb.put(data, 100));
-			if(handles[i] == -1 && bdb.error_num){
-				cerr<<"Put bdb failed"<<endl;
-				exit(1);
-			}
-		}
-		TimeEnd(put);
-		TimeBeg(append);
-		const int wvsSize = 1000;
-		WriteVector wvs[wvsSize];
-		WriteVector wv;
-		wv.size = 100;
-		wv.buffer = data;
-		int wvIdx = 0;
-		for(size_t i=0; i<accessCnt; ++i){
-			fin>>handle;
-			wv.address = &handles[handle];
-			wvs[wvIdx++] = wv;
-			if(0 == wvIdx % wvsSize || i+1 == accessCnt){
-				size_t j = (wvIdx % wvsSize)?
-					i - i % wvsSize :
-					i + 1 - wvsSize;
-				// cout<<"Processing: "<<j<<"-"<<i<<endl;
-				int rt = bdb.append(wvs, wvIdx);
-				if(rt != wvIdx){
-					cerr<<"Append bdb failed"<<endl;
-					exit(1);
-				}
-				wvIdx = 0;
-			}
-		}
-		TimeEnd(append);
-	}else  if('f' == mode){ // no restriction filesystem mode
-		vector<FILE*> handles(handleCnt, 0);
-		stringstream cvt;
-		TimeBeg(put);
-		for(int i=0; i<handleCnt; ++i){
-			cvt.str("");
-			cvt<<"./benchfiles/";
-			cvt<<setw(8)<<setfill('0')<<hex<<i;
-			handles[i] = fopen(cvt.str().c_str(), "a");
-			if(handles[i] == 0){
-				cerr<<"Open written file error"<<endl;
-				cerr<<"System: "<<strerror(errno)<<endl;
-				exit(1);
-			}
-			fwrite(data, 1, 100, handles[i]);
-		}
-		TimeEnd(put);
-		TimeBeg(append);
-		for(size_t i=0; i<accessCnt; ++i){
-			fin>>handle;
-			fwrite(data, 1, 100, handles[handle]);
-		}
-		for(int i=0; i< handleCnt; ++i)
-			fclose(handles[i]);
-		TimeEnd(append);
-	}else if('r' == mode){	// restricted filesystem mode
-		vector<string> handles(handleCnt);
-		stringstream cvt;
-		TimeBeg(put);
-		FILE* fp = 0;
-		for(int i=0; i<handleCnt; ++i){
-			cvt.str("");
-			cvt.clear();
-			cvt<<"./benchfiles/";
-			cvt<<setw(8)<<setfill('0')<<hex<<i;
-			handles[i] = cvt.str();
-			fp = fopen(handles[i].c_str(), "a");
-			if(0 == fp){
-				cerr<<"Open written file error"<<endl;
-				cerr<<"System: "<<strerror(errno)<<endl;
-				exit(1);
-			}
-			fwrite(data, 1, 100, fp);
-			fclose(fp);
-		}
-		TimeEnd(put);
-		TimeBeg(append);
-		for(size_t i=0; i<accessCnt; ++i){
-			fin>>handle;
-			fp = fopen(handles[handle].c_str(), "a");
-			fwrite(data, 1, 100, fp);
-			fclose(fp);
-		}
-		TimeEnd(append);
-
-	}
-	cout.clear();
+  if(argc < 2) usage();
+
+  options opt;
+  opt.dir = argv[1];
+  opt.records = 10000;
+  opt.ops = 100000;
+  opt.dist = ZIPFIAN;
+  opt.vsize.parse("fixed:100");
+  opt.append_size = 100;
+  opt.scan_len = 100;
+  opt.baseline = opt.json = false;
+  std::string which("all");
+
+  for(int i = 2; i < argc; ++i){
+    std::string o(argv[i]);
+    bool has_arg = i + 1 < argc;
+    if(o == "--workload" && has_arg) which = argv[++i];
+    else if(o == "--records" && has_arg) opt.records = strtoull(argv[++i], 0, 10);
+    else if(o == "--ops" && has_arg) opt.ops = strtoull(argv[++i], 0, 10);
+    else if(o == "--append" && has_arg) opt.append_size = atoi(argv[++i]);
+    else if(o == "--scan" && has_arg) opt.scan_len = atoi(argv[++i]);
+    else if(o == "--baseline") opt.baseline = true;
+    else if(o == "--json") opt.json = true;
+    else if(o == "--value" && has_arg){
+      if(!opt.vsize.parse(argv[++i])) usage();
+    }else if(o == "--dist" && has_arg){
+      std::string d(argv[++i]);
+      if(d == "uniform") opt.dist = UNIFORM;
+      else if(d == "zipfian") opt.dist = ZIPFIAN;
+      else if(d == "latest") opt.dist = LATEST;
+      else usage();
+    }else usage();
+  }
+  if(!opt.records || !opt.scan_len || !opt.append_size) usage();
+
+  bool first = true;
+  if(opt.json) std::cout << "{\"version\": \"" << BDB::VERSION
+    << "\", \"results\": [\n";
 
+  unsigned int count = sizeof(workloads) / sizeof(workload);
+  for(unsigned int i = 0; i < count; ++i){
+    if(which != "all" && which != workloads[i].name) continue;
+    {
+      bdb_store st(opt.dir.c_str());
+      print(run(workloads[i], st, opt), opt.json, first);
+      first = false;
+    }
+    if(opt.baseline){
+      file_store st(opt.dir.c_str());
+      print(run(workloads[i], st, opt), opt.json, first);
+    }
+  }
+  if(first) usage();
+  if(opt.json) std::cout << "]}\n";
+  return 0;
 }
@@ -0,0 +1,82 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cassert>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Durable commits (Config::sync_commit) of concurrent writers. Each run
+// puts the same number of records split among threads, and reports how
+// many operations a sync of the group commit covers.
+
+void usage()
+{
+  printf("./bdb_commit work_dir/ [records] [commit_delay_us]\n");
+  exit(1);
+}
+
+void clean(std::string const &dir)
+{
+  std::string cmd = "rm -f " + dir + "*";
+  if(0 != system(cmd.c_str()))
+    exit(1);
+}
+
+void run(std::string const &dir, unsigned int threads, int records,
+         uint32_t delay)
+{
+  using namespace BDB;
+
+  clean(dir);
+  Config conf;
+  conf.root_dir = dir;
+  conf.beg = 0;
+  conf.collect_metrics = true;
+  conf.wal_checkpoint = 1 << 22;
+  conf.sync_commit = true;
+  conf.commit_delay = delay;
+
+  BehaviorDB bdb(conf);
+  std::string rec(100, 'r');
+  int per_thread = records / threads;
+
+  std::chrono::steady_clock::time_point beg =
+    std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for(unsigned int t = 0; t < threads; ++t){
+    workers.push_back(std::thread([&]() {
+      for(int i = 0; i < per_thread; ++i)
+        bdb.put(rec);
+    }));
+  }
+  for(unsigned int t = 0; t < threads; ++t)
+    workers[t].join();
+  double sec = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - beg).count();
+
+  Stat s;
+  bdb.stat(&s);
+  unsigned long long ops = s.ops[OP_PUT].count;
+  assert(ops == (unsigned long long)per_thread * threads);
+  printf("%3u threads: %9.0f commits/s  %6.3f syncs/commit  "
+         "p99 %8.3f ms\n", threads, ops / sec, (double)s.sync_count / ops,
+         s.ops[OP_PUT].latency_percentile(0.99) / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+  if(argc < 2) usage();
+
+  int records = argc > 2 ? atoi(argv[2]) : 4096;
+  uint32_t delay = argc > 3 ? strtoul(argv[3], 0, 10) : 0;
+
+  printf("==== BehaviorDB Durable Commit Benchmark ====\n");
+  printf("%d puts of 100 bytes, commit_delay %u us\n", records, delay);
+
+  unsigned int threads[] = { 1, 2, 4, 8, 16, 32, 64 };
+  for(size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i)
+    run(argv[1], threads[i], records, delay);
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void usage()
+{
+  printf("./bdb_compact work_dir/\n");
+  exit(1);
+}
+
+std::string make_record(int i)
+{
+  char buf[32];
+  sprintf(buf, "record-%d-", i);
+  std::string rt(buf);
+  rt.append(i % 7 * 10, 'a' + i % 26);
+  return rt;
+}
+
+// a crash right after compaction loses none of the moved records
+void test_synced(std::string const &dir, int count)
+{
+  using namespace BDB;
+
+  std::string root = dir + "synced/";
+  std::string cmd = "rm -rf " + root + " && mkdir -p " + root;
+  if(0 != system(cmd.c_str()))
+    exit(1);
+
+  Config conf;
+  conf.root_dir = root;
+  conf.beg = 0;
+  conf.wal_checkpoint = 1 << 22;
+  conf.sync_commit = true;
+
+  std::vector<AddrType> addrs(count);
+  Stat before;
+  {
+    BehaviorDB bdb(conf);
+    for(int i=0; i < count; ++i)
+      addrs[i] = bdb.put(make_record(i));
+    bdb.stat(&before);
+  }
+
+  pid_t pid = fork();
+  if(0 == pid){
+    // neither checkpoints nor closes after compaction
+    BehaviorDB *bdb = new BehaviorDB(conf);
+    for(int i=0; i < count; ++i)
+      if(i % 4) bdb->del(addrs[i]);
+    while(bdb->compact(1 << 20))
+      ;
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+
+  BehaviorDB bdb(conf);
+  Stat after;
+  bdb.stat(&after);
+  printf(" - synced compaction, disk size %llu -> %llu\n",
+         before.disk_size, after.disk_size);
+  assert(after.disk_size < before.disk_size);
+  std::string rec;
+  for(int i=0; i < count; i += 4){
+    bdb.get(&rec, 1024, addrs[i]);
+    assert(make_record(i) == rec);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Compaction Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+
+  int const count = 2000;
+  std::vector<AddrType> addrs(count);
+  std::string rec;
+  Stat before, after;
+
+  {
+    BehaviorDB bdb(conf);
+    for(int i=0; i < count; ++i)
+      addrs[i] = bdb.put(make_record(i));
+
+    // leave holes near the head of pool files
+    for(int i=0; i < count; ++i)
+      if(i % 4 || i < count / 2)
+        bdb.del(addrs[i]);
+
+    bdb.stat(&before);
+
+    printf(" - compact in bounded steps\n");
+    unsigned long long step, steps(0);
+    while(0 != (step = bdb.compact(4096)))
+      ++steps;
+    assert(steps > 1);
+
+    bdb.stat(&after);
+    printf(" - disk size %llu -> %llu, reclaimed %llu\n",
+           before.disk_size, after.disk_size, after.reclaimed_size);
+    assert(after.disk_size < before.disk_size);
+    assert(after.reclaimed_size > 0);
+
+    printf(" - verify moved records\n");
+    for(int i=count / 2; i < count; i += 4){
+      bdb.get(&rec, 1024, addrs[i]);
+      assert(make_record(i) == rec);
+    }
+
+    printf(" - write after compaction\n");
+    for(int i=0; i < count / 2; i += 4)
+      addrs[i] = bdb.put(make_record(i));
+  }
+
+  {
+    printf(" - reopen and verify\n");
+    BehaviorDB bdb(conf);
+    for(int i=0; i < count; i += 4){
+      bdb.get(&rec, 1024, addrs[i]);
+      assert(make_record(i) == rec);
+    }
+    for(int i=0; i < count; i += 4)
+      bdb.del(addrs[i]);
+    while(bdb.compact(1 << 20))
+      ;
+    after = Stat();
+    bdb.stat(&after);
+    printf(" - delete all then compact, disk size %llu\n", after.disk_size);
+    assert(0 == after.disk_size);
+  }
+
+  test_synced(argv[1], count);
+
+  return 0;
+}
@@ -0,0 +1,208 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <map>
+#include <vector>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void usage()
+{
+  printf("./bdb_direct work_dir/\n");
+  exit(1);
+}
+
+void clean(std::string const &dir)
+{
+  std::string cmd = "rm -f " + dir + "*";
+  if(0 != system(cmd.c_str()))
+    exit(1);
+}
+
+std::string make_data(size_t size)
+{
+  std::string s(size, 0);
+  for(size_t i = 0; i < size; ++i)
+    s[i] = 'a' + rand() % 26;
+  return s;
+}
+
+// pages of a file in the page cache
+size_t resident_pages(std::string const &path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) return 0;
+  struct stat st;
+  fstat(fd, &st);
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t pages = (st.st_size + page - 1) / page, rt = 0;
+  if(pages){
+    void *p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    assert(MAP_FAILED != p);
+    std::vector<unsigned char> vec(pages);
+    assert(0 == mincore(p, st.st_size, &vec[0]));
+    for(size_t i = 0; i < pages; ++i)
+      rt += vec[i] & 1;
+    munmap(p, st.st_size);
+  }
+  close(fd);
+  return rt;
+}
+
+void check(BDB::BehaviorDB &bdb,
+           std::map<BDB::AddrType, std::string> const &model)
+{
+  std::map<BDB::AddrType, std::string>::const_iterator it;
+  for(it = model.begin(); it != model.end(); ++it){
+    std::string got;
+    bdb.get(&got, BDB::npos, it->first);
+    assert(got == it->second);
+  }
+}
+
+bool match_model(BDB::AddrType addr, char const *data, uint32_t size,
+                 void *arg)
+{
+  std::map<BDB::AddrType, std::string> const &model = 
+    *(std::map<BDB::AddrType, std::string> const*)arg;
+  assert(model.find(addr)->second == std::string(data, size));
+  return true;
+}
+
+bool direct_pools = false;
+
+// random puts, inserts, appends, updates and erases of records around
+// the direct threshold, checked against a model
+size_t run(std::string const &dir, uint32_t threshold, bool hints = false)
+{
+  using namespace BDB;
+
+  clean(dir);
+  Config conf;
+  conf.root_dir = dir;
+  conf.beg = 0;
+  conf.direct_threshold = threshold;
+  conf.io_hints = hints;
+
+  std::map<AddrType, std::string> model;
+  srand(7);
+  {
+    BehaviorDB bdb(conf);
+
+    Stat s;
+    bdb.stat(&s);
+    // pools stay buffered where O_DIRECT is not supported
+    for(size_t p = 0; p < s.pool_direct.size(); ++p){
+      if(!s.pool_direct[p]) continue;
+      assert(threshold && s.pool_chunk_size[p] >= threshold);
+      direct_pools = true;
+    }
+
+    for(int i = 0; i < 400; ++i){
+      // records grow, and migrate, more often than they go
+      int const ops[] = { 0, 0, 0, 1, 1, 1, 2, 3, 4, 5 };
+      int op = model.empty() ? 0 : ops[rand() % 10];
+      std::map<AddrType, std::string>::iterator it = model.begin();
+      if(!model.empty())
+        std::advance(it, rand() % model.size());
+
+      switch(op){
+      case 0: {
+        std::string d = make_data(1 + rand() % 200000);
+        model[bdb.put(d)] = d;
+        break;
+      }
+      case 1: {
+        // appends start within a block
+        std::string d = make_data(1 + rand() % 30000);
+        assert(it->first == bdb.put(d, it->first));
+        it->second += d;
+        break;
+      }
+      case 2: {
+        uint32_t off = rand() % (it->second.size() + 1);
+        std::string d = make_data(1 + rand() % 5000);
+        assert(it->first == bdb.put(d, it->first, off));
+        it->second.insert(off, d);
+        break;
+      }
+      case 3: {
+        std::string d = make_data(1 + rand() % 150000);
+        assert(it->first == bdb.update(d, it->first));
+        it->second = d;
+        break;
+      }
+      case 4: {
+        uint32_t off = rand() % (it->second.size() + 1);
+        uint32_t size = rand() % 10000;
+        bdb.del(it->first, off, size);
+        it->second.erase(off, size);
+        break;
+      }
+      case 5:
+        assert(0 == bdb.del(it->first));
+        model.erase(it);
+        break;
+      }
+    }
+    check(bdb, model);
+
+    // reads at offsets not aligned to blocks
+    std::map<AddrType, std::string>::iterator it = model.begin();
+    for(; it != model.end(); ++it){
+      if(it->second.size() < 3) continue;
+      uint32_t off = it->second.size() / 3;
+      char buf[5000];
+      uint32_t n = bdb.get(buf, sizeof(buf), it->first, off);
+      assert(std::string(buf, n) == it->second.substr(off, sizeof(buf)));
+    }
+
+    bdb.compact(1 << 24);
+    check(bdb, model);
+  }
+
+  // pages of the pools of the largest records
+  size_t pages = 0;
+  char fname[32];
+  for(unsigned int p = 11; p < 16; ++p){
+    sprintf(fname, "%04x.pool", p);
+    pages += resident_pages(dir + fname);
+  }
+
+  // scans read direct pools through the page cache
+  BehaviorDB bdb(conf);
+  check(bdb, model);
+  assert(model.size() == bdb.scan(&match_model, &model));
+  return pages;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Direct I/O Testing ====\n");
+
+  printf(" - buffered pools\n");
+  size_t buffered = run(argv[1], 0);
+  printf("   %zu pages of large-chunk pools cached\n", buffered);
+
+  // records read back are cached whatever the hints, see 
+  // bdb_hints_bench for what they save
+  printf(" - buffered pools with page cache hints\n");
+  run(argv[1], 0, true);
+
+  printf(" - pools of chunks from 64KB on are direct\n");
+  size_t direct = run(argv[1], 1 << 16);
+  printf("   %zu pages of large-chunk pools cached\n", direct);
+  if(direct_pools)
+    assert(0 == direct && 0 < buffered);
+  else
+    printf("   O_DIRECT is not supported here\n");
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+void usage()
+{
+  printf("./bdb_exporter work_dir/\n");
+  exit(1);
+}
+
+std::string read_file(std::string const &path)
+{
+  std::ifstream in(path.c_str());
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+bool exists(std::string const &path)
+{
+  FILE *fp = fopen(path.c_str(), "rb");
+  if(fp) fclose(fp);
+  return 0 != fp;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Metrics Exporter Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+  conf.collect_metrics = true;
+  conf.metrics_file = conf.root_dir + "bdb.prom";
+  conf.metrics_interval = 20;
+
+  {
+    BehaviorDB bdb(conf);
+    for(int i=0; i < 100; ++i)
+      bdb.put(std::string(100, 'a'));
+
+    printf(" - periodic export\n");
+    std::string text;
+    for(int i=0; i < 100; ++i){
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      text = read_file(conf.metrics_file);
+      if(text.find("bdb_ops_total{op=\"put\"} 100\n") != std::string::npos)
+        break;
+    }
+    assert(text.find("bdb_ops_total{op=\"put\"} 100\n") != std::string::npos);
+    assert(text.find("# TYPE bdb_op_latency_seconds histogram\n") != 
+           std::string::npos);
+    assert(text.find(
+      "bdb_op_latency_seconds_bucket{op=\"put\",le=\"+Inf\"} 100\n") !=
+      std::string::npos);
+    assert(text.find("bdb_pool_occupancy_ratio{pool=\"3\"} 1\n") != 
+           std::string::npos);
+    assert(text.find("bdb_transaction_log_bytes ") != std::string::npos);
+    assert(text.find("bdb_device_written_bytes_total{device=\"0\"} ") != 
+           std::string::npos);
+    assert(!exists(conf.metrics_file + ".tmp"));
+
+    bdb.get(&text, 1024, 0);
+  }
+
+  printf(" - final export on close\n");
+  std::string text = read_file(conf.metrics_file);
+  assert(text.find("bdb_ops_total{op=\"get\"} 1\n") != std::string::npos);
+
+  printf(" - invalid interval\n");
+  conf.metrics_interval = 0;
+  try{
+    conf.validate();
+    assert(false && "zero interval should be rejected");
+  }catch(std::invalid_argument const &){}
+
+  return 0;
+}
@@ -8,7 +8,7 @@ int main()
 	ChunkHeader header;
 	header.size = 17;
 	
-	fixed_pool<ChunkHeader, 8> fpool(0, "");
+	fixed_pool<ChunkHeader, CHUNK_HEADER_SIZ> fpool(0, "");
 	
 	fpool.write(header, 0);
 
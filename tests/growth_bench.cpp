@@ -0,0 +1,94 @@
+#include "bdb.hpp"
+#include "bench.h"
+#include <cstdio>
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Replay a growth-heavy workload: records are created small and grow 
+// to final_size through interleaved appends.
+
+void usage()
+{
+  printf("./bdb_growth work_dir/ [records] [final_size]\n");
+  exit(1);
+}
+
+enum hint_mode { NO_HINT, PUT_HINT, RESERVE, ADAPTIVE };
+
+void run(char const *dir, hint_mode mode, int count, uint32_t final_size)
+{
+  using namespace std;
+  using namespace BDB;
+
+  Config conf;
+  conf.root_dir = dir;
+  conf.beg = 0;
+  conf.adaptive_growth = (ADAPTIVE == mode);
+  
+  uint32_t const init_size = 100, step = 1024;
+  std::string init(init_size, 'i'), chunk(step, 'a');
+  std::vector<AddrType> addrs(count);
+  std::string rec;
+  timeval beg;
+
+  BehaviorDB bdb(conf);
+
+  char const *label[] = {
+    "without hints:  ", "put with hints: ", "reserve:        ", 
+    "adaptive:       " };
+  cout << label[mode];
+  TimeBeg(beg);
+  for(int i=0; i < count; ++i){
+    if(PUT_HINT == mode){
+      addrs[i] = bdb.put(init, reserve_hint(final_size));
+    }else{
+      addrs[i] = bdb.put(init);
+      if(RESERVE == mode)
+        bdb.reserve(addrs[i], final_size);
+    }
+  }
+  for(uint32_t size = init_size; size + step <= final_size; size += step)
+    for(int i=0; i < count; ++i)
+      bdb.put(chunk, addrs[i]);
+  TimeEnd(beg);
+
+  Stat st;
+  unsigned long long migrations(0), copied(0);
+  bdb.stat(&st);
+  for(size_t i=0; i < st.pool_migrations.size(); ++i){
+    migrations += st.pool_migrations[i];
+    copied += st.pool_copied_size[i];
+  }
+  cout << "  migrations " << migrations << ", bytes copied " << copied << "\n";
+
+  if(ADAPTIVE == mode){
+    bdb.recommend(&conf);
+    cout << "  recommended min_size " << conf.min_size 
+      << ", addr_prefix_len " << conf.addr_prefix_len << "\n";
+  }
+
+  uint32_t expected = init_size + (final_size - init_size) / step * step;
+  for(int i=0; i < count; ++i){
+    assert(expected == bdb.get(&rec, final_size, addrs[i]));
+    bdb.del(addrs[i]);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if(argc < 2) usage();
+  
+  int count = argc > 2 ? atoi(argv[2]) : 200;
+  uint32_t final_size = argc > 3 ? strtoul(argv[3], 0, 10) : 64 << 10;
+  
+  printf("==== BehaviorDB Growth Benchmark ====\n");
+  printf("%d records grow from 100 bytes to %u bytes\n", count, final_size);
+  
+  run(argv[1], NO_HINT, count, final_size);
+  run(argv[1], PUT_HINT, count, final_size);
+  run(argv[1], RESERVE, count, final_size);
+  run(argv[1], ADAPTIVE, count, final_size);
+  return 0;
+}
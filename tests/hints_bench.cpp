@@ -0,0 +1,126 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Lookups of small hot records mixed with a stream of large puts and
+// appends that migrate, with and without Config::io_hints. Reports the
+// latency of the lookups and the page cache taken by pools of small and
+// of large chunks at the end.
+
+void usage()
+{
+  printf("./bdb_hints_bench work_dir/ [rounds]\n");
+  exit(1);
+}
+
+void clean(std::string const &dir)
+{
+  std::string cmd = "rm -f " + dir + "*";
+  if(0 != system(cmd.c_str()))
+    exit(1);
+}
+
+// pages of a file in the page cache
+size_t resident_pages(std::string const &path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) return 0;
+  struct stat st;
+  fstat(fd, &st);
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t pages = (st.st_size + page - 1) / page, rt = 0;
+  if(pages){
+    void *p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    assert(MAP_FAILED != p);
+    std::vector<unsigned char> vec(pages);
+    assert(0 == mincore(p, st.st_size, &vec[0]));
+    for(size_t i = 0; i < pages; ++i)
+      rt += vec[i] & 1;
+    munmap(p, st.st_size);
+  }
+  close(fd);
+  return rt;
+}
+
+uint32_t const LARGE = 1 << 16;
+
+void run(std::string const &dir, bool hints, int rounds)
+{
+  using namespace BDB;
+  typedef std::chrono::steady_clock clock_type;
+
+  clean(dir);
+  Config conf;
+  conf.root_dir = dir;
+  conf.beg = 0;
+  conf.io_hints = hints;
+  conf.dontneed_threshold = LARGE;
+
+  BehaviorDB bdb(conf);
+  srand(11);
+
+  std::vector<AddrType> small, large;
+  for(int i = 0; i < 4000; ++i)
+    small.push_back(bdb.put(std::string(200 + rand() % 3000, 's')));
+
+  std::vector<double> lat;
+  std::string got, big(1 << 20, 'l');
+  clock_type::time_point beg = clock_type::now();
+  for(int r = 0; r < rounds; ++r){
+    if(large.empty() || rand() % 3)
+      large.push_back(bdb.put(big.data(), LARGE + rand() % (LARGE * 4)));
+    else
+      bdb.put(big.data(), 1 + rand() % LARGE, large[rand() % large.size()]);
+
+    for(int i = 0; i < 20; ++i){
+      clock_type::time_point t = clock_type::now();
+      bdb.get(&got, npos, small[rand() % small.size()]);
+      lat.push_back(std::chrono::duration<double, std::micro>(
+        clock_type::now() - t).count());
+    }
+  }
+  double sec = std::chrono::duration<double>(clock_type::now() - beg).count();
+
+  if(getenv("SYNC")) { sync(); }
+  Stat s;
+  bdb.stat(&s);
+  size_t small_pages = 0, large_pages = 0;
+  char fname[32];
+  for(size_t p = 0; p < s.pool_chunk_size.size(); ++p){
+    sprintf(fname, "%04x.pool", (unsigned int)p);
+    size_t pages = resident_pages(dir + fname);
+    if(s.pool_chunk_size[p] >= LARGE)
+      large_pages += pages;
+    else
+      small_pages += pages;
+  }
+
+  std::sort(lat.begin(), lat.end());
+  double mb = sysconf(_SC_PAGESIZE) / (double)(1 << 20);
+  printf("%-6s %8.2f %8.2f %8.2f %12.1f %12.1f\n", hints ? "on" : "off",
+         sec, lat[lat.size() / 2], lat[lat.size() * 99 / 100],
+         small_pages * mb, large_pages * mb);
+}
+
+int main(int argc, char** argv)
+{
+  if(argc < 2) usage();
+  int rounds = argc > 2 ? atoi(argv[2]) : 3000;
+
+  printf("==== BehaviorDB I/O Hints Benchmark ====\n");
+  printf("%d rounds of a large put or append and 20 small gets\n", rounds);
+  printf("hints   total s  p50 us   p99 us  small MB cached  large MB cached\n");
+  run(argv[1], false, rounds);
+  run(argv[1], true, rounds);
+  return 0;
+}
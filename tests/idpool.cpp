@@ -25,7 +25,7 @@ int main(int argc, char **argv)
   AddrType addr;
   AddrType end_addr = std::numeric_limits<AddrType>::max();
 
-  typedef IDPool<fixed_pool<ChunkHeader, 8> >  header_pool_t;
+  typedef IDPool<fixed_pool<ChunkHeader, CHUNK_HEADER_SIZ> >  header_pool_t;
   typedef IDPool<vec_wrapper<AddrType> > addr_pool_t;
 
   {
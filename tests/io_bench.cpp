@@ -0,0 +1,94 @@
+#include "io_engine.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Random 4KB reads and synced 4KB writes submitted in batches of a
+// queue depth, through each I/O engine. Cached pages of the file are
+// dropped before each read run, so reads go to the device.
+
+void usage()
+{
+  printf("./bdb_io_bench work_dir/ [file_mb] [requests]\n");
+  exit(1);
+}
+
+uint32_t const BLOCK = 4096;
+
+double run(BDB::io_engine &engine, int fd, BDB::io_op op, 
+           uint32_t depth, off_t blocks, int requests)
+{
+  using namespace BDB;
+
+  std::vector<char> buf((size_t)depth * BLOCK, 'w');
+  engine.register_buffer(&buf[0], buf.size());
+  engine.register_files(&fd, 1);
+  if(IO_READ == op)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+  std::vector<io_request> reqs(depth);
+  srand(depth);
+  std::chrono::steady_clock::time_point beg =
+    std::chrono::steady_clock::now();
+  for(int done = 0; done < requests; done += depth){
+    for(uint32_t i = 0; i < depth; ++i){
+      reqs[i].op = op;
+      reqs[i].fd = fd;
+      reqs[i].buf = &buf[i * BLOCK];
+      reqs[i].len = BLOCK;
+      reqs[i].off = (off_t)(rand() % blocks) * BLOCK;
+      reqs[i].sync = (IO_WRITE == op);
+    }
+    engine.run(&reqs[0], depth);
+    for(uint32_t i = 0; i < depth; ++i)
+      assert(BLOCK == (uint32_t)reqs[i].result);
+  }
+  double sec = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - beg).count();
+  return (requests + depth - 1) / depth * depth / sec;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  off_t file_mb = argc > 2 ? atoi(argv[2]) : 256;
+  int requests = argc > 3 ? atoi(argv[3]) : 8192;
+  off_t blocks = file_mb * (1 << 20) / BLOCK;
+
+  std::string path = std::string(argv[1]) + "io_bench";
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+  std::vector<char> chunk(1 << 20, 'd');
+  for(off_t i = 0; i < file_mb; ++i)
+    assert((ssize_t)chunk.size() == 
+           pwrite(fd, &chunk[0], chunk.size(), i << 20));
+  fsync(fd);
+
+  printf("==== BehaviorDB I/O Engine Benchmark ====\n");
+  printf("%d requests of 4KB over %lld MB\n", requests, (long long)file_mb);
+  printf("depth  engine    read IOPS  write+sync IOPS\n");
+
+  IOEngine kinds[] = { IO_ENGINE_SYNC, IO_ENGINE_URING };
+  for(uint32_t depth = 1; depth <= 128; depth <<= 1){
+    for(size_t k = 0; k < 2; ++k){
+      std::unique_ptr<io_engine> engine(io_engine::create(kinds[k], depth));
+      double r = run(*engine, fd, IO_READ, depth, blocks, requests);
+      double w = run(*engine, fd, IO_WRITE, depth, blocks, requests / 8);
+      printf("%5u  %-8s  %9.0f  %15.0f\n", depth, engine->name(), r, w);
+    }
+  }
+
+  close(fd);
+  unlink(path.c_str());
+  return 0;
+}
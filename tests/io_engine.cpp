@@ -0,0 +1,223 @@
+#include "bdb.hpp"
+#include "io_engine.hpp"
+#include "exception.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+void usage()
+{
+  printf("./bdb_io work_dir/\n");
+  exit(1);
+}
+
+uint32_t const BLOCK = 4096;
+
+void test_engine(BDB::IOEngine kind, std::string const &dir)
+{
+  using namespace BDB;
+
+  // a small depth makes batches larger than the ring
+  std::unique_ptr<io_engine> engine(io_engine::create(kind, 8));
+  printf(" - %s\n", engine->name());
+
+  std::string path = dir + "io_" + engine->name();
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+
+  printf("   writes with and without a chained sync\n");
+  int const count = 64;
+  std::vector<char> data(count * BLOCK);
+  for(int i = 0; i < count; ++i)
+    memset(&data[i * BLOCK], 'a' + i % 26, BLOCK);
+  std::vector<io_request> reqs(count);
+  for(int i = 0; i < count; ++i){
+    reqs[i].op = IO_WRITE;
+    reqs[i].fd = fd;
+    reqs[i].buf = &data[i * BLOCK];
+    reqs[i].len = BLOCK;
+    reqs[i].off = (off_t)i * BLOCK;
+    reqs[i].sync = (0 == i % 3);
+  }
+  engine->run(&reqs[0], reqs.size());
+  for(int i = 0; i < count; ++i)
+    assert(BLOCK == (uint32_t)reqs[i].result);
+
+  printf("   reads in reverse order\n");
+  std::vector<char> back(count * BLOCK);
+  for(int i = 0; i < count; ++i){
+    reqs[i] = io_request();
+    reqs[i].op = IO_READ;
+    reqs[i].fd = fd;
+    reqs[i].buf = &back[(count - 1 - i) * BLOCK];
+    reqs[i].len = BLOCK;
+    reqs[i].off = (off_t)(count - 1 - i) * BLOCK;
+  }
+  engine->run(&reqs[0], reqs.size());
+  for(int i = 0; i < count; ++i)
+    assert(BLOCK == (uint32_t)reqs[i].result);
+  assert(data == back);
+
+  printf("   registered files and buffer\n");
+  bool files = engine->register_files(&fd, 1);
+  bool buffer = engine->register_buffer(&back[0], back.size());
+  printf("   (files %s, buffer %s)\n", files ? "kept" : "ignored",
+         buffer ? "kept" : "ignored");
+  memset(&back[0], 0, back.size());
+  for(int i = 0; i < count; ++i){
+    reqs[i].result = 0;
+    reqs[i].drain = (count / 2 == i);
+  }
+  engine->run(&reqs[0], reqs.size());
+  for(int i = 0; i < count; ++i)
+    assert(BLOCK == (uint32_t)reqs[i].result);
+  assert(data == back);
+
+  printf("   short reads at the end of file, errors and syncs\n");
+  io_request tail[4];
+  tail[0].op = IO_READ;
+  tail[0].fd = fd;
+  tail[0].buf = &back[0];
+  tail[0].len = 2 * BLOCK;
+  tail[0].off = (off_t)(count - 1) * BLOCK;
+  tail[1] = tail[0];
+  tail[1].off = (off_t)count * BLOCK;
+  tail[1].buf = &back[2 * BLOCK];
+  tail[2].op = IO_WRITE;
+  tail[2].fd = -1;
+  tail[2].buf = &data[0];
+  tail[2].len = BLOCK;
+  tail[2].sync = true;
+  tail[3].op = IO_SYNC;
+  tail[3].fd = fd;
+  tail[3].drain = true;
+  engine->run(tail, 4);
+  assert(BLOCK == (uint32_t)tail[0].result);
+  assert(0 == tail[1].result);
+  assert(-EBADF == tail[2].result);
+  assert(0 == tail[3].result);
+
+  engine->register_files(0, 0);
+  engine->register_buffer(0, 0);
+
+  printf("   a write and its sync fit a ring of depth 1\n");
+  std::unique_ptr<io_engine> single(io_engine::create(kind, 1));
+  tail[2].fd = fd;
+  single->run(&tail[2], 2);
+  assert(BLOCK == (uint32_t)tail[2].result);
+  assert(0 == tail[3].result);
+  close(fd);
+}
+
+bool count_records(BDB::AddrType, char const *data, uint32_t size, void *arg)
+{
+  for(uint32_t i = 1; i < size; ++i)
+    assert(data[i] == data[0]);
+  ++*(std::atomic<int>*)arg;
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB I/O Engine Testing ====\n");
+
+  test_engine(IO_ENGINE_SYNC, argv[1]);
+  test_engine(IO_ENGINE_URING, argv[1]);
+
+  printf(" - parallel_scan and sync_commit through the engine\n");
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+  conf.wal_checkpoint = 1 << 22;
+  conf.sync_commit = true;
+  conf.collect_metrics = true;
+  conf.io_engine = IO_ENGINE_URING;
+  conf.io_depth = 4;
+
+  int const records = 600;
+  size_t sizes[] = { 20, 300, 5000 };
+  std::vector<AddrType> addrs;
+  std::vector<std::string> data;
+  {
+    BehaviorDB bdb(conf);
+    for(int i = 0; i < records; ++i){
+      data.push_back(std::string(sizes[i % 3] + i % 7, 'a' + i % 26));
+      addrs.push_back(bdb.put(data.back()));
+    }
+
+    Stat s;
+    bdb.stat(&s);
+    assert(s.sync_count >= (unsigned long long)records);
+
+    std::atomic<int> seen(0);
+    ScanStat st = bdb.parallel_scan(&count_records, &seen, 4);
+    assert(records == seen);
+    assert((unsigned long long)records == st.records);
+  }
+  {
+    // reopened, data synced by the engine
+    BehaviorDB bdb(conf);
+    std::atomic<int> seen(0);
+    bdb.parallel_scan(&count_records, &seen, 2);
+    assert(records == seen);
+
+    printf(" - batch and asynchronous gets through the engine\n");
+    std::vector<std::string> got;
+    bdb.get(addrs, &got);
+    assert(got == data);
+
+    // the others are still read when one fails
+    bdb.del(addrs[1]);
+    try {
+      bdb.get(addrs, &got);
+      assert(false && "deleted record");
+    }catch(invalid_addr const &){}
+    assert(got[0] == data[0] && got[2] == data[2] && got.back() == data.back());
+
+    std::vector<std::future<std::string> > futures;
+    for(int i = 0; i < records; ++i)
+      futures.push_back(bdb.async_get(addrs[i], 100, 3));
+    for(int i = 0; i < records; ++i){
+      if(1 == i){
+        try {
+          futures[i].get();
+          assert(false && "deleted record");
+        }catch(invalid_addr const &){}
+        continue;
+      }
+      assert(futures[i].get() == data[i].substr(3, 100));
+    }
+
+    printf(" - compaction copies through the engine\n");
+    for(int i = 0; i < records; ++i)
+      if(i % 5 && 1 != i) bdb.del(addrs[i]);
+    assert(0 < bdb.compact(1 << 30));
+    for(int i = 0; i < records; i += 5){
+      std::string rec;
+      bdb.get(&rec, npos, addrs[i]);
+      assert(data[i] == rec);
+    }
+  }
+
+  conf.io_depth = 0;
+  try {
+    conf.validate();
+    assert(false && "io_depth 0");
+  }catch(std::invalid_argument const &){}
+
+  return 0;
+}
@@ -0,0 +1,139 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_metrics work_dir/\n");
+  exit(1);
+}
+
+std::string make_record(int i)
+{
+  return std::string(100 + i % 50, 'a' + i % 26);
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Metrics Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+
+  int const count = 1000;
+  std::vector<AddrType> addrs(count);
+  std::string rec;
+
+  {
+    printf(" - disabled by default\n");
+    BehaviorDB bdb(conf);
+    bdb.del(bdb.put(make_record(0)));
+    Stat s;
+    bdb.stat(&s);
+    assert(0 == s.ops[OP_PUT].count);
+    assert(0 == s.write_count);
+  }
+
+  conf.collect_metrics = true;
+  {
+    BehaviorDB bdb(conf);
+    Stat s;
+    bdb.stat_reset(&s);
+
+    printf(" - count operations\n");
+    unsigned long long put_bytes = 0;
+    for(int i=0; i < count; ++i){
+      rec = make_record(i);
+      addrs[i] = bdb.put(rec);
+      put_bytes += rec.size();
+    }
+    for(int i=0; i < count; ++i)
+      bdb.get(&rec, 1024, addrs[i]);
+    for(int i=0; i < count; i += 2)
+      bdb.put(std::string(200, 't'), addrs[i]);
+    for(int i=0; i < count; i += 4)
+      bdb.update(make_record(i), addrs[i]);
+    for(int i=1; i < count; i += 2)
+      bdb.del(addrs[i]);
+    try{
+      bdb.get(&rec, 1024, addrs[1]);
+      assert(false && "get of a deleted record should throw");
+    }catch(...){}
+
+    s = Stat();
+    bdb.stat(&s);
+    assert(count == s.ops[OP_PUT].count);
+    assert(put_bytes == s.ops[OP_PUT].bytes);
+    assert(count == s.ops[OP_GET].count);
+    assert(1 == s.ops[OP_GET].errors);
+    assert(count / 2 == s.ops[OP_INSERT].count);
+    assert(count / 4 == s.ops[OP_UPDATE].count);
+    assert(count / 2 == s.ops[OP_DEL].count);
+
+    OpStat const &put = s.ops[OP_PUT];
+    printf(" - put latency mean %.0f p50 %llu p99 %llu max %llu ns\n",
+           put.latency_mean(), put.latency_percentile(0.5),
+           put.latency_percentile(0.99), put.latency_max);
+    assert(put.latency_percentile(0.5) > 0);
+    assert(put.latency_percentile(0.5) <= put.latency_percentile(0.99));
+    assert(put.latency_percentile(1) == put.latency_max);
+
+    printf(" - seeks %llu reads %llu writes %llu flushes %llu, "
+           "write amplification %.2f\n",
+           s.seek_count, s.read_count, s.write_count, s.flush_count,
+           s.write_amplification());
+    assert(s.write_count > 0 && s.flush_count > 0 && s.read_count > 0);
+    assert(s.write_amplification() >= 1);
+
+    printf(" - pool occupancy\n");
+    unsigned long long chunks = 0, migrations = 0;
+    for(unsigned int i=0; i < s.pool_slots.size(); ++i){
+      chunks += s.pool_chunks[i];
+      migrations += s.pool_migrations_in[i];
+      assert(s.pool_chunks[i] <= s.pool_slots[i]);
+      if(s.pool_slots[i])
+        printf("   pool %u chunk %llu occupancy %.2f\n", i,
+               s.pool_chunk_size[i], s.occupancy(i));
+    }
+    assert(count / 2 == chunks);
+    assert(migrations > 0);
+
+    printf(" - reset while operations are running\n");
+    bdb.stat_reset(&s);
+    s = Stat();
+    bdb.stat(&s);
+    assert(0 == s.ops[OP_PUT].count && 0 == s.write_count);
+
+    int const threads = 4, per_thread = 500;
+    std::vector<std::thread> workers;
+    for(int t=0; t < threads; ++t)
+      workers.push_back(std::thread([&bdb]() {
+        for(int i=0; i < per_thread; ++i)
+          bdb.put(make_record(i));
+      }));
+    unsigned long long seen = 0;
+    for(int i=0; i < 50; ++i){
+      s = Stat();
+      bdb.stat_reset(&s);
+      seen += s.ops[OP_PUT].count;
+    }
+    for(int t=0; t < threads; ++t)
+      workers[t].join();
+    s = Stat();
+    bdb.stat_reset(&s);
+    seen += s.ops[OP_PUT].count;
+    assert(threads * per_thread == seen);
+  }
+
+  return 0;
+}
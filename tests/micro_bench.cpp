@@ -0,0 +1,349 @@
+#include "id_pool.hpp"
+#include "fixedPool.hpp"
+#include "addr_eval.hpp"
+#include "poolImpl.hpp"
+#include "v_iovec.hpp"
+#include "chunk.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Micro-benchmarks of the layers beneath BehaviorDB::put.
+//
+// Each benchmark runs a fixed number of iterations --reps times on
+// fresh files and prints one line in the Go benchmark format
+//
+//   Benchmark<Name>/<param>=<value>  <iterations>  <median> ns/op  <min> ns/op
+//
+// Lines come out in a fixed order, so results of two commits can be
+// compared with diff or benchstat.
+
+namespace {
+
+  typedef std::chrono::steady_clock clock_type;
+  typedef BDB::IDPool<BDB::fixed_pool<ChunkHeader, CHUNK_HEADER_SIZ> > idpool_t;
+
+  std::string work_dir;
+  std::string filter;
+  unsigned int reps = 5;
+
+  void usage()
+  {
+    printf(
+      "./bdb_micro work_dir/ [options]\n"
+      "  --sizes a,b,...   data sizes in bytes (default 16,256,4096,65536)\n"
+      "  --pools a,b,...   pool sizes in IDs (default 1024,65536)\n"
+      "  --reps N          repetitions per benchmark (default 5)\n"
+      "  --filter STR      run benchmarks whose name contains STR\n");
+    exit(1);
+  }
+
+  std::vector<uint32_t>
+  parse_list(char const *s)
+  {
+    std::vector<uint32_t> rt;
+    char *end;
+    while(*s){
+      rt.push_back(strtoul(s, &end, 10));
+      if(end == s) usage();
+      s = *end ? end + 1 : end;
+    }
+    return rt;
+  }
+
+  void
+  clean()
+  {
+    char const *exts[] = { "tran", "fpo", "pool" };
+    char fname[32];
+    for(unsigned int dir = 0; dir < 16; ++dir){
+      for(size_t i = 0; i < 3; ++i){
+        sprintf(fname, "%04x.%s", dir, exts[i]);
+        remove((work_dir + fname).c_str());
+      }
+    }
+    remove((work_dir + "src.dat").c_str());
+    remove((work_dir + "dest.dat").c_str());
+  }
+
+  uint64_t
+  elapsed_ns(clock_type::time_point beg)
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      clock_type::now() - beg).count();
+  }
+
+  /** Run fn reps times. fn does its own setup and returns the time
+   *  spent by iters operations.
+   */
+  template<typename Fn>
+  void
+  bench(std::string const &name, char const *param, uint32_t value,
+        uint64_t iters, Fn fn)
+  {
+    char full[256];
+    snprintf(full, sizeof(full), "Benchmark%s/%s=%u",
+             name.c_str(), param, value);
+    if(!filter.empty() && std::string(full).find(filter) == std::string::npos)
+      return;
+
+    std::vector<uint64_t> ns;
+    for(unsigned int i = 0; i < reps; ++i){
+      clean();
+      ns.push_back(fn());
+    }
+    clean();
+    std::sort(ns.begin(), ns.end());
+    printf("%-48s %10llu %12.1f ns/op %12.1f ns/op\n", full,
+           (unsigned long long)iters,
+           (double)ns[ns.size() / 2] / iters, (double)ns[0] / iters);
+    fflush(stdout);
+  }
+
+  // ---------------- IDPool ----------------
+
+  void
+  bench_idpool(uint32_t n)
+  {
+    bench("IDPoolAcquire", "pool", n, n, [n]() {
+      idpool_t ids(0, work_dir.c_str(), 0, BDB::npos, BDB::dynamic);
+      clock_type::time_point beg = clock_type::now();
+      for(uint32_t i = 0; i < n; ++i)
+        ids.Acquire();
+      return elapsed_ns(beg);
+    });
+
+    bench("IDPoolRelease", "pool", n, n, [n]() {
+      idpool_t ids(0, work_dir.c_str(), 0, BDB::npos, BDB::dynamic);
+      for(uint32_t i = 0; i < n; ++i)
+        ids.Acquire();
+      clock_type::time_point beg = clock_type::now();
+      for(uint32_t i = 0; i < n; ++i)
+        ids.Release(i);
+      return elapsed_ns(beg);
+    });
+
+    // each commit appends a line to .tran and flushes it
+    uint32_t commits = std::min(n, 16384u);
+    bench("IDPoolCommit", "pool", n, commits, [n, commits]() {
+      idpool_t ids(0, work_dir.c_str(), 0, BDB::npos, BDB::dynamic);
+      ChunkHeader ch;
+      ch.size = 100;
+      for(uint32_t i = 0; i < n; ++i)
+        ids.Acquire();
+      clock_type::time_point beg = clock_type::now();
+      for(uint32_t i = 0; i < commits; ++i)
+        ids.Commit((i * 7919u) % n, ch);
+      return elapsed_ns(beg);
+    });
+
+    bench("IDPoolReplay", "pool", n, n, [n]() {
+      {
+        idpool_t ids(0, work_dir.c_str(), 0, BDB::npos, BDB::dynamic);
+        ChunkHeader ch;
+        for(uint32_t i = 0; i < n; ++i){
+          ch.size = i;
+          ids.Commit(ids.Acquire(), ch);
+        }
+      }
+      clock_type::time_point beg = clock_type::now();
+      idpool_t ids(0, work_dir.c_str(), 0, BDB::npos, BDB::dynamic);
+      return elapsed_ns(beg);
+    });
+  }
+
+  // ---------------- fixed_pool ----------------
+
+  void
+  bench_fixed_pool(uint32_t n)
+  {
+    bench("FixedPoolStore", "pool", n, n, [n]() {
+      BDB::fixed_pool<ChunkHeader, CHUNK_HEADER_SIZ> fp(0, work_dir.c_str());
+      ChunkHeader ch;
+      clock_type::time_point beg = clock_type::now();
+      for(uint32_t i = 0; i < n; ++i){
+        ch.size = i;
+        fp.store(ch, i);
+      }
+      return elapsed_ns(beg);
+    });
+
+    bench("FixedPoolIndex", "pool", n, n, [n]() {
+      BDB::fixed_pool<ChunkHeader, CHUNK_HEADER_SIZ> fp(0, work_dir.c_str());
+      ChunkHeader ch;
+      for(uint32_t i = 0; i < n; ++i){
+        ch.size = i;
+        fp.store(ch, i);
+      }
+      uint64_t sum = 0;
+      clock_type::time_point beg = clock_type::now();
+      for(uint32_t i = 0; i < n; ++i)
+        sum += fp[(i * 7919u) % n].size;
+      uint64_t rt = elapsed_ns(beg);
+      if(sum == 1) puts("");  // keep the loop
+      return rt;
+    });
+  }
+
+  // ---------------- addr_eval ----------------
+
+  void
+  bench_addr_eval(uint32_t size)
+  {
+    uint32_t const iters = 1000000;
+
+    bench("AddrEvalDirectory", "size", size, iters, [size]() {
+      BDB::addr_eval<BDB::AddrType> ae;
+      ae.init(4, 32);
+      volatile unsigned int sink = 0;
+      clock_type::time_point beg = clock_type::now();
+      for(uint32_t i = 0; i < iters; ++i)
+        sink = ae.directory(size + (i & 7));
+      (void)sink;
+      return elapsed_ns(beg);
+    });
+
+    bench("AddrEvalGlobalAddr", "size", size, iters, [size]() {
+      BDB::addr_eval<BDB::AddrType> ae;
+      ae.init(4, 32);
+      unsigned int dir = ae.directory(size);
+      volatile BDB::AddrType sink = 0;
+      clock_type::time_point beg = clock_type::now();
+      for(uint32_t i = 0; i < iters; ++i)
+        sink = ae.global_addr(dir, i);
+      (void)sink;
+      return elapsed_ns(beg);
+    });
+  }
+
+  // ---------------- writevv ----------------
+
+  enum viov_kind { FILE_SRC, BUFFER, BLANK };
+
+  void
+  bench_writevv(uint32_t size)
+  {
+    char const *names[] = {
+      "WritevvFileSrc", "WritevvBuffer", "WritevvBlank" };
+    uint32_t const iters = std::max(64u, (16u << 20) / size);
+
+    for(int kind = FILE_SRC; kind <= BLANK; ++kind){
+      bench(names[kind], "size", size, iters, [size, kind, iters]() {
+        std::string data(size, 'x');
+        FILE *src = fopen((work_dir + "src.dat").c_str(), "w+b");
+        FILE *dest = fopen((work_dir + "dest.dat").c_str(), "w+b");
+        fwrite(data.data(), 1, size, src);
+        fflush(src);
+
+        BDB::viov vv;
+        vv.size = size;
+        if(FILE_SRC == kind){
+          BDB::file_src fs;
+          fs.fp = src;
+          fs.off = 0;
+          vv.data = fs;
+        }else if(BUFFER == kind){
+          vv.data = data.data();
+        }else{
+          vv.data = BDB::blank_src();
+        }
+
+        clock_type::time_point beg = clock_type::now();
+        for(uint32_t i = 0; i < iters; ++i)
+          BDB::writevv(&vv, 1, dest, (off_t)i * size);
+        uint64_t rt = elapsed_ns(beg);
+        fclose(src);
+        fclose(dest);
+        return rt;
+      });
+    }
+  }
+
+  // ---------------- pool ----------------
+
+  void
+  bench_pool(uint32_t size)
+  {
+    uint32_t const iters = std::max(64u, (1u << 20) / size);
+
+    // src chunks are filled to size, merges go to a pool twice as large
+    BDB::addr_eval<BDB::AddrType> ae;
+    ae.init(4, 32);
+    unsigned int dir = ae.directory(size);
+    if((unsigned int)-1 == dir || dir + 1 >= ae.dir_count())
+      return;
+
+    struct pools
+    {
+      BDB::pool *src, *dest;
+      BDB::AddrType addr;
+
+      pools(BDB::addr_eval<BDB::AddrType> &ae, unsigned int dir,
+            uint32_t size)
+      {
+        BDB::pool::config conf;
+        conf.work_dir = conf.trans_dir = conf.header_dir = work_dir;
+        conf.dirID = dir;
+        src = new BDB::pool(conf, ae);
+        conf.dirID = dir + 1;
+        dest = new BDB::pool(conf, ae);
+        std::string data(size, 'x');
+        addr = src->write(data.data(), size);
+      }
+      ~pools() { delete src; delete dest; }
+    };
+
+    char const *copy_names[] = { "PoolMergeCopy", "PoolMergeErase" };
+    for(int erase = 0; erase < 2; ++erase){
+      bench(copy_names[erase], "size", size, iters,
+            [&ae, dir, size, erase, iters]() {
+        pools p(ae, dir, size);
+        char const data[16] = "merge-copy-data";
+        clock_type::time_point beg = clock_type::now();
+        for(uint32_t i = 0; i < iters; ++i){
+          if(erase)
+            p.src->merge_erase(16, p.addr, size / 2, p.dest);
+          else
+            p.src->merge_copy(data, 16, p.addr, size / 2, p.dest);
+        }
+        return elapsed_ns(beg);
+      });
+    }
+  }
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  if(argc < 2) usage();
+
+  work_dir = argv[1];
+  std::vector<uint32_t> sizes = parse_list("16,256,4096,65536");
+  std::vector<uint32_t> pool_sizes = parse_list("1024,65536");
+
+  for(int i = 2; i < argc; ++i){
+    std::string o(argv[i]);
+    if(i + 1 >= argc) usage();
+    if(o == "--sizes") sizes = parse_list(argv[++i]);
+    else if(o == "--pools") pool_sizes = parse_list(argv[++i]);
+    else if(o == "--reps") reps = atoi(argv[++i]);
+    else if(o == "--filter") filter = argv[++i];
+    else usage();
+  }
+  if(!reps) usage();
+
+  for(size_t i = 0; i < pool_sizes.size(); ++i){
+    bench_idpool(pool_sizes[i]);
+    bench_fixed_pool(pool_sizes[i]);
+  }
+  for(size_t i = 0; i < sizes.size(); ++i){
+    bench_addr_eval(sizes[i]);
+    bench_writevv(sizes[i]);
+    bench_pool(sizes[i]);
+  }
+  return 0;
+}
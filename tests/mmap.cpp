@@ -0,0 +1,226 @@
+#include "bdb.hpp"
+#include "mmap_reader.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+void usage()
+{
+  printf("./bdb_mmap work_dir/\n");
+  exit(1);
+}
+
+void clean(std::string const &dir)
+{
+  std::string cmd = "rm -f " + dir + "*";
+  if(0 != system(cmd.c_str()))
+    exit(1);
+}
+
+std::string make_data(size_t size)
+{
+  std::string s(size, 0);
+  for(size_t i = 0; i < size; ++i)
+    s[i] = 'a' + rand() % 26;
+  return s;
+}
+
+void test_reader(std::string const &dir)
+{
+  using namespace BDB::detail;
+
+  printf(" - windows of two pages, two windows mapped\n");
+  std::string path = dir + "mmap_file";
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+  off_t page = sysconf(_SC_PAGESIZE);
+
+  std::string data = make_data(10 * page + 100);
+  assert((ssize_t)data.size() == pwrite(fd, data.data(), data.size(), 0));
+
+  mmap_reader reader(fd, 2 * page, 2);
+  std::vector<char> buf(data.size() + page);
+  for(int i = 0; i < 200; ++i){
+    off_t off = rand() % data.size();
+    uint32_t size = rand() % (5 * page);
+    uint32_t n = reader.read(&buf[0], size, off);
+    assert(n == std::min<off_t>(size, data.size() - off));
+    assert(0 == memcmp(&buf[0], data.data() + off, n));
+    assert(reader.mapped() <= 2);
+  }
+  assert(0 == reader.read(&buf[0], 10, data.size()));
+
+  printf("   writes are seen, in place and behind the end\n");
+  std::string more = make_data(3 * page);
+  assert((ssize_t)more.size() ==
+         pwrite(fd, more.data(), more.size(), data.size() - 50));
+  data.replace(data.size() - 50, 50, more);
+  buf.resize(data.size() + page);
+  uint32_t n = reader.read(&buf[0], buf.size(), 0);
+  assert(n == data.size() && 0 == memcmp(&buf[0], data.data(), n));
+
+  printf("   truncated\n");
+  reader.truncate(3 * page);
+  assert(0 == ftruncate(fd, 3 * page));
+  assert(page == (off_t)reader.read(&buf[0], 4 * page, 2 * page));
+  assert(0 == memcmp(&buf[0], data.data() + 2 * page, page));
+  assert(0 == reader.read(&buf[0], 10, 3 * page));
+
+  close(fd);
+}
+
+bool match_model(BDB::AddrType addr, char const *data, uint32_t size,
+                 void *arg)
+{
+  std::map<BDB::AddrType, std::string> const &model =
+    *(std::map<BDB::AddrType, std::string> const*)arg;
+  assert(model.find(addr)->second == std::string(data, size));
+  return true;
+}
+
+void check(BDB::BehaviorDB &bdb,
+           std::map<BDB::AddrType, std::string> const &model)
+{
+  std::map<BDB::AddrType, std::string>::const_iterator it;
+  for(it = model.begin(); it != model.end(); ++it){
+    std::string got;
+    bdb.get(&got, BDB::npos, it->first);
+    assert(got == it->second);
+  }
+}
+
+// seconds of random gets of every record
+double time_gets(BDB::BehaviorDB &bdb,
+                 std::map<BDB::AddrType, std::string> const &model)
+{
+  std::vector<BDB::AddrType> addrs;
+  std::map<BDB::AddrType, std::string>::const_iterator it;
+  for(it = model.begin(); it != model.end(); ++it)
+    addrs.push_back(it->first);
+
+  std::string got;
+  std::chrono::steady_clock::time_point beg =
+    std::chrono::steady_clock::now();
+  for(int i = 0; i < 20000; ++i)
+    bdb.get(&got, BDB::npos, addrs[rand() % addrs.size()]);
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - beg).count();
+}
+
+// random puts, appends, inserts, updates and erases, checked against a
+// model, with pool files preallocated ahead and shrunk
+double run(std::string const &dir, BDB::Mmap_test mmap_func)
+{
+  using namespace BDB;
+
+  clean(dir);
+  Config conf;
+  conf.root_dir = dir;
+  conf.beg = 0;
+  conf.mmap_func = mmap_func;
+  conf.prealloc_func = &extent_prealloc_est;
+
+  std::map<AddrType, std::string> model;
+  srand(5);
+  double sec;
+  {
+    BehaviorDB bdb(conf);
+
+    Stat s;
+    bdb.stat(&s);
+    for(size_t p = 0; p < s.pool_mmap.size(); ++p)
+      assert(s.pool_mmap[p] == (&all_mmap_test == mmap_func));
+
+    for(int i = 0; i < 3000; ++i){
+      int const ops[] = { 0, 0, 0, 1, 1, 2, 3, 4, 5 };
+      int op = model.empty() ? 0 : ops[rand() % 9];
+      std::map<AddrType, std::string>::iterator it = model.begin();
+      if(!model.empty())
+        std::advance(it, rand() % model.size());
+
+      switch(op){
+      case 0: {
+        std::string d = make_data(1 + rand() % (rand() % 8 ? 2000 : 100000));
+        model[bdb.put(d)] = d;
+        break;
+      }
+      case 1: {
+        std::string d = make_data(1 + rand() % 3000);
+        assert(it->first == bdb.put(d, it->first));
+        it->second += d;
+        break;
+      }
+      case 2: {
+        uint32_t off = rand() % (it->second.size() + 1);
+        std::string d = make_data(1 + rand() % 500);
+        assert(it->first == bdb.put(d, it->first, off));
+        it->second.insert(off, d);
+        break;
+      }
+      case 3: {
+        std::string d = make_data(1 + rand() % 4000);
+        assert(it->first == bdb.update(d, it->first));
+        it->second = d;
+        break;
+      }
+      case 4: {
+        uint32_t off = rand() % (it->second.size() + 1);
+        uint32_t size = 1 + rand() % 1000;
+        bdb.del(it->first, off, size);
+        it->second.erase(off, size);
+        break;
+      }
+      case 5:
+        assert(0 == bdb.del(it->first));
+        model.erase(it);
+        break;
+      }
+    }
+    check(bdb, model);
+
+    // records moved by compaction, pool files shrunk
+    bdb.compact(1 << 26);
+    check(bdb, model);
+    assert(model.size() == bdb.scan(&match_model, &model));
+    sec = time_gets(bdb, model);
+  }
+
+  BehaviorDB bdb(conf);
+  check(bdb, model);
+  return sec;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Memory-mapped Reads Testing ====\n");
+
+  test_reader(argv[1]);
+
+  printf(" - pools read through their stdio buffer\n");
+  double buffered = run(argv[1], &default_mmap_test);
+  printf("   20000 gets in %.3f s\n", buffered);
+
+  printf(" - pools read through mappings\n");
+  double mapped = run(argv[1], &all_mmap_test);
+  printf("   20000 gets in %.3f s\n", mapped);
+
+  Config conf;
+  conf.mmap_func = 0;
+  try {
+    conf.validate();
+    assert(false && "null mmap_func");
+  }catch(std::invalid_argument const &){}
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include "bdb.hpp"
+#include "bdbImpl.hpp"
+#include "poolImpl.hpp"
+#include "addr_eval.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_owner work_dir/\n");
+  exit(1);
+}
+
+std::string work_dir;
+
+BDB::pool*
+open_pool(BDB::addr_eval<BDB::AddrType> &ae, unsigned int dir)
+{
+  BDB::pool::config conf;
+  conf.work_dir = conf.trans_dir = conf.header_dir = work_dir;
+  conf.dirID = dir;
+  return new BDB::pool(conf, ae);
+}
+
+void
+test_pool()
+{
+  using namespace BDB;
+
+  addr_eval<AddrType> ae;
+  ae.init(4, 32);
+  std::string data(100, 'x');
+
+  printf(" - chunk headers keep owners\n");
+  pool *src = open_pool(ae, 2), *dest = open_pool(ae, 3);
+  AddrType a = src->write(data.data(), data.size(), chunk_owner(7));
+  AddrType b = src->write(data.data(), data.size());
+  assert(7 == src->owner(a));
+  assert(npos == src->owner(b));
+
+  printf(" - copies keep owners of their sources\n");
+  AddrType c = src->merge_move("abc", 3, a, npos, dest);
+  assert(7 == dest->owner(c));
+  c = dest->write("de", 2, c);
+  assert(7 == dest->owner(c));
+  c = dest->replace("fgh", 3, c);
+  assert(7 == dest->owner(c));
+  AddrType d = dest->write(data.data(), data.size(), chunk_owner(8));
+  dest->free(c);
+  d = dest->relocate(d, c);
+  assert(8 == dest->owner(d));
+  dest->set_owner(d, 9);
+
+  printf(" - owners are replayed\n");
+  delete src;
+  delete dest;
+  dest = open_pool(ae, 3);
+  assert(9 == dest->owner(d));
+  delete dest;
+
+  printf(" - headers without owners are upgraded\n");
+  FILE *fp = fopen((work_dir + "0005.tran").c_str(), "wb");
+  fprintf(fp, "+0\t%08x\n+1\t%08x\n-0\n+0\t%08x\n", 16, 32, 48);
+  fclose(fp);
+  fp = fopen((work_dir + "0005.fpo").c_str(), "wb");
+  fprintf(fp, "%08x%08x", 48, 32);
+  fclose(fp);
+  pool::upgrade(work_dir, 6);
+  pool::upgrade(work_dir, 6);
+  src = open_pool(ae, 5);
+  assert(48 == src->data_size(0) && npos == src->owner(0));
+  assert(32 == src->data_size(1) && npos == src->owner(1));
+  delete src;
+  dest = open_pool(ae, 3);
+  assert(9 == dest->owner(d));
+  delete dest;
+
+  printf(" - pools of a newer format are refused\n");
+  std::string marker = work_dir + "pool_format";
+  fp = fopen(marker.c_str(), "wb");
+  fprintf(fp, "3\n");
+  fclose(fp);
+  try {
+    pool::upgrade(work_dir, 6);
+    assert(false && "newer format");
+  }catch(std::invalid_argument const &){}
+  fp = fopen(marker.c_str(), "wb");
+  fprintf(fp, "2\n");
+  fclose(fp);
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+  work_dir = argv[1];
+
+  printf("==== BehaviorDB Chunk Owner Testing ====\n");
+
+  test_pool();
+
+  Config conf;
+  conf.root_dir = work_dir;
+  conf.beg = 0;
+  conf.slab_threshold = 64;
+
+  int const count = 2000;
+  std::vector<AddrType> addrs(count);
+  {
+    BehaviorDB bdb(conf);
+    BDBImpl *impl = bdb.impl();
+    for(int i=0; i < count; ++i)
+      addrs[i] = bdb.put(std::string(i % 3 ? 20 : 300, 'a'));
+
+    printf(" - records keep owners through migrations\n");
+    for(int i=0; i < count; i += 2)
+      bdb.put(std::string(500, 'b'), addrs[i]);
+    for(int i=1; i < count; i += 4)
+      bdb.update(std::string(3000, 'c'), addrs[i]);
+    for(int i=3; i < count; i += 8)
+      bdb.reserve(addrs[i], 6000);
+    bdb.put("spec", 4, count * 2);
+    assert(0 == impl->stale_owners());
+
+    printf(" - compaction relocates by owners\n");
+    for(int i=0; i < count; ++i)
+      if(i % 3 && i < count - 100)
+        bdb.del(addrs[i]);
+    assert(0 < bdb.compact(1 << 30));
+    assert(0 == impl->stale_owners());
+  }
+
+  BehaviorDB bdb(conf);
+  assert(0 == bdb.impl()->stale_owners());
+  for(int i=0; i < count; ++i){
+    if(i % 3 && i < count - 100) continue;
+    std::string rec;
+    bdb.get(&rec, npos, addrs[i]);
+    assert(!rec.empty());
+  }
+
+  return 0;
+}
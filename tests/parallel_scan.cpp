@@ -0,0 +1,176 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_pscan work_dir/\n");
+  exit(1);
+}
+
+// records of one repeated character, so torn reads are detected
+std::string make_record(int i)
+{
+  // small, medium and large records land in different pools
+  size_t sizes[] = { 20, 300, 5000 };
+  return std::string(sizes[i % 3] + i % 7, 'a' + i % 26);
+}
+
+struct visit
+{
+  BDB::BehaviorDB *bdb;
+  std::mutex mutex;
+  std::map<BDB::AddrType, std::string> seen;
+};
+
+bool collect(BDB::AddrType addr, char const *data, uint32_t size, void *arg)
+{
+  visit *v = (visit*)arg;
+
+  // the callback may use the BehaviorDB
+  std::string cur;
+  v->bdb->get(&cur, BDB::npos, addr);
+  assert(cur == std::string(data, size));
+
+  std::lock_guard<std::mutex> guard(v->mutex);
+  assert(v->seen.find(addr) == v->seen.end());
+  v->seen[addr].assign(data, size);
+  return true;
+}
+
+bool stop_at_ten(BDB::AddrType, char const *, uint32_t, void *arg)
+{
+  return ++*(std::atomic<int>*)arg < 10;
+}
+
+bool check_uniform(BDB::AddrType addr, char const *data, uint32_t size,
+                   void *arg)
+{
+  visit *v = (visit*)arg;
+  assert(size > 0);
+  for(uint32_t i = 1; i < size; ++i)
+    assert(data[i] == data[0]);
+
+  std::lock_guard<std::mutex> guard(v->mutex);
+  assert(v->seen.find(addr) == v->seen.end());
+  v->seen[addr].assign(data, size);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Parallel Scan Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+  conf.slab_threshold = 64;
+
+  int const total = 6000;
+  std::vector<AddrType> addrs(total);
+  BehaviorDB bdb(conf);
+  for(int i=0; i < total; ++i)
+    addrs[i] = bdb.put(make_record(i));
+
+  std::map<AddrType, std::string> expect;
+  unsigned long long bytes = 0;
+  for(int i=0; i < total; ++i){
+    if(i % 5 == 1 || (i > 2000 && i < 3000)){
+      bdb.del(addrs[i]);
+    }else{
+      expect[addrs[i]] = make_record(i);
+      bytes += expect[addrs[i]].size();
+    }
+  }
+
+  unsigned int threads[] = { 1, 4 };
+  for(size_t i = 0; i < 2; ++i){
+    printf(" - %u thread(s)\n", threads[i]);
+    visit v;
+    v.bdb = &bdb;
+    ScanStat st = bdb.parallel_scan(&collect, &v, threads[i]);
+    assert(expect == v.seen);
+    assert(expect.size() == st.records);
+    assert(bytes == st.bytes);
+    assert(0 == st.retries && 0 == st.moved);
+    printf("   %llu records, %.1f MB/s\n", st.records, st.throughput() / 1e6);
+  }
+
+  printf(" - stop early\n");
+  std::atomic<int> n(0);
+  ScanStat st = bdb.parallel_scan(&stop_at_ten, &n, 4);
+  assert(st.records >= 10 && st.records < 10 + 4);
+
+  printf(" - concurrent writes\n");
+  std::vector<AddrType> stable, changing;
+  for(int i=0; i < total; ++i){
+    if(expect.find(addrs[i]) == expect.end()) continue;
+    (i % 2 ? changing : stable).push_back(addrs[i]);
+  }
+
+  std::atomic<bool> done(false);
+  std::thread writer([&]() {
+    unsigned int round = 0;
+    size_t sizes[] = { 10, 40, 600, 3000, 9000 };
+    while(!done){
+      for(size_t i = 0; i < changing.size() && !done; ++i){
+        AddrType addr = changing[i];
+        switch((i + round) % 4){
+        case 0:
+          bdb.update(std::string(sizes[(i + round) % 5], 'A' + round % 26),
+                     addr);
+          break;
+        case 1: {
+          std::string cur;
+          bdb.get(&cur, npos, addr);
+          bdb.put(std::string(200, cur[0]), addr);
+          break;
+        }
+        case 2:
+          bdb.del(addr);
+          changing[i] = bdb.put(std::string(sizes[i % 5], 'z'));
+          break;
+        default:
+          bdb.compact(1 << 16);
+        }
+      }
+      ++round;
+    }
+  });
+
+  for(int i=0; i < 5; ++i){
+    visit v;
+    st = bdb.parallel_scan(&check_uniform, &v, 4);
+    assert(st.records == v.seen.size());
+    for(size_t j = 0; j < stable.size(); ++j)
+      assert(v.seen[stable[j]] == expect[stable[j]]);
+    printf("   %llu records, %llu retries, %llu moved\n",
+           st.records, st.retries, st.moved);
+  }
+  done = true;
+  writer.join();
+
+  printf(" - empty database\n");
+  visit v;
+  v.bdb = &bdb;
+  bdb.parallel_scan(&collect, &v, 4);
+  for(std::map<AddrType, std::string>::iterator i = v.seen.begin();
+      i != v.seen.end(); ++i)
+    bdb.del(i->first);
+  v.seen.clear();
+  assert(0 == bdb.parallel_scan(&collect, &v).records);
+
+  return 0;
+}
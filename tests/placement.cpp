@@ -0,0 +1,268 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <chrono>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+void usage()
+{
+  printf("./bdb_placement work_dir/\n");
+  exit(1);
+}
+
+// directories made empty
+std::vector<std::string> make_dirs(std::string const &dir, int count)
+{
+  std::vector<std::string> rt;
+  for(int i = 0; i < count; ++i){
+    char name[16];
+    sprintf(name, "d%d/", i);
+    rt.push_back(dir + name);
+    std::string cmd = "rm -rf " + rt.back() + " && mkdir -p " + rt.back();
+    if(0 != system(cmd.c_str()))
+      exit(1);
+  }
+  return rt;
+}
+
+// a root directory and pool directories of devices, all empty
+BDB::Config make_conf(std::string const &dir, int devices)
+{
+  std::vector<std::string> dirs = make_dirs(dir, devices + 1);
+  BDB::Config conf;
+  conf.root_dir = dirs[0];
+  conf.beg = 0;
+  conf.pool_dirs.assign(dirs.begin() + 1, dirs.end());
+  return conf;
+}
+
+bool has_pool(std::string const &dir, unsigned int id)
+{
+  char name[16];
+  sprintf(name, "%04x.pool", id);
+  return 0 == access((dir + name).c_str(), F_OK);
+}
+
+std::string make_data(size_t size)
+{
+  std::string s(size, 0);
+  for(size_t i = 0; i < size; ++i)
+    s[i] = 'a' + rand() % 26;
+  return s;
+}
+
+bool match_model(BDB::AddrType addr, char const *data, uint32_t size,
+                 void *arg)
+{
+  std::map<BDB::AddrType, std::string> const &model =
+    *(std::map<BDB::AddrType, std::string> const*)arg;
+  assert(model.find(addr)->second == std::string(data, size));
+  return true;
+}
+
+void check(BDB::BehaviorDB &bdb,
+           std::map<BDB::AddrType, std::string> const &model)
+{
+  std::map<BDB::AddrType, std::string>::const_iterator it;
+  for(it = model.begin(); it != model.end(); ++it){
+    std::string got;
+    bdb.get(&got, BDB::npos, it->first);
+    assert(got == it->second);
+  }
+  assert(model.size() == bdb.scan(&match_model, (void*)&model));
+  BDB::ScanStat st = bdb.parallel_scan(&match_model, (void*)&model, 3);
+  assert(model.size() == st.records);
+}
+
+// random puts, appends, inserts, updates and erases, checked against a
+// model, compacted and reopened
+void run(BDB::Config const &conf)
+{
+  using namespace BDB;
+
+  std::map<AddrType, std::string> model;
+  srand(11);
+  {
+    BehaviorDB bdb(conf);
+    for(int i = 0; i < 3000; ++i){
+      int const ops[] = { 0, 0, 0, 1, 1, 2, 3, 4, 5 };
+      int op = model.empty() ? 0 : ops[rand() % 9];
+      std::map<AddrType, std::string>::iterator it = model.begin();
+      if(!model.empty())
+        std::advance(it, rand() % model.size());
+
+      switch(op){
+      case 0: {
+        std::string d = make_data(1 + rand() % (rand() % 8 ? 2000 : 100000));
+        model[bdb.put(d)] = d;
+        break;
+      }
+      case 1: {
+        std::string d = make_data(1 + rand() % 3000);
+        assert(it->first == bdb.put(d, it->first));
+        it->second += d;
+        break;
+      }
+      case 2: {
+        uint32_t off = rand() % (it->second.size() + 1);
+        std::string d = make_data(1 + rand() % 500);
+        assert(it->first == bdb.put(d, it->first, off));
+        it->second.insert(off, d);
+        break;
+      }
+      case 3: {
+        std::string d = make_data(1 + rand() % 4000);
+        assert(it->first == bdb.update(d, it->first));
+        it->second = d;
+        break;
+      }
+      case 4: {
+        uint32_t off = rand() % (it->second.size() + 1);
+        uint32_t size = 1 + rand() % 1000;
+        bdb.del(it->first, off, size);
+        it->second.erase(off, size);
+        break;
+      }
+      case 5:
+        assert(0 == bdb.del(it->first));
+        model.erase(it);
+        break;
+      }
+    }
+    check(bdb, model);
+
+    // chunks of pools on different devices are moved at once
+    bdb.compact(1 << 26);
+    check(bdb, model);
+  }
+
+  BehaviorDB bdb(conf);
+  check(bdb, model);
+
+  Stat s;
+  bdb.stat(&s);
+  size_t devices = conf.pool_dirs.empty() ? 1 : conf.pool_dirs.size();
+  assert(devices == s.device_files.size());
+  assert(devices == s.device_reads.size());
+  unsigned long long files(0);
+  for(size_t d = 0; d < devices; ++d){
+    files += s.device_files[d];
+    printf("   device %zu: %llu files, %llu reads of %llu bytes\n", d,
+           s.device_files[d], s.device_reads[d], s.device_read_bytes[d]);
+  }
+  if(BDB::PLACE_STRIPE != conf.placement || devices == 1)
+    assert(s.pool_chunk_size.size() == files);
+}
+
+bool visit(BDB::AddrType, char const *, uint32_t, void *)
+{
+  return true;
+}
+
+// seconds of parallel scans of records striped over pool directories
+double time_scan(std::string const &dir, int devices)
+{
+  using namespace BDB;
+
+  Config conf = make_conf(dir, devices);
+  conf.placement = PLACE_STRIPE;
+
+  BehaviorDB bdb(conf);
+  std::string d = make_data(40000);
+  for(int i = 0; i < 2000; ++i)
+    bdb.put(d);
+
+  std::chrono::steady_clock::time_point beg =
+    std::chrono::steady_clock::now();
+  for(int i = 0; i < 5; ++i)
+    bdb.parallel_scan(&visit, 0, 4);
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - beg).count();
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+  std::string dir = argv[1];
+
+  printf("==== BehaviorDB Pool Placement Testing ====\n");
+
+  printf(" - directories are checked\n");
+  Config conf;
+  conf.root_dir = dir;
+  conf.beg = 0;
+  conf.pool_dirs.push_back(dir + "dev0");
+  try {
+    conf.validate();
+    assert(false && "no path delimiter");
+  }catch(std::invalid_argument const &){}
+  conf.pool_dirs[0] += "/";
+  conf.pool_dirs.push_back(conf.pool_dirs[0]);
+  try {
+    conf.validate();
+    assert(false && "same directory twice");
+  }catch(std::invalid_argument const &){}
+
+  printf(" - pools round-robin\n");
+  conf = make_conf(dir + "rr/", 3);
+  conf.placement = PLACE_ROUND_ROBIN;
+  run(conf);
+  for(unsigned int i = 0; i < 16; ++i){
+    for(unsigned int d = 0; d < 3; ++d)
+      assert(has_pool(conf.pool_dirs[d], i) == (i % 3 == d));
+  }
+
+  printf(" - pools of chunks from 64KB on have a device to themselves\n");
+  conf = make_conf(dir + "size/", 3);
+  conf.placement = PLACE_SIZE_CLASS;
+  conf.large_pool_threshold = 1 << 16;
+  run(conf);
+  Stat s;
+  {
+    BehaviorDB bdb(conf);
+    bdb.stat(&s);
+  }
+  for(unsigned int i = 0; i < s.pool_chunk_size.size(); ++i){
+    bool large = s.pool_chunk_size[i] >= (1 << 16);
+    assert(has_pool(conf.pool_dirs[2], i) == large);
+    assert(has_pool(conf.pool_dirs[i % 2], i) == !large);
+  }
+
+  printf(" - chunks striped, packed pool in one file, synced commits\n");
+  conf = make_conf(dir + "stripe/", 3);
+  conf.placement = PLACE_STRIPE;
+  conf.slab_threshold = 128;
+  conf.wal_checkpoint = 1 << 22;
+  conf.sync_commit = true;
+  run(conf);
+  for(unsigned int i = 1; i < 16; ++i){
+    for(unsigned int d = 0; d < 3; ++d)
+      assert(has_pool(conf.pool_dirs[d], i));
+  }
+  {
+    BehaviorDB bdb(conf);
+    bdb.stat(&s);
+    // chunks of every pool are read from every device
+    assert(3 == s.device_files.size());
+    for(unsigned int d = 0; d < 3; ++d)
+      assert(s.device_files[d] >= 15 && 0 < s.device_disk_size[d]);
+  }
+
+  printf(" - without pool_dirs, one device\n");
+  run(make_conf(dir + "plain/", 0));
+
+  printf(" - parallel scans of 80MB, 4 threads\n");
+  double one = time_scan(dir + "scan1/", 1);
+  double three = time_scan(dir + "scan3/", 3);
+  printf("   one directory %.3f s, striped over three %.3f s\n", one, three);
+
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_prealloc work_dir/\n");
+  exit(1);
+}
+
+std::string make_record(int i)
+{
+  char buf[32];
+  sprintf(buf, "record-%d-", i);
+  std::string rt(buf);
+  rt.append(i % 5 * 40, 'a' + i % 26);
+  return rt;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Preallocation Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+  conf.prealloc_func = &extent_prealloc_est;
+
+  int const count = 5000;
+  std::vector<AddrType> addrs(count);
+  std::string rec;
+  Stat st;
+
+  {
+    BehaviorDB bdb(conf);
+    for(int i=0; i < count; ++i)
+      addrs[i] = bdb.put(make_record(i));
+
+    bdb.stat(&st);
+    printf(" - used %llu, preallocated %llu\n", 
+           st.used_size, st.prealloc_size);
+    assert(st.used_size > 0);
+    if(0 == st.prealloc_size)
+      printf(" - preallocation is not supported by the file system\n");
+
+    for(int i=0; i < count; ++i){
+      bdb.get(&rec, 1024, addrs[i]);
+      assert(make_record(i) == rec);
+    }
+  }
+
+  {
+    printf(" - reopen and verify\n");
+    BehaviorDB bdb(conf);
+    for(int i=0; i < count; ++i){
+      bdb.get(&rec, 1024, addrs[i]);
+      assert(make_record(i) == rec);
+    }
+    for(int i=0; i < count; ++i)
+      addrs[i] = bdb.put(make_record(i), addrs[i]);
+    for(int i=0; i < count; ++i){
+      bdb.get(&rec, 2048, addrs[i]);
+      assert(make_record(i) + make_record(i) == rec);
+    }
+
+    printf(" - delete all then compact\n");
+    for(int i=0; i < count; ++i)
+      bdb.del(addrs[i]);
+    while(bdb.compact(1 << 20))
+      ;
+    st = Stat();
+    bdb.stat(&st);
+    assert(0 == st.used_size && 0 == st.prealloc_size && 0 == st.disk_size);
+  }
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_punch work_dir/\n");
+  exit(1);
+}
+
+std::string make_record(int i)
+{
+  return std::string(60000, 'a' + i % 26);
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Hole Punching Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+  conf.punch_threshold = 4096;
+
+  int const count = 32;
+  std::vector<AddrType> addrs(count);
+  std::string rec;
+  Stat before, after;
+
+  BehaviorDB bdb(conf);
+  for(int i=0; i < count; ++i)
+    addrs[i] = bdb.put(make_record(i));
+
+  bdb.stat(&before);
+
+  printf(" - delete every other record\n");
+  for(int i=0; i < count; i += 2)
+    bdb.del(addrs[i]);
+
+  bdb.stat(&after);
+  printf(" - disk size %llu -> %llu\n", before.disk_size, after.disk_size);
+  if(after.disk_size == before.disk_size)
+    printf(" - hole punching is not supported by the file system\n");
+  else
+    assert(after.disk_size < before.disk_size);
+
+  printf(" - verify remaining records\n");
+  for(int i=1; i < count; i += 2){
+    bdb.get(&rec, 65536, addrs[i]);
+    assert(make_record(i) == rec);
+  }
+
+  printf(" - reuse punched chunks\n");
+  for(int i=0; i < count; i += 2)
+    addrs[i] = bdb.put(make_record(i));
+  for(int i=0; i < count; ++i){
+    bdb.get(&rec, 65536, addrs[i]);
+    assert(make_record(i) == rec);
+  }
+
+  for(int i=0; i < count; ++i)
+    bdb.del(addrs[i]);
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_scan work_dir/\n");
+  exit(1);
+}
+
+std::string make_record(int i)
+{
+  char buf[32];
+  sprintf(buf, "record-%d-", i);
+  std::string rt(buf);
+  // small, medium and large records land in different pools
+  size_t sizes[] = { 20, 300, 5000 };
+  rt.append(sizes[i % 3], 'a' + i % 26);
+  return rt;
+}
+
+struct visit
+{
+  std::map<BDB::AddrType, std::string> seen;
+  std::vector<size_t> sizes;
+};
+
+bool collect(BDB::AddrType addr, char const *data, uint32_t size, void *arg)
+{
+  visit *v = (visit*)arg;
+  assert(v->seen.find(addr) == v->seen.end());
+  v->seen[addr].assign(data, size);
+  v->sizes.push_back(size);
+  return true;
+}
+
+bool stop_at_ten(BDB::AddrType, char const *, uint32_t, void *arg)
+{
+  return ++*(int*)arg < 10;
+}
+
+bool count(BDB::AddrType, char const *data, uint32_t size, void *arg)
+{
+  assert(0 == memcmp(data, "record-", 7));
+  (*(std::atomic<unsigned long long>*)arg) += size;
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Scan Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+  conf.slab_threshold = 64;
+
+  int const total = 3000;
+  std::vector<AddrType> addrs(total);
+  BehaviorDB bdb(conf);
+  for(int i=0; i < total; ++i)
+    addrs[i] = bdb.put(make_record(i));
+
+  // free slots in the middle of pool files
+  std::map<AddrType, std::string> expect;
+  unsigned long long bytes = 0;
+  for(int i=0; i < total; ++i){
+    if(i % 5 == 1 || (i > 1000 && i < 2000)){
+      bdb.del(addrs[i]);
+    }else{
+      expect[addrs[i]] = make_record(i);
+      bytes += expect[addrs[i]].size();
+    }
+  }
+
+  printf(" - scan in file order\n");
+  visit v;
+  assert(expect.size() == bdb.scan(&collect, &v));
+  assert(expect == v.seen);
+  // pools are visited in order of their chunk sizes
+  for(size_t i=1; i < v.sizes.size(); ++i)
+    assert(v.sizes[i - 1] / 100 <= v.sizes[i] / 100 || 
+           v.sizes[i - 1] < 100);
+
+  printf(" - stop early\n");
+  int n = 0;
+  assert(10 == bdb.scan(&stop_at_ten, &n));
+
+  printf(" - one thread per pool\n");
+  std::atomic<unsigned long long> scanned(0);
+  assert(expect.size() == bdb.scan(&count, &scanned, true));
+  assert(bytes == scanned);
+
+  printf(" - empty database\n");
+  for(std::map<AddrType, std::string>::iterator i = expect.begin();
+      i != expect.end(); ++i)
+    bdb.del(i->first);
+  assert(0 == bdb.scan(&collect, &v));
+
+  return 0;
+}
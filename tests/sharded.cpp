@@ -0,0 +1,238 @@
+#include "bdb.hpp"
+#include "sharded.hpp"
+#include "exception.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_sharded work_dir/\n");
+  exit(1);
+}
+
+// root directories of shards, made empty
+std::vector<std::string> make_dirs(std::string const &dir, int count)
+{
+  std::vector<std::string> rt;
+  for(int i = 0; i < count; ++i){
+    char name[32];
+    snprintf(name, sizeof(name), "shard%d/", i);
+    rt.push_back(dir + name);
+    std::string cmd = "rm -rf " + rt.back() + " && mkdir -p " + rt.back();
+    if(0 != system(cmd.c_str()))
+      exit(1);
+  }
+  return rt;
+}
+
+std::string make_record(int i)
+{
+  return std::string(10 + i % 3000, 'a' + i % 26);
+}
+
+struct scan_arg
+{
+  std::map<BDB::AddrType, std::string> const *model;
+  std::atomic<int> seen;
+};
+
+bool match_model(BDB::AddrType addr, char const *data, uint32_t size,
+                 void *arg)
+{
+  scan_arg *a = (scan_arg*)arg;
+  assert(a->model->find(addr)->second == std::string(data, size));
+  ++a->seen;
+  return true;
+}
+
+bool stop_at_ten(BDB::AddrType, char const *, uint32_t, void *arg)
+{
+  return ++((scan_arg*)arg)->seen < 10;
+}
+
+// seconds to put records in batches through shards
+double ingest(std::string const &dir, int shards, int records)
+{
+  using namespace BDB;
+
+  Config conf;
+  conf.beg = 0;
+  ShardedBehaviorDB db(
+    ShardedBehaviorDB::split(conf, make_dirs(dir + "ingest/", shards)),
+    SHARD_ROUND_ROBIN);
+
+  std::vector<std::string> batch;
+  for(int i = 0; i < 1000; ++i)
+    batch.push_back(make_record(i));
+  std::vector<AddrType> addrs;
+
+  std::chrono::steady_clock::time_point beg =
+    std::chrono::steady_clock::now();
+  for(int i = 0; i < records; i += batch.size())
+    db.put(batch, &addrs);
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - beg).count();
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+  std::string dir = argv[1];
+
+  printf("==== BehaviorDB Sharded Testing ====\n");
+
+  Config conf;
+  conf.beg = 0;
+  conf.end = 1000000;
+  std::vector<Config> confs =
+    ShardedBehaviorDB::split(conf, make_dirs(dir, 4));
+  assert(4 == confs.size());
+  assert(0 == confs[0].beg && 1000000 == confs[3].end);
+  for(size_t i = 1; i < confs.size(); ++i)
+    assert(confs[i - 1].end == confs[i].beg);
+
+  printf(" - ranges are checked\n");
+  std::vector<Config> bad = confs;
+  bad[1].beg -= 1;
+  try {
+    ShardedBehaviorDB db(bad);
+    assert(false && "overlapping ranges");
+  }catch(std::invalid_argument const &){}
+  bad = confs;
+  bad[2].root_dir = bad[0].root_dir;
+  try {
+    ShardedBehaviorDB db(bad);
+    assert(false && "shared root_dir");
+  }catch(std::invalid_argument const &){}
+  try {
+    Config tiny;
+    tiny.beg = 0;
+    tiny.end = 2;
+    ShardedBehaviorDB::split(tiny, make_dirs(dir, 3));
+    assert(false && "fewer addresses than shards");
+  }catch(std::invalid_argument const &){}
+
+  std::map<AddrType, std::string> model;
+  {
+    // shards given out of range order
+    std::vector<Config> shuffled(confs.rbegin(), confs.rend());
+    ShardedBehaviorDB db(shuffled);
+    assert(4 == db.shard_count());
+
+    printf(" - single operations are routed\n");
+    std::vector<int> per_shard(db.shard_count(), 0);
+    for(int i = 0; i < 400; ++i){
+      std::string d = make_record(i);
+      AddrType addr = db.put(d);
+      size_t s = db.shard_of(addr);
+      assert(shuffled[s].beg <= addr && addr < shuffled[s].end);
+      ++per_shard[s];
+      model[addr] = d;
+    }
+    // records hashed to every shard
+    for(size_t s = 0; s < per_shard.size(); ++s)
+      assert(per_shard[s] > 0);
+    std::map<AddrType, std::string>::iterator it = model.begin();
+    for(int i = 0; i < 100; ++i, ++it){
+      std::string more(50, 'z');
+      assert(it->first == db.put(more, it->first));
+      it->second += more;
+    }
+    ++it;
+    assert(it->first == db.update(std::string("updated"), it->first));
+    it->second = "updated";
+    ++it;
+    assert(0 == db.del(it->first));
+    model.erase(it++);
+
+    try {
+      db.shard_of(conf.end);
+      assert(false && "address of no shard");
+    }catch(invalid_addr const &){}
+
+    std::string got;
+    for(it = model.begin(); it != model.end(); ++it){
+      db.get(&got, npos, it->first);
+      assert(got == it->second);
+    }
+
+    printf(" - batches\n");
+    std::vector<std::string> batch;
+    for(int i = 0; i < 2000; ++i)
+      batch.push_back(make_record(i * 7));
+    std::vector<AddrType> addrs;
+    db.put(batch, &addrs);
+    assert(batch.size() == addrs.size());
+    for(size_t i = 0; i < addrs.size(); ++i)
+      model[addrs[i]] = batch[i];
+
+    std::vector<std::string> records;
+    db.get(addrs, &records);
+    assert(records == batch);
+
+    std::vector<AddrType> gone(addrs.begin(), addrs.begin() + 500);
+    db.del(gone);
+    for(size_t i = 0; i < gone.size(); ++i)
+      model.erase(gone[i]);
+
+    // the others are still read when one fails
+    std::vector<AddrType> some(addrs.begin() + 499, addrs.begin() + 600);
+    try {
+      db.get(some, &records);
+      assert(false && "deleted record");
+    }catch(invalid_addr const &){}
+    for(size_t i = 1; i < some.size(); ++i)
+      assert(records[i] == model[some[i]]);
+
+    printf(" - scans over shards\n");
+    scan_arg arg;
+    arg.model = &model;
+    arg.seen = 0;
+    assert(model.size() == db.scan(&match_model, &arg));
+    assert((int)model.size() == arg.seen);
+
+    arg.seen = 0;
+    ScanStat st = db.parallel_scan(&match_model, &arg, 2);
+    assert((int)model.size() == arg.seen);
+    assert(model.size() == st.records);
+
+    arg.seen = 0;
+    db.scan(&stop_at_ten, &arg);
+    assert(10 == arg.seen);
+  }
+
+  printf(" - reopened\n");
+  {
+    ShardedBehaviorDB db(confs, SHARD_ROUND_ROBIN);
+    std::string got;
+    std::map<AddrType, std::string>::iterator it;
+    for(it = model.begin(); it != model.end(); ++it){
+      db.get(&got, npos, it->first);
+      assert(got == it->second);
+    }
+
+    // in turn, whatever the data
+    std::string same("same");
+    for(int i = 0; i < 8; ++i)
+      assert((size_t)(i % 4) == db.shard_of(db.put(same)));
+  }
+
+  printf(" - ingest of 40000 records in batches of 1000\n");
+  int const records = 40000;
+  double one = ingest(dir, 1, records);
+  double four = ingest(dir, 4, records);
+  printf("   1 shard %.0f records/s, 4 shards %.0f records/s\n",
+         records / one, records / four);
+
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_slab work_dir/\n");
+  exit(1);
+}
+
+// slots of puts whose global addresses were lost by a crash
+void test_orphans(std::string const &dir)
+{
+  using namespace BDB;
+
+  std::string root = dir + "orphan/";
+  std::string cmd = "rm -rf " + root + " && mkdir -p " + root + "snap";
+  if(0 != system(cmd.c_str()))
+    exit(1);
+
+  Config conf;
+  conf.root_dir = root;
+  conf.beg = 0;
+  conf.slab_threshold = 256;
+
+  std::vector<AddrType> kept;
+  {
+    BehaviorDB bdb(conf);
+    for(int i=0; i < 100; ++i)
+      kept.push_back(bdb.put("kept", 4));
+  }
+  // the global table as if the puts below never committed
+  cmd = "cp " + root + "gid_* " + root + "snap/";
+  if(0 != system(cmd.c_str()))
+    exit(1);
+  Stat grown, after;
+  {
+    BehaviorDB bdb(conf);
+    for(int i=0; i < 1000; ++i)
+      bdb.put("lost", 4);
+    bdb.stat(&grown);
+  }
+  cmd = "cp " + root + "snap/gid_* " + root;
+  if(0 != system(cmd.c_str()))
+    exit(1);
+
+  BehaviorDB bdb(conf);
+  for(int i=0; i < 1000; ++i)
+    bdb.put("again", 5);
+  bdb.stat(&after);
+  assert(grown.pool_chunks[0] == after.pool_chunks[0]);
+  std::string rec;
+  for(size_t i=0; i < kept.size(); ++i){
+    bdb.get(&rec, 1024, kept[i]);
+    assert(rec == "kept");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Packed Pool Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+  conf.slab_threshold = 256;
+
+  std::string rec;
+  AddrType addrs[1000];
+
+  { // put then reopen
+    printf(" - put 1000 small records\n");
+    {
+      BehaviorDB bdb(conf);
+      char buf[32];
+      for(int i=0; i < 1000; ++i){
+        int len = sprintf(buf, "record-%d", i);
+        addrs[i] = bdb.put(buf, len);
+      }
+    }
+    printf(" - reopen and read\n");
+    BehaviorDB bdb(conf);
+    char buf[32], out[32];
+    for(int i=0; i < 1000; ++i){
+      uint32_t len = sprintf(buf, "record-%d", i);
+      assert(len == bdb.get(out, 32, addrs[i]));
+      assert(0 == strncmp(buf, out, len));
+    }
+  }
+
+  BehaviorDB bdb(conf);
+  std::string should;
+
+  { // in place append and insert
+    should = "record-0";
+    bdb.put("tail", 4, addrs[0]);
+    should += "tail";
+    bdb.put("head", 4, addrs[0], 0);
+    should.insert(0, "head");
+    bdb.put(" mid ", 5, addrs[0], 4);
+    should.insert(4, " mid ");
+    bdb.get(&rec, 1024, addrs[0]);
+    printf(" - append/prepend/insert within packed pool\n");
+    assert(should == rec);
+  }
+
+  { // relocate within packed pool
+    std::string more(100, 'x');
+    bdb.put(more, addrs[0]);
+    should += more;
+    bdb.get(&rec, 1024, addrs[0]);
+    printf(" - grow to another size class\n");
+    assert(should == rec);
+  }
+
+  { // migrate to a chunk pool
+    std::string large(300, 'y');
+    bdb.put(large, addrs[0]);
+    should += large;
+    bdb.get(&rec, 1024, addrs[0]);
+    printf(" - grow beyond slab_threshold\n");
+    assert(should == rec);
+  }
+
+  { // update
+    bdb.update("short", addrs[1]);
+    bdb.get(&rec, 1024, addrs[1]);
+    assert(rec == "short");
+    should.assign(200, 'z');
+    bdb.update(should, addrs[1]);
+    bdb.get(&rec, 1024, addrs[1]);
+    printf(" - update in place and across size classes\n");
+    assert(should == rec);
+  }
+
+  { // partial delete
+    uint32_t nsize = bdb.del(addrs[2], 0, 7);
+    bdb.get(&rec, 1024, addrs[2]);
+    printf(" - partial delete\n");
+    assert(nsize == 1 && rec == "2");
+  }
+
+  { // free slots are reused
+    Stat before, after;
+    bdb.stat(&before);
+    for(int i=3; i < 1000; ++i)
+      bdb.del(addrs[i]);
+    for(int i=3; i < 1000; ++i)
+      addrs[i] = bdb.put("again", 5);
+    bdb.stat(&after);
+    printf(" - reuse freed slots\n");
+    assert(before.disk_size == after.disk_size);
+  }
+
+  for(int i=0; i < 1000; ++i)
+    bdb.del(addrs[i]);
+
+  printf(" - slots of puts lost by a crash are freed on open\n");
+  test_orphans(argv[1]);
+
+  return 0;
+}
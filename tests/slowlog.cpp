@@ -0,0 +1,86 @@
+#include "bdb.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+void usage()
+{
+  printf("./bdb_slowlog work_dir/\n");
+  exit(1);
+}
+
+// value of "key=" in a tab separated slow.log line
+unsigned long long field(std::string const &line, char const *key)
+{
+  std::string k = std::string("\t") + key + "=";
+  size_t pos = line.find(k);
+  assert(pos != std::string::npos);
+  return strtoull(line.c_str() + pos + k.size(), 0, 10);
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+
+  printf("==== BehaviorDB Slow Operation Log Testing ====\n");
+
+  Config conf;
+  conf.root_dir = argv[1];
+  conf.beg = 0;
+  std::string path = conf.root_dir + "slow.log";
+
+  {
+    printf(" - disabled by default\n");
+    BehaviorDB bdb(conf);
+    bdb.del(bdb.put(std::string(100, 'a')));
+    assert(!std::ifstream(path.c_str()));
+  }
+
+  // every operation is slower than a microsecond
+  conf.slow_op_threshold = 1;
+  {
+    BehaviorDB bdb(conf);
+    std::string rec;
+    AddrType addr = bdb.put(std::string(100, 'a'));
+    bdb.put(std::string(400, 'b'), addr);
+    bdb.get(&rec, 1024, addr);
+    bdb.del(addr);
+  }
+
+  printf(" - one line per operation\n");
+  std::ifstream in(path.c_str());
+  std::vector<std::string> lines;
+  std::string line;
+  while(std::getline(in, line))
+    lines.push_back(line);
+  assert(4 == lines.size());
+  assert(lines[0].find("\tput ") != std::string::npos);
+  assert(lines[1].find("\tinsert ") != std::string::npos);
+  assert(lines[2].find("\tget ") != std::string::npos);
+  assert(lines[3].find("\tdel ") != std::string::npos);
+
+  printf(" - migration and phases\n");
+  assert(0 == field(lines[0], "migrated"));
+  assert(1 == field(lines[1], "migrated"));
+  assert(lines[1].find("\tpools=3->5\t") != std::string::npos);
+  assert(lines[2].find("\t500\t") != std::string::npos);
+
+  char const *phases[] = { "lookup", "header", "io", "commit", "log", "other" };
+  for(size_t i=0; i < lines.size(); ++i){
+    unsigned long long sum = 0;
+    for(size_t p=0; p < 6; ++p)
+      sum += field(lines[i], phases[p]);
+    unsigned long long total = field(lines[i], "total");
+    // each phase is rounded down to microseconds
+    assert(sum <= total && total <= sum + 6);
+  }
+  printf("%s\n", lines[1].c_str());
+
+  return 0;
+}
@@ -0,0 +1,240 @@
+#include "bdb.hpp"
+#include "exception.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void usage()
+{
+  printf("./bdb_wal work_dir/\n");
+  exit(1);
+}
+
+std::string work_dir;
+int const count = 1000;
+
+std::string make_record(int i, int round)
+{ return std::string(100 + (i * 37 + round * 11) % 900, 'a' + (i + round) % 26); }
+
+BDB::Config make_config(uint32_t wal_checkpoint)
+{
+  BDB::Config conf;
+  conf.root_dir = work_dir;
+  conf.beg = 0;
+  conf.wal_checkpoint = wal_checkpoint;
+  return conf;
+}
+
+void clean()
+{
+  std::string cmd = "rm -f " + work_dir + "*";
+  if(0 != system(cmd.c_str()))
+    exit(1);
+}
+
+long file_size(std::string const &name)
+{
+  FILE *fp = fopen((work_dir + name).c_str(), "rb");
+  if(!fp) return -1;
+  fseek(fp, 0, SEEK_END);
+  long rt = ftell(fp);
+  fclose(fp);
+  return rt;
+}
+
+double writes_per_put(uint32_t wal_checkpoint)
+{
+  using namespace BDB;
+
+  clean();
+  Config conf = make_config(wal_checkpoint);
+  conf.collect_metrics = true;
+  BehaviorDB bdb(conf);
+  for(int i=0; i < count; ++i)
+    bdb.put(make_record(i, 0));
+
+  Stat s;
+  bdb.stat(&s);
+  return (double)s.write_count / count;
+}
+
+bool deleted(int i)
+{ return i % 7 == 2; }
+
+std::string expected(int i)
+{
+  std::string rt = make_record(i, i % 3 ? 0 : 1);
+  if(i % 5 == 1) rt += make_record(i, 0);
+  return rt;
+}
+
+void run_ops(BDB::BehaviorDB &bdb, std::vector<BDB::AddrType> *addrs)
+{
+  for(int i=0; i < count; ++i)
+    (*addrs)[i] = bdb.put(make_record(i, 0));
+  for(int i=0; i < count; i += 3)
+    bdb.update(make_record(i, 1), (*addrs)[i]);
+  for(int i=1; i < count; i += 5)
+    bdb.put(make_record(i, 0), (*addrs)[i]);
+  for(int i=0; i < count; ++i)
+    if(deleted(i)) bdb.del((*addrs)[i]);
+}
+
+void verify(BDB::BehaviorDB &bdb, std::vector<BDB::AddrType> const &addrs)
+{
+  using namespace BDB;
+
+  for(int i=0; i < count; ++i){
+    std::string rec;
+    if(deleted(i)){
+      try {
+        bdb.get(&rec, npos, addrs[i]);
+        assert(false && "deleted record is found");
+      }catch(invalid_addr const&){}
+      continue;
+    }
+    bdb.get(&rec, npos, addrs[i]);
+    assert(expected(i) == rec);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  using namespace BDB;
+
+  if(argc < 2) usage();
+  work_dir = argv[1];
+
+  printf("==== BehaviorDB Write-Ahead Log Testing ====\n");
+
+  printf(" - off by default\n");
+  clean();
+  {
+    Config conf;
+    conf.root_dir = work_dir;
+    conf.beg = 0;
+    assert(0 == conf.wal_checkpoint);
+    BehaviorDB bdb(conf);
+    bdb.put(make_record(0, 0));
+  }
+  assert(-1 == file_size("bdb.wal"));
+
+  printf(" - writes per put\n");
+  double legacy = writes_per_put(0);
+  double logged = writes_per_put(1 << 30);
+  printf("   %.2f without log, %.2f with log\n", legacy, logged);
+  assert(logged <= 2.0 && logged < legacy);
+
+  printf(" - recovery after a crash\n");
+  clean();
+  std::vector<AddrType> addrs(count, npos);
+  int fds[2];
+  assert(0 == pipe(fds));
+  pid_t pid = fork();
+  if(0 == pid){
+    // neither checkpoints nor closes
+    BehaviorDB *bdb = new BehaviorDB(make_config(1 << 30));
+    run_ops(*bdb, &addrs);
+    size_t size = sizeof(AddrType) * count;
+    _exit(size == (size_t)write(fds[1], &addrs[0], size) ? 0 : 1);
+  }
+  close(fds[1]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+  assert((ssize_t)(sizeof(AddrType) * count) == 
+         read(fds[0], &addrs[0], sizeof(AddrType) * count));
+  close(fds[0]);
+  assert(0 == file_size("gid_0000.tran") && 0 < file_size("bdb.wal"));
+
+  // a record torn by the crash
+  FILE *fp = fopen((work_dir + "bdb.wal").c_str(), "ab");
+  fprintf(fp, "%08x\t%08x\ngid +", 100, 0);
+  fclose(fp);
+
+  {
+    BehaviorDB bdb(make_config(1 << 30));
+    assert(0 == file_size("bdb.wal") && 0 < file_size("gid_0000.tran"));
+    verify(bdb, addrs);
+  }
+
+  printf(" - frequent checkpoints\n");
+  clean();
+  {
+    BehaviorDB bdb(make_config(256));
+    run_ops(bdb, &addrs);
+    verify(bdb, addrs);
+    bdb.compact(1 << 30);
+    verify(bdb, addrs);
+  }
+  {
+    BehaviorDB bdb(make_config(1 << 30));
+    verify(bdb, addrs);
+  }
+
+  printf(" - synced commits\n");
+  clean();
+  {
+    Config conf = make_config(1 << 16);
+    conf.sync_commit = true;
+    conf.commit_delay = 100;
+    conf.collect_metrics = true;
+    BehaviorDB bdb(conf);
+    std::vector<std::vector<AddrType> > thread_addrs(8);
+    std::vector<std::thread> writers;
+    for(size_t t = 0; t < thread_addrs.size(); ++t){
+      writers.push_back(std::thread([&bdb, &thread_addrs, t]() {
+        for(int i=0; i < 200; ++i){
+          AddrType addr = bdb.put(make_record(i, t));
+          if(i % 4) 
+            thread_addrs[t].push_back(addr);
+          else 
+            bdb.del(addr);
+        }
+      }));
+    }
+    for(size_t t = 0; t < writers.size(); ++t)
+      writers[t].join();
+
+    Stat s;
+    bdb.stat(&s);
+    unsigned long long ops = s.ops[OP_PUT].count + s.ops[OP_DEL].count;
+    printf("   %llu syncs for %llu operations\n", s.sync_count, ops);
+    assert(0 < s.sync_count && s.sync_count < 2 * ops);
+    for(size_t t = 0; t < thread_addrs.size(); ++t){
+      for(size_t i = 0; i < thread_addrs[t].size(); ++i){
+        std::string rec;
+        bdb.get(&rec, npos, thread_addrs[t][i]);
+        assert(make_record(i + i / 3 + 1, t) == rec);
+      }
+    }
+  }
+
+  Config conf = make_config(0);
+  conf.sync_commit = true;
+  try {
+    BehaviorDB bdb(conf);
+    assert(false && "sync_commit without log");
+  }catch(std::invalid_argument const &){}
+
+  printf(" - without log\n");
+  clean();
+  {
+    BehaviorDB bdb(make_config(0));
+    run_ops(bdb, &addrs);
+    verify(bdb, addrs);
+  }
+  assert(-1 == file_size("bdb.wal"));
+  BehaviorDB bdb(make_config(0));
+  verify(bdb, addrs);
+
+  return 0;
+}
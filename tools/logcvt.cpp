@@ -37,8 +37,9 @@ int main(int argc, char** argv)
   char fmt_log[100]={};
   int len(0);
   while(fin>>token){
-    if("put" != token || 0 == fin>>token ) break;
+    if("put" != token || !(fin>>token) ) break;
     size = strtoul(token.c_str(), 0, 16);
+    getline(fin, token); // put address, if any
     len = snprintf(fmt_log, 100, "%-12s\t%08x\t%08x\t%08x\n", 
       "get", size, address, 0); 
     fout.write(fmt_log, len);
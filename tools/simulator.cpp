@@ -1,84 +1,450 @@
 #include <fstream>
 #include <iostream>
+#include <iomanip>
 #include <memory>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "bdb.hpp"
+#include "histogram.hpp"
+
+// Replay an access.log against a BehaviorDB and report latency
+// percentiles of each operation type. With --threads, the log is 
+// partitioned by global address so that operations on the same 
+// address keep their order. Puts then write to the addresses they 
+// logged, and are reported apart from puts that pick their own.
+
+namespace {
+
+  char const* op_names[] = {
+    "put", "put-spec", "insert", "get", "string_get", "del",
+    "partial_del", "update", "update_put", "put-reserve", "reserve",
+    "put/addr", "put-reserve/addr"
+  };
+
+  enum {
+    PUT, PUT_SPEC, INSERT, GET, STRING_GET, DEL,
+    PARTIAL_DEL, UPDATE, UPDATE_PUT, PUT_RESERVE, RESERVE,
+    OP_COUNT,
+    // puts replayed to their logged addresses
+    PUT_TO_ADDR = OP_COUNT, PUT_RESERVE_TO_ADDR,
+    STAT_COUNT
+  };
+
+  struct op
+  {
+    unsigned int type;
+    uint32_t size, off, capacity;
+    BDB::AddrType addr;
+    bool has_addr; ///< put logged with its assigned address
+    size_t seq;    ///< position in the log
+  };
+
+  /// Per-thread replay state
+  struct worker
+  {
+    std::vector<op> ops;
+    BDB::histogram hist[STAT_COUNT];
+    unsigned long long errors[STAT_COUNT];
+    /// operations slower than --stall-us, and their total latency
+    unsigned long long stalls;
+    uint64_t busy_ns, stall_ns;
+
+    worker() : stalls(0), busy_ns(0), stall_ns(0)
+    { memset(errors, 0, sizeof(errors)); }
+  };
+
+  struct sim_conf
+  {
+    BDB::AddrType beg, end;
+    unsigned int addr_prefix_len;
+    uint32_t min_size;
+  };
+
+  void usage()
+  {
+    std::cerr <<
+      "Usage: sim <log> <work_dir> [options]\n"
+      "  --rate <ops/s>     open-loop mode, issue operations at a fixed rate\n"
+      "                     (default is max-throughput mode)\n"
+      "  --load <log>       replay this log untimed before <log>\n"
+      "  --cache cold|warm  evict or preload files in work_dir before\n"
+      "                     the timed replay\n"
+      "  --threads <n>      replay with n threads, partitioned by address.\n"
+      "                     Puts are written to their logged addresses\n"
+      "                     and reported as put/addr and put-reserve/addr.\n"
+      "                     Logs whose puts have no address are refused\n"
+      "  --stall-us <us>    per thread, count operations slower than this\n"
+      "                     as stalls and sum their latencies (default 1000)\n"
+      "  --json             print results in JSON\n";
+    exit(1);
+  }
+
+  bool
+  parse_log(char const* fname, sim_conf *conf, std::vector<op> *ops)
+  {
+    using namespace std;
+
+    ifstream fin(fname, ios::binary | ios::in);
+    if(!fin.is_open()){
+      cerr << "open file " << fname << " failed\n";
+      return false;
+    }
+
+    string cmd;
+    fin >> cmd;
+    if(cmd != "conf"){
+      cerr << "no configuration log in " << fname << "\n";
+      return false;
+    }
+    fin >> conf->beg >> conf->end >> conf->addr_prefix_len >> conf->min_size;
+    getline(fin, cmd); // ignore others
+
+    op o;
+    string line;
+    while(getline(fin, line)){
+      istringstream is(line);
+      if(!(is >> cmd)) continue;
+
+      // the log is appended by every open of a BehaviorDB
+      if(cmd == "conf") continue;
+
+      memset(&o, 0, sizeof(o));
+      for(o.type = 0; o.type < OP_COUNT; ++o.type)
+        if(cmd == op_names[o.type]) break;
+
+      switch(o.type){
+      case PUT:
+        is >> o.size; 
+        o.has_addr = !!(is >> o.addr);
+        break;
+      case PUT_SPEC: case INSERT: case GET: case STRING_GET:
+        is >> o.size >> o.addr >> o.off; break;
+      case DEL:
+        is >> o.addr; break;
+      case PARTIAL_DEL:
+        is >> o.addr >> o.off >> o.size; break;
+      case UPDATE: case UPDATE_PUT:
+        is >> o.size >> o.addr; break;
+      case PUT_RESERVE:
+        is >> o.size >> o.capacity;
+        o.has_addr = !!(is >> o.addr);
+        break;
+      case RESERVE:
+        is >> o.addr >> o.capacity; break;
+      default:
+        cerr << "unknown method " << cmd << "\n";
+        return false;
+      }
+      o.seq = ops->size();
+      ops->push_back(o);
+    }
+    return true;
+  }
+
+  // spec_put: write puts to their logged addresses, which keeps 
+  // addresses identical to the log when puts run out of order
+  void
+  execute(BDB::BehaviorDB &bdb, op const &o, std::string &data, 
+          bool spec_put = false)
+  {
+    spec_put = spec_put && o.has_addr;
+
+    switch(o.type){
+    case PUT:
+      data.resize(o.size);
+      if(spec_put)
+        bdb.put(data.c_str(), o.size, o.addr);
+      else
+        bdb.put(data.c_str(), o.size);
+      break;
+    case PUT_SPEC: case INSERT:
+      data.resize(o.size);
+      bdb.put(data.c_str(), o.size, o.addr, o.off);
+      break;
+    case GET:
+      data.resize(o.size);
+      bdb.get(&data[0], o.size, o.addr, o.off);
+      break;
+    case STRING_GET:
+      bdb.get(&data, o.size, o.addr, o.off);
+      break;
+    case DEL:
+      bdb.del(o.addr);
+      break;
+    case PARTIAL_DEL:
+      bdb.del(o.addr, o.off, o.size);
+      break;
+    case UPDATE: case UPDATE_PUT:
+      data.resize(o.size);
+      bdb.update(data.c_str(), o.size, o.addr);
+      break;
+    case PUT_RESERVE:
+      data.resize(o.size);
+      if(spec_put){
+        bdb.put(data.c_str(), o.size, o.addr);
+        bdb.reserve(o.addr, o.capacity);
+      }else{
+        bdb.put(data.c_str(), o.size, BDB::reserve_hint(o.capacity));
+      }
+      break;
+    case RESERVE:
+      bdb.reserve(o.addr, o.capacity);
+      break;
+    }
+  }
+
+  // drop (cold) or load (warm) page cache of files in dir
+  void
+  prepare_cache(std::string const &dir, bool cold)
+  {
+#ifndef _WIN32
+    DIR *d = opendir(dir.empty() ? "." : dir.c_str());
+    if(!d) return;
+
+    std::vector<char> buf(1<<20);
+    struct dirent *ent;
+    while(0 != (ent = readdir(d))){
+      std::string fname = dir + ent->d_name;
+      int fd = open(fname.c_str(), O_RDONLY);
+      if(fd < 0) continue;
+      if(cold){
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      }else{
+        while(read(fd, &buf[0], buf.size()) > 0)
+          ;
+      }
+      close(fd);
+    }
+    closedir(d);
+#endif
+  }
+
+  typedef std::chrono::steady_clock clock_type;
+
+  void
+  replay(BDB::BehaviorDB &bdb, worker *w, clock_type::time_point beg,
+         std::chrono::nanoseconds interval, uint64_t stall_ns, 
+         bool spec_put)
+  {
+    using namespace std;
+    string data;
+
+    for(size_t i = 0; i < w->ops.size(); ++i){
+      op const &o = w->ops[i];
+      clock_type::time_point start = clock_type::now();
+
+      // open-loop: latency counts from the scheduled time so that
+      // queueing behind slow operations is not hidden
+      if(interval.count()){
+        clock_type::time_point sched = beg + interval * o.seq;
+        if(sched > start)
+          this_thread::sleep_until(sched);
+        start = sched;
+      }
+
+      unsigned int slot = o.type;
+      if(spec_put && o.has_addr && PUT == o.type)
+        slot = PUT_TO_ADDR;
+      else if(spec_put && o.has_addr && PUT_RESERVE == o.type)
+        slot = PUT_RESERVE_TO_ADDR;
+      try{
+        execute(bdb, o, data, spec_put);
+      }catch(std::exception const&){
+        w->errors[slot]++;
+      }
+
+      uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(
+        clock_type::now() - start).count();
+      w->hist[slot].record(ns);
+      w->busy_ns += ns;
+      if(ns > stall_ns){
+        w->stalls++;
+        w->stall_ns += ns;
+      }
+    }
+  }
+
+  double
+  us(uint64_t ns)
+  { return ns / 1000.0; }
+
+} // anonymous namespace
 
 int main(int argc, char** argv)
 {
   using namespace std;
 
-  if(argc < 3){
-    cerr << "Usage: sim2 <log> <work_dir>\n";
-    return 1;
+  if(argc < 3) usage();
+
+  double rate = 0;
+  char const *load_log = 0;
+  string cache;
+  bool json = false;
+  unsigned int threads = 1;
+  uint64_t stall_ns = 1000000;
+
+  for(int i = 3; i < argc; ++i){
+    string opt(argv[i]);
+    if(opt == "--rate" && i + 1 < argc)
+      rate = atof(argv[++i]);
+    else if(opt == "--load" && i + 1 < argc)
+      load_log = argv[++i];
+    else if(opt == "--cache" && i + 1 < argc)
+      cache = argv[++i];
+    else if(opt == "--threads" && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if(opt == "--stall-us" && i + 1 < argc)
+      stall_ns = strtoull(argv[++i], 0, 10) * 1000;
+    else if(opt == "--json")
+      json = true;
+    else
+      usage();
   }
+  if((!cache.empty() && cache != "cold" && cache != "warm") || !threads)
+    usage();
 
-  ifstream fin(argv[1], ios::binary | ios::in);
+  sim_conf sconf;
+  vector<op> load_ops, ops;
 
-  if(!fin.is_open()){
-    cerr << "open file " << argv[1] << "failed\n";
+  if(load_log && !parse_log(load_log, &sconf, &load_ops))
+    return 1;
+  if(!parse_log(argv[1], &sconf, &ops))
     return 1;
+
+  // partition by address, which puts without logged address lack
+  vector<worker> workers(threads);
+  for(size_t i = 0; i < ops.size(); ++i){
+    bool keyed = (PUT != ops[i].type && PUT_RESERVE != ops[i].type) ||
+      ops[i].has_addr;
+    if(!keyed && threads > 1){
+      cerr << argv[1] << " has puts without address, "
+        "replay it without --threads\n";
+      return 1;
+    }
+    workers[ops[i].addr % threads].ops.push_back(ops[i]);
   }
+  vector<op>().swap(ops);
 
-  std::string cmd;
-  shared_ptr<BDB::BehaviorDB> bdb;
+  BDB::Config conf(sconf.beg, sconf.end, sconf.addr_prefix_len,
+                   sconf.min_size, argv[2]);
+  BDB::BehaviorDB bdb(conf);
+  string data;
 
-  fin >> cmd;
-  if(cmd != "conf"){
-    cerr << "no configuration log\n";
-    return 1;
+  for(size_t i = 0; i < load_ops.size(); ++i)
+    execute(bdb, load_ops[i], data);
+
+  if(!cache.empty())
+    prepare_cache(argv[2], cache == "cold");
+
+  chrono::nanoseconds interval(rate > 0 ? (long long)(1e9 / rate) : 0);
+  clock_type::time_point beg = clock_type::now();
+
+  if(1 == threads){
+    replay(bdb, &workers[0], beg, interval, stall_ns, false);
   }else{
-    BDB::AddrType beg, end;
-    unsigned int addr_prefix_len;
-    uint32_t min_size;
-    fin >> beg >> end >> addr_prefix_len >> min_size;
-    BDB::Config conf(beg, end, addr_prefix_len, min_size, argv[2]);
-    bdb.reset(new BDB::BehaviorDB(conf));
-    getline(fin, cmd); // ignore others
+    vector<thread> pool;
+    for(unsigned int t = 0; t < threads; ++t)
+      pool.push_back(thread(replay, ref(bdb), &workers[t], beg, 
+                            interval, stall_ns, true));
+    for(unsigned int t = 0; t < threads; ++t)
+      pool[t].join();
   }
-  
-  uint32_t size, off;
-  BDB::AddrType addr;
-  std::string data;
-
-  while(fin >> cmd){
-    if(cmd == "put"){
-      fin >> size;
-      data.resize(size);
-      bdb->put(data.c_str(), size);
-    }else if(cmd == "put-spec"){
-      fin >> size >> addr >> off;
-      data.resize(size);
-      bdb->put(data.c_str(), size, addr, off);
-    }else if(cmd == "insert"){
-      fin >> size >> addr >> off;
-      data.resize(size);
-      bdb->put(data.c_str(), size, addr, off);
-    }else if(cmd == "get"){
-      fin >> size >> addr >> off;
-      data.resize(size);
-      bdb->get(&data[0], size, addr, off);
-    }else if(cmd == "string_get"){
-      fin >> size >> addr >> off;
-      bdb->get(&data, size, addr, off);
-    }else if(cmd == "del"){
-      fin >> addr;
-      bdb->del(addr);
-    }else if(cmd == "partial_del"){
-      fin >> addr >> off >> size;
-      bdb->del(addr, off, size);
-    }else if(cmd == "update"){
-      fin >> size >> addr;
-      data.resize(size);
-      bdb->update(data.c_str(), size, addr);
-    }else if(cmd == "update_put"){
-      fin >> size >> addr;
-      data.resize(size);
-      bdb->update(data.c_str(), size, addr);
-    }else{
-      cerr << "unknown method " << cmd <<"\n";
-      return 1;
+
+  double elapsed = chrono::duration<double>(clock_type::now() - beg).count();
+
+  BDB::histogram hist[STAT_COUNT], total;
+  unsigned long long errors[STAT_COUNT] = {};
+  for(unsigned int t = 0; t < threads; ++t){
+    for(unsigned int i = 0; i < STAT_COUNT; ++i){
+      hist[i].merge(workers[t].hist[i]);
+      total.merge(workers[t].hist[i]);
+      errors[i] += workers[t].errors[i];
+    }
+  }
+  double throughput = elapsed > 0 ? total.count() / elapsed : 0;
+
+  if(json){
+    cout << fixed << setprecision(3)
+      << "{\"version\": \"" << BDB::VERSION << "\""
+      << ", \"mode\": \"" << (rate > 0 ? "open-loop" : "max-throughput") << "\""
+      << ", \"target_rate\": " << rate
+      << ", \"cache\": \"" << (cache.empty() ? "none" : cache) << "\""
+      << ", \"threads\": " << threads
+      << ", \"ops\": " << total.count()
+      << ", \"elapsed_s\": " << elapsed
+      << ", \"throughput\": " << throughput
+      << ", \"latency_us\": {";
+    bool first = true;
+    for(unsigned int t = 0; t <= STAT_COUNT; ++t){
+      BDB::histogram const &h = (t == STAT_COUNT) ? total : hist[t];
+      if(!h.count()) continue;
+      cout << (first ? "" : ", ") << "\""
+        << (t == STAT_COUNT ? "all" : op_names[t]) << "\": {"
+        << "\"count\": " << h.count()
+        << ", \"errors\": " << (t == STAT_COUNT ? 0 : errors[t])
+        << ", \"mean\": " << us(h.mean())
+        << ", \"p50\": " << us(h.percentile(0.5))
+        << ", \"p99\": " << us(h.percentile(0.99))
+        << ", \"p999\": " << us(h.percentile(0.999))
+        << ", \"max\": " << us(h.max()) << "}";
+      first = false;
     }
+    cout << "}, \"per_thread\": [";
+    for(unsigned int t = 0; t < threads; ++t){
+      cout << (t ? ", " : "") 
+        << "{\"ops\": " << workers[t].ops.size()
+        << ", \"busy_s\": " << workers[t].busy_ns / 1e9
+        << ", \"stalls\": " << workers[t].stalls
+        << ", \"stall_s\": " << workers[t].stall_ns / 1e9 << "}";
+    }
+    cout << "]}\n";
+    return 0;
+  }
+
+  cout << "mode: " << (rate > 0 ? "open-loop" : "max-throughput")
+    << ", cache: " << (cache.empty() ? "none" : cache) 
+    << ", threads: " << threads << "\n"
+    << "ops: " << total.count() << ", elapsed: " << elapsed << " s"
+    << ", throughput: " << throughput << " ops/s\n"
+    << "latency (us):\n"
+    << left << setw(18) << "op" << right
+    << setw(10) << "count" << setw(8) << "errors"
+    << setw(10) << "p50" << setw(10) << "p99"
+    << setw(10) << "p999" << setw(10) << "max" << "\n";
+  cout << fixed << setprecision(1);
+  for(unsigned int t = 0; t <= STAT_COUNT; ++t){
+    BDB::histogram const &h = (t == STAT_COUNT) ? total : hist[t];
+    if(!h.count()) continue;
+    cout << left << setw(18) << (t == STAT_COUNT ? "all" : op_names[t])
+      << right << setw(10) << h.count()
+      << setw(8) << (t == STAT_COUNT ? 0 : errors[t])
+      << setw(10) << us(h.percentile(0.5))
+      << setw(10) << us(h.percentile(0.99))
+      << setw(10) << us(h.percentile(0.999))
+      << setw(10) << us(h.max()) << "\n";
+  }
+  cout << "per thread (stall > " << us(stall_ns) << " us):\n"
+    << setw(8) << "thread" << setw(10) << "ops" << setw(12) << "busy s"
+    << setw(10) << "stalls" << setw(12) << "stall s" << "\n"
+    << setprecision(3);
+  for(unsigned int t = 0; t < threads; ++t){
+    cout << setw(8) << t << setw(10) << workers[t].ops.size()
+      << setw(12) << workers[t].busy_ns / 1e9
+      << setw(10) << workers[t].stalls
+      << setw(12) << workers[t].stall_ns / 1e9 << "\n";
   }
 
   return 0;